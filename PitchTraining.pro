@@ -8,18 +8,28 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(core.pri)
+
 SOURCES += \
     main.cpp \
     pitchtraining.cpp \
-    trainingmodel.cpp \
     toneplayer.cpp \
-    profilemanager.cpp
+    responsepad.cpp \
+    responsetimebar.cpp \
+    theme.cpp \
+    feedbackbanner.cpp \
+    triallogmodel.cpp \
+    profilelistmodel.cpp
 
 HEADERS += \
     pitchtraining.h \
-    trainingmodel.h \
     toneplayer.h \
-    profilemanager.h
+    responsepad.h \
+    responsetimebar.h \
+    theme.h \
+    feedbackbanner.h \
+    triallogmodel.h \
+    profilelistmodel.h
 
 FORMS += \
     pitchtraining.ui
@@ -0,0 +1,647 @@
+#include "analyticsstore.h"
+
+#include "trainingmodel.h"
+#include "trialjournal.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+constexpr char kManifestFormat[] = "pitchtraining-analytics";
+constexpr int kManifestVersion = 1;
+constexpr int kBlockRows = 4096;
+constexpr int kIngestChunkRecords = 65536;
+// larger group spaces fall back to a hash table
+constexpr qint64 kDenseGroupLimit = qint64(1) << 20;
+constexpr int kMaxGroupKeys = 4;
+constexpr qint64 kDayMs = 24 * 60 * 60 * 1000;
+constexpr qint64 kWeekMs = 7 * kDayMs;
+// 1970-01-05 was the first Monday after the epoch
+constexpr qint64 kWeekOriginMs = 4 * kDayMs;
+constexpr int kOctaveSlots = 16;
+// -1 (none) through 12 ("Other")
+constexpr int kPitchSlots = 14;
+
+struct ColumnInfo {
+    const char *name;
+    int width;
+};
+
+constexpr ColumnInfo kColumnInfo[AnalyticsStore::kColumnCount] = {
+    {"timestamp", 8},
+    {"profile", 2},
+    {"level", 2},
+    {"pitch", 1},
+    {"octave", 1},
+    {"response", 1},
+    {"rt", 2},
+    {"flags", 2}
+};
+
+const char *hostByteOrder()
+{
+    return Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? "little" : "big";
+}
+
+qint64 floorDiv(qint64 value, qint64 divisor)
+{
+    qint64 quotient = value / divisor;
+    if (value % divisor != 0 && value < 0) {
+        --quotient;
+    }
+    return quotient;
+}
+
+template <typename T>
+void appendValue(QByteArray &buffer, T value)
+{
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+void maskRange(const T *values, int count, qint64 minimum, qint64 maximum, quint8 *mask)
+{
+    const qint64 lowest = std::numeric_limits<T>::min();
+    const qint64 highest = std::numeric_limits<T>::max();
+    if (minimum > maximum || minimum > highest || maximum < lowest) {
+        std::fill_n(mask, count, quint8(0));
+        return;
+    }
+    const T lo = static_cast<T>(qMax(minimum, lowest));
+    const T hi = static_cast<T>(qMin(maximum, highest));
+    for (int i = 0; i < count; ++i) {
+        mask[i] &= static_cast<quint8>((values[i] >= lo) & (values[i] <= hi));
+    }
+}
+
+template <typename T>
+void addKeySlots(const T *values, int count, qint64 origin, qint64 size, quint64 *group)
+{
+    for (int i = 0; i < count; ++i) {
+        const qint64 slot = qBound<qint64>(0, static_cast<qint64>(values[i]) - origin, size - 1);
+        group[i] = group[i] * static_cast<quint64>(size) + static_cast<quint64>(slot);
+    }
+}
+
+const QVector<quint8> &stageForLevel()
+{
+    static const QVector<quint8> s_table = []() {
+        QVector<quint8> table(std::numeric_limits<quint16>::max() + 1, 0);
+        const auto &specs = TrainingSpec::levelSpecs();
+        for (int i = 0; i < table.size(); ++i) {
+            table[i] = static_cast<quint8>(specs[qMin(i, TrainingSpec::kLevelCount - 1)].stageIndex);
+        }
+        return table;
+    }();
+    return s_table;
+}
+
+struct Accumulator {
+    quint64 trials = 0;
+    quint64 correct = 0;
+    quint64 timeouts = 0;
+    quint64 answered = 0;
+    quint64 responseTimeSum = 0;
+};
+}
+
+double AnalyticsGroup::accuracy() const
+{
+    return trials == 0 ? 0.0 : static_cast<double>(correct) / static_cast<double>(trials);
+}
+
+double AnalyticsGroup::meanResponseTimeMs() const
+{
+    return answered == 0 ? -1.0 : static_cast<double>(responseTimeSum) / static_cast<double>(answered);
+}
+
+AnalyticsStore::AnalyticsStore(const QString &directory)
+    : m_directory(directory)
+{
+}
+
+AnalyticsStore::~AnalyticsStore()
+{
+    close();
+}
+
+QString AnalyticsStore::defaultDirectory(const QString &rootPath)
+{
+    return QDir(rootPath).filePath(QStringLiteral("analytics"));
+}
+
+QString AnalyticsStore::directory() const
+{
+    return m_directory;
+}
+
+bool AnalyticsStore::isOpen() const
+{
+    return m_open;
+}
+
+bool AnalyticsStore::open()
+{
+    close();
+    if (!loadManifest() || !mapColumns()) {
+        close();
+        return false;
+    }
+    m_open = true;
+    return true;
+}
+
+void AnalyticsStore::close()
+{
+    unmapColumns();
+    m_open = false;
+    m_rows = 0;
+    m_firstTimestamp = 0;
+    m_lastTimestamp = 0;
+    m_profiles.clear();
+}
+
+QString AnalyticsStore::columnPath(int column) const
+{
+    return QDir(m_directory).filePath(QStringLiteral("%1.col").arg(QLatin1String(kColumnInfo[column].name)));
+}
+
+bool AnalyticsStore::loadManifest()
+{
+    m_rows = 0;
+    m_firstTimestamp = 0;
+    m_lastTimestamp = 0;
+    m_profiles.clear();
+
+    QFile file(QDir(m_directory).filePath(QStringLiteral("manifest.cbor")));
+    if (!file.exists()) {
+        return true;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QCborMap manifest = QCborValue::fromCbor(file.readAll()).toMap();
+    if (manifest.value(QStringLiteral("format")).toString() != QLatin1String(kManifestFormat) ||
+        manifest.value(QStringLiteral("version")).toInteger() != kManifestVersion ||
+        manifest.value(QStringLiteral("byteOrder")).toString() != QLatin1String(hostByteOrder())) {
+        return false;
+    }
+    m_rows = qMax<qint64>(0, manifest.value(QStringLiteral("rows")).toInteger());
+    m_firstTimestamp = manifest.value(QStringLiteral("firstTimestamp")).toInteger();
+    m_lastTimestamp = manifest.value(QStringLiteral("lastTimestamp")).toInteger();
+    const QCborArray profiles = manifest.value(QStringLiteral("profiles")).toArray();
+    for (const auto &value : profiles) {
+        const QCborMap map = value.toMap();
+        ProfileEntry entry;
+        entry.id = map.value(QStringLiteral("id")).toString();
+        entry.consumedRecords = map.value(QStringLiteral("consumed")).toInteger();
+        m_profiles.append(entry);
+    }
+    return true;
+}
+
+bool AnalyticsStore::saveManifest() const
+{
+    QCborArray profiles;
+    for (const auto &entry : m_profiles) {
+        QCborMap map;
+        map[QStringLiteral("id")] = entry.id;
+        map[QStringLiteral("consumed")] = entry.consumedRecords;
+        profiles.append(map);
+    }
+    QCborMap manifest;
+    manifest[QStringLiteral("format")] = QLatin1String(kManifestFormat);
+    manifest[QStringLiteral("version")] = kManifestVersion;
+    manifest[QStringLiteral("byteOrder")] = QLatin1String(hostByteOrder());
+    manifest[QStringLiteral("rows")] = m_rows;
+    manifest[QStringLiteral("firstTimestamp")] = m_firstTimestamp;
+    manifest[QStringLiteral("lastTimestamp")] = m_lastTimestamp;
+    manifest[QStringLiteral("profiles")] = profiles;
+
+    QSaveFile file(QDir(m_directory).filePath(QStringLiteral("manifest.cbor")));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(manifest.toCborValue().toCbor());
+    return file.commit();
+}
+
+bool AnalyticsStore::mapColumns()
+{
+    for (int c = 0; c < kColumnCount; ++c) {
+        auto &column = m_columns[c];
+        column.data = nullptr;
+        if (m_rows == 0) {
+            continue;
+        }
+        const qint64 bytes = m_rows * kColumnInfo[c].width;
+        column.file.reset(new QFile(columnPath(c)));
+        if (!column.file->open(QIODevice::ReadOnly) || column.file->size() < bytes) {
+            return false;
+        }
+        column.data = column.file->map(0, bytes);
+        if (!column.data) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AnalyticsStore::unmapColumns()
+{
+    for (auto &column : m_columns) {
+        // closing the file releases its mappings
+        column.file.reset();
+        column.data = nullptr;
+    }
+}
+
+qint64 AnalyticsStore::ingest(const QString &rootPath)
+{
+    if (!QDir().mkpath(m_directory) || (!m_open && !open())) {
+        return -1;
+    }
+    unmapColumns();
+
+    auto fail = [this]() -> qint64 {
+        unmapColumns();
+        open();
+        return -1;
+    };
+
+    // rows past the manifest count belong to an ingest that never
+    // committed; cut them off and append after the committed rows
+    std::array<std::unique_ptr<QFile>, kColumnCount> files;
+    for (int c = 0; c < kColumnCount; ++c) {
+        const qint64 committed = m_rows * kColumnInfo[c].width;
+        files[c].reset(new QFile(columnPath(c)));
+        if (!files[c]->open(QIODevice::ReadWrite) || !files[c]->resize(committed) || !files[c]->seek(committed)) {
+            return fail();
+        }
+    }
+
+    qint64 added = 0;
+    qint64 first = m_rows > 0 ? m_firstTimestamp : std::numeric_limits<qint64>::max();
+    qint64 last = m_rows > 0 ? m_lastTimestamp : std::numeric_limits<qint64>::min();
+    std::array<QByteArray, kColumnCount> buffers;
+
+    const QDir root(rootPath);
+    const QStringList ids = root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const auto &id : ids) {
+        const QString journal = TrialJournal::pathForProfile(root.filePath(id));
+        if (!QFile::exists(journal)) {
+            continue;
+        }
+        int index = profileIndex(id);
+        if (index < 0) {
+            if (m_profiles.size() > std::numeric_limits<quint16>::max()) {
+                continue;
+            }
+            m_profiles.append(ProfileEntry{id, 0});
+            index = static_cast<int>(m_profiles.size()) - 1;
+        }
+
+        ProfileEntry &entry = m_profiles[index];
+        forever {
+            qint64 end = entry.consumedRecords;
+            const auto records = TrialJournal::readRange(journal, entry.consumedRecords, kIngestChunkRecords, &end);
+            if (end <= entry.consumedRecords) {
+                // nothing new, or the journal shrank and is not the file
+                // ingested before
+                break;
+            }
+            for (const auto &record : records) {
+                if (record.kind != JournalRecord::Trial) {
+                    continue;
+                }
+                appendValue<qint64>(buffers[0], record.timestampMs);
+                appendValue<quint16>(buffers[1], static_cast<quint16>(index));
+                appendValue<quint16>(buffers[2], record.levelIndex);
+                appendValue<qint8>(buffers[3], record.presented);
+                appendValue<qint8>(buffers[4], record.octave);
+                appendValue<qint8>(buffers[5], record.response);
+                appendValue<quint16>(buffers[6], static_cast<quint16>(qMin<quint32>(record.value, 0xffff)));
+                appendValue<quint16>(buffers[7], record.flags);
+                first = qMin(first, record.timestampMs);
+                last = qMax(last, record.timestampMs);
+                ++added;
+            }
+            entry.consumedRecords = end;
+
+            for (int c = 0; c < kColumnCount; ++c) {
+                if (files[c]->write(buffers[c]) != buffers[c].size()) {
+                    return fail();
+                }
+                buffers[c].clear();
+            }
+        }
+    }
+
+    for (auto &file : files) {
+        if (!file->flush()) {
+            return fail();
+        }
+        file->close();
+    }
+
+    m_rows += added;
+    if (m_rows > 0) {
+        m_firstTimestamp = first;
+        m_lastTimestamp = last;
+    }
+    if (!saveManifest() || !mapColumns()) {
+        return fail();
+    }
+    return added;
+}
+
+qint64 AnalyticsStore::rowCount() const
+{
+    return m_rows;
+}
+
+QStringList AnalyticsStore::profileIds() const
+{
+    QStringList ids;
+    ids.reserve(m_profiles.size());
+    for (const auto &entry : m_profiles) {
+        ids.append(entry.id);
+    }
+    return ids;
+}
+
+int AnalyticsStore::profileIndex(const QString &id) const
+{
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        if (m_profiles.at(i).id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+qint64 AnalyticsStore::firstTimestamp() const
+{
+    return m_firstTimestamp;
+}
+
+qint64 AnalyticsStore::lastTimestamp() const
+{
+    return m_lastTimestamp;
+}
+
+AnalyticsStore::KeyDomain AnalyticsStore::domainFor(AnalyticsKey key) const
+{
+    KeyDomain domain;
+    domain.key = key;
+    switch (key) {
+    case AnalyticsKey::Profile:
+        domain.size = qMax<qint64>(1, m_profiles.size());
+        break;
+    case AnalyticsKey::Level:
+        domain.size = TrainingSpec::totalLevelCount();
+        break;
+    case AnalyticsKey::Stage:
+        domain.origin = 1;
+        domain.size = TrainingSpec::kStageCount;
+        break;
+    case AnalyticsKey::Pitch:
+    case AnalyticsKey::Response:
+        domain.origin = -1;
+        domain.size = kPitchSlots;
+        break;
+    case AnalyticsKey::Octave:
+        domain.size = kOctaveSlots;
+        break;
+    case AnalyticsKey::Day:
+        domain.origin = floorDiv(m_firstTimestamp, kDayMs);
+        domain.size = floorDiv(m_lastTimestamp, kDayMs) - domain.origin + 1;
+        break;
+    case AnalyticsKey::Week:
+        domain.origin = floorDiv(m_firstTimestamp - kWeekOriginMs, kWeekMs);
+        domain.size = floorDiv(m_lastTimestamp - kWeekOriginMs, kWeekMs) - domain.origin + 1;
+        break;
+    }
+    domain.size = qMax<qint64>(1, domain.size);
+    return domain;
+}
+
+qint64 AnalyticsStore::keyValue(const KeyDomain &domain, qint64 slot) const
+{
+    const qint64 bucket = domain.origin + slot;
+    switch (domain.key) {
+    case AnalyticsKey::Day:
+        return bucket * kDayMs;
+    case AnalyticsKey::Week:
+        return bucket * kWeekMs + kWeekOriginMs;
+    default:
+        return bucket;
+    }
+}
+
+QVector<AnalyticsGroup> AnalyticsStore::run(const AnalyticsQuery &query) const
+{
+    if (!m_open || m_rows == 0 || query.groupBy.size() > kMaxGroupKeys) {
+        return {};
+    }
+
+    QVector<KeyDomain> domains;
+    qint64 groupSpace = 1;
+    bool dense = true;
+    for (const auto key : query.groupBy) {
+        const KeyDomain domain = domainFor(key);
+        if (groupSpace > kDenseGroupLimit / domain.size) {
+            dense = false;
+        }
+        groupSpace = dense ? groupSpace * domain.size : groupSpace;
+        domains.append(domain);
+    }
+    std::vector<Accumulator> denseTable(dense ? static_cast<std::size_t>(groupSpace) : 0);
+    QHash<quint64, Accumulator> sparseTable;
+
+    const auto *timestamps = columnData<qint64>(AnalyticsColumn::Timestamp);
+    const auto *profiles = columnData<quint16>(AnalyticsColumn::Profile);
+    const auto *levels = columnData<quint16>(AnalyticsColumn::Level);
+    const auto *pitches = columnData<qint8>(AnalyticsColumn::Pitch);
+    const auto *octaves = columnData<qint8>(AnalyticsColumn::Octave);
+    const auto *responses = columnData<qint8>(AnalyticsColumn::Response);
+    const auto *responseTimes = columnData<quint16>(AnalyticsColumn::ResponseTime);
+    const auto *flags = columnData<quint16>(AnalyticsColumn::Flags);
+    const quint8 *stages = stageForLevel().constData();
+
+    std::array<quint8, kBlockRows> mask;
+    std::array<quint64, kBlockRows> group;
+    std::array<qint64, kBlockRows> derived;
+
+    for (qint64 start = 0; start < m_rows; start += kBlockRows) {
+        const int count = static_cast<int>(qMin<qint64>(kBlockRows, m_rows - start));
+
+        std::fill_n(mask.begin(), count, quint8(1));
+        for (const auto &range : query.ranges) {
+            switch (range.column) {
+            case AnalyticsColumn::Timestamp:
+                maskRange(timestamps + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            case AnalyticsColumn::Profile:
+                maskRange(profiles + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            case AnalyticsColumn::Level:
+                maskRange(levels + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            case AnalyticsColumn::Pitch:
+                maskRange(pitches + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            case AnalyticsColumn::Octave:
+                maskRange(octaves + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            case AnalyticsColumn::Response:
+                maskRange(responses + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            case AnalyticsColumn::ResponseTime:
+                maskRange(responseTimes + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            case AnalyticsColumn::Flags:
+                maskRange(flags + start, count, range.minimum, range.maximum, mask.data());
+                break;
+            }
+        }
+        if (query.requiredFlags != 0 || query.excludedFlags != 0) {
+            const quint16 *blockFlags = flags + start;
+            for (int i = 0; i < count; ++i) {
+                mask[i] &= static_cast<quint8>(((blockFlags[i] & query.requiredFlags) == query.requiredFlags) &
+                                               ((blockFlags[i] & query.excludedFlags) == 0));
+            }
+        }
+
+        std::fill_n(group.begin(), count, quint64(0));
+        for (const auto &domain : domains) {
+            switch (domain.key) {
+            case AnalyticsKey::Profile:
+                addKeySlots(profiles + start, count, domain.origin, domain.size, group.data());
+                break;
+            case AnalyticsKey::Level:
+                addKeySlots(levels + start, count, domain.origin, domain.size, group.data());
+                break;
+            case AnalyticsKey::Stage:
+                for (int i = 0; i < count; ++i) {
+                    derived[i] = stages[levels[start + i]];
+                }
+                addKeySlots(derived.data(), count, domain.origin, domain.size, group.data());
+                break;
+            case AnalyticsKey::Pitch:
+                addKeySlots(pitches + start, count, domain.origin, domain.size, group.data());
+                break;
+            case AnalyticsKey::Octave:
+                addKeySlots(octaves + start, count, domain.origin, domain.size, group.data());
+                break;
+            case AnalyticsKey::Response:
+                addKeySlots(responses + start, count, domain.origin, domain.size, group.data());
+                break;
+            case AnalyticsKey::Day:
+            case AnalyticsKey::Week: {
+                const qint64 period = domain.key == AnalyticsKey::Day ? kDayMs : kWeekMs;
+                const qint64 offset = domain.key == AnalyticsKey::Day ? 0 : kWeekOriginMs;
+                for (int i = 0; i < count; ++i) {
+                    derived[i] = floorDiv(timestamps[start + i] - offset, period);
+                }
+                addKeySlots(derived.data(), count, domain.origin, domain.size, group.data());
+                break;
+            }
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (!mask[i]) {
+                continue;
+            }
+            Accumulator &acc = dense ? denseTable[group[i]] : sparseTable[group[i]];
+            const quint16 rowFlags = flags[start + i];
+            ++acc.trials;
+            acc.correct += (rowFlags & JournalRecord::Correct) ? 1 : 0;
+            if (rowFlags & JournalRecord::TimedOut) {
+                ++acc.timeouts;
+            } else {
+                ++acc.answered;
+                acc.responseTimeSum += responseTimes[start + i];
+            }
+        }
+    }
+
+    QVector<AnalyticsGroup> result;
+    auto emitGroup = [&](quint64 id, const Accumulator &acc) {
+        AnalyticsGroup row;
+        row.key.resize(domains.size());
+        for (int k = static_cast<int>(domains.size()) - 1; k >= 0; --k) {
+            const quint64 size = static_cast<quint64>(domains.at(k).size);
+            row.key[k] = keyValue(domains.at(k), static_cast<qint64>(id % size));
+            id /= size;
+        }
+        row.trials = acc.trials;
+        row.correct = acc.correct;
+        row.timeouts = acc.timeouts;
+        row.answered = acc.answered;
+        row.responseTimeSum = acc.responseTimeSum;
+        result.append(row);
+    };
+    if (dense) {
+        for (std::size_t id = 0; id < denseTable.size(); ++id) {
+            if (denseTable[id].trials > 0) {
+                emitGroup(id, denseTable[id]);
+            }
+        }
+    } else {
+        const auto keys = sparseTable.keys();
+        QVector<quint64> ids(keys.begin(), keys.end());
+        std::sort(ids.begin(), ids.end());
+        for (const auto id : ids) {
+            emitGroup(id, sparseTable.value(id));
+        }
+    }
+    return result;
+}
+
+QString AnalyticsStore::keyName(AnalyticsKey key)
+{
+    switch (key) {
+    case AnalyticsKey::Profile:
+        return QStringLiteral("profile");
+    case AnalyticsKey::Level:
+        return QStringLiteral("level");
+    case AnalyticsKey::Stage:
+        return QStringLiteral("stage");
+    case AnalyticsKey::Pitch:
+        return QStringLiteral("pitch");
+    case AnalyticsKey::Octave:
+        return QStringLiteral("octave");
+    case AnalyticsKey::Response:
+        return QStringLiteral("response");
+    case AnalyticsKey::Day:
+        return QStringLiteral("day");
+    case AnalyticsKey::Week:
+        return QStringLiteral("week");
+    }
+    return QString();
+}
+
+bool AnalyticsStore::parseKey(const QString &name, AnalyticsKey *key)
+{
+    static const AnalyticsKey kKeys[] = {
+        AnalyticsKey::Profile, AnalyticsKey::Level, AnalyticsKey::Stage, AnalyticsKey::Pitch,
+        AnalyticsKey::Octave, AnalyticsKey::Response, AnalyticsKey::Day, AnalyticsKey::Week
+    };
+    for (const auto candidate : kKeys) {
+        if (name.compare(keyName(candidate), Qt::CaseInsensitive) == 0) {
+            *key = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,140 @@
+#ifndef ANALYTICSSTORE_H
+#define ANALYTICSSTORE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+#include <array>
+#include <memory>
+
+class QFile;
+
+enum class AnalyticsColumn : quint8 {
+    Timestamp,
+    Profile,
+    Level,
+    Pitch,
+    Octave,
+    Response,
+    ResponseTime,
+    Flags
+};
+
+enum class AnalyticsKey : quint8 {
+    Profile,
+    Level,
+    Stage,
+    Pitch,
+    Octave,
+    Response,
+    Day,
+    Week
+};
+
+// Inclusive bounds on one column. Pitch and Response use the journal
+// encoding (-1 for none, 12 for "Other").
+struct AnalyticsRange {
+    AnalyticsColumn column = AnalyticsColumn::Level;
+    qint64 minimum = 0;
+    qint64 maximum = 0;
+};
+
+struct AnalyticsQuery {
+    QVector<AnalyticsRange> ranges;
+    // JournalRecord::Flag bits
+    quint16 requiredFlags = 0;
+    quint16 excludedFlags = 0;
+    QVector<AnalyticsKey> groupBy;
+};
+
+struct AnalyticsGroup {
+    // one value per groupBy key; Day and Week are the bucket start in ms
+    // since the epoch (UTC, weeks start on Monday)
+    QVector<qint64> key;
+    quint64 trials = 0;
+    quint64 correct = 0;
+    quint64 timeouts = 0;
+    quint64 answered = 0;
+    quint64 responseTimeSum = 0;
+
+    double accuracy() const;
+    double meanResponseTimeMs() const;
+};
+
+// Trial records of every profile, one memory-mapped file per column. Rows
+// are appended by ingest(), which reads each profile's journal from where
+// the previous ingest stopped. The manifest is replaced last, so rows
+// written by an interrupted ingest are invisible and get overwritten by
+// the next one. Queries scan the columns in fixed-size blocks, building a
+// selection mask per block and accumulating groups into a dense table.
+class AnalyticsStore
+{
+public:
+    static constexpr int kColumnCount = 8;
+
+    explicit AnalyticsStore(const QString &directory);
+    ~AnalyticsStore();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+    QString directory() const;
+
+    // appends the journal records not seen yet from every profile
+    // directory under rootPath; returns the number of new rows or -1
+    qint64 ingest(const QString &rootPath);
+
+    qint64 rowCount() const;
+    QStringList profileIds() const;
+    int profileIndex(const QString &id) const;
+    qint64 firstTimestamp() const;
+    qint64 lastTimestamp() const;
+
+    QVector<AnalyticsGroup> run(const AnalyticsQuery &query) const;
+
+    static QString defaultDirectory(const QString &rootPath);
+    static QString keyName(AnalyticsKey key);
+    static bool parseKey(const QString &name, AnalyticsKey *key);
+
+private:
+    struct ProfileEntry {
+        QString id;
+        qint64 consumedRecords = 0;
+    };
+
+    struct Column {
+        std::unique_ptr<QFile> file;
+        const uchar *data = nullptr;
+    };
+
+    struct KeyDomain {
+        AnalyticsKey key = AnalyticsKey::Level;
+        qint64 origin = 0;
+        qint64 size = 1;
+    };
+
+    bool loadManifest();
+    bool saveManifest() const;
+    bool mapColumns();
+    void unmapColumns();
+    QString columnPath(int column) const;
+    KeyDomain domainFor(AnalyticsKey key) const;
+    qint64 keyValue(const KeyDomain &domain, qint64 slot) const;
+
+    template <typename T>
+    const T *columnData(AnalyticsColumn column) const
+    {
+        return reinterpret_cast<const T *>(m_columns[static_cast<int>(column)].data);
+    }
+
+    QString m_directory;
+    bool m_open = false;
+    qint64 m_rows = 0;
+    qint64 m_firstTimestamp = 0;
+    qint64 m_lastTimestamp = 0;
+    QVector<ProfileEntry> m_profiles;
+    std::array<Column, kColumnCount> m_columns;
+};
+
+#endif // ANALYTICSSTORE_H
@@ -0,0 +1,322 @@
+#include "cohortreport.h"
+
+#include "profilemanager.h"
+#include "tableexport.h"
+#include "trainingmodel.h"
+
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <algorithm>
+#include <vector>
+
+CohortReport::CohortReport()
+    : m_levels(TrainingSpec::totalLevelCount())
+{
+}
+
+void CohortReport::addProfile(const UserProfile &profile, TrainingState &state)
+{
+    CohortProfileRow row;
+    row.id = profile.id;
+    row.name = profile.name;
+    row.levelIndex = state.currentLevelIndex();
+    row.stage = TrainingSpec::specForIndex(row.levelIndex).stageIndex;
+    row.countedHours = state.countedTrainingHours();
+    row.tokens = state.tokens();
+    row.tokensSpent = state.tokensSpent();
+    row.trainingCompleted = state.trainingCompleted();
+
+    auto add = [&](const LevelSummary &summary) {
+        if (summary.specialExercise) {
+            ++row.specialExercises;
+            return;
+        }
+        if (summary.levelIndex < 0 || summary.levelIndex >= m_levels.size()) {
+            return;
+        }
+        CohortLevelStats &level = m_levels[summary.levelIndex];
+        ++level.attempts;
+        level.accuracySum += summary.accuracy;
+        ++row.levelAttempts;
+        if (summary.passed) {
+            ++level.passes;
+            ++row.levelsPassed;
+        }
+    };
+    HistoryCursor cursor = state.archiveCursor();
+    LevelSummary summary;
+    while (cursor.next(&summary)) {
+        add(summary);
+    }
+    const auto recent = state.recentSummaries(LevelHistory::kRecentCapacity);
+    for (const auto &entry : recent) {
+        add(entry);
+    }
+    m_profiles.append(row);
+}
+
+void CohortReport::merge(const CohortReport &other)
+{
+    m_profiles += other.m_profiles;
+    for (int i = 0; i < m_levels.size(); ++i) {
+        m_levels[i].attempts += other.m_levels.at(i).attempts;
+        m_levels[i].passes += other.m_levels.at(i).passes;
+        m_levels[i].accuracySum += other.m_levels.at(i).accuracySum;
+    }
+}
+
+int CohortReport::profileCount() const
+{
+    return static_cast<int>(m_profiles.size());
+}
+
+const QVector<CohortProfileRow> &CohortReport::profiles() const
+{
+    return m_profiles;
+}
+
+const QVector<CohortLevelStats> &CohortReport::levels() const
+{
+    return m_levels;
+}
+
+QVector<CohortReport::StageStats> CohortReport::stageStats() const
+{
+    const int stages = TrainingSpec::kStageCount;
+    QVector<QVector<const CohortProfileRow *>> byStage(stages + 1);
+    for (const auto &row : m_profiles) {
+        if (row.stage >= 0 && row.stage <= stages) {
+            byStage[row.stage].append(&row);
+        }
+    }
+
+    QVector<StageStats> result(stages + 1);
+    for (int stage = 0; stage <= stages; ++stage) {
+        auto rows = byStage.at(stage);
+        if (rows.isEmpty()) {
+            continue;
+        }
+        std::sort(rows.begin(), rows.end(), [](const CohortProfileRow *a, const CohortProfileRow *b) {
+            return a->countedHours < b->countedHours;
+        });
+        StageStats &stats = result[stage];
+        stats.profiles = static_cast<int>(rows.size());
+        stats.hoursMin = rows.constFirst()->countedHours;
+        stats.hoursMax = rows.constLast()->countedHours;
+        const int middle = stats.profiles / 2;
+        stats.hoursMedian = stats.profiles % 2
+                                ? rows.at(middle)->countedHours
+                                : (rows.at(middle - 1)->countedHours + rows.at(middle)->countedHours) / 2.0;
+        for (const auto *row : rows) {
+            stats.hoursMean += row->countedHours;
+            stats.tokensMean += row->tokens;
+            stats.tokensSpentMean += row->tokensSpent;
+        }
+        stats.hoursMean /= stats.profiles;
+        stats.tokensMean /= stats.profiles;
+        stats.tokensSpentMean /= stats.profiles;
+    }
+    return result;
+}
+
+QJsonObject CohortReport::toJson() const
+{
+    qint64 attempts = 0;
+    qint64 specials = 0;
+    qint64 tokens = 0;
+    qint64 tokensSpent = 0;
+    int completed = 0;
+    for (const auto &row : m_profiles) {
+        attempts += row.levelAttempts;
+        specials += row.specialExercises;
+        tokens += row.tokens;
+        tokensSpent += row.tokensSpent;
+        completed += row.trainingCompleted ? 1 : 0;
+    }
+    const double profiles = qMax(1, profileCount());
+
+    QJsonArray stages;
+    const auto stats = stageStats();
+    for (int stage = 0; stage < stats.size(); ++stage) {
+        const StageStats &entry = stats.at(stage);
+        if (entry.profiles == 0) {
+            continue;
+        }
+        stages.append(QJsonObject{
+            {QStringLiteral("stage"), stage},
+            {QStringLiteral("profiles"), entry.profiles},
+            {QStringLiteral("hoursMin"), entry.hoursMin},
+            {QStringLiteral("hoursMedian"), entry.hoursMedian},
+            {QStringLiteral("hoursMean"), entry.hoursMean},
+            {QStringLiteral("hoursMax"), entry.hoursMax},
+            {QStringLiteral("tokensMean"), entry.tokensMean},
+            {QStringLiteral("tokensSpentMean"), entry.tokensSpentMean}
+        });
+    }
+
+    QJsonArray levels;
+    for (int i = 0; i < m_levels.size(); ++i) {
+        const CohortLevelStats &level = m_levels.at(i);
+        if (level.attempts == 0) {
+            continue;
+        }
+        const LevelSpec spec = TrainingSpec::specForIndex(i);
+        levels.append(QJsonObject{
+            {QStringLiteral("level"), i},
+            {QStringLiteral("stage"), spec.stageIndex},
+            {QStringLiteral("levelInStage"), spec.levelInStage},
+            {QStringLiteral("attempts"), level.attempts},
+            {QStringLiteral("passes"), level.passes},
+            {QStringLiteral("passRate"), static_cast<double>(level.passes) / level.attempts},
+            {QStringLiteral("meanAccuracy"), level.accuracySum / level.attempts}
+        });
+    }
+
+    QJsonObject root;
+    root[QStringLiteral("profiles")] = profileCount();
+    root[QStringLiteral("trainingCompleted")] = completed;
+    root[QStringLiteral("stages")] = stages;
+    root[QStringLiteral("levels")] = levels;
+    root[QStringLiteral("specialExercises")] = QJsonObject{
+        {QStringLiteral("total"), specials},
+        {QStringLiteral("perProfile"), specials / profiles},
+        {QStringLiteral("per100LevelAttempts"), attempts ? 100.0 * specials / attempts : 0.0}
+    };
+    root[QStringLiteral("tokens")] = QJsonObject{
+        {QStringLiteral("held"), tokens},
+        {QStringLiteral("spent"), tokensSpent},
+        {QStringLiteral("heldPerProfile"), tokens / profiles},
+        {QStringLiteral("spentPerProfile"), tokensSpent / profiles},
+        {QStringLiteral("spentShare"), (tokens + tokensSpent) ? static_cast<double>(tokensSpent) / (tokens + tokensSpent) : 0.0}
+    };
+    return root;
+}
+
+QByteArray CohortReport::profilesCsv() const
+{
+    ExportChunk chunk({
+        {QStringLiteral("profile_id"), ExportType::Utf8},
+        {QStringLiteral("profile_name"), ExportType::Utf8},
+        {QStringLiteral("level_index"), ExportType::Int32},
+        {QStringLiteral("stage"), ExportType::Int32},
+        {QStringLiteral("counted_hours"), ExportType::Float64},
+        {QStringLiteral("level_attempts"), ExportType::Int32},
+        {QStringLiteral("levels_passed"), ExportType::Int32},
+        {QStringLiteral("special_exercises"), ExportType::Int32},
+        {QStringLiteral("tokens"), ExportType::Int32},
+        {QStringLiteral("tokens_spent"), ExportType::Int32},
+        {QStringLiteral("training_completed"), ExportType::Bool}
+    });
+    for (const auto &row : m_profiles) {
+        chunk.addString(row.id);
+        chunk.addString(row.name);
+        chunk.addInt(row.levelIndex);
+        chunk.addInt(row.stage);
+        chunk.addDouble(row.countedHours);
+        chunk.addInt(row.levelAttempts);
+        chunk.addInt(row.levelsPassed);
+        chunk.addInt(row.specialExercises);
+        chunk.addInt(row.tokens);
+        chunk.addInt(row.tokensSpent);
+        chunk.addBool(row.trainingCompleted);
+    }
+    return chunk.toCsv();
+}
+
+QByteArray CohortReport::levelsCsv() const
+{
+    ExportChunk chunk({
+        {QStringLiteral("level_index"), ExportType::Int32},
+        {QStringLiteral("stage"), ExportType::Int32},
+        {QStringLiteral("level_in_stage"), ExportType::Int32},
+        {QStringLiteral("pass_accuracy"), ExportType::Float64},
+        {QStringLiteral("feedback"), ExportType::Bool},
+        {QStringLiteral("attempts"), ExportType::Int64},
+        {QStringLiteral("passes"), ExportType::Int64},
+        {QStringLiteral("pass_rate"), ExportType::Float64},
+        {QStringLiteral("mean_accuracy"), ExportType::Float64}
+    });
+    for (int i = 0; i < m_levels.size(); ++i) {
+        const CohortLevelStats &level = m_levels.at(i);
+        const LevelSpec spec = TrainingSpec::specForIndex(i);
+        chunk.addInt(i);
+        chunk.addInt(spec.stageIndex);
+        chunk.addInt(spec.levelInStage);
+        chunk.addDouble(spec.passAccuracy);
+        chunk.addBool(spec.feedback);
+        chunk.addInt(level.attempts);
+        chunk.addInt(level.passes);
+        chunk.addDouble(level.attempts ? static_cast<double>(level.passes) / level.attempts : 0.0);
+        chunk.addDouble(level.attempts ? level.accuracySum / level.attempts : 0.0);
+    }
+    return chunk.toCsv();
+}
+
+QByteArray CohortReport::stagesCsv() const
+{
+    ExportChunk chunk({
+        {QStringLiteral("stage"), ExportType::Int32},
+        {QStringLiteral("profiles"), ExportType::Int32},
+        {QStringLiteral("hours_min"), ExportType::Float64},
+        {QStringLiteral("hours_median"), ExportType::Float64},
+        {QStringLiteral("hours_mean"), ExportType::Float64},
+        {QStringLiteral("hours_max"), ExportType::Float64},
+        {QStringLiteral("tokens_mean"), ExportType::Float64},
+        {QStringLiteral("tokens_spent_mean"), ExportType::Float64}
+    });
+    const auto stats = stageStats();
+    for (int stage = 0; stage < stats.size(); ++stage) {
+        const StageStats &entry = stats.at(stage);
+        if (entry.profiles == 0) {
+            continue;
+        }
+        chunk.addInt(stage);
+        chunk.addInt(entry.profiles);
+        chunk.addDouble(entry.hoursMin);
+        chunk.addDouble(entry.hoursMedian);
+        chunk.addDouble(entry.hoursMean);
+        chunk.addDouble(entry.hoursMax);
+        chunk.addDouble(entry.tokensMean);
+        chunk.addDouble(entry.tokensSpentMean);
+    }
+    return chunk.toCsv();
+}
+
+CohortReport CohortReport::build(const CohortOptions &options)
+{
+    const QDir root(options.rootPath);
+    const QVector<UserProfile> profiles = ProfileManager::readProfiles(options.rootPath);
+    const int jobs = ProfileManager::workerCount(options.jobs, static_cast<int>(profiles.size()));
+
+    // each worker reduces into its own report; they are merged once at the end
+    std::vector<CohortReport> partials(jobs);
+    ProfileManager::forEachProfile(profiles, jobs, [&](const UserProfile &profile, int worker) {
+        TrainingState state;
+        // analysis must never migrate or rewrite a participant's files
+        state.setReadOnly(true);
+        state.setProfileDirectory(root.filePath(profile.id));
+        if (state.load()) {
+            partials[worker].addProfile(profile, state);
+        }
+    });
+
+    CohortReport report;
+    for (const auto &partial : partials) {
+        report.merge(partial);
+    }
+    ProfileManager::sortByProfileOrder(profiles, &report.m_profiles);
+    return report;
+}
+
+bool CohortReport::write(const QString &directory) const
+{
+    if (!QDir().mkpath(directory)) {
+        return false;
+    }
+    const QDir dir(directory);
+    return writeFileAtomically(dir.filePath(QStringLiteral("cohort.json")), QJsonDocument(toJson()).toJson())
+           && writeFileAtomically(dir.filePath(QStringLiteral("cohort_profiles.csv")), profilesCsv())
+           && writeFileAtomically(dir.filePath(QStringLiteral("cohort_levels.csv")), levelsCsv())
+           && writeFileAtomically(dir.filePath(QStringLiteral("cohort_stages.csv")), stagesCsv());
+}
@@ -0,0 +1,84 @@
+#ifndef COHORTREPORT_H
+#define COHORTREPORT_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+struct UserProfile;
+class TrainingState;
+
+struct CohortOptions {
+    QString rootPath;
+    // 0 picks one reader per core
+    int jobs = 0;
+};
+
+struct CohortProfileRow {
+    QString id;
+    QString name;
+    int levelIndex = 0;
+    int stage = 0;
+    double countedHours = 0.0;
+    int levelAttempts = 0;
+    int levelsPassed = 0;
+    int specialExercises = 0;
+    int tokens = 0;
+    int tokensSpent = 0;
+    bool trainingCompleted = false;
+};
+
+struct CohortLevelStats {
+    qint64 attempts = 0;
+    qint64 passes = 0;
+    double accuracySum = 0.0;
+};
+
+// Cohort-wide view of every profile's progress state: how far each
+// participant got for the hours counted, how often each level is passed,
+// how often special exercises come up and how tokens are earned and spent.
+// Partial reports from different workers merge by concatenating rows and
+// adding level counts, so the result does not depend on the worker count.
+class CohortReport
+{
+public:
+    CohortReport();
+
+    void addProfile(const UserProfile &profile, TrainingState &state);
+    void merge(const CohortReport &other);
+
+    int profileCount() const;
+    const QVector<CohortProfileRow> &profiles() const;
+    const QVector<CohortLevelStats> &levels() const;
+
+    QJsonObject toJson() const;
+    QByteArray profilesCsv() const;
+    QByteArray levelsCsv() const;
+    QByteArray stagesCsv() const;
+
+    // reads every profile under options.rootPath in parallel
+    static CohortReport build(const CohortOptions &options);
+    // cohort.json plus cohort_profiles.csv, cohort_levels.csv and
+    // cohort_stages.csv
+    bool write(const QString &directory) const;
+
+private:
+    struct StageStats {
+        int profiles = 0;
+        double hoursMin = 0.0;
+        double hoursMedian = 0.0;
+        double hoursMean = 0.0;
+        double hoursMax = 0.0;
+        double tokensMean = 0.0;
+        double tokensSpentMean = 0.0;
+    };
+
+    QVector<StageStats> stageStats() const;
+
+    QVector<CohortProfileRow> m_profiles;
+    // indexed by LevelSpec::globalIndex
+    QVector<CohortLevelStats> m_levels;
+};
+
+#endif // COHORTREPORT_H
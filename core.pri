@@ -0,0 +1,46 @@
+# Training model, persistence and analytics shared by the app and the
+# command-line tools. Needs only QtCore.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/trainingmodel.cpp \
+    $$PWD/trainingprotocol.cpp \
+    $$PWD/profilemanager.cpp \
+    $$PWD/trialscheduler.cpp \
+    $$PWD/trainingsession.cpp \
+    $$PWD/testbattery.cpp \
+    $$PWD/tonesynth.cpp \
+    $$PWD/trialjournal.cpp \
+    $$PWD/statewriter.cpp \
+    $$PWD/levelhistory.cpp \
+    $$PWD/pitchstatistics.cpp \
+    $$PWD/responsetimesketch.cpp \
+    $$PWD/analyticsstore.cpp \
+    $$PWD/tableexport.cpp \
+    $$PWD/dataexporter.cpp \
+    $$PWD/cohortreport.cpp \
+    $$PWD/replayengine.cpp \
+    $$PWD/psychometrics.cpp
+
+HEADERS += \
+    $$PWD/trainingmodel.h \
+    $$PWD/trainingprotocol.h \
+    $$PWD/profilemanager.h \
+    $$PWD/ringbuffer.h \
+    $$PWD/trialscheduler.h \
+    $$PWD/trainingsession.h \
+    $$PWD/testbattery.h \
+    $$PWD/tonesynth.h \
+    $$PWD/trialjournal.h \
+    $$PWD/statewriter.h \
+    $$PWD/levelsummary.h \
+    $$PWD/levelhistory.h \
+    $$PWD/pitchstatistics.h \
+    $$PWD/responsetimesketch.h \
+    $$PWD/analyticsstore.h \
+    $$PWD/tableexport.h \
+    $$PWD/dataexporter.h \
+    $$PWD/cohortreport.h \
+    $$PWD/replayengine.h \
+    $$PWD/psychometrics.h
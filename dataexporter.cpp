@@ -0,0 +1,312 @@
+#include "dataexporter.h"
+
+#include "profilemanager.h"
+#include "trainingmodel.h"
+#include "trialjournal.h"
+
+#include <QAtomicInteger>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <memory>
+
+namespace {
+// Output files for one table. Chunks are encoded by the calling worker;
+// only the writes are serialised.
+class TableSink
+{
+public:
+    TableSink(const QString &basePath, const ExportSchema &schema, bool csv, bool arrow)
+        : m_schema(schema)
+    {
+        if (csv) {
+            m_csv.reset(new QSaveFile(basePath + QStringLiteral(".csv")));
+        }
+        if (arrow) {
+            m_arrowFile.reset(new QSaveFile(basePath + QStringLiteral(".arrow")));
+            m_arrow.reset(new ArrowIpcWriter(m_arrowFile.get(), schema));
+        }
+    }
+
+    bool open()
+    {
+        if (m_csv && (!m_csv->open(QIODevice::WriteOnly) || m_csv->write(ExportChunk::csvHeader(m_schema)) < 0)) {
+            return false;
+        }
+        if (m_arrow && (!m_arrowFile->open(QIODevice::WriteOnly) || !m_arrow->begin())) {
+            return false;
+        }
+        return true;
+    }
+
+    void write(const ExportChunk &chunk)
+    {
+        if (chunk.isEmpty()) {
+            return;
+        }
+        QByteArray csv;
+        if (m_csv) {
+            chunk.appendCsv(&csv);
+        }
+        const QByteArray batch = m_arrow ? ArrowIpcWriter::encodeBatch(chunk) : QByteArray();
+
+        QMutexLocker locker(&m_mutex);
+        if (m_csv && m_csv->write(csv) != csv.size()) {
+            m_failed = true;
+        }
+        if (m_arrow && !m_arrow->writeEncodedBatch(batch)) {
+            m_failed = true;
+        }
+    }
+
+    bool commit()
+    {
+        bool ok = !m_failed;
+        if (m_arrow && !m_arrow->finish()) {
+            ok = false;
+        }
+        // a failed table leaves any earlier export in place
+        for (QSaveFile *file : {m_arrowFile.get(), m_csv.get()}) {
+            if (!file) {
+                continue;
+            }
+            if (ok) {
+                ok = file->commit();
+            } else {
+                file->cancelWriting();
+            }
+        }
+        return ok;
+    }
+
+private:
+    ExportSchema m_schema;
+    std::unique_ptr<QSaveFile> m_csv;
+    std::unique_ptr<QSaveFile> m_arrowFile;
+    std::unique_ptr<ArrowIpcWriter> m_arrow;
+    QMutex m_mutex;
+    bool m_failed = false;
+};
+
+QString pitchName(qint8 value)
+{
+    if (value == JournalRecord::kOtherResponse) {
+        return QStringLiteral("OUT");
+    }
+    return TrainingSpec::chromaticOrder().value(value);
+}
+
+qint64 msecsOrZero(const QDateTime &dateTime)
+{
+    return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : 0;
+}
+
+void addProfileColumns(ExportChunk &chunk, const UserProfile &profile)
+{
+    chunk.addString(profile.id);
+    chunk.addString(profile.name);
+    chunk.addTimestamp(msecsOrZero(profile.createdAt));
+}
+
+void addLevelColumns(ExportChunk &chunk, int levelIndex, bool special)
+{
+    const LevelSpec spec = TrainingSpec::specForIndex(levelIndex);
+    chunk.addInt(levelIndex);
+    chunk.addInt(spec.stageIndex);
+    chunk.addInt(spec.levelInStage);
+    chunk.addBool(special);
+}
+
+qint64 exportTrials(const UserProfile &profile, const QString &directory, int chunkRows, TableSink &sink)
+{
+    const QString journal = TrialJournal::pathForProfile(directory);
+    ExportChunk chunk(DataExporter::trialSchema());
+    qint64 rows = 0;
+    qint64 next = 0;
+    forever {
+        qint64 end = next;
+        const auto records = TrialJournal::readRange(journal, next, chunkRows, &end);
+        if (end <= next) {
+            break;
+        }
+        next = end;
+        for (const auto &record : records) {
+            if (record.kind != JournalRecord::Trial) {
+                continue;
+            }
+            addProfileColumns(chunk, profile);
+            addLevelColumns(chunk, record.levelIndex, record.hasFlag(JournalRecord::Special));
+            chunk.addBool(record.hasFlag(JournalRecord::TestBattery));
+            chunk.addBool(record.hasFlag(JournalRecord::Feedback));
+            chunk.addInt(record.trialNumber);
+            chunk.addTimestamp(record.timestampMs);
+            chunk.addString(pitchName(record.presented));
+            chunk.addInt(record.octave);
+            chunk.addBool(record.hasFlag(JournalRecord::OutOfBounds));
+            chunk.addString(pitchName(record.response));
+            chunk.addBool(record.hasFlag(JournalRecord::Correct));
+            chunk.addBool(record.hasFlag(JournalRecord::SemitoneError));
+            chunk.addBool(record.hasFlag(JournalRecord::TimedOut));
+            chunk.addInt(record.value);
+            chunk.addBool(record.hasFlag(JournalRecord::UsedDouble));
+            chunk.addBool(record.hasFlag(JournalRecord::LuckyDouble));
+            if (chunk.rowCount() >= chunkRows) {
+                rows += chunk.rowCount();
+                sink.write(chunk);
+                chunk.clear();
+            }
+        }
+    }
+    rows += chunk.rowCount();
+    sink.write(chunk);
+    return rows;
+}
+
+void addSummaryRow(ExportChunk &chunk, const UserProfile &profile, const LevelSummary &summary)
+{
+    addProfileColumns(chunk, profile);
+    addLevelColumns(chunk, summary.levelIndex, summary.specialExercise);
+    chunk.addDouble(summary.accuracy);
+    chunk.addBool(summary.passed);
+    chunk.addInt(summary.seed);
+    chunk.addInt(summary.octaveMask);
+    chunk.addDouble(summary.outOfBoundsProportion);
+    chunk.addInt(summary.trialsSkipped);
+    chunk.addTimestamp(msecsOrZero(summary.completedAt));
+    QVector<QString> pitches = TrainingSpec::chromaticOrder();
+    pitches.append(QStringLiteral("OUT"));
+    for (const auto &pitch : pitches) {
+        const PitchSummary counts = summary.perPitch.value(pitch);
+        chunk.addInt(counts.totalTrials);
+        chunk.addInt(counts.correctTrials);
+    }
+}
+
+qint64 exportSummaries(const UserProfile &profile, const QString &directory, int chunkRows, TableSink &sink)
+{
+    TrainingState state;
+    // an export must never migrate or rewrite a participant's files
+    state.setReadOnly(true);
+    state.setProfileDirectory(directory);
+    if (!state.load()) {
+        return 0;
+    }
+    ExportChunk chunk(DataExporter::summarySchema());
+    qint64 rows = 0;
+    auto add = [&](const LevelSummary &summary) {
+        addSummaryRow(chunk, profile, summary);
+        if (chunk.rowCount() >= chunkRows) {
+            rows += chunk.rowCount();
+            sink.write(chunk);
+            chunk.clear();
+        }
+    };
+    HistoryCursor cursor = state.archiveCursor();
+    LevelSummary summary;
+    while (cursor.next(&summary)) {
+        add(summary);
+    }
+    const auto recent = state.recentSummaries(LevelHistory::kRecentCapacity);
+    for (const auto &entry : recent) {
+        add(entry);
+    }
+    rows += chunk.rowCount();
+    sink.write(chunk);
+    return rows;
+}
+}
+
+DataExporter::DataExporter(const ExportOptions &options)
+    : m_options(options)
+{
+}
+
+ExportSchema DataExporter::trialSchema()
+{
+    return {
+        {QStringLiteral("profile_id"), ExportType::Utf8},
+        {QStringLiteral("profile_name"), ExportType::Utf8},
+        {QStringLiteral("profile_created"), ExportType::TimestampMs},
+        {QStringLiteral("level_index"), ExportType::Int32},
+        {QStringLiteral("stage"), ExportType::Int32},
+        {QStringLiteral("level_in_stage"), ExportType::Int32},
+        {QStringLiteral("special"), ExportType::Bool},
+        {QStringLiteral("test_battery"), ExportType::Bool},
+        {QStringLiteral("feedback"), ExportType::Bool},
+        {QStringLiteral("trial_number"), ExportType::Int32},
+        {QStringLiteral("timestamp"), ExportType::TimestampMs},
+        {QStringLiteral("presented_pitch"), ExportType::Utf8},
+        {QStringLiteral("octave"), ExportType::Int32},
+        {QStringLiteral("out_of_bounds"), ExportType::Bool},
+        {QStringLiteral("response"), ExportType::Utf8},
+        {QStringLiteral("correct"), ExportType::Bool},
+        {QStringLiteral("semitone_error"), ExportType::Bool},
+        {QStringLiteral("timed_out"), ExportType::Bool},
+        {QStringLiteral("response_time_ms"), ExportType::Int32},
+        {QStringLiteral("used_double"), ExportType::Bool},
+        {QStringLiteral("lucky_double"), ExportType::Bool}
+    };
+}
+
+ExportSchema DataExporter::summarySchema()
+{
+    ExportSchema schema = {
+        {QStringLiteral("profile_id"), ExportType::Utf8},
+        {QStringLiteral("profile_name"), ExportType::Utf8},
+        {QStringLiteral("profile_created"), ExportType::TimestampMs},
+        {QStringLiteral("level_index"), ExportType::Int32},
+        {QStringLiteral("stage"), ExportType::Int32},
+        {QStringLiteral("level_in_stage"), ExportType::Int32},
+        {QStringLiteral("special"), ExportType::Bool},
+        {QStringLiteral("accuracy"), ExportType::Float64},
+        {QStringLiteral("passed"), ExportType::Bool},
+        {QStringLiteral("seed"), ExportType::Int64},
+        {QStringLiteral("octave_mask"), ExportType::Int32},
+        {QStringLiteral("out_of_bounds_share"), ExportType::Float64},
+        {QStringLiteral("trials_skipped"), ExportType::Int32},
+        {QStringLiteral("completed_at"), ExportType::TimestampMs}
+    };
+    QVector<QString> pitches = TrainingSpec::chromaticOrder();
+    pitches.append(QStringLiteral("OUT"));
+    for (const auto &pitch : pitches) {
+        schema.append({pitch + QStringLiteral("_total"), ExportType::Int32});
+        schema.append({pitch + QStringLiteral("_correct"), ExportType::Int32});
+    }
+    return schema;
+}
+
+ExportReport DataExporter::run()
+{
+    ExportReport report;
+    const QDir root(m_options.rootPath);
+    const QVector<UserProfile> profiles = ProfileManager::readProfiles(m_options.rootPath);
+    if (!QDir().mkpath(m_options.outputDirectory)) {
+        return report;
+    }
+
+    const QDir output(m_options.outputDirectory);
+    TableSink trials(output.filePath(QStringLiteral("trials")), trialSchema(), m_options.csv, m_options.arrow);
+    TableSink summaries(output.filePath(QStringLiteral("summaries")), summarySchema(), m_options.csv, m_options.arrow);
+    if (!trials.open() || !summaries.open()) {
+        return report;
+    }
+
+    const int chunkRows = qMax(1, m_options.chunkRows);
+    const int jobs = ProfileManager::workerCount(m_options.jobs, static_cast<int>(profiles.size()));
+    QAtomicInteger<qint64> trialRows(0);
+    QAtomicInteger<qint64> summaryRows(0);
+    ProfileManager::forEachProfile(profiles, jobs, [&](const UserProfile &profile, int) {
+        const QString directory = root.filePath(profile.id);
+        trialRows.fetchAndAddRelaxed(exportTrials(profile, directory, chunkRows, trials));
+        summaryRows.fetchAndAddRelaxed(exportSummaries(profile, directory, chunkRows, summaries));
+    });
+
+    const bool trialsOk = trials.commit();
+    const bool summariesOk = summaries.commit();
+    report.ok = trialsOk && summariesOk;
+    report.profiles = static_cast<int>(profiles.size());
+    report.trialRows = trialRows.loadRelaxed();
+    report.summaryRows = summaryRows.loadRelaxed();
+    return report;
+}
@@ -0,0 +1,45 @@
+#ifndef DATAEXPORTER_H
+#define DATAEXPORTER_H
+
+#include <QString>
+
+#include "tableexport.h"
+
+struct ExportOptions {
+    QString rootPath;
+    QString outputDirectory;
+    bool csv = true;
+    bool arrow = true;
+    int chunkRows = 65536;
+    // 0 picks one reader per core
+    int jobs = 0;
+};
+
+struct ExportReport {
+    bool ok = false;
+    int profiles = 0;
+    qint64 trialRows = 0;
+    qint64 summaryRows = 0;
+};
+
+// Writes trials.{csv,arrow} and summaries.{csv,arrow} for every profile
+// listed in profiles.json. Profiles are read in parallel, each worker
+// streaming its journal and summary history in chunks of chunkRows, so
+// memory stays bounded by jobs x chunkRows whatever the lab size. Chunks
+// from different profiles interleave in the output; rows of one chunk are
+// always from a single profile and in journal order.
+class DataExporter
+{
+public:
+    explicit DataExporter(const ExportOptions &options);
+
+    ExportReport run();
+
+    static ExportSchema trialSchema();
+    static ExportSchema summarySchema();
+
+private:
+    ExportOptions m_options;
+};
+
+#endif // DATAEXPORTER_H
@@ -0,0 +1,118 @@
+#include "feedbackbanner.h"
+
+#include <QEvent>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QPaintEvent>
+
+namespace {
+constexpr int kPaddingX = 12;
+constexpr int kPaddingY = 10;
+constexpr int kTextFlags = Qt::AlignLeft | Qt::AlignVCenter | Qt::TextWordWrap;
+}
+
+FeedbackBanner::FeedbackBanner(QWidget *parent)
+    : QWidget(parent)
+{
+    QFont bannerFont = font();
+    bannerFont.setPixelSize(13);
+    bannerFont.setWeight(QFont::DemiBold);
+    setFont(bannerFont);
+    setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Minimum);
+}
+
+void FeedbackBanner::setMessage(const QString &text, FeedbackTone tone)
+{
+    if (text == m_text && tone == m_tone) {
+        return;
+    }
+    const bool textChanged = text != m_text;
+    m_text = text;
+    m_tone = tone;
+    if (textChanged) {
+        const int previousHeight = m_cachedHeight;
+        m_cachedWidth = -1;
+        if (textHeightFor(width()) != previousHeight) {
+            updateGeometry();
+        }
+    }
+    update();
+}
+
+void FeedbackBanner::clear()
+{
+    setMessage(QString(), m_tone);
+}
+
+QString FeedbackBanner::text() const
+{
+    return m_text;
+}
+
+bool FeedbackBanner::hasHeightForWidth() const
+{
+    return true;
+}
+
+int FeedbackBanner::heightForWidth(int width) const
+{
+    return textHeightFor(width) + 2 * kPaddingY;
+}
+
+QSize FeedbackBanner::sizeHint() const
+{
+    return QSize(320, heightForWidth(width() > 0 ? width() : 320));
+}
+
+QSize FeedbackBanner::minimumSizeHint() const
+{
+    return QSize(120, fontMetrics().height() + 2 * kPaddingY);
+}
+
+int FeedbackBanner::textHeightFor(int width) const
+{
+    if (width == m_cachedWidth) {
+        return m_cachedHeight;
+    }
+    const int lineHeight = fontMetrics().height();
+    int height = lineHeight;
+    const int available = width - 2 * kPaddingX;
+    if (!m_text.isEmpty() && available > 0) {
+        const QRect bounds = fontMetrics().boundingRect(QRect(0, 0, available, 0), kTextFlags, m_text);
+        height = qMax(lineHeight, bounds.height());
+    }
+    m_cachedWidth = width;
+    m_cachedHeight = height;
+    return height;
+}
+
+void FeedbackBanner::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    m_cachedWidth = -1;
+}
+
+void FeedbackBanner::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::FontChange) {
+        m_cachedWidth = -1;
+        updateGeometry();
+    }
+    QWidget::changeEvent(event);
+}
+
+void FeedbackBanner::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    if (m_text.isEmpty()) {
+        return;
+    }
+    const auto &style = Theme::current().feedback(m_tone);
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    painter.setPen(style.border);
+    painter.setBrush(style.background);
+    painter.drawRoundedRect(QRectF(rect()).adjusted(0.5, 0.5, -0.5, -0.5), 5, 5);
+    painter.setPen(style.text);
+    painter.drawText(rect().adjusted(kPaddingX, kPaddingY, -kPaddingX, -kPaddingY), kTextFlags, m_text);
+}
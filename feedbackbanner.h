@@ -0,0 +1,41 @@
+#ifndef FEEDBACKBANNER_H
+#define FEEDBACKBANNER_H
+
+#include <QString>
+#include <QWidget>
+
+#include "theme.h"
+
+// Feedback strip under the progress bars. Switching between neutral,
+// positive and negative only swaps precomputed colours and repaints; the
+// widget is never re-polished.
+class FeedbackBanner : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit FeedbackBanner(QWidget *parent = nullptr);
+
+    void setMessage(const QString &text, FeedbackTone tone);
+    void clear();
+    QString text() const;
+
+    bool hasHeightForWidth() const override;
+    int heightForWidth(int width) const override;
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
+private:
+    int textHeightFor(int width) const;
+
+    QString m_text;
+    FeedbackTone m_tone = FeedbackTone::Positive;
+    mutable int m_cachedWidth = -1;
+    mutable int m_cachedHeight = 0;
+};
+
+#endif // FEEDBACKBANNER_H
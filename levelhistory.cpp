@@ -0,0 +1,238 @@
+#include "levelhistory.h"
+
+#include "statewriter.h"
+
+#include <QCborStreamReader>
+#include <QCborValue>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+
+namespace {
+qint64 segmentStartFor(qint64 index)
+{
+    return (index / LevelHistory::kSegmentCapacity) * LevelHistory::kSegmentCapacity;
+}
+}
+
+HistoryCursor::HistoryCursor(const QString &archiveDirectory, qint64 archivedCount)
+    : m_directory(archiveDirectory)
+    , m_count(qMax<qint64>(0, archivedCount))
+{
+}
+
+HistoryCursor::HistoryCursor(HistoryCursor &&other) noexcept = default;
+HistoryCursor &HistoryCursor::operator=(HistoryCursor &&other) noexcept = default;
+HistoryCursor::~HistoryCursor() = default;
+
+bool HistoryCursor::next(LevelSummary *summary)
+{
+    while (m_position < m_count) {
+        if (!m_reader && !openSegment(segmentStartFor(m_position))) {
+            // a missing segment is skipped rather than ending the walk
+            m_position = segmentStartFor(m_position) + LevelHistory::kSegmentCapacity;
+            continue;
+        }
+        if (m_reader->isNull()) {
+            // a summary lost from the segment
+            m_reader->next();
+            ++m_position;
+            if (m_position % LevelHistory::kSegmentCapacity == 0) {
+                closeSegment();
+            }
+            continue;
+        }
+        if (!m_reader->isMap()) {
+            closeSegment();
+            m_position = segmentStartFor(m_position) + LevelHistory::kSegmentCapacity;
+            continue;
+        }
+        const QCborValue value = QCborValue::fromCbor(*m_reader);
+        if (summary) {
+            *summary = LevelSummary::fromCbor(value.toMap());
+        }
+        ++m_position;
+        if (m_position % LevelHistory::kSegmentCapacity == 0) {
+            closeSegment();
+        }
+        return true;
+    }
+    closeSegment();
+    return false;
+}
+
+qint64 HistoryCursor::position() const
+{
+    return m_position;
+}
+
+qint64 HistoryCursor::count() const
+{
+    return m_count;
+}
+
+bool HistoryCursor::openSegment(qint64 start)
+{
+    closeSegment();
+    auto file = std::make_unique<QFile>(QDir(m_directory).filePath(LevelHistory::segmentFileName(start)));
+    if (!file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    m_file = std::move(file);
+    m_reader = std::make_unique<QCborStreamReader>(m_file.get());
+    // resume inside the segment when the cursor did not start at its head
+    for (qint64 skip = start; skip < m_position && (m_reader->isMap() || m_reader->isNull()); ++skip) {
+        m_reader->next();
+    }
+    return true;
+}
+
+void HistoryCursor::closeSegment()
+{
+    m_reader.reset();
+    m_file.reset();
+}
+
+LevelHistory::LevelHistory()
+    : m_recent(kRecentCapacity)
+{
+}
+
+void LevelHistory::setArchiveDirectory(const QString &path)
+{
+    if (path == m_archiveDirectory) {
+        return;
+    }
+    m_archiveDirectory = path;
+    m_segmentStart = -1;
+    m_segmentSize = 0;
+    m_segmentPadding.clear();
+}
+
+QString LevelHistory::archiveDirectory() const
+{
+    return m_archiveDirectory;
+}
+
+void LevelHistory::setWriter(StateWriter *writer)
+{
+    if (writer == m_writer) {
+        return;
+    }
+    m_writer = writer;
+    // spills made without a writer never reached the disk; the open
+    // segment is measured again before the next one
+    m_segmentStart = -1;
+}
+
+void LevelHistory::clear()
+{
+    m_recent.clear();
+    m_archivedCount = 0;
+    m_segmentStart = -1;
+    m_segmentSize = 0;
+    m_segmentPadding.clear();
+}
+
+void LevelHistory::setArchivedCount(qint64 count)
+{
+    m_archivedCount = qMax<qint64>(0, count);
+    m_segmentStart = -1;
+    m_segmentSize = 0;
+    m_segmentPadding.clear();
+}
+
+qint64 LevelHistory::archivedCount() const
+{
+    return m_archivedCount;
+}
+
+qint64 LevelHistory::totalCount() const
+{
+    return m_archivedCount + m_recent.size();
+}
+
+void LevelHistory::append(const LevelSummary &summary)
+{
+    if (m_recent.isFull()) {
+        spill(m_recent.takeFirst());
+    }
+    m_recent.push(summary);
+}
+
+const RingBuffer<LevelSummary> &LevelHistory::recent() const
+{
+    return m_recent;
+}
+
+HistoryCursor LevelHistory::archiveCursor() const
+{
+    return HistoryCursor(m_archiveDirectory, m_archivedCount);
+}
+
+QString LevelHistory::segmentFileName(qint64 start)
+{
+    return QStringLiteral("segment-%1.cbor").arg(start, 9, 10, QLatin1Char('0'));
+}
+
+void LevelHistory::spill(const LevelSummary &summary)
+{
+    if (m_segmentStart < 0) {
+        loadOpenSegment();
+    }
+    if (m_archivedCount - m_segmentStart >= kSegmentCapacity) {
+        m_segmentStart = m_archivedCount;
+        m_segmentSize = 0;
+        m_segmentPadding.clear();
+    }
+    const QByteArray bytes = m_segmentPadding + summary.toCbor().toCborValue().toCbor();
+    ++m_archivedCount;
+
+    if (!m_writer || m_archiveDirectory.isEmpty()) {
+        return;
+    }
+    QDir().mkpath(m_archiveDirectory);
+    m_writer->writeAt(QDir(m_archiveDirectory).filePath(segmentFileName(m_segmentStart)), m_segmentSize, bytes);
+    m_segmentSize += bytes.size();
+    m_segmentPadding.clear();
+}
+
+void LevelHistory::loadOpenSegment()
+{
+    m_segmentStart = segmentStartFor(m_archivedCount);
+    m_segmentSize = 0;
+    m_segmentPadding.clear();
+    const qint64 expected = m_archivedCount - m_segmentStart;
+    if (expected == 0) {
+        return;
+    }
+
+    // records past the archived count come from a spill whose state save
+    // never landed, or were torn by a crash; the next spill writes over
+    // them, and they are spilled again from the recent window
+    QFile file(QDir(m_archiveDirectory).filePath(segmentFileName(m_segmentStart)));
+    const QByteArray data = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    QCborStreamReader reader(data);
+    qint64 kept = 0;
+    qint64 end = 0;
+    while (kept < expected && (reader.isMap() || reader.isNull())) {
+        reader.next();
+        // the end of the data after a complete record reads as EndOfFile
+        const QCborError error = reader.lastError();
+        if (error != QCborError::NoError && error != QCborError::EndOfFile) {
+            break;
+        }
+        ++kept;
+        end = reader.currentOffset();
+    }
+    m_segmentSize = end;
+    if (kept < expected) {
+        // the count is kept so no index is handed out twice
+        qWarning() << "history segment" << file.fileName() << "lost" << expected - kept << "of" << expected
+                   << "summaries";
+        const QByteArray null = QCborValue(QCborValue::Null).toCbor();
+        for (qint64 k = kept; k < expected; ++k) {
+            m_segmentPadding += null;
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef LEVELHISTORY_H
+#define LEVELHISTORY_H
+
+#include <QByteArray>
+#include <QString>
+#include <memory>
+
+#include "levelsummary.h"
+#include "ringbuffer.h"
+
+class QCborStreamReader;
+class QFile;
+class StateWriter;
+
+// Streams archived summaries oldest first, one segment file open at a time.
+class HistoryCursor
+{
+public:
+    HistoryCursor(const QString &archiveDirectory, qint64 archivedCount);
+    HistoryCursor(HistoryCursor &&other) noexcept;
+    HistoryCursor &operator=(HistoryCursor &&other) noexcept;
+    ~HistoryCursor();
+
+    bool next(LevelSummary *summary);
+    qint64 position() const;
+    qint64 count() const;
+
+private:
+    bool openSegment(qint64 start);
+    void closeSegment();
+
+    QString m_directory;
+    qint64 m_count = 0;
+    qint64 m_position = 0;
+    std::unique_ptr<QFile> m_file;
+    std::unique_ptr<QCborStreamReader> m_reader;
+};
+
+// Level summaries of one profile. The newest kRecentCapacity live in a ring
+// buffer; each one pushed out of it is appended to an archive segment on
+// disk. Segments hold kSegmentCapacity summaries as a CBOR sequence and are
+// named by the index of their first summary. Each spill writes only its
+// own record through the state writer, at the offset where the open
+// segment ends. Reopening cuts records past the saved archived count; a
+// summary lost from the segment is kept as a null so later indexes stay
+// put, and the cursor skips it.
+class LevelHistory
+{
+public:
+    static constexpr int kRecentCapacity = 80;
+    static constexpr int kSegmentCapacity = 512;
+
+    LevelHistory();
+
+    void setArchiveDirectory(const QString &path);
+    QString archiveDirectory() const;
+    void setWriter(StateWriter *writer);
+
+    void clear();
+    void setArchivedCount(qint64 count);
+    qint64 archivedCount() const;
+    qint64 totalCount() const;
+
+    void append(const LevelSummary &summary);
+    const RingBuffer<LevelSummary> &recent() const;
+
+    HistoryCursor archiveCursor() const;
+    static QString segmentFileName(qint64 start);
+
+private:
+    void spill(const LevelSummary &summary);
+    void loadOpenSegment();
+
+    RingBuffer<LevelSummary> m_recent;
+    QString m_archiveDirectory;
+    StateWriter *m_writer = nullptr;
+    qint64 m_archivedCount = 0;
+    // -1 until the open segment has been read back from disk
+    qint64 m_segmentStart = -1;
+    qint64 m_segmentSize = 0;
+    // nulls standing in for lost summaries, written with the next spill
+    QByteArray m_segmentPadding;
+};
+
+#endif // LEVELHISTORY_H
@@ -0,0 +1,36 @@
+#ifndef LEVELSUMMARY_H
+#define LEVELSUMMARY_H
+
+#include <QCborMap>
+#include <QDateTime>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+
+struct PitchSummary {
+    int totalTrials = 0;
+    int correctTrials = 0;
+};
+
+struct LevelSummary {
+    int levelIndex = 0;
+    double accuracy = 0.0;
+    bool passed = false;
+    bool specialExercise = false;
+    quint32 seed = 0;
+    // the schedule inputs the window supplied next to the seed; 0 when
+    // not recorded
+    quint16 octaveMask = 0;
+    double outOfBoundsProportion = 0.0;
+    // trials an early decision left unplayed
+    int trialsSkipped = 0;
+    QDateTime completedAt;
+    QHash<QString, PitchSummary> perPitch;
+
+    QJsonObject toJson() const;
+    static LevelSummary fromJson(const QJsonObject &obj);
+    QCborMap toCbor() const;
+    static LevelSummary fromCbor(const QCborMap &map);
+};
+
+#endif // LEVELSUMMARY_H
@@ -0,0 +1,331 @@
+#include "pitchstatistics.h"
+
+#include "levelsummary.h"
+#include "trainingmodel.h"
+
+#include <QCborArray>
+
+namespace {
+constexpr int kFormatVersion = 1;
+
+template <typename T, std::size_t N>
+QCborArray toCborArray(const std::array<T, N> &values)
+{
+    QCborArray array;
+    for (const auto value : values) {
+        array.append(static_cast<qint64>(value));
+    }
+    return array;
+}
+
+template <typename T, std::size_t N>
+void fromCborArray(const QCborValue &value, std::array<T, N> *values)
+{
+    const QCborArray array = value.toArray();
+    for (std::size_t i = 0; i < N; ++i) {
+        (*values)[i] = static_cast<T>(qMax<qint64>(0, array.at(static_cast<qsizetype>(i)).toInteger()));
+    }
+}
+
+int categoryForName(const QString &name)
+{
+    if (name == QLatin1String("OUT")) {
+        return PitchStatistics::kOtherCategory;
+    }
+    return TrainingSpec::chromaticOrder().indexOf(name);
+}
+
+bool validCategory(int category)
+{
+    return category >= 0 && category < PitchStatistics::kCategoryCount;
+}
+}
+
+PitchStatistics::PitchStatistics() = default;
+
+void PitchStatistics::clear()
+{
+    *this = PitchStatistics();
+}
+
+void PitchStatistics::recordTrial(int expected, int answered, bool correct, int responseTimeMs)
+{
+    if (!validCategory(expected)) {
+        return;
+    }
+    const bool hasAnswer = validCategory(answered);
+    const quint16 rt = static_cast<quint16>(qBound(0, responseTimeMs, 0xffff));
+
+    TrialEntry entry;
+    entry.category = static_cast<qint8>(expected);
+    entry.correct = correct;
+    entry.answered = hasAnswer;
+    entry.responseTimeMs = rt;
+    pushTrialEntry(entry);
+
+    ++m_currentLevel.total[expected];
+    ++m_allTotal[expected];
+    if (correct) {
+        ++m_currentLevel.correct[expected];
+        ++m_allCorrect[expected];
+    }
+    if (hasAnswer) {
+        m_allRtSum[expected] += rt;
+        ++m_allRtCount[expected];
+        ++m_confusion[expected * kCategoryCount + answered];
+    } else {
+        ++m_timeouts[expected];
+    }
+    ++m_currentLevelTrials;
+}
+
+void PitchStatistics::pushTrialEntry(const TrialEntry &entry)
+{
+    if (m_trialCount == kTrialWindow) {
+        const TrialEntry &oldest = m_trials[m_trialHead];
+        --m_trialTotal[oldest.category];
+        if (oldest.correct) {
+            --m_trialCorrect[oldest.category];
+        }
+        if (oldest.answered) {
+            m_trialRtSum[oldest.category] -= oldest.responseTimeMs;
+            --m_trialRtCount[oldest.category];
+        }
+    } else {
+        ++m_trialCount;
+    }
+    m_trials[m_trialHead] = entry;
+    m_trialHead = (m_trialHead + 1) % kTrialWindow;
+
+    ++m_trialTotal[entry.category];
+    if (entry.correct) {
+        ++m_trialCorrect[entry.category];
+    }
+    if (entry.answered) {
+        m_trialRtSum[entry.category] += entry.responseTimeMs;
+        ++m_trialRtCount[entry.category];
+    }
+}
+
+void PitchStatistics::beginLevel()
+{
+    m_currentLevel = LevelBlock{};
+    m_currentLevelTrials = 0;
+}
+
+void PitchStatistics::commitLevel()
+{
+    if (m_currentLevelTrials > 0) {
+        pushLevelBlock(m_currentLevel);
+    }
+    beginLevel();
+}
+
+int PitchStatistics::pendingLevelTrials() const
+{
+    return m_currentLevelTrials;
+}
+
+void PitchStatistics::pushLevelBlock(const LevelBlock &block)
+{
+    if (m_levelCount == kLevelWindow) {
+        const LevelBlock &oldest = m_levels[m_levelHead];
+        for (int c = 0; c < kCategoryCount; ++c) {
+            m_levelTotal[c] -= oldest.total[c];
+            m_levelCorrect[c] -= oldest.correct[c];
+        }
+    } else {
+        ++m_levelCount;
+    }
+    m_levels[m_levelHead] = block;
+    m_levelHead = (m_levelHead + 1) % kLevelWindow;
+    for (int c = 0; c < kCategoryCount; ++c) {
+        m_levelTotal[c] += block.total[c];
+        m_levelCorrect[c] += block.correct[c];
+    }
+}
+
+void PitchStatistics::seedFromSummary(const LevelSummary &summary)
+{
+    if (summary.specialExercise) {
+        return;
+    }
+    LevelBlock block;
+    for (auto it = summary.perPitch.constBegin(); it != summary.perPitch.constEnd(); ++it) {
+        const int category = categoryForName(it.key());
+        if (!validCategory(category)) {
+            continue;
+        }
+        block.total[category] += static_cast<quint32>(qMax(0, it.value().totalTrials));
+        block.correct[category] += static_cast<quint32>(qMax(0, it.value().correctTrials));
+        m_allTotal[category] += block.total[category];
+        m_allCorrect[category] += block.correct[category];
+    }
+    pushLevelBlock(block);
+}
+
+quint64 PitchStatistics::total(Window window, int category) const
+{
+    if (!validCategory(category)) {
+        return 0;
+    }
+    switch (window) {
+    case Window::RecentTrials:
+        return m_trialTotal[category];
+    case Window::RecentLevels:
+        return m_levelTotal[category];
+    case Window::AllTime:
+        return m_allTotal[category];
+    }
+    return 0;
+}
+
+quint64 PitchStatistics::correct(Window window, int category) const
+{
+    if (!validCategory(category)) {
+        return 0;
+    }
+    switch (window) {
+    case Window::RecentTrials:
+        return m_trialCorrect[category];
+    case Window::RecentLevels:
+        return m_levelCorrect[category];
+    case Window::AllTime:
+        return m_allCorrect[category];
+    }
+    return 0;
+}
+
+double PitchStatistics::accuracy(Window window, int category) const
+{
+    const quint64 count = total(window, category);
+    return count == 0 ? 0.0 : static_cast<double>(correct(window, category)) / static_cast<double>(count);
+}
+
+quint32 PitchStatistics::confusion(int expected, int answered) const
+{
+    if (!validCategory(expected) || !validCategory(answered)) {
+        return 0;
+    }
+    return m_confusion[expected * kCategoryCount + answered];
+}
+
+quint32 PitchStatistics::timeouts(int expected) const
+{
+    return validCategory(expected) ? m_timeouts[expected] : 0;
+}
+
+double PitchStatistics::meanResponseTimeMs(Window window, int category) const
+{
+    if (!validCategory(category)) {
+        return -1.0;
+    }
+    quint64 sum = 0;
+    quint64 count = 0;
+    if (window == Window::AllTime) {
+        sum = m_allRtSum[category];
+        count = m_allRtCount[category];
+    } else {
+        // level blocks only carry counts, so both recent windows use the
+        // trial window for timing
+        sum = m_trialRtSum[category];
+        count = m_trialRtCount[category];
+    }
+    return count == 0 ? -1.0 : static_cast<double>(sum) / static_cast<double>(count);
+}
+
+int PitchStatistics::weakestPitch(Window window) const
+{
+    int weakest = -1;
+    double lowest = 2.0;
+    for (int c = 0; c < kOtherCategory; ++c) {
+        if (total(window, c) == 0) {
+            continue;
+        }
+        const double acc = accuracy(window, c);
+        if (acc < lowest) {
+            lowest = acc;
+            weakest = c;
+        }
+    }
+    return weakest;
+}
+
+QCborMap PitchStatistics::toCbor() const
+{
+    QCborMap map;
+    map[QStringLiteral("version")] = kFormatVersion;
+
+    // oldest first, three numbers per trial
+    QCborArray trials;
+    for (int i = 0; i < m_trialCount; ++i) {
+        const int slot = (m_trialHead - m_trialCount + i + kTrialWindow) % kTrialWindow;
+        const TrialEntry &entry = m_trials[slot];
+        trials.append(entry.category);
+        trials.append((entry.correct ? 1 : 0) | (entry.answered ? 2 : 0));
+        trials.append(entry.responseTimeMs);
+    }
+    map[QStringLiteral("trials")] = trials;
+
+    QCborArray levels;
+    for (int i = 0; i < m_levelCount; ++i) {
+        const int slot = (m_levelHead - m_levelCount + i + kLevelWindow) % kLevelWindow;
+        levels.append(toCborArray(m_levels[slot].total));
+        levels.append(toCborArray(m_levels[slot].correct));
+    }
+    map[QStringLiteral("levels")] = levels;
+    map[QStringLiteral("currentTotal")] = toCborArray(m_currentLevel.total);
+    map[QStringLiteral("currentCorrect")] = toCborArray(m_currentLevel.correct);
+    map[QStringLiteral("currentTrials")] = m_currentLevelTrials;
+
+    map[QStringLiteral("allTotal")] = toCborArray(m_allTotal);
+    map[QStringLiteral("allCorrect")] = toCborArray(m_allCorrect);
+    map[QStringLiteral("allRtSum")] = toCborArray(m_allRtSum);
+    map[QStringLiteral("allRtCount")] = toCborArray(m_allRtCount);
+    map[QStringLiteral("confusion")] = toCborArray(m_confusion);
+    map[QStringLiteral("timeouts")] = toCborArray(m_timeouts);
+    return map;
+}
+
+PitchStatistics PitchStatistics::fromCbor(const QCborMap &map)
+{
+    PitchStatistics stats;
+    if (map.value(QStringLiteral("version")).toInteger() != kFormatVersion) {
+        return stats;
+    }
+
+    // replay the trial window; the all-time arrays are restored below
+    const QCborArray trials = map.value(QStringLiteral("trials")).toArray();
+    for (qsizetype i = 0; i + 2 < trials.size(); i += 3) {
+        const int category = static_cast<int>(trials.at(i).toInteger());
+        if (!validCategory(category)) {
+            continue;
+        }
+        const int flags = static_cast<int>(trials.at(i + 1).toInteger());
+        TrialEntry entry;
+        entry.category = static_cast<qint8>(category);
+        entry.correct = flags & 1;
+        entry.answered = flags & 2;
+        entry.responseTimeMs = static_cast<quint16>(trials.at(i + 2).toInteger());
+        stats.pushTrialEntry(entry);
+    }
+
+    const QCborArray levels = map.value(QStringLiteral("levels")).toArray();
+    for (qsizetype i = 0; i + 1 < levels.size(); i += 2) {
+        LevelBlock block;
+        fromCborArray(levels.at(i), &block.total);
+        fromCborArray(levels.at(i + 1), &block.correct);
+        stats.pushLevelBlock(block);
+    }
+    fromCborArray(map.value(QStringLiteral("currentTotal")), &stats.m_currentLevel.total);
+    fromCborArray(map.value(QStringLiteral("currentCorrect")), &stats.m_currentLevel.correct);
+    stats.m_currentLevelTrials = static_cast<int>(map.value(QStringLiteral("currentTrials")).toInteger());
+
+    fromCborArray(map.value(QStringLiteral("allTotal")), &stats.m_allTotal);
+    fromCborArray(map.value(QStringLiteral("allCorrect")), &stats.m_allCorrect);
+    fromCborArray(map.value(QStringLiteral("allRtSum")), &stats.m_allRtSum);
+    fromCborArray(map.value(QStringLiteral("allRtCount")), &stats.m_allRtCount);
+    fromCborArray(map.value(QStringLiteral("confusion")), &stats.m_confusion);
+    fromCborArray(map.value(QStringLiteral("timeouts")), &stats.m_timeouts);
+    return stats;
+}
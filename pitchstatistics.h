@@ -0,0 +1,100 @@
+#ifndef PITCHSTATISTICS_H
+#define PITCHSTATISTICS_H
+
+#include <QCborMap>
+#include <QtGlobal>
+#include <array>
+
+struct LevelSummary;
+
+// Running per-pitch counts for level trials, updated in O(1) per trial.
+// Categories are the twelve pitch classes plus kOtherCategory, which
+// stands for out-of-bounds tones (whose correct answer is "Other") on the
+// presented side and for the "Other" answer on the response side, so the
+// diagonal of the confusion matrix is exactly the correct answers.
+class PitchStatistics
+{
+public:
+    static constexpr int kCategoryCount = 13;
+    static constexpr int kOtherCategory = 12;
+    static constexpr int kTrialWindow = 120;
+    static constexpr int kLevelWindow = 15;
+
+    enum class Window {
+        RecentTrials,
+        RecentLevels,
+        AllTime
+    };
+
+    PitchStatistics();
+
+    void clear();
+
+    // answered is a category, or -1 for a timeout
+    void recordTrial(int expected, int answered, bool correct, int responseTimeMs);
+    void beginLevel();
+    void commitLevel();
+    int pendingLevelTrials() const;
+
+    // rebuilds the level and all-time counts of an older profile from its
+    // per-pitch summary totals
+    void seedFromSummary(const LevelSummary &summary);
+
+    quint64 total(Window window, int category) const;
+    quint64 correct(Window window, int category) const;
+    double accuracy(Window window, int category) const;
+    quint32 confusion(int expected, int answered) const;
+    quint32 timeouts(int expected) const;
+    // mean over answered trials, -1 when there are none
+    double meanResponseTimeMs(Window window, int category) const;
+
+    int weakestPitch(Window window) const;
+
+    QCborMap toCbor() const;
+    static PitchStatistics fromCbor(const QCborMap &map);
+
+private:
+    using CategoryCounts = std::array<quint32, kCategoryCount>;
+
+    struct TrialEntry {
+        qint8 category = -1;
+        bool correct = false;
+        bool answered = false;
+        quint16 responseTimeMs = 0;
+    };
+
+    struct LevelBlock {
+        CategoryCounts total{};
+        CategoryCounts correct{};
+    };
+
+    void pushTrialEntry(const TrialEntry &entry);
+    void pushLevelBlock(const LevelBlock &block);
+
+    // last kTrialWindow trials
+    std::array<TrialEntry, kTrialWindow> m_trials{};
+    int m_trialHead = 0;
+    int m_trialCount = 0;
+    CategoryCounts m_trialTotal{};
+    CategoryCounts m_trialCorrect{};
+    std::array<quint64, kCategoryCount> m_trialRtSum{};
+    CategoryCounts m_trialRtCount{};
+
+    // last kLevelWindow completed levels, plus the one in progress
+    std::array<LevelBlock, kLevelWindow> m_levels{};
+    int m_levelHead = 0;
+    int m_levelCount = 0;
+    CategoryCounts m_levelTotal{};
+    CategoryCounts m_levelCorrect{};
+    LevelBlock m_currentLevel;
+    int m_currentLevelTrials = 0;
+
+    std::array<quint64, kCategoryCount> m_allTotal{};
+    std::array<quint64, kCategoryCount> m_allCorrect{};
+    std::array<quint64, kCategoryCount> m_allRtSum{};
+    std::array<quint64, kCategoryCount> m_allRtCount{};
+    std::array<quint32, kCategoryCount * kCategoryCount> m_confusion{};
+    CategoryCounts m_timeouts{};
+};
+
+#endif // PITCHSTATISTICS_H
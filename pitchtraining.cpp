@@ -1,14 +1,16 @@
 #include "pitchtraining.h"
 #include "ui_pitchtraining.h"
+#include "tonesynth.h"
 
-#include <QAbstractButton>
 #include <QAbstractItemView>
 #include <QApplication>
 #include <QBoxLayout>
 #include <QVBoxLayout>
 #include <QColor>
 #include <QDateTime>
+#include <QDir>
 #include <QDialog>
+#include <QFileDialog>
 #include <QFrame>
 #include <QGridLayout>
 #include <QInputDialog>
@@ -19,16 +21,15 @@
 #include <QScrollArea>
 #include <QSignalBlocker>
 #include <QSizePolicy>
+#include <QStandardPaths>
 #include <QStyle>
 #include <QTabWidget>
 #include <QtCore/qoverload.h>
 #include <QVariant>
 #include <algorithm>
-#include <cmath>
 #include <random>
 
 namespace {
-constexpr int kTokenCostForDouble = 10;
 constexpr int kSessionMinimumSeconds = 15 * 60;
 }
 
@@ -38,6 +39,13 @@ PitchTraining::PitchTraining(QWidget *parent)
 {
     ui->setupUi(this);
     qApp->installEventFilter(this);
+    quint16 octaveMask = 0;
+    for (int octave : m_toneLibrary.supportedOctaves()) {
+        if (octave >= 0 && octave < 16) {
+            octaveMask |= static_cast<quint16>(1u << octave);
+        }
+    }
+    m_session.setOctaveMask(octaveMask);
     buildUi();
     applyTheme();
 
@@ -49,9 +57,16 @@ PitchTraining::PitchTraining(QWidget *parent)
     m_responseTimer->setSingleShot(true);
     connect(m_responseTimer, &QTimer::timeout, this, &PitchTraining::handleResponseTimeout);
 
-    m_responseProgressTimer = new QTimer(this);
-    m_responseProgressTimer->setInterval(40);
-    connect(m_responseProgressTimer, &QTimer::timeout, this, &PitchTraining::updateResponseTimeBar);
+    // the queued tone starts when this fires, so it must not drift
+    m_interTrialTimer = new QTimer(this);
+    m_interTrialTimer->setSingleShot(true);
+    m_interTrialTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_interTrialTimer, &QTimer::timeout, this, &PitchTraining::presentQueuedTrial);
+
+    m_batteryClock = new QTimer(this);
+    m_batteryClock->setInterval(10);
+    m_batteryClock->setTimerType(Qt::PreciseTimer);
+    connect(m_batteryClock, &QTimer::timeout, this, &PitchTraining::handleBatteryTick);
 
     connect(&m_tonePlayer, &TonePlayer::playbackFinished, this, &PitchTraining::handlePlaybackFinished);
 
@@ -61,8 +76,11 @@ PitchTraining::PitchTraining(QWidget *parent)
     connect(m_sessionButton, &QPushButton::clicked, this, &PitchTraining::handleSessionToggle);
     connect(m_newProfileButton, &QPushButton::clicked, this, &PitchTraining::handleCreateProfile);
     connect(m_deleteProfileButton, &QPushButton::clicked, this, &PitchTraining::handleDeleteProfile);
+    connect(m_exportProfileButton, &QPushButton::clicked, this, &PitchTraining::handleExportProfile);
     connect(m_profileCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &PitchTraining::handleProfileSelection);
+    connect(m_profileCompleter, QOverload<const QModelIndex &>::of(&QCompleter::activated), this, &PitchTraining::handleProfileSearchActivated);
     connect(m_helpButton, &QPushButton::clicked, this, &PitchTraining::handleShowInstructions);
+    connect(m_testBatteryButton, &QPushButton::clicked, this, &PitchTraining::handleRunTestBattery);
 
     setMinimumSize(1000, 680);
     resize(1180, 760);
@@ -71,8 +89,11 @@ PitchTraining::PitchTraining(QWidget *parent)
 
 PitchTraining::~PitchTraining()
 {
+    if (m_session.batteryActive()) {
+        finishTestBattery(true);
+    }
     concludeSessionIfNeeded();
-    m_state.save();
+    m_session.state().save();
     if (qApp) {
         qApp->removeEventFilter(this);
     }
@@ -163,9 +184,35 @@ void PitchTraining::buildUi()
     profileRow->setContentsMargins(0, 6, 0, 0);
     profileRow->setSpacing(6);
     m_profileCombo = new QComboBox(profileFrame);
-    m_profileCombo->setFocusPolicy(Qt::NoFocus);
+    m_profileCombo->setFocusPolicy(Qt::ClickFocus);
     m_profileCombo->setMinimumHeight(24);
     m_profileCombo->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+    // sizing to contents would measure every profile name
+    m_profileCombo->setSizeAdjustPolicy(QComboBox::AdjustToMinimumContentsLengthWithIcon);
+    m_profileCombo->setMinimumContentsLength(16);
+    m_profileCombo->setEditable(true);
+    m_profileCombo->setInsertPolicy(QComboBox::NoInsert);
+    m_profileModel = new ProfileListModel(&m_profileManager, this);
+    m_profileCombo->setModel(m_profileModel);
+    if (auto *profileView = qobject_cast<QListView *>(m_profileCombo->view())) {
+        profileView->setUniformItemSizes(true);
+    }
+    m_profileSearchModel = new ProfileListModel(&m_profileManager, this);
+    m_profileSearchModel->setMatchLimit(50);
+    m_profileCompleter = new QCompleter(m_profileSearchModel, this);
+    m_profileCompleter->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    m_profileCombo->lineEdit()->setCompleter(m_profileCompleter);
+    m_profileCombo->lineEdit()->setPlaceholderText(tr("Search profiles"));
+    connect(m_profileCombo->lineEdit(), &QLineEdit::textEdited, this, [this](const QString &text) {
+        m_profileSearchModel->setFilter(text);
+        m_profileCompleter->complete();
+    });
+    connect(m_profileCombo->lineEdit(), &QLineEdit::editingFinished, this, [this]() {
+        if (!m_profileCompleter->popup()->isVisible()) {
+            // drop a search that was not picked
+            refreshProfileControls();
+        }
+    });
     profileRow->addWidget(m_profileCombo, 1);
     m_newProfileButton = new QPushButton(tr("New"), profileFrame);
     m_newProfileButton->setFocusPolicy(Qt::NoFocus);
@@ -175,6 +222,11 @@ void PitchTraining::buildUi()
     m_deleteProfileButton->setFocusPolicy(Qt::NoFocus);
     m_deleteProfileButton->setMinimumHeight(24);
     profileRow->addWidget(m_deleteProfileButton);
+    m_exportProfileButton = new QPushButton(tr("Export"), profileFrame);
+    m_exportProfileButton->setFocusPolicy(Qt::NoFocus);
+    m_exportProfileButton->setMinimumHeight(24);
+    m_exportProfileButton->setToolTip(tr("Save this profile's progress as JSON"));
+    profileRow->addWidget(m_exportProfileButton);
     profileLayout->addLayout(profileRow);
     layout->addWidget(profileFrame);
 
@@ -211,35 +263,50 @@ void PitchTraining::buildUi()
     m_sampleButton->setFocusPolicy(Qt::NoFocus);
     m_sampleButton->setMinimumHeight(24);
     m_sampleButton->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
-    m_doubleButton = new QPushButton(tr("Arm double bonus (-10 tokens)"), controlFrame);
+    m_doubleButton = new QPushButton(tr("Arm double bonus (-%1 tokens)").arg(TrainingSession::kDoubleTokenCost), controlFrame);
     m_doubleButton->setEnabled(false);
     m_doubleButton->setFocusPolicy(Qt::NoFocus);
     m_doubleButton->setMinimumHeight(24);
     m_doubleButton->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+    m_autoAdvanceButton = new QPushButton(tr("Auto-advance"), controlFrame);
+    m_autoAdvanceButton->setCheckable(true);
+    m_autoAdvanceButton->setFocusPolicy(Qt::NoFocus);
+    m_autoAdvanceButton->setMinimumHeight(24);
+    m_autoAdvanceButton->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+    m_autoAdvanceButton->setToolTip(tr("Play each tone on its own after a short pause; press any key to pause."));
     m_sessionButton = new QPushButton(tr("Start 15-min session"), controlFrame);
     m_sessionButton->setFocusPolicy(Qt::NoFocus);
     m_sessionButton->setProperty("accent", true);
     m_sessionButton->setMinimumHeight(26);
 
     connect(m_doubleButton, &QPushButton::clicked, [this]() {
-        if (!m_levelActive || !m_currentSpec.tokensAllowed) {
+        if (!m_session.levelActive() || !m_session.currentSpec().tokensAllowed) {
             updateFeedback(tr("Bonus unavailable right now"), false);
             return;
         }
-        if (!m_state.consumeTokens(kTokenCostForDouble)) {
-            updateFeedback(tr("You need %1 tokens").arg(kTokenCostForDouble), false);
+        if (!m_session.armDouble()) {
+            updateFeedback(tr("You need %1 tokens").arg(TrainingSession::kDoubleTokenCost), false);
             return;
         }
-        m_doubleArmed = true;
         refreshStateLabels();
         updateFeedback(tr("Double bonus armed for the next correct answer"), true);
     });
+    connect(m_autoAdvanceButton, &QPushButton::toggled, [this](bool on) {
+        m_autoPaused = false;
+        if (!on && m_interTrialTimer && m_interTrialTimer->isActive()) {
+            m_interTrialTimer->stop();
+            m_startTrialButton->setEnabled(true);
+        } else if (on && m_startTrialButton->isEnabled() && m_session.isRunning()) {
+            awaitNextTrial();
+        }
+    });
 
     controlLayout->addWidget(m_sessionButton);
     controlGrid->addWidget(m_startLevelButton, 0, 0);
     controlGrid->addWidget(m_startTrialButton, 0, 1);
     controlGrid->addWidget(m_sampleButton, 1, 0);
     controlGrid->addWidget(m_doubleButton, 1, 1);
+    controlGrid->addWidget(m_autoAdvanceButton, 2, 0, 1, 2);
     controlGrid->setColumnStretch(0, 1);
     controlGrid->setColumnStretch(1, 1);
     controlLayout->addLayout(controlGrid);
@@ -257,10 +324,15 @@ void PitchTraining::buildUi()
     m_helpButton->setProperty("link", true);
     m_helpButton->setFocusPolicy(Qt::NoFocus);
     m_helpButton->setCursor(Qt::PointingHandCursor);
+    m_testBatteryButton = new QPushButton(tr("Run a pre/post test"), statusFrame);
+    m_testBatteryButton->setProperty("link", true);
+    m_testBatteryButton->setFocusPolicy(Qt::NoFocus);
+    m_testBatteryButton->setCursor(Qt::PointingHandCursor);
     statusLayout->addWidget(m_statusLabel);
     auto *helpRow = new QHBoxLayout();
     helpRow->setContentsMargins(0, 0, 0, 0);
     helpRow->addWidget(m_helpButton, 0, Qt::AlignLeft);
+    helpRow->addWidget(m_testBatteryButton, 0, Qt::AlignLeft);
     helpRow->addStretch();
     statusLayout->addLayout(helpRow);
     layout->addWidget(statusFrame);
@@ -274,20 +346,13 @@ void PitchTraining::buildUi()
     m_trialProgress->setRange(0, 20);
     m_trialProgress->setObjectName("trialProgress");
     progressLayout->addWidget(m_trialProgress);
-    m_responseProgress = new QProgressBar(progressFrame);
-    m_responseProgress->setTextVisible(true);
-    m_responseProgress->setFormat(tr("Time left"));
-    m_responseProgress->setMinimum(0);
-    m_responseProgress->setMaximum(100);
+    m_responseProgress = new ResponseTimeBar(progressFrame);
     m_responseProgress->setObjectName("responseProgress");
-    m_responseProgress->setValue(0);
     progressLayout->addWidget(m_responseProgress);
     layout->addWidget(progressFrame);
 
-    m_feedbackLabel = new QLabel(central);
-    m_feedbackLabel->setWordWrap(true);
+    m_feedbackLabel = new FeedbackBanner(central);
     m_feedbackLabel->setObjectName("feedbackLabel");
-    m_feedbackLabel->setProperty("positive", true);
     layout->addWidget(m_feedbackLabel);
 
     m_specialContainer = new QFrame(central);
@@ -320,7 +385,7 @@ void PitchTraining::buildUi()
     m_keyboardHintLabel = new QLabel(central);
     m_keyboardHintLabel->setWordWrap(true);
     m_keyboardHintLabel->setObjectName("hintLabel");
-    m_keyboardHintLabel->setText(tr("Keyboard shortcuts: press note letters (A-G) for notes, hold Ctrl for sharps, Backspace for \"Other\", and 1 for \"Hear next tone\"."));
+    m_keyboardHintLabel->setText(tr("Keyboard shortcuts: press note letters (A-G) for notes, hold Ctrl for sharps, Backspace for \"Other\", and 1 for \"Hear next tone\". With auto-advance, any key between tones pauses."));
     layout->addWidget(m_keyboardHintLabel);
 
     auto *interactionTabs = new QTabWidget(central);
@@ -342,17 +407,11 @@ void PitchTraining::buildUi()
     auto *responseTitle = new QLabel(tr("Choose the note you heard"), responseFrame);
     responseTitle->setObjectName("sectionTitle");
     responseLayout->addWidget(responseTitle);
-    m_responseContainer = new QWidget(responseFrame);
-    m_responseContainer->setObjectName("responseContainer");
-    m_responseContainer->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
-    m_responseContainer->setMinimumHeight(160);
-    auto *grid = new QGridLayout(m_responseContainer);
-    grid->setContentsMargins(0, 0, 0, 0);
-    grid->setSpacing(10);
-    m_responseButtons = new QButtonGroup(this);
-    m_responseButtons->setExclusive(true);
-    connect(m_responseButtons, &QButtonGroup::idClicked, this, &PitchTraining::handleResponse);
-    responseLayout->addWidget(m_responseContainer);
+    m_responsePad = new ResponsePad(responseFrame);
+    m_responsePad->setObjectName("responsePad");
+    m_responsePad->setMinimumHeight(160);
+    connect(m_responsePad, &ResponsePad::responseChosen, this, &PitchTraining::handleResponse);
+    responseLayout->addWidget(m_responsePad);
     responsePageLayout->addWidget(responseFrame);
     interactionTabs->addTab(responsePage, tr("Tone pad"));
 
@@ -368,10 +427,13 @@ void PitchTraining::buildUi()
     auto *logTitle = new QLabel(tr("Trial log"), logFrame);
     logTitle->setObjectName("sectionTitle");
     logLayout->addWidget(logTitle);
-    m_trialLogList = new QListWidget(logFrame);
+    m_trialLogModel = new TrialLogModel(500, this);
+    m_trialLogList = new QListView(logFrame);
     m_trialLogList->setObjectName("trialLog");
     m_trialLogList->setSelectionMode(QAbstractItemView::NoSelection);
-    m_trialLogList->setAlternatingRowColors(true);
+    m_trialLogList->setUniformItemSizes(true);
+    m_trialLogList->setItemDelegate(new TrialLogDelegate(m_trialLogList));
+    m_trialLogList->setModel(m_trialLogModel);
     logLayout->addWidget(m_trialLogList);
     logPageLayout->addWidget(logFrame);
     interactionTabs->addTab(logPage, tr("Trial history"));
@@ -385,273 +447,7 @@ void PitchTraining::buildUi()
 
 void PitchTraining::applyTheme()
 {
-    const QString style = QStringLiteral(R"(
-QMainWindow#PitchTraining {
-    background-color: #f4f6fb;
-}
-QWidget#mainSurface {
-    background-color: #f4f6fb;
-}
-QScrollArea {
-    background-color: transparent;
-    border: none;
-}
-QScrollArea > QWidget > QWidget {
-    background-color: transparent;
-}
-QLabel {
-    color: #0f172a;
-    font-size: 13px;
-}
-QLabel#heroCaption {
-    color: #475569;
-    font-size: 11px;
-    font-weight: 600;
-}
-QLabel#heroAboutLink {
-    color: #0a58ca;
-    font-size: 14px;
-}
-QLabel#heroAboutLink:hover {
-    color: #0a58ca;
-    text-decoration: underline;
-}
-QLabel#levelLabel {
-    font-size: 22px;
-    font-weight: 700;
-    color: #0b1120;
-}
-QLabel#requirementLabel {
-    color: #1f2933;
-    font-size: 13px;
-}
-QFrame#heroFrame,
-QFrame#sectionFrame,
-QFrame#statCard,
-QFrame#specialCard {
-    border-radius: 12px;
-    border: 1px solid #cfd8e3;
-    background-color: #ffffff;
-}
-QWidget#responseContainer {
-    border-radius: 10px;
-    border: 1px solid #cbd5f5;
-    background-color: #eef2ff;
-}
-QLabel#sectionTitle {
-    font-size: 16px;
-    font-weight: 600;
-    color: #0f172a;
-}
-QLabel#sectionSubtitle {
-    font-size: 12px;
-    color: #475569;
-}
-QLabel#statusLabel {
-    font-size: 14px;
-}
-QLabel#statTitle {
-    font-size: 11px;
-    color: #64748b;
-    letter-spacing: 0.05em;
-}
-QLabel#statValue {
-    font-size: 13px;
-    font-weight: 600;
-    color: #0f172a;
-}
-QLabel#feedbackLabel {
-    border-radius: 5px;
-    padding: 10px 12px;
-    font-weight: 600;
-    border: 1px solid #fbbf24;
-    background-color: #fff7e6;
-    color: #92400e;
-}
-QLabel#feedbackLabel[positive="true"] {
-    background-color: #ecfdf5;
-    color: #065f46;
-    border-color: #34d399;
-}
-QLabel#feedbackLabel[positive="false"] {
-    background-color: #fef2f2;
-    color: #991b1b;
-    border-color: #fca5a5;
-}
-QLabel#hintLabel {
-    font-size: 13px;
-    color: #0f172a;
-    padding: 8px 12px;
-    border-radius: 6px;
-    background-color: #e0f2fe;
-}
-QProgressBar {
-    background-color: #e5e7eb;
-    border: 1px solid #cfd8e3;
-    border-radius: 5px;
-    padding: 2px;
-    color: #0f172a;
-    height: 17px;
-}
-QProgressBar::chunk {
-    border-radius: 4px;
-    background-color: #2563eb;
-}
-QProgressBar#responseProgress::chunk {
-    background-color: #dc2626;
-}
-QPushButton {
-    background-color: #f9fafb;
-    border: 1px solid #94a3b8;
-    border-radius: 4px;
-    color: #0f172a;
-    font-weight: 600;
-    font-size: 13px;
-    padding: 6px 12px;
-}
-QPushButton:hover:!disabled {
-    background-color: #e2e8f0;
-}
-QPushButton:disabled {
-    color: #94a3b8;
-    border-color: #e2e8f0;
-    background-color: #f4f4f5;
-}
-QPushButton[sessionRequired="true"]:disabled {
-    background-color: #dfe3ea;
-    border-color: #cbd5f5;
-    color: #94a3b8;
-}
-QPushButton[noteButton="true"] {
-    font-size: 15px;
-    font-weight: 600;
-    letter-spacing: 0.01em;
-    background-color: #ffffff;
-    color: #0f172a;
-    border: 1px solid #1d4ed8;
-    border-radius: 6px;
-    padding: 6px 10px;
-}
-QPushButton[noteButton="true"]:hover {
-    background-color: #e0f2fe;
-}
-QPushButton[noteButton="true"]:disabled {
-    background-color: #f1f5f9;
-    border-color: #cbd5f5;
-    color: #94a3b8;
-}
-QPushButton[primary="true"] {
-    background-color: #1d4ed8;
-    color: #ffffff;
-    border-color: #1d4ed8;
-    padding: 6px 14px;
-}
-QPushButton[primary="true"]:hover {
-    background-color: #1e40af;
-}
-QPushButton[accent="true"] {
-    background-color: #047857;
-    color: #ffffff;
-    border-color: #047857;
-}
-QPushButton[accent="true"]:hover {
-    background-color: #036749;
-}
-QPushButton[outline="true"] {
-    background-color: transparent;
-    border-color: #0f172a;
-    color: #0f172a;
-}
-QPushButton[outline="true"]:hover {
-    background-color: #e2e8f0;
-}
-QPushButton[link="true"] {
-    background-color: transparent;
-    border: none;
-    color: #0a58ca;
-    font-size: 14px;
-    font-weight: 600;
-    padding: 0;
-}
-QPushButton[link="true"]:hover {
-    text-decoration: underline;
-}
-QComboBox {
-    background-color: #ffffff;
-    border: 1px solid #94a3b8;
-    border-radius: 5px;
-    padding: 5px 26px 5px 10px;
-    color: #0f172a;
-    font-size: 13px;
-}
-QComboBox::drop-down {
-    border: none;
-    width: 20px;
-}
-QComboBox QAbstractItemView {
-    background-color: #ffffff;
-    color: #0f172a;
-    selection-background-color: #e0f2fe;
-    selection-color: #0c4a6e;
-    border: 1px solid #cbd5f5;
-    font-size: 13px;
-}
-QListWidget#trialLog {
-    background-color: #ffffff;
-    border: 1px solid #d1d5db;
-    border-radius: 8px;
-    padding: 8px;
-    color: #111827;
-}
-QListWidget#trialLog::item {
-    padding: 6px 8px;
-}
-QListWidget#trialLog::item:alternate {
-    background-color: #f3f4f6;
-}
-QListWidget#trialLog::item:selected {
-    background-color: #dbeafe;
-    color: #1e3a8a;
-}
-QScrollBar:vertical, QScrollBar:horizontal {
-    background: transparent;
-    width: 10px;
-    margin: 4px;
-}
-QScrollBar::handle {
-    background: #cbd5f5;
-    border-radius: 5px;
-}
-QScrollBar::handle:hover {
-    background: #94a3b8;
-}
-QScrollBar::add-line, QScrollBar::sub-line {
-    width: 0px;
-    height: 0px;
-}
-QTabWidget#interactionTabs::pane {
-    border: none;
-}
-QTabWidget#interactionTabs > QTabBar {
-    alignment: center;
-}
-QTabBar::tab {
-    background: transparent;
-    border: none;
-    color: #4b5563;
-    padding: 8px 16px;
-    margin: 0 6px;
-    font-weight: 500;
-}
-QTabBar::tab:selected {
-    color: #1d4ed8;
-    border-bottom: 2px solid #1d4ed8;
-}
-QTabBar::tab:hover:!selected {
-    color: #111827;
-}
-    )");
-    setStyleSheet(style);
+    setStyleSheet(Theme::current().styleSheet);
 }
 
 QMessageBox::StandardButton PitchTraining::showMessage(QMessageBox::Icon icon,
@@ -680,40 +476,37 @@ void PitchTraining::refreshProfileControls()
     if (!m_profileCombo) {
         return;
     }
-    const auto profiles = m_profileManager.profiles();
     QSignalBlocker blocker(m_profileCombo);
-    m_profileCombo->clear();
-    int activeIndex = -1;
-    for (const auto &profile : profiles) {
-        m_profileCombo->addItem(profile.name, profile.id);
-        if (profile.id == m_profileManager.activeProfileId()) {
-            activeIndex = m_profileCombo->count() - 1;
-        }
-    }
-    if (activeIndex >= 0) {
-        m_profileCombo->setCurrentIndex(activeIndex);
+    m_profileModel->sync();
+    m_profileSearchModel->sync();
+    const int activeRow = m_profileModel->rowForId(m_profileManager.activeProfileId());
+    if (activeRow >= 0) {
+        m_profileCombo->setCurrentIndex(activeRow);
     }
     if (m_deleteProfileButton) {
-        m_deleteProfileButton->setEnabled(profiles.size() > 1);
+        m_deleteProfileButton->setEnabled(m_profileManager.profileCount() > 1);
     }
 }
 
 void PitchTraining::applyActiveProfile()
 {
-    m_state.setProfileDirectory(m_profileManager.activeProfileDirectory());
-    m_state.load();
+    if (m_session.batteryActive()) {
+        finishTestBattery(true);
+    }
+    m_session.open(m_profileManager.activeProfileDirectory());
+    m_journalWarned = false;
     if (m_responseTimer) {
         m_responseTimer->stop();
     }
-    if (m_responseProgressTimer) {
-        m_responseProgressTimer->stop();
+    if (m_autoAdvanceButton) {
+        const QSignalBlocker blocker(m_autoAdvanceButton);
+        m_autoAdvanceButton->setChecked(m_session.protocol().interTrial().autoAdvance);
+    }
+    if (m_responseProgress) {
+        m_responseProgress->stop();
     }
     m_tonePlayer.stop();
     resetLevelState();
-    m_levelActive = false;
-    m_waitingForShepard = false;
-    m_specialContext = SpecialContext{};
-    m_mode = SessionMode::Idle;
     if (m_startTrialButton) {
         m_startTrialButton->setEnabled(false);
     }
@@ -732,8 +525,26 @@ void PitchTraining::applyActiveProfile()
     setResponseEnabled(false, false);
     refreshStateLabels();
     updateLevelDescription();
-    rebuildResponseButtons();
+    updateResponsePad();
     refreshStartLevelButton();
+    if (m_session.isReadOnly()) {
+        updateFeedback(tr("This profile is open in another window. Progress is shown read-only."), false);
+    } else if (m_session.protocolUnavailable()) {
+        updateFeedback(tr("This profile's training protocol file is missing. Restore it to continue training."), false);
+    } else if (m_session.journalFailing()) {
+        m_journalWarned = true;
+        updateFeedback(tr("The trial record of this profile cannot be written, so answers will not be kept."), false);
+    }
+}
+
+void PitchTraining::warnIfJournalFailing()
+{
+    if (m_journalWarned || !m_session.journalFailing()) {
+        return;
+    }
+    m_journalWarned = true;
+    showMessage(QMessageBox::Warning, tr("Trial record"),
+                tr("Some answers could not be saved to the trial record. Check that the disk has free space, then reopen the profile."));
 }
 
 bool PitchTraining::switchProfile(const QString &profileId)
@@ -751,56 +562,59 @@ bool PitchTraining::switchProfile(const QString &profileId)
 
 void PitchTraining::resetTrialLog()
 {
-    m_trialLogHasEntries = false;
-    if (!m_trialLogList) {
-        return;
+    if (m_trialLogModel) {
+        m_trialLogModel->reset();
     }
-    m_trialLogList->clear();
-    auto *placeholder = new QListWidgetItem(tr("No trials yet. Press \"Hear next tone\" to begin."));
-    placeholder->setFlags(Qt::NoItemFlags);
-    placeholder->setForeground(QColor(QStringLiteral("#94a3b8")));
-    m_trialLogList->addItem(placeholder);
 }
 
-void PitchTraining::appendTrialLogEntry(int trialNumber, const QString &description, bool positive)
+TrialLogRecord PitchTraining::trialLogRecordFor(const TrialData &trial, int trialNumber) const
 {
-    if (!m_trialLogList) {
-        return;
+    const auto &order = TrainingSpec::chromaticOrder();
+    TrialLogRecord logRecord;
+    logRecord.trialNumber = static_cast<quint16>(trialNumber);
+    logRecord.presented = static_cast<qint8>(order.indexOf(trial.presentedPitch));
+    if (trial.response == QStringLiteral("OUT")) {
+        logRecord.response = TrialLogRecord::kOtherResponse;
+    } else if (!trial.response.isEmpty()) {
+        logRecord.response = static_cast<qint8>(order.indexOf(trial.response));
+    }
+    if (trial.correct) {
+        logRecord.flags |= TrialLogRecord::Correct;
+    }
+    if (trial.timedOut) {
+        logRecord.flags |= TrialLogRecord::TimedOut;
+    }
+    if (trial.outOfBounds) {
+        logRecord.flags |= TrialLogRecord::OutOfBounds;
     }
-    if (!m_trialLogHasEntries) {
-        m_trialLogList->clear();
-        m_trialLogHasEntries = true;
+    if (m_session.specialActive()) {
+        logRecord.flags |= TrialLogRecord::Special;
     }
-    auto *item = new QListWidgetItem(tr("Trial %1: %2").arg(trialNumber).arg(description));
-    item->setForeground(QColor(positive ? QStringLiteral("#1b5e20") : QStringLiteral("#b71c1c")));
-    m_trialLogList->addItem(item);
-    m_trialLogList->scrollToBottom();
+    return logRecord;
 }
 
-void PitchTraining::clearActiveResponses()
+void PitchTraining::appendTrialLogEntry(const TrialLogRecord &record)
 {
-    if (!m_responseButtons) {
+    if (!m_trialLogModel) {
         return;
     }
-    const bool wasExclusive = m_responseButtons->exclusive();
-    if (wasExclusive) {
-        m_responseButtons->setExclusive(false);
-    }
-    const auto buttons = m_responseButtons->buttons();
-    for (auto *button : buttons) {
-        if (button) {
-            button->setChecked(false);
-        }
+    m_trialLogModel->append(record);
+    if (m_trialLogList) {
+        m_trialLogList->scrollToBottom();
     }
-    if (wasExclusive) {
-        m_responseButtons->setExclusive(true);
+}
+
+void PitchTraining::clearActiveResponses()
+{
+    if (m_responsePad) {
+        m_responsePad->clearSelection();
     }
 }
 
 void PitchTraining::setResponseEnabled(bool levelEnabled, bool specialEnabled)
 {
-    if (m_responseContainer) {
-        m_responseContainer->setEnabled(levelEnabled);
+    if (m_responsePad) {
+        m_responsePad->setEnabled(levelEnabled);
     }
     if (m_specialContainer) {
         m_specialContainer->setEnabled(specialEnabled);
@@ -820,38 +634,11 @@ void PitchTraining::refreshStartLevelButton()
     if (!m_startLevelButton) {
         return;
     }
-    const bool canStart = m_sessionActive && !m_levelActive && !m_specialContext.active && !m_waitingForShepard;
+    const bool canStart = m_sessionActive && !m_session.isRunning() && !m_waitingForShepard
+                          && !m_session.isReadOnly() && !m_session.protocolUnavailable();
     m_startLevelButton->setEnabled(canStart);
 }
 
-void PitchTraining::updateResponseTimeBar()
-{
-    if (!m_responseProgress) {
-        return;
-    }
-    if (m_currentResponseWindowMs <= 0 || !(m_levelActive || m_specialContext.active)) {
-        if (m_responseProgressTimer) {
-            m_responseProgressTimer->stop();
-        }
-        m_responseProgress->setMaximum(100);
-        m_responseProgress->setValue(0);
-        m_responseProgress->setFormat(tr("Time left"));
-        return;
-    }
-    const int elapsed = m_trialTimer.isValid() ? m_trialTimer.elapsed() : 0;
-    const int remaining = qMax(0, m_currentResponseWindowMs - elapsed);
-    m_responseProgress->setMaximum(m_currentResponseWindowMs);
-    m_responseProgress->setValue(remaining);
-    m_responseProgress->setFormat(tr("Time left: %1 s").arg(remaining / 1000.0, 0, 'f', 1));
-    if (remaining <= 0) {
-        if (m_responseProgressTimer) {
-            m_responseProgressTimer->stop();
-        }
-    } else {
-        // keep bar visible; values already updated
-    }
-}
-
 QString PitchTraining::pitchFromKeyEvent(QKeyEvent *event, bool &isOther) const
 {
     isOther = false;
@@ -896,42 +683,28 @@ QString PitchTraining::pitchFromKeyEvent(QKeyEvent *event, bool &isOther) const
 
 bool PitchTraining::handleLevelKeyResponse(const QString &pitch, bool isOther)
 {
-    if (!m_levelActive || !m_responseButtons) {
+    if ((!m_session.levelActive() && !m_session.batteryActive()) || !m_responsePad) {
         return false;
     }
-    if (!isOther && pitch.isEmpty()) {
-        return false;
+    if (isOther) {
+        return m_responsePad->trigger(ResponsePad::kOtherIndex);
     }
-    for (auto *button : m_responseButtons->buttons()) {
-        if (!button) {
-            continue;
-        }
-        const bool isOutButton = button->property("outOfBound").toBool();
-        if (isOther && isOutButton) {
-            button->click();
-            return true;
-        }
-        if (!isOther && !pitch.isEmpty()) {
-            const QString buttonPitch = button->property("pitch").toString();
-            if (!buttonPitch.isEmpty() && buttonPitch.compare(pitch, Qt::CaseInsensitive) == 0) {
-                button->click();
-                return true;
-            }
-        }
+    if (pitch.isEmpty()) {
+        return false;
     }
-    return false;
+    return m_responsePad->trigger(TrainingSpec::chromaticOrder().indexOf(pitch.toUpper()));
 }
 
 bool PitchTraining::handleSpecialKeyResponse(const QString &pitch, bool isOther)
 {
-    if (!m_specialContext.active) {
+    if (!m_session.specialActive()) {
         return false;
     }
     if (isOther) {
         handleSpecialResponse(false);
         return true;
     }
-    if (!pitch.isEmpty() && pitch.compare(m_specialContext.targetPitch, Qt::CaseInsensitive) == 0) {
+    if (!pitch.isEmpty() && pitch.compare(m_session.special().targetPitch, Qt::CaseInsensitive) == 0) {
         handleSpecialResponse(true);
         return true;
     }
@@ -949,6 +722,21 @@ bool PitchTraining::handleShortcutKey(QKeyEvent *event)
     }
 
     const int key = event->key();
+    if (key == Qt::Key_Escape && m_session.batteryActive()) {
+        event->accept();
+        if (showMessage(QMessageBox::Question, tr("Stop the test"),
+                        tr("Stop the test now? The answers so far are kept, marked as an unfinished test."),
+                        QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes
+            && m_session.batteryActive()) {
+            finishTestBattery(true);
+        }
+        return true;
+    }
+    if (m_interTrialTimer && m_interTrialTimer->isActive()) {
+        pauseAutoAdvance();
+        event->accept();
+        return true;
+    }
     if (key == Qt::Key_1) {
         if (m_startTrialButton && m_startTrialButton->isEnabled()) {
             handleStartTrial();
@@ -957,8 +745,9 @@ bool PitchTraining::handleShortcutKey(QKeyEvent *event)
         return true;
     }
 
-    const bool canRespond = (m_levelActive && m_responseContainer && m_responseContainer->isEnabled()) ||
-                            (m_specialContext.active && m_specialContainer && m_specialContainer->isEnabled());
+    const bool padActive = m_session.levelActive() || m_session.batteryActive();
+    const bool canRespond = (padActive && m_responsePad && m_responsePad->isEnabled()) ||
+                            (m_session.specialActive() && m_specialContainer && m_specialContainer->isEnabled());
     const auto consumesShortcut = [](int k) {
         switch (k) {
         case Qt::Key_Space:
@@ -999,9 +788,9 @@ bool PitchTraining::handleShortcutKey(QKeyEvent *event)
     }
 
     bool handled = false;
-    if (m_mode == SessionMode::Level && m_levelActive && m_responseContainer && m_responseContainer->isEnabled()) {
+    if (padActive && m_responsePad && m_responsePad->isEnabled()) {
         handled = handleLevelKeyResponse(pitch, isOther);
-    } else if (m_mode == SessionMode::SpecialExercise && m_specialContext.active && m_specialContainer && m_specialContainer->isEnabled()) {
+    } else if (m_session.specialActive() && m_specialContainer && m_specialContainer->isEnabled()) {
         handled = handleSpecialKeyResponse(pitch, isOther);
     }
 
@@ -1021,7 +810,13 @@ void PitchTraining::keyPressEvent(QKeyEvent *event)
 
 bool PitchTraining::eventFilter(QObject *watched, QEvent *event)
 {
-    if (event && event->type() == QEvent::KeyPress) {
+    // pick up profiles another instance added or removed meanwhile
+    if (event && event->type() == QEvent::ApplicationStateChange
+        && QApplication::applicationState() == Qt::ApplicationActive && m_profileManager.refresh()) {
+        refreshProfileControls();
+    }
+    // typing into the profile search must not trigger responses
+    if (event && event->type() == QEvent::KeyPress && !qobject_cast<QLineEdit *>(QApplication::focusWidget())) {
         auto *keyEvent = static_cast<QKeyEvent *>(event);
         if (handleShortcutKey(keyEvent)) {
             return true;
@@ -1032,12 +827,14 @@ bool PitchTraining::eventFilter(QObject *watched, QEvent *event)
 
 void PitchTraining::refreshStateLabels()
 {
-    m_tokensLabel->setText(QString::number(m_state.tokens()));
-    m_streakLabel->setText(tr("%1 day(s)").arg(m_state.streakCount()));
-    m_hoursLabel->setText(tr("%1 h").arg(QString::number(m_state.countedTrainingHours(), 'f', 2)));
+    m_tokensLabel->setText(QString::number(m_session.state().tokens()));
+    m_streakLabel->setText(tr("%1 day(s)").arg(m_session.state().streakCount()));
+    m_hoursLabel->setText(tr("%1 h").arg(QString::number(m_session.state().countedTrainingHours(), 'f', 2)));
     if (m_sessionActive) {
         const int secs = static_cast<int>(m_sessionTimer.elapsed() / 1000);
-        m_sessionLabel->setText(tr("%1 min active").arg(secs / 60));
+        m_sessionLabel->setText(tr("%1 min active • %2 trials/min")
+                                    .arg(secs / 60)
+                                    .arg(m_session.trialsPerMinute(), 0, 'f', 1));
     } else {
         m_sessionLabel->setText(tr("Idle"));
     }
@@ -1045,10 +842,11 @@ void PitchTraining::refreshStateLabels()
 
 void PitchTraining::updateLevelDescription()
 {
-    const auto spec = TrainingSpec::specForIndex(m_state.currentLevelIndex());
+    const auto &protocol = m_session.protocol();
+    const auto spec = protocol.spec(m_session.state().currentLevelIndex());
     m_levelLabel->setText(tr("Level %1 of %2 • Stage %3")
                               .arg(spec.globalIndex + 1)
-                              .arg(TrainingSpec::totalLevelCount())
+                              .arg(protocol.levelCount())
                               .arg(spec.stageIndex));
     m_requirementLabel->setText(tr("Accuracy ≥ %1% • Response window %2 ms • Tokens %3 • Feedback %4")
                                     .arg(static_cast<int>(spec.passAccuracy * 100))
@@ -1057,62 +855,19 @@ void PitchTraining::updateLevelDescription()
                                     .arg(spec.feedback ? tr("on") : tr("off")));
 }
 
-void PitchTraining::rebuildResponseButtons()
+void PitchTraining::updateResponsePad()
 {
-    if (!m_responseContainer->layout()) {
-        m_responseContainer->setLayout(new QGridLayout());
-    }
-    auto *grid = qobject_cast<QGridLayout *>(m_responseContainer->layout());
-    grid->setContentsMargins(8, 8, 8, 8);
-    grid->setHorizontalSpacing(8);
-    grid->setVerticalSpacing(8);
-    while (auto *item = grid->takeAt(0)) {
-        if (auto *widget = item->widget()) {
-            m_responseButtons->removeButton(qobject_cast<QAbstractButton *>(widget));
-            widget->deleteLater();
-        }
-        delete item;
-    }
-    const auto pitches = TrainingSpec::stagePitchSet(TrainingSpec::specForIndex(m_state.currentLevelIndex()).stageIndex);
-    const int columns = 4;
-    grid->setColumnStretch(0, 1);
-    grid->setColumnStretch(1, 1);
-    grid->setColumnStretch(2, 1);
-    grid->setColumnStretch(3, 1);
-    int row = 0;
-    int column = 0;
-    int id = 0;
-    for (const auto &pitch : pitches) {
-        auto *btn = new QPushButton(pitch, m_responseContainer);
-        btn->setProperty("pitch", pitch);
-        btn->setCheckable(true);
-        btn->setFocusPolicy(Qt::NoFocus);
-        btn->setProperty("noteButton", true);
-        btn->setMinimumHeight(30);
-        grid->addWidget(btn, row, column);
-        m_responseButtons->addButton(btn, id++);
-        if (++column >= columns) {
-            column = 0;
-            ++row;
-        }
-    }
-    if (column != 0) {
-        ++row;
-        column = 0;
+    if (!m_responsePad) {
+        return;
     }
-    auto *oob = new QPushButton(tr("Other"), m_responseContainer);
-    oob->setProperty("outOfBound", true);
-    oob->setCheckable(true);
-    oob->setFocusPolicy(Qt::NoFocus);
-    oob->setProperty("noteButton", true);
-    oob->setMinimumHeight(30);
-    grid->addWidget(oob, row, 0, 1, columns);
-    m_responseButtons->addButton(oob, id);
+    const auto &protocol = m_session.protocol();
+    const int stage = protocol.spec(m_session.state().currentLevelIndex()).stageIndex;
+    m_responsePad->setActiveMask(static_cast<quint16>(protocol.stagePitchMask(stage) | (1u << ResponsePad::kOtherIndex)));
 }
 
 void PitchTraining::handleStartLevel()
 {
-    if (m_levelActive || m_specialContext.active) {
+    if (m_session.isRunning()) {
         return;
     }
 
@@ -1125,84 +880,86 @@ void PitchTraining::handleStartLevel()
         return;
     }
 
-    if (shouldRunSpecialExercise()) {
+    switch (m_session.startLevel()) {
+    case TrainingSession::StartResult::Busy:
+        return;
+    case TrainingSession::StartResult::FinalCooldown:
+        updateFeedback(tr("Wait at least %1 h after the final level's clears before the last attempt.")
+                           .arg(m_session.protocol().finalLevel().cooldownSecs / 3600.0), false);
+        return;
+    case TrainingSession::StartResult::ReadOnly:
+        updateFeedback(tr("This profile is open in another window, so it can only be viewed here."), false);
+        return;
+    case TrainingSession::StartResult::ProtocolUnavailable:
+        updateFeedback(tr("This profile's training protocol file is missing. Restore it to continue training."), false);
+        return;
+    case TrainingSession::StartResult::SpecialExercise:
         startSpecialExercise();
         return;
+    case TrainingSession::StartResult::Started:
+        startLevelInternal(false);
+        return;
+    case TrainingSession::StartResult::Resumed:
+        startLevelInternal(true);
+        return;
     }
-
-    const auto spec = TrainingSpec::specForIndex(m_state.currentLevelIndex());
-    if (spec.globalIndex == TrainingSpec::totalLevelCount() - 1 &&
-        m_state.finalLevelConsecutivePasses() >= 3 &&
-        !m_state.trainingCompleted()) {
-        const auto last = m_state.finalLevelCooldownStart();
-        const auto now = QDateTime::currentDateTimeUtc();
-        if (!last.isValid() || last.secsTo(now) < 12 * 3600) {
-            updateFeedback(tr("Wait at least 12 h after the third clear before the final attempt."), false);
-            return;
-        }
-    }
-
-    startLevelInternal();
 }
 
-void PitchTraining::startLevelInternal()
+void PitchTraining::startLevelInternal(bool resumed)
 {
-    m_currentSpec = TrainingSpec::specForIndex(m_state.currentLevelIndex());
-    m_trainingPitches = TrainingSpec::stagePitchSet(m_currentSpec.stageIndex);
-    m_outOfBoundsPitches = TrainingSpec::outOfBoundsForStage(m_currentSpec.stageIndex);
-    rebuildResponseButtons();
+    updateResponsePad();
     resetLevelState();
     setResponseEnabled(false, false);
-    m_mode = SessionMode::Level;
-    m_levelActive = true;
-    m_requiredTrials = m_currentSpec.trialCount;
-    m_trialProgress->setRange(0, m_requiredTrials);
+    m_trialProgress->setRange(0, m_session.blockLength());
     m_trialProgress->setValue(0);
     m_statusLabel->setText(tr("Level in progress. Press \"Hear next tone\" to hear a tone."));
-    m_startTrialButton->setEnabled(true);
     m_sampleButton->setEnabled(true);
-    m_doubleButton->setEnabled(m_currentSpec.tokensAllowed);
+    m_doubleButton->setEnabled(m_session.currentSpec().tokensAllowed);
+    if (resumed) {
+        showResumedLevel();
+    }
     scheduleShepardIfNeeded();
+    if (!m_waitingForShepard) {
+        awaitNextTrial();
+    }
     updateLevelDescription();
     refreshStartLevelButton();
 }
 
+void PitchTraining::showResumedLevel()
+{
+    const auto &trials = m_session.blockTrials();
+    for (int i = 0; i < trials.size(); ++i) {
+        appendTrialLogEntry(trialLogRecordFor(trials.at(i), i + 1));
+    }
+    updateProgress();
+    m_statusLabel->setText(tr("Resumed the interrupted level: %1 of %2 trials restored.")
+                               .arg(m_session.trialsCompleted())
+                               .arg(m_session.blockLength()));
+}
+
 void PitchTraining::resetLevelState()
 {
-    m_trialLog.clear();
-    m_trialsCompleted = 0;
-    m_correctTrials = 0;
-    m_effectiveBonus = 0.0;
-    m_doubleArmed = false;
-    m_randomDouble = false;
+    if (m_interTrialTimer) {
+        m_interTrialTimer->stop();
+    }
+    m_trialQueued = false;
+    m_autoPaused = false;
     m_waitingForShepard = false;
     m_samplesQueued = false;
     m_sampleQueue.clear();
-    m_currentTrial = TrialData{};
     if (m_feedbackLabel) {
         m_feedbackLabel->clear();
     }
-    m_currentResponseWindowMs = 0;
-    if (m_responseProgressTimer) {
-        m_responseProgressTimer->stop();
-    }
     if (m_responseProgress) {
-        m_responseProgress->setMaximum(100);
-        m_responseProgress->setValue(0);
-        m_responseProgress->setFormat(tr("Time left"));
+        m_responseProgress->stop();
     }
     resetTrialLog();
 }
 
-bool PitchTraining::shouldRunSpecialExercise() const
-{
-    const auto spec = TrainingSpec::specForIndex(m_state.currentLevelIndex());
-    return m_state.levelsSinceSpecial() >= 15 && spec.stageIndex >= 5;
-}
-
 void PitchTraining::scheduleShepardIfNeeded()
 {
-    const bool shouldPlayShepard = (m_mode == SessionMode::Level && !m_currentSpec.feedback);
+    const bool shouldPlayShepard = (m_session.levelActive() && !m_session.currentSpec().feedback);
     if (shouldPlayShepard) {
         playShepardTone();
     }
@@ -1222,412 +979,241 @@ void PitchTraining::playShepardTone()
 
 void PitchTraining::handleStartTrial()
 {
-    if (!(m_levelActive || m_specialContext.active) || m_waitingForShepard) {
+    if (!m_session.isRunning() || m_waitingForShepard) {
         return;
     }
+    // pressing on resumes a paused auto-advance
+    m_autoPaused = false;
     prepareNextTrial();
 }
 
 void PitchTraining::prepareNextTrial()
 {
+    m_interTrialTimer->stop();
+    queueNextTrial();
+    presentQueuedTrial();
+}
+
+void PitchTraining::queueNextTrial()
+{
+    if (m_trialQueued) {
+        return;
+    }
+    const TrialData &trial = m_session.nextTrial();
+    m_tonePlayer.prepareSample(m_toneLibrary.toneFor(trial.presentedPitch, trial.octave));
+    m_trialQueued = true;
+}
+
+void PitchTraining::awaitNextTrial()
+{
+    if (!m_autoAdvanceButton || !m_autoAdvanceButton->isChecked() || m_autoPaused) {
+        m_startTrialButton->setEnabled(true);
+        return;
+    }
+    m_startTrialButton->setEnabled(false);
+    queueNextTrial();
+    m_interTrialTimer->start(m_session.nextInterTrialMs());
+}
+
+void PitchTraining::pauseAutoAdvance()
+{
+    if (!m_interTrialTimer->isActive()) {
+        return;
+    }
+    m_interTrialTimer->stop();
+    m_autoPaused = true;
+    m_startTrialButton->setEnabled(true);
+    m_statusLabel->setText(tr("Paused. Press 1 or \"Hear next tone\" to continue."));
+}
+
+void PitchTraining::presentQueuedTrial()
+{
+    if (!m_trialQueued || !m_session.isRunning()) {
+        return;
+    }
+    m_trialQueued = false;
     if (m_startTrialButton) {
         m_startTrialButton->setEnabled(false);
     }
     setResponseEnabled(false, false);
     m_playbackContext = PlaybackContext::Trial;
-    m_currentTrial = TrialData{};
-
-    if (m_mode == SessionMode::SpecialExercise) {
-        const bool playTarget = QRandomGenerator::global()->bounded(2) == 0;
-        if (playTarget || m_outOfBoundsPitches.isEmpty()) {
-            m_currentTrial.presentedPitch = m_specialContext.targetPitch;
-            m_currentTrial.outOfBounds = false;
-        } else {
-            const auto fallback = m_outOfBoundsPitches.at(QRandomGenerator::global()->bounded(m_outOfBoundsPitches.size()));
-            m_currentTrial.presentedPitch = fallback;
-            m_currentTrial.outOfBounds = true;
-        }
-    } else {
-        QVector<QString> pool = m_trainingPitches;
-        for (const auto &name : m_outOfBoundsPitches) {
-            if (!pool.contains(name)) {
-                pool.append(name);
-            }
-        }
-        const int index = QRandomGenerator::global()->bounded(pool.size());
-        m_currentTrial.presentedPitch = pool.at(index);
-        m_currentTrial.outOfBounds = m_outOfBoundsPitches.contains(m_currentTrial.presentedPitch);
-        m_randomDouble = m_currentSpec.tokensAllowed && QRandomGenerator::global()->bounded(80) == 0;
-        if (m_randomDouble) {
-            updateFeedback(tr("Lucky double bonus ready!"), true);
-        }
+    if (m_session.luckyDoubleReady()) {
+        updateFeedback(tr("Lucky double bonus ready!"), true);
     }
 
-    const auto octaves = m_toneLibrary.supportedOctaves();
-    if (!octaves.isEmpty()) {
-        const int octaveIndex = QRandomGenerator::global()->bounded(octaves.size());
-        m_currentTrial.octave = octaves.at(octaveIndex);
-    }
-    m_tonePlayer.playSample(m_toneLibrary.toneFor(m_currentTrial.presentedPitch, m_currentTrial.octave));
+    m_tonePlayer.playPrepared();
     m_trialTimer.restart();
-    const int window = m_currentSpec.responseWindowMs;
+    const int window = m_session.currentSpec().responseWindowMs;
     m_responseTimer->start(window);
-    m_currentResponseWindowMs = window;
     if (m_responseProgress) {
-        m_responseProgress->setMaximum(window);
-        m_responseProgress->setValue(window);
-        m_responseProgress->setFormat(tr("Time left: %1 s").arg(window / 1000.0, 0, 'f', 1));
-        // already visible
-    }
-    if (m_responseProgressTimer) {
-        m_responseProgressTimer->start();
+        m_responseProgress->start(window);
     }
-    updateResponseTimeBar();
     m_statusLabel->setText(tr("Tone presented. Identify it."));
-    m_responseContainer->setVisible(m_mode == SessionMode::Level);
-    m_specialContainer->setVisible(m_mode == SessionMode::SpecialExercise);
-    if (m_mode == SessionMode::SpecialExercise) {
-        setResponseEnabled(false, true);
-    } else {
-        setResponseEnabled(true, false);
-    }
+    const bool special = m_session.specialActive();
+    m_responsePad->setVisible(!special);
+    m_specialContainer->setVisible(special);
+    setResponseEnabled(!special, special);
 }
 
-void PitchTraining::handleResponse(int buttonId)
+void PitchTraining::handleResponse(int pitchIndex)
 {
-    if (!m_levelActive || m_mode != SessionMode::Level) {
+    const auto &order = TrainingSpec::chromaticOrder();
+    if (m_session.batteryActive()) {
+        if (pitchIndex >= 0 && pitchIndex < order.size()) {
+            handleBatteryResponse(order.at(pitchIndex));
+        }
         return;
     }
-    auto *button = m_responseButtons->button(buttonId);
-    if (!button) {
+    if (!m_session.levelActive()) {
         return;
     }
-    const bool isOut = button->property("outOfBound").toBool();
-    const QString pitch = button->property("pitch").toString();
-    m_currentTrial.response = isOut ? QStringLiteral("OUT") : pitch;
-    finishCurrentTrial();
+    if (pitchIndex == ResponsePad::kOtherIndex) {
+        finishCurrentTrial(QStringLiteral("OUT"));
+    } else if (pitchIndex >= 0 && pitchIndex < order.size()) {
+        finishCurrentTrial(order.at(pitchIndex));
+    }
 }
 
 void PitchTraining::handleSpecialResponse(bool isTarget)
 {
-    if (!m_specialContext.active) {
+    if (!m_session.specialActive()) {
         return;
     }
-    m_currentTrial.response = isTarget ? m_specialContext.targetPitch : QStringLiteral("OUT");
-    finishCurrentTrial();
+    finishCurrentTrial(isTarget ? m_session.special().targetPitch : QStringLiteral("OUT"));
 }
 
 void PitchTraining::handleResponseTimeout()
 {
-    finishCurrentTrial(true);
+    finishCurrentTrial(QString(), true);
 }
 
-void PitchTraining::finishCurrentTrial(bool timedOut)
+void PitchTraining::finishCurrentTrial(const QString &response, bool timedOut)
 {
-    if (!(m_levelActive || m_specialContext.active)) {
+    if (!m_session.isRunning()) {
         return;
     }
     m_responseTimer->stop();
-    m_currentTrial.timedOut = timedOut;
-    m_currentTrial.responseTimeMs = m_trialTimer.isValid() ? static_cast<int>(m_trialTimer.elapsed()) : 0;
-    const int trialNumber = m_trialsCompleted + 1;
-
-    bool correct = false;
-    if (!timedOut) {
-        if (m_mode == SessionMode::SpecialExercise) {
-            const bool targetTone = !m_currentTrial.outOfBounds;
-            const bool answeredTarget = (m_currentTrial.response == m_specialContext.targetPitch);
-            correct = (targetTone && answeredTarget) || (!targetTone && m_currentTrial.response == QStringLiteral("OUT"));
-        } else {
-            if (m_currentTrial.outOfBounds) {
-                correct = m_currentTrial.response == QStringLiteral("OUT");
-            } else {
-                correct = m_currentTrial.response == m_currentTrial.presentedPitch;
-                if (!correct) {
-                    const auto &order = TrainingSpec::chromaticOrder();
-                    const int played = order.indexOf(m_currentTrial.presentedPitch);
-                    const int answered = order.indexOf(m_currentTrial.response);
-                    if (played >= 0 && answered >= 0 && std::abs(played - answered) == 1) {
-                        m_currentTrial.semitoneError = true;
-                    }
-                }
-            }
-        }
-    }
-
-    m_currentTrial.correct = correct;
-    if (correct && m_mode != SessionMode::SpecialExercise) {
-        ++m_correctTrials;
-    }
+    const int responseTimeMs = m_trialTimer.isValid() ? static_cast<int>(m_trialTimer.elapsed()) : 0;
+    const TrialData trial = m_session.finishTrial(response, responseTimeMs, timedOut);
 
-    if (correct) {
-        bool appliedBonus = false;
-        if (m_doubleArmed) {
-            m_effectiveBonus += 1.0;
-            appliedBonus = true;
-            m_currentTrial.usedDouble = true;
-            m_doubleArmed = false;
-        }
-        if (m_randomDouble && m_currentSpec.tokensAllowed && !appliedBonus) {
-            m_effectiveBonus += 1.0;
-            appliedBonus = true;
-            m_currentTrial.luckyDouble = true;
-        }
-    } else {
-        m_doubleArmed = false;
-    }
-    m_randomDouble = false;
-
-    if (!correct && timedOut) {
+    if (!trial.correct && timedOut) {
         updateFeedback(tr("Time up!"), false);
-    } else if (!correct) {
+    } else if (!trial.correct) {
         updateFeedback(tr("Incorrect."), false);
     } else {
         updateFeedback(tr("Correct"), true);
     }
-    for (auto *button : m_responseButtons->buttons()) {
-        if (button) {
-            button->setChecked(false);
-        }
-    }
-    m_currentResponseWindowMs = 0;
-    if (m_responseProgressTimer) {
-        m_responseProgressTimer->stop();
-    }
     if (m_responseProgress) {
-        m_responseProgress->setMaximum(100);
-        m_responseProgress->setValue(0);
-        m_responseProgress->setFormat(tr("Time left"));
+        m_responseProgress->stop();
     }
     setResponseEnabled(false, false);
 
-    const QString actualDisplay = m_currentTrial.outOfBounds ? tr("other") : m_currentTrial.presentedPitch;
-    const QString responseDisplay = m_currentTrial.response.isEmpty()
-                                       ? tr("none")
-                                       : (m_currentTrial.response == QStringLiteral("OUT") ? tr("other") : m_currentTrial.response);
-    QString logText;
-    bool positiveLog = correct && !timedOut;
-    if (timedOut) {
-        logText = tr("Time expired (target %1)").arg(actualDisplay);
-        positiveLog = false;
-    } else if (correct) {
-        logText = tr("Correct (%1)").arg(actualDisplay);
-    } else {
-        logText = tr("Incorrect (target %1, answered %2)").arg(actualDisplay, responseDisplay);
-    }
-    if (m_mode == SessionMode::SpecialExercise) {
-        logText = tr("[Special] %1").arg(logText);
-    }
-    appendTrialLogEntry(trialNumber, logText, positiveLog);
-
-    m_trialLog.append(m_currentTrial);
-    ++m_trialsCompleted;
+    appendTrialLogEntry(trialLogRecordFor(trial, m_session.trialsCompleted()));
     updateProgress();
 
-    const int needed = (m_mode == SessionMode::SpecialExercise) ? m_specialContext.totalTrials : m_requiredTrials;
-    if (m_trialsCompleted >= needed) {
-        if (m_mode == SessionMode::SpecialExercise) {
+    if (m_session.blockComplete()) {
+        if (m_session.specialActive()) {
             resolveSpecialExercise();
         } else {
             resolveLevelCompletion();
         }
     } else {
-        m_startTrialButton->setEnabled(true);
+        awaitNextTrial();
     }
 }
 
 void PitchTraining::updateProgress()
 {
-    const int maximum = (m_mode == SessionMode::SpecialExercise) ? m_specialContext.totalTrials : m_requiredTrials;
-    m_trialProgress->setMaximum(maximum);
-    m_trialProgress->setValue(m_trialsCompleted);
+    m_trialProgress->setMaximum(m_session.blockLength());
+    m_trialProgress->setValue(m_session.trialsCompleted());
 }
 
 void PitchTraining::resolveLevelCompletion()
 {
-    const double actualAccuracy = m_requiredTrials == 0 ? 0.0 : static_cast<double>(m_correctTrials) / m_requiredTrials;
-    const double effectiveAccuracy = m_requiredTrials == 0 ? 0.0 : qMin(1.0, (m_correctTrials + m_effectiveBonus) / m_requiredTrials);
-    const bool passed = effectiveAccuracy >= m_currentSpec.passAccuracy;
-
-    if (passed) {
-        updateFeedback(tr("Level passed at %1% accuracy.").arg(static_cast<int>(effectiveAccuracy * 100)), true);
+    const LevelOutcome outcome = m_session.resolveLevel();
+    const int shownAccuracy = static_cast<int>(outcome.effectiveAccuracy * 100);
+    if (outcome.trialsSkipped > 0 && outcome.passed) {
+        updateFeedback(tr("Level passed at %1% accuracy, settled %2 trials early.").arg(shownAccuracy).arg(outcome.trialsSkipped), true);
+    } else if (outcome.trialsSkipped > 0) {
+        updateFeedback(tr("Level failed (%1% accuracy), settled %2 trials early. Keep going!").arg(shownAccuracy).arg(outcome.trialsSkipped), false);
+    } else if (outcome.passed) {
+        updateFeedback(tr("Level passed at %1% accuracy.").arg(shownAccuracy), true);
     } else {
-        updateFeedback(tr("Level failed (%1% accuracy). Keep going!").arg(static_cast<int>(effectiveAccuracy * 100)), false);
-    }
-
-    static const QVector<double> kTokenThresholds = {0.60, 0.75, 0.90};
-    int earned = 0;
-    for (double threshold : kTokenThresholds) {
-        if (actualAccuracy >= threshold) {
-            ++earned;
-        }
+        updateFeedback(tr("Level failed (%1% accuracy). Keep going!").arg(shownAccuracy), false);
     }
-    if (earned > 0) {
-        m_state.addTokens(earned);
+    if (outcome.finalCooldownStarted) {
+        const auto &rule = m_session.protocol().finalLevel();
+        updateFeedback(tr("Final level cleared %1 times. Wait %2 h, then clear it once more.")
+                           .arg(rule.clears)
+                           .arg(rule.cooldownSecs / 3600.0), true);
+    } else if (outcome.trainingCompleted) {
+        updateFeedback(tr("Congratulations! Training sequence completed."), true);
     }
 
-    m_state.incrementLevelAttempts();
-    recordSummary(false, actualAccuracy, passed);
-    m_state.incrementLevelsSinceSpecial();
-    m_state.markActivity();
-
-    m_levelActive = false;
-    m_mode = SessionMode::Idle;
     m_startTrialButton->setEnabled(false);
     m_sampleButton->setEnabled(false);
     m_doubleButton->setEnabled(false);
     setResponseEnabled(false, false);
     refreshStartLevelButton();
-
-    int nextLevel = m_state.currentLevelIndex();
-    if (passed) {
-        const auto &specs = TrainingSpec::levelSpecs();
-        const double achieved = actualAccuracy;
-        nextLevel = qMin(m_state.currentLevelIndex() + 1, TrainingSpec::totalLevelCount() - 1);
-        for (int idx = m_state.currentLevelIndex() + 1; idx < specs.size(); ++idx) {
-            const auto &candidate = specs.at(idx);
-            if (candidate.stageIndex != m_currentSpec.stageIndex) {
-                nextLevel = idx;
-                break;
-            }
-            if (candidate.feedback != m_currentSpec.feedback) {
-                break;
-            }
-            nextLevel = idx;
-            if (achieved < candidate.passAccuracy) {
-                break;
-            }
-        }
-    }
-    m_state.setCurrentLevelIndex(nextLevel);
-
-    if (m_currentSpec.globalIndex == TrainingSpec::totalLevelCount() - 1) {
-        if (passed) {
-            auto passes = m_state.finalLevelConsecutivePasses() + 1;
-            m_state.setFinalLevelConsecutivePasses(passes);
-            if (passes == 3) {
-                m_state.setFinalLevelCooldownStart(QDateTime::currentDateTimeUtc());
-                updateFeedback(tr("Final level cleared three times. Wait 12 h, then clear it once more."), true);
-            } else if (passes > 3) {
-                const auto last = m_state.finalLevelCooldownStart();
-                if (last.isValid() && last.secsTo(QDateTime::currentDateTimeUtc()) >= 12 * 3600) {
-                    m_state.setTrainingCompleted(true);
-                    updateFeedback(tr("Congratulations! Training sequence completed."), true);
-                }
-            }
-        } else {
-            m_state.setFinalLevelConsecutivePasses(0);
-            m_state.setFinalLevelCooldownStart(QDateTime());
-        }
-    }
-
     refreshStateLabels();
     updateLevelDescription();
-    m_state.save();
-}
-
-void PitchTraining::recordSummary(bool specialExercise, double accuracy, bool passed)
-{
-    LevelSummary summary;
-    summary.levelIndex = m_currentSpec.globalIndex;
-    summary.accuracy = accuracy;
-    summary.passed = passed;
-    summary.specialExercise = specialExercise;
-    summary.completedAt = QDateTime::currentDateTime();
-
-    for (const auto &trial : m_trialLog) {
-        const QString key = trial.outOfBounds ? QStringLiteral("OUT") : trial.presentedPitch;
-        auto stats = summary.perPitch.value(key);
-        ++stats.totalTrials;
-        if (trial.correct) {
-            ++stats.correctTrials;
-        }
-        summary.perPitch.insert(key, stats);
-    }
-
-    m_state.recordLevelSummary(summary);
-    m_trialLog.clear();
+    warnIfJournalFailing();
 }
 
 void PitchTraining::startSpecialExercise()
 {
-    m_currentSpec = TrainingSpec::specForIndex(m_state.currentLevelIndex());
-    m_specialContext = SpecialContext{};
-    m_specialContext.active = true;
-    m_specialContext.feedbackPhase = true;
-    m_specialContext.totalTrials = 12;
-    m_specialContext.secondPhasePending = true;
-    m_mode = SessionMode::SpecialExercise;
-    m_levelActive = false;
-
-    const QString weakest = m_state.leastAccuratePitch();
-    if (!weakest.isEmpty()) {
-        m_specialContext.targetPitch = weakest;
-    } else if (!m_trainingPitches.isEmpty()) {
-        m_specialContext.targetPitch = m_trainingPitches.first();
-    } else {
-        m_specialContext.targetPitch = QStringLiteral("F");
-    }
-
-    m_statusLabel->setText(tr("Special exercise: lock onto pitch %1").arg(m_specialContext.targetPitch));
-    m_specialTargetButton->setText(tr("This is %1").arg(m_specialContext.targetPitch));
-    m_specialOtherButton->setText(tr("Not %1").arg(m_specialContext.targetPitch));
+    const QString target = m_session.special().targetPitch;
+    m_statusLabel->setText(tr("Special exercise: lock onto pitch %1").arg(target));
+    m_specialTargetButton->setText(tr("This is %1").arg(target));
+    m_specialOtherButton->setText(tr("Not %1").arg(target));
     m_specialContainer->show();
-    m_responseContainer->hide();
-    m_startTrialButton->setEnabled(true);
+    m_responsePad->hide();
     resetLevelState();
     setResponseEnabled(false, false);
+    awaitNextTrial();
     refreshStartLevelButton();
 }
 
 void PitchTraining::resolveSpecialExercise()
 {
-    if (m_specialContext.feedbackPhase && m_specialContext.secondPhasePending) {
-        m_specialContext.feedbackPhase = false;
-        m_specialContext.totalTrials = 22;
-        m_specialContext.secondPhasePending = false;
-        m_trialsCompleted = 0;
-        m_trialLog.clear();
-        m_currentResponseWindowMs = 0;
-        if (m_responseProgressTimer) {
-            m_responseProgressTimer->stop();
-        }
+    if (m_session.resolveSpecialExercise()) {
         if (m_responseProgress) {
-            m_responseProgress->setMaximum(100);
-            m_responseProgress->setValue(0);
-            m_responseProgress->setFormat(tr("Time left"));
+            m_responseProgress->stop();
         }
         resetTrialLog();
         m_statusLabel->setText(tr("Special exercise phase 2: no feedback."));
-        m_startTrialButton->setEnabled(true);
         setResponseEnabled(false, false);
+        awaitNextTrial();
         return;
     }
 
-    recordSummary(true, 0.0, true);
-    m_specialContext = SpecialContext{};
-    m_mode = SessionMode::Idle;
-    m_state.resetLevelsSinceSpecial();
     m_waitingForShepard = false;
     m_specialContainer->hide();
-    m_responseContainer->show();
+    m_responsePad->show();
     m_startTrialButton->setEnabled(false);
     m_statusLabel->setText(tr("Special exercise done. Resume main training."));
     setResponseEnabled(false, false);
-    m_state.save();
     refreshStartLevelButton();
 }
 
 void PitchTraining::handlePlaybackFinished()
 {
+    if (m_playbackContext == PlaybackContext::Battery) {
+        // the stream ran out, so every response window has closed
+        handleBatteryTick();
+        if (m_session.batteryActive()) {
+            finishTestBattery(false);
+        }
+        return;
+    }
     if (m_playbackContext == PlaybackContext::Sample) {
         playNextSample();
     } else if (m_playbackContext == PlaybackContext::Shepard) {
         m_waitingForShepard = false;
         m_playbackContext = PlaybackContext::None;
         m_statusLabel->setText(tr("Memory reset complete. Start the trials."));
-        m_startTrialButton->setEnabled(true);
         setControlsEnabled(true);
+        awaitNextTrial();
         refreshStartLevelButton();
     } else {
         m_playbackContext = PlaybackContext::None;
@@ -1636,9 +1222,11 @@ void PitchTraining::handlePlaybackFinished()
 
 void PitchTraining::handleSampleButton()
 {
-    if (!m_levelActive) {
+    if (!m_session.levelActive()) {
         return;
     }
+    // a preview would otherwise be cut off by the queued tone
+    pauseAutoAdvance();
 
     QDialog dialog(this);
     dialog.setWindowTitle(tr("Pick a pitch to preview"));
@@ -1650,7 +1238,13 @@ void PitchTraining::handleSampleButton()
     auto *scroll = new QScrollArea(&dialog);
     auto *inner = new QWidget(scroll);
     auto *innerLayout = new QVBoxLayout(inner);
-    for (const auto &pitch : m_trainingPitches) {
+    const auto &order = TrainingSpec::chromaticOrder();
+    const quint16 trained = m_session.trainingPitchMask();
+    for (int index : m_session.protocol().introductionOrder()) {
+        if (!(trained & (1u << index))) {
+            continue;
+        }
+        const QString pitch = order.at(index);
         auto *btn = new QPushButton(pitch, inner);
         connect(btn, &QPushButton::clicked, &dialog, [this, &dialog, pitch]() {
             enqueueSamplePlayback(pitch);
@@ -1662,7 +1256,7 @@ void PitchTraining::handleSampleButton()
     scroll->setWidgetResizable(true);
     layout->addWidget(scroll);
     dialog.exec();
-    if (!m_currentSpec.feedback && !m_waitingForShepard) {
+    if (!m_session.currentSpec().feedback && !m_waitingForShepard) {
         playShepardTone();
     }
 }
@@ -1708,6 +1302,7 @@ void PitchTraining::handleSessionToggle()
         m_sessionActive = true;
         m_sessionStart = QDateTime::currentDateTime();
         m_sessionTimer.start();
+        m_session.resetCadence();
         m_sessionButton->setText(tr("End session"));
     }
     refreshStateLabels();
@@ -1722,18 +1317,30 @@ void PitchTraining::handleProfileSelection(int index)
     if (index < 0 || index >= m_profileCombo->count()) {
         return;
     }
-    const QString id = m_profileCombo->itemData(index).toString();
-    if (id.isEmpty() || id == m_profileManager.activeProfileId()) {
+    m_profileCombo->lineEdit()->clearFocus();
+    selectProfile(m_profileCombo->itemData(index).toString());
+}
+
+void PitchTraining::handleProfileSearchActivated(const QModelIndex &index)
+{
+    m_profileCombo->lineEdit()->clearFocus();
+    selectProfile(index.data(ProfileListModel::IdRole).toString());
+    refreshProfileControls();
+}
+
+void PitchTraining::selectProfile(const QString &profileId)
+{
+    if (profileId.isEmpty() || profileId == m_profileManager.activeProfileId()) {
         return;
     }
     concludeSessionIfNeeded();
-    m_state.save();
-    if (!switchProfile(id)) {
+    m_session.state().save();
+    if (!switchProfile(profileId)) {
         updateFeedback(tr("Unable to switch profile."), false);
         refreshProfileControls();
         return;
     }
-    updateFeedback(tr("Switched to profile %1").arg(m_profileCombo->itemText(index)), true);
+    updateFeedback(tr("Switched to profile %1").arg(m_profileManager.activeProfile().name), true);
 }
 
 void PitchTraining::handleCreateProfile()
@@ -1761,8 +1368,7 @@ void PitchTraining::handleCreateProfile()
 
 void PitchTraining::handleDeleteProfile()
 {
-    const auto profiles = m_profileManager.profiles();
-    if (profiles.size() <= 1) {
+    if (m_profileManager.profileCount() <= 1) {
         showMessage(QMessageBox::Information, tr("Delete profile"), tr("At least one profile must remain."));
         return;
     }
@@ -1787,8 +1393,10 @@ void PitchTraining::handleDeleteProfile()
         return;
     }
     concludeSessionIfNeeded();
-    m_state.save();
+    // nothing may still be writing into the directory that goes away
+    m_session.close();
     if (!m_profileManager.deleteProfile(id)) {
+        applyActiveProfile();
         showMessage(QMessageBox::Warning, tr("Delete profile"), tr("Unable to delete the profile."));
         refreshProfileControls();
         return;
@@ -1798,12 +1406,188 @@ void PitchTraining::handleDeleteProfile()
     updateFeedback(tr("Profile %1 deleted.").arg(name), false);
 }
 
+void PitchTraining::handleExportProfile()
+{
+    const QString name = m_profileManager.activeProfile().name;
+    const QString suggested = QDir(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation))
+                                  .filePath(tr("%1 progress.json").arg(name));
+    const QString path = QFileDialog::getSaveFileName(this, tr("Export progress"), suggested, tr("JSON files (*.json)"));
+    if (path.isEmpty()) {
+        return;
+    }
+    if (!m_session.state().exportJson(path)) {
+        showMessage(QMessageBox::Warning, tr("Export progress"), tr("Unable to write %1.").arg(QDir::toNativeSeparators(path)));
+        return;
+    }
+    updateFeedback(tr("Progress exported."), true);
+}
+
 void PitchTraining::handleShowInstructions()
 {
-    const QString text = tr("Training levels present 20 randomized piano tones drawn from the current pitch set plus nearby 'out-of-bound' distractors. You have to label each tone within the response window; semitone errors and responses after the timer are counted as incorrect. Once you clear a block of 24 levels for the current pitch set, the next chromatic pitch is added.\n\nSpecial exercises appear after every 15 attempted levels once at least five pitches are active. They focus on the weakest pitch with a short feedback block followed by a no-feedback block.\n\nWhen you run pre/post tests (outside of this trainer) they mirror the paper: no feedback, tones spaced more than an octave apart, and a 5-second response limit. Use the sample button here if you want to rehearse the reference tones before starting a level.");
+    const QString text = tr("Training levels present 20 randomized piano tones drawn from the current pitch set plus nearby 'out-of-bound' distractors. You have to label each tone within the response window; semitone errors and responses after the timer are counted as incorrect. Once you clear a block of 24 levels for the current pitch set, the next chromatic pitch is added.\n\nSpecial exercises appear after every 15 attempted levels once at least five pitches are active. They focus on the weakest pitch with a short feedback block followed by a no-feedback block.\n\nPre/post tests (\"Run a pre/post test\") mirror the paper: every pitch in three octaves, no feedback, tones spaced more than an octave apart, and a 5-second response limit. The tones play on a fixed schedule, the same for everyone, and the answers are saved with your trial records. Press Esc to stop a test. Use the sample button here if you want to rehearse the reference tones before starting a level.");
     showMessage(QMessageBox::Information, tr("How the training and tests work"), text);
 }
 
+void PitchTraining::handleRunTestBattery()
+{
+    if (m_session.isRunning() || m_waitingForShepard) {
+        updateFeedback(tr("Finish the running level before starting a test."), false);
+        return;
+    }
+    if (m_session.isReadOnly()) {
+        updateFeedback(tr("This profile is open in another window."), false);
+        return;
+    }
+    if (m_session.protocolUnavailable()) {
+        updateFeedback(tr("This profile's training protocol file is missing. Restore it to continue training."), false);
+        return;
+    }
+    const QStringList forms = {tr("Pre-test"), tr("Post-test")};
+    bool ok = false;
+    const QString choice = QInputDialog::getItem(this, tr("Pre/post test"), tr("Which test do you want to run?"), forms, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    const TestBattery battery(choice == forms.at(1) ? TestBattery::Form::Post : TestBattery::Form::Pre);
+    const qint64 minutes = (TestBattery::msForFrames(battery.frameCount()) + 59999) / 60000;
+    const QString text = tr("%1 tones play one after another, one every %2 seconds, without pauses. Name each one within %3 seconds "
+                            "using the note keys or the piano; there is no feedback and no \"Other\" answer. The test takes about %4 minutes. "
+                            "Press Esc to stop early.")
+                             .arg(battery.trialCount())
+                             .arg(TestBattery::kInterOnsetMs / 1000)
+                             .arg(TestBattery::kResponseLimitMs / 1000)
+                             .arg(minutes);
+    if (showMessage(QMessageBox::Question, choice, text, QMessageBox::Ok | QMessageBox::Cancel, QMessageBox::Ok) != QMessageBox::Ok) {
+        return;
+    }
+    if (m_session.startTestBattery(battery) != TrainingSession::StartResult::Started) {
+        return;
+    }
+
+    resetLevelState();
+    m_startTrialButton->setEnabled(false);
+    m_sampleButton->setEnabled(false);
+    m_doubleButton->setEnabled(false);
+    m_testBatteryButton->setEnabled(false);
+    refreshStartLevelButton();
+    m_responsePad->setActiveMask(static_cast<quint16>((1u << ResponsePad::kPitchCount) - 1));
+    m_responsePad->show();
+    m_specialContainer->hide();
+    setResponseEnabled(false, false);
+    updateProgress();
+    m_statusLabel->setText(tr("%1 running. Name each tone as it plays.").arg(choice));
+
+    m_batteryTimeline = new BatteryTimeline(battery, this);
+    m_batteryTimeline->open(QIODevice::ReadOnly);
+    m_batteryNext = 0;
+    m_batteryTrialOpen = false;
+    m_playbackContext = PlaybackContext::Battery;
+    m_tonePlayer.playStream(m_batteryTimeline);
+    m_batteryClock->start();
+}
+
+qint64 PitchTraining::batteryFrame() const
+{
+    return m_tonePlayer.playedUSecs() * ToneSynth::kSampleRate / 1000000;
+}
+
+void PitchTraining::handleBatteryTick()
+{
+    if (!m_session.batteryActive() || !m_batteryTimeline) {
+        m_batteryClock->stop();
+        return;
+    }
+    const TestBattery &battery = m_batteryTimeline->battery();
+    const qint64 frame = batteryFrame();
+    // a stalled event loop catches up window by window, so a late tick
+    // never shifts a trial's timing
+    forever {
+        if (m_batteryTrialOpen) {
+            if (frame < battery.responseEndFrame(m_batteryNext - 1)) {
+                break;
+            }
+            finishBatteryTrial(QString(), TestBattery::kResponseLimitMs, true);
+        } else if (m_batteryNext < battery.trialCount() && frame >= battery.onsetFrame(m_batteryNext)) {
+            m_session.nextTrial();
+            ++m_batteryNext;
+            m_batteryTrialOpen = true;
+            setResponseEnabled(true, false);
+            if (m_responseProgress) {
+                m_responseProgress->start(TestBattery::kResponseLimitMs,
+                                          static_cast<int>(TestBattery::msForFrames(frame - battery.onsetFrame(m_batteryNext - 1))));
+            }
+        } else {
+            break;
+        }
+    }
+    if (!m_batteryTrialOpen && m_session.blockComplete()) {
+        finishTestBattery(false);
+    }
+}
+
+void PitchTraining::handleBatteryResponse(const QString &response)
+{
+    if (!m_batteryTrialOpen || !m_batteryTimeline) {
+        return;
+    }
+    const TestBattery &battery = m_batteryTimeline->battery();
+    const int trial = m_batteryNext - 1;
+    const qint64 frame = batteryFrame();
+    if (frame >= battery.responseEndFrame(trial)) {
+        // the window closed before the clock noticed: a timeout
+        handleBatteryTick();
+        return;
+    }
+    const qint64 sinceOnset = qMax<qint64>(0, frame - battery.onsetFrame(trial));
+    finishBatteryTrial(response, static_cast<int>(TestBattery::msForFrames(sinceOnset)), false);
+}
+
+void PitchTraining::finishBatteryTrial(const QString &response, int responseTimeMs, bool timedOut)
+{
+    m_session.finishTrial(response, responseTimeMs, timedOut);
+    m_batteryTrialOpen = false;
+    if (m_responseProgress) {
+        m_responseProgress->stop();
+    }
+    setResponseEnabled(false, false);
+    updateProgress();
+}
+
+void PitchTraining::finishTestBattery(bool aborted)
+{
+    m_batteryClock->stop();
+    m_tonePlayer.stop();
+    m_playbackContext = PlaybackContext::None;
+    const int trials = m_session.blockLength();
+    const int correct = m_session.correctTrials();
+    if (aborted) {
+        m_session.abort();
+    } else {
+        m_session.resolveTestBattery();
+    }
+    if (m_batteryTimeline) {
+        m_batteryTimeline->close();
+        m_batteryTimeline->deleteLater();
+        m_batteryTimeline = nullptr;
+    }
+    m_batteryTrialOpen = false;
+    if (m_responseProgress) {
+        m_responseProgress->stop();
+    }
+    setResponseEnabled(false, false);
+    updateResponsePad();
+    m_testBatteryButton->setEnabled(true);
+    refreshStartLevelButton();
+    if (aborted) {
+        m_statusLabel->setText(tr("Test stopped. The answers so far are saved as an unfinished test."));
+    } else {
+        m_statusLabel->setText(tr("Test complete: %1 of %2 tones named correctly. The answers are saved with your trial records.")
+                                   .arg(correct)
+                                   .arg(trials));
+    }
+    warnIfJournalFailing();
+}
+
 void PitchTraining::handleShowAbout()
 {
     const QString text = tr("<p>PitchTraining was built by <a style=\"color:#0a58ca;\" href=\"https://github.com/bigorenski\">Lucas Bigorenski</a> based on the paper <em>\"Learning fast and accurate absolute pitch judgment in adulthood\"</em>.</p>");
@@ -1819,15 +1603,18 @@ void PitchTraining::concludeSessionIfNeeded()
     m_sessionButton->setText(tr("Start 15-min session"));
     const qint64 elapsedSeconds = m_sessionTimer.elapsed() / 1000;
     if (elapsedSeconds >= kSessionMinimumSeconds) {
-        m_state.addCountedSeconds(static_cast<double>(elapsedSeconds));
-        updateFeedback(tr("Session logged: %1 minutes counted.").arg(elapsedSeconds / 60), true);
+        m_session.state().addCountedSeconds(static_cast<double>(elapsedSeconds));
+        updateFeedback(tr("Session logged: %1 minutes counted, %2 trials at %3 per minute.")
+                           .arg(elapsedSeconds / 60)
+                           .arg(m_session.cadenceTrials())
+                           .arg(m_session.trialsPerMinute(), 0, 'f', 1), true);
     } else if (elapsedSeconds > 0) {
         showMessage(QMessageBox::Information,
                     tr("Short session"),
                     tr("Only sessions longer than 15 min count. You logged %1 minutes.").arg(elapsedSeconds / 60.0, 0, 'f', 1));
     }
     refreshStateLabels();
-    m_state.save();
+    m_session.state().save();
     refreshStartLevelButton();
 }
 
@@ -1836,9 +1623,5 @@ void PitchTraining::updateFeedback(const QString &text, bool positive)
     if (!m_feedbackLabel) {
         return;
     }
-    m_feedbackLabel->setText(text);
-    m_feedbackLabel->setProperty("positive", positive);
-    m_feedbackLabel->style()->unpolish(m_feedbackLabel);
-    m_feedbackLabel->style()->polish(m_feedbackLabel);
-    m_feedbackLabel->update();
+    m_feedbackLabel->setMessage(text, positive ? FeedbackTone::Positive : FeedbackTone::Negative);
 }
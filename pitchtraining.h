@@ -1,13 +1,13 @@
 #ifndef PITCHTRAINING_H
 #define PITCHTRAINING_H
 
-#include <QButtonGroup>
 #include <QDateTime>
 #include <QElapsedTimer>
 #include <QComboBox>
+#include <QCompleter>
 #include <QLabel>
 #include <QGroupBox>
-#include <QListWidget>
+#include <QListView>
 #include <QKeyEvent>
 #include <QEvent>
 #include <QMainWindow>
@@ -19,9 +19,16 @@
 #include <QTimer>
 #include <QVector>
 
+#include "feedbackbanner.h"
+#include "profilelistmodel.h"
 #include "profilemanager.h"
+#include "responsepad.h"
+#include "responsetimebar.h"
+#include "testbattery.h"
+#include "theme.h"
 #include "toneplayer.h"
-#include "trainingmodel.h"
+#include "trainingsession.h"
+#include "triallogmodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -40,16 +47,20 @@ public:
 private slots:
     void handleStartLevel();
     void handleStartTrial();
-    void handleResponse(int buttonId);
+    void handleResponse(int pitchIndex);
     void handleSpecialResponse(bool isTarget);
     void handleResponseTimeout();
     void handlePlaybackFinished();
     void handleSampleButton();
     void handleSessionToggle();
     void handleProfileSelection(int index);
+    void handleProfileSearchActivated(const QModelIndex &index);
     void handleCreateProfile();
     void handleDeleteProfile();
+    void handleExportProfile();
     void handleShowInstructions();
+    void handleRunTestBattery();
+    void handleBatteryTick();
     void handleShowAbout();
 
 protected:
@@ -61,52 +72,33 @@ private:
         None,
         Trial,
         Sample,
-        Shepard
-    };
-
-    enum class SessionMode {
-        Idle,
-        Level,
-        SpecialExercise
-    };
-
-    struct TrialData {
-        QString presentedPitch;
-        int octave = 4;
-        bool outOfBounds = false;
-        QString response;
-        bool correct = false;
-        bool semitoneError = false;
-        bool timedOut = false;
-        int responseTimeMs = 0;
-        bool usedDouble = false;
-        bool luckyDouble = false;
-    };
-
-    struct SpecialContext {
-        bool active = false;
-        QString targetPitch;
-        bool feedbackPhase = true;
-        int totalTrials = 0;
-        int completedTrials = 0;
-        bool secondPhasePending = false;
+        Shepard,
+        Battery
     };
 
     void buildUi();
     void refreshStateLabels();
     void updateLevelDescription();
-    void rebuildResponseButtons();
+    void updateResponsePad();
     void resetLevelState();
-    void maybeScheduleSpecialExercise();
-    bool shouldRunSpecialExercise() const;
-    void startLevelInternal();
+    void startLevelInternal(bool resumed);
+    void showResumedLevel();
     void resolveLevelCompletion();
-    void recordSummary(bool specialExercise, double accuracy, bool passed);
     void startSpecialExercise();
-    void continueSpecialExercise();
     void resolveSpecialExercise();
     void prepareNextTrial();
-    void finishCurrentTrial(bool timedOut = false);
+    void queueNextTrial();
+    void presentQueuedTrial();
+    // enables "Hear next tone", or with auto-advance queues the next tone
+    // and starts the inter-trial interval
+    void awaitNextTrial();
+    void pauseAutoAdvance();
+    // position in the running battery, in frames of its timeline
+    qint64 batteryFrame() const;
+    void handleBatteryResponse(const QString &response);
+    void finishBatteryTrial(const QString &response, int responseTimeMs, bool timedOut);
+    void finishTestBattery(bool aborted);
+    void finishCurrentTrial(const QString &response, bool timedOut = false);
     void setControlsEnabled(bool enabled);
     void updateFeedback(const QString &text, bool positive);
     void updateProgress();
@@ -119,11 +111,13 @@ private:
     void addTrainingTimeForSession();
     void refreshProfileControls();
     void applyActiveProfile();
+    void warnIfJournalFailing();
     bool switchProfile(const QString &profileId);
+    void selectProfile(const QString &profileId);
     void resetTrialLog();
-    void appendTrialLogEntry(int trialNumber, const QString &description, bool positive);
+    void appendTrialLogEntry(const TrialLogRecord &record);
+    TrialLogRecord trialLogRecordFor(const TrialData &trial, int trialNumber) const;
     void setResponseEnabled(bool levelEnabled, bool specialEnabled);
-    void updateResponseTimeBar();
     QString pitchFromKeyEvent(QKeyEvent *event, bool &isOther) const;
     void clearActiveResponses();
     bool handleLevelKeyResponse(const QString &pitch, bool isOther);
@@ -139,34 +133,30 @@ private:
 
     Ui::PitchTraining *ui;
 
-    TrainingState m_state;
+    TrainingSession m_session;
     ProfileManager m_profileManager;
     ToneLibrary m_toneLibrary;
     TonePlayer m_tonePlayer;
 
-    LevelSpec m_currentSpec;
-    QVector<QString> m_trainingPitches;
-    QVector<QString> m_outOfBoundsPitches;
-    QVector<TrialData> m_trialLog;
     QElapsedTimer m_trialTimer;
     QTimer *m_responseTimer = nullptr;
-    QTimer *m_responseProgressTimer = nullptr;
-    bool m_levelActive = false;
+    QTimer *m_interTrialTimer = nullptr;
+    bool m_trialQueued = false;
+    bool m_autoPaused = false;
     bool m_waitingForShepard = false;
-    bool m_doubleArmed = false;
-    bool m_randomDouble = false;
+    // the lost-records warning is shown once per opened profile
+    bool m_journalWarned = false;
     bool m_samplesQueued = false;
     QStringList m_sampleQueue;
-    int m_trialsCompleted = 0;
-    int m_requiredTrials = 0;
-    int m_correctTrials = 0;
-    double m_effectiveBonus = 0.0;
-    int m_currentResponseWindowMs = 0;
-    TrialData m_currentTrial;
-    SpecialContext m_specialContext;
-    SessionMode m_mode = SessionMode::Idle;
     PlaybackContext m_playbackContext = PlaybackContext::None;
 
+    // Pre/post test: the timeline plays as one stream and the clock only
+    // polls its position to open and close response windows
+    BatteryTimeline *m_batteryTimeline = nullptr;
+    QTimer *m_batteryClock = nullptr;
+    int m_batteryNext = 0;
+    bool m_batteryTrialOpen = false;
+
     // Session tracking
     bool m_sessionActive = false;
     QDateTime m_sessionStart;
@@ -179,28 +169,33 @@ private:
     QLabel *m_streakLabel = nullptr;
     QLabel *m_hoursLabel = nullptr;
     QLabel *m_statusLabel = nullptr;
-    QLabel *m_feedbackLabel = nullptr;
+    FeedbackBanner *m_feedbackLabel = nullptr;
     QLabel *m_sessionLabel = nullptr;
     QLabel *m_keyboardHintLabel = nullptr;
     QComboBox *m_profileCombo = nullptr;
+    ProfileListModel *m_profileModel = nullptr;
+    ProfileListModel *m_profileSearchModel = nullptr;
+    QCompleter *m_profileCompleter = nullptr;
     QPushButton *m_startLevelButton = nullptr;
     QPushButton *m_startTrialButton = nullptr;
     QPushButton *m_sampleButton = nullptr;
     QPushButton *m_doubleButton = nullptr;
+    QPushButton *m_autoAdvanceButton = nullptr;
     QPushButton *m_sessionButton = nullptr;
     QPushButton *m_helpButton = nullptr;
+    QPushButton *m_testBatteryButton = nullptr;
     QToolButton *m_titleAboutButton = nullptr;
     QPushButton *m_newProfileButton = nullptr;
     QPushButton *m_deleteProfileButton = nullptr;
+    QPushButton *m_exportProfileButton = nullptr;
     QProgressBar *m_trialProgress = nullptr;
-    QProgressBar *m_responseProgress = nullptr;
-    QListWidget *m_trialLogList = nullptr;
-    QButtonGroup *m_responseButtons = nullptr;
-    QWidget *m_responseContainer = nullptr;
+    ResponseTimeBar *m_responseProgress = nullptr;
+    QListView *m_trialLogList = nullptr;
+    TrialLogModel *m_trialLogModel = nullptr;
+    ResponsePad *m_responsePad = nullptr;
     QWidget *m_specialContainer = nullptr;
     QPushButton *m_specialTargetButton = nullptr;
     QPushButton *m_specialOtherButton = nullptr;
-    bool m_trialLogHasEntries = false;
 };
 
 #endif // PITCHTRAINING_H
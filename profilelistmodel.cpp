@@ -0,0 +1,138 @@
+#include "profilelistmodel.h"
+
+#include "profilemanager.h"
+
+namespace {
+constexpr int kFetchBatch = 200;
+}
+
+ProfileListModel::ProfileListModel(const ProfileManager *manager, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_manager(manager)
+{
+    sync();
+}
+
+void ProfileListModel::sync()
+{
+    if (m_revision == m_manager->revision()) {
+        return;
+    }
+    beginResetModel();
+    m_revision = m_manager->revision();
+    rebuild();
+    endResetModel();
+}
+
+void ProfileListModel::setFilter(const QString &text)
+{
+    const QString filter = text.trimmed();
+    if (filter == m_filter && m_revision == m_manager->revision()) {
+        return;
+    }
+    beginResetModel();
+    m_filter = filter;
+    m_revision = m_manager->revision();
+    rebuild();
+    endResetModel();
+}
+
+void ProfileListModel::setMatchLimit(int limit)
+{
+    m_matchLimit = qMax(0, limit);
+}
+
+int ProfileListModel::rowForId(const QString &id)
+{
+    const int index = m_manager->indexOfProfile(id);
+    if (index < 0) {
+        return -1;
+    }
+    int row = index;
+    if (!m_filter.isEmpty()) {
+        row = static_cast<int>(m_matches.indexOf(index));
+        if (row < 0) {
+            return -1;
+        }
+    }
+    fetchTo(row);
+    return row;
+}
+
+int ProfileListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_fetched;
+}
+
+QVariant ProfileListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_fetched) {
+        return {};
+    }
+    const int profile = profileIndex(index.row());
+    if (profile < 0 || profile >= m_manager->profileCount()) {
+        return {};
+    }
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+        return m_manager->profileAt(profile).name;
+    case IdRole:
+        return m_manager->profileAt(profile).id;
+    default:
+        return {};
+    }
+}
+
+bool ProfileListModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && m_fetched < available();
+}
+
+void ProfileListModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    fetchTo(qMin(m_fetched + kFetchBatch, available()) - 1);
+}
+
+int ProfileListModel::available() const
+{
+    return m_filter.isEmpty() ? m_manager->profileCount() : static_cast<int>(m_matches.size());
+}
+
+int ProfileListModel::profileIndex(int row) const
+{
+    return m_filter.isEmpty() ? row : m_matches.value(row, -1);
+}
+
+void ProfileListModel::rebuild()
+{
+    m_matches.clear();
+    if (!m_filter.isEmpty()) {
+        const int count = m_manager->profileCount();
+        for (int i = 0; i < count; ++i) {
+            if (m_manager->profileAt(i).name.contains(m_filter, Qt::CaseInsensitive)) {
+                m_matches.append(i);
+                if (m_matchLimit > 0 && m_matches.size() >= m_matchLimit) {
+                    break;
+                }
+            }
+        }
+    }
+    m_fetched = qMin(kFetchBatch, available());
+}
+
+void ProfileListModel::fetchTo(int row)
+{
+    if (row < m_fetched || row >= available()) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), m_fetched, row);
+    m_fetched = row + 1;
+    endInsertRows();
+}
@@ -0,0 +1,52 @@
+#ifndef PROFILELISTMODEL_H
+#define PROFILELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+
+class ProfileManager;
+
+// Profile names straight out of a ProfileManager, without copying them into
+// items. Rows reach the view in batches through fetchMore(), so a picker over
+// thousands of profiles only lays out what has been scrolled to. With a
+// filter set, the model lists profiles whose name contains the text, up to
+// the match limit, for type-ahead search.
+class ProfileListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Roles {
+        // Qt::UserRole so QComboBox::itemData() finds the id
+        IdRole = Qt::UserRole
+    };
+
+    explicit ProfileListModel(const ProfileManager *manager, QObject *parent = nullptr);
+
+    // resets the rows if profiles were added or removed since the last call
+    void sync();
+    void setFilter(const QString &text);
+    void setMatchLimit(int limit);
+    // fetches up to the profile's row; -1 if the filter hides it
+    int rowForId(const QString &id);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+private:
+    int available() const;
+    int profileIndex(int row) const;
+    void rebuild();
+    void fetchTo(int row);
+
+    const ProfileManager *m_manager = nullptr;
+    QString m_filter;
+    // profile indices matching m_filter; unused without a filter
+    QVector<int> m_matches;
+    int m_matchLimit = 0;
+    int m_fetched = 0;
+    int m_revision = -1;
+};
+
+#endif // PROFILELISTMODEL_H
@@ -1,18 +1,43 @@
 #include "profilemanager.h"
 
+#include <QAtomicInt>
 #include <QCoreApplication>
 #include <QDir>
 #include <QDateTime>
 #include "trainingmodel.h"
+#include "trainingsession.h"
 #include <QFile>
+#include <QFileInfo>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QLockFile>
+#include <QSaveFile>
 #include <QStandardPaths>
+#include <QThread>
 #include <QUuid>
 #include <QDate>
+#include <vector>
 
 namespace {
+const QString kMetadataFile = QStringLiteral("profiles.json");
+const QString kLogFile = QStringLiteral("profiles.log");
+const QString kLockFile = QStringLiteral("profiles.lock");
+// log entries after which the next change rewrites the snapshot instead
+constexpr int kCompactAfterEntries = 512;
+constexpr int kLockTimeoutMs = 5000;
+// a read that keeps racing compactions settles for what it has
+constexpr int kReadAttempts = 4;
+
+struct MetadataView
+{
+    QVector<UserProfile> profiles;
+    QString activeId;
+    int version = 0;
+    int logEntries = 0;
+    qint64 logBytes = 0;
+};
+
 QString sanitizeName(const QString &name, int fallbackIndex)
 {
     const QString trimmed = name.trimmed();
@@ -21,6 +46,135 @@ QString sanitizeName(const QString &name, int fallbackIndex)
     }
     return QStringLiteral("Player %1").arg(fallbackIndex);
 }
+
+QJsonObject profileToJson(const UserProfile &profile)
+{
+    QJsonObject obj;
+    obj[QStringLiteral("id")] = profile.id;
+    obj[QStringLiteral("name")] = profile.name;
+    obj[QStringLiteral("created")] = profile.createdAt.toString(Qt::ISODate);
+    obj[QStringLiteral("lastActive")] = profile.lastActiveAt.toString(Qt::ISODate);
+    return obj;
+}
+
+UserProfile profileFromJson(const QJsonObject &obj)
+{
+    UserProfile profile;
+    profile.id = obj.value(QStringLiteral("id")).toString();
+    profile.name = obj.value(QStringLiteral("name")).toString();
+    profile.createdAt = QDateTime::fromString(obj.value(QStringLiteral("created")).toString(), Qt::ISODate);
+    profile.lastActiveAt = QDateTime::fromString(obj.value(QStringLiteral("lastActive")).toString(), Qt::ISODate);
+    if (!profile.createdAt.isValid()) {
+        profile.createdAt = QDateTime::currentDateTimeUtc();
+    }
+    if (!profile.lastActiveAt.isValid()) {
+        profile.lastActiveAt = profile.createdAt;
+    }
+    return profile;
+}
+
+// Entries are idempotent, so replaying a log over a snapshot that already
+// contains it (a crash between compaction and removing the log) is harmless.
+void replayEntry(const QJsonObject &entry, QVector<UserProfile> &profiles, QHash<QString, int> &index, QString &activeId)
+{
+    const QString op = entry.value(QStringLiteral("op")).toString();
+    const QString id = entry.value(QStringLiteral("id")).toString();
+    if (id.isEmpty()) {
+        return;
+    }
+    const int row = index.value(id, -1);
+    if (op == QLatin1String("add")) {
+        const UserProfile profile = profileFromJson(entry);
+        if (row >= 0) {
+            profiles[row] = profile;
+        } else {
+            index.insert(id, static_cast<int>(profiles.size()));
+            profiles.append(profile);
+        }
+    } else if (op == QLatin1String("remove")) {
+        if (row < 0) {
+            return;
+        }
+        profiles.removeAt(row);
+        index.remove(id);
+        for (auto it = index.begin(); it != index.end(); ++it) {
+            if (it.value() > row) {
+                --it.value();
+            }
+        }
+        if (activeId == id) {
+            activeId.clear();
+        }
+    } else if (op == QLatin1String("active")) {
+        activeId = id;
+        // instances append in any order; the latest activity wins
+        const QDateTime at = QDateTime::fromString(entry.value(QStringLiteral("at")).toString(), Qt::ISODate);
+        if (row >= 0 && at.isValid() && at > profiles.at(row).lastActiveAt) {
+            profiles[row].lastActiveAt = at;
+        }
+    }
+}
+
+int snapshotVersion(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    return QJsonDocument::fromJson(file.readAll()).object().value(QStringLiteral("version")).toInt();
+}
+
+MetadataView readMetadata(const QString &rootPath)
+{
+    const QDir root(rootPath);
+    const QString metadataPath = root.filePath(kMetadataFile);
+    MetadataView view;
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+        view = MetadataView{};
+        QFile file(metadataPath);
+        if (file.open(QIODevice::ReadOnly)) {
+            const auto obj = QJsonDocument::fromJson(file.readAll()).object();
+            view.activeId = obj.value(QStringLiteral("activeId")).toString();
+            view.version = obj.value(QStringLiteral("version")).toInt();
+            const auto arr = obj.value(QStringLiteral("profiles")).toArray();
+            view.profiles.reserve(arr.size());
+            for (const auto &value : arr) {
+                UserProfile profile = profileFromJson(value.toObject());
+                if (!profile.id.isEmpty()) {
+                    view.profiles.append(profile);
+                }
+            }
+        }
+
+        QFile log(root.filePath(kLogFile));
+        if (log.open(QIODevice::ReadOnly)) {
+            QHash<QString, int> index;
+            index.reserve(view.profiles.size());
+            for (int i = 0; i < view.profiles.size(); ++i) {
+                index.insert(view.profiles.at(i).id, i);
+            }
+            const QByteArray data = log.readAll();
+            view.logBytes = data.size();
+            const QList<QByteArray> lines = data.split('\n');
+            for (const auto &line : lines) {
+                // a line torn by a crash does not parse and is dropped
+                const auto entry = QJsonDocument::fromJson(line).object();
+                if (entry.isEmpty()) {
+                    continue;
+                }
+                replayEntry(entry, view.profiles, index, view.activeId);
+                ++view.logEntries;
+            }
+        }
+
+        // a compaction between the two reads may have taken log entries
+        // into a snapshot this read never saw
+        if (snapshotVersion(metadataPath) == view.version) {
+            break;
+        }
+    }
+    return view;
+}
 }
 
 ProfileManager::ProfileManager()
@@ -32,75 +186,135 @@ ProfileManager::ProfileManager()
     m_rootPath = base.filePath(QStringLiteral("profiles"));
 }
 
+ProfileManager::ProfileManager(const QString &rootPath)
+    : m_rootPath(rootPath)
+{
+}
+
 bool ProfileManager::load()
 {
     if (!ensureRoot()) {
         return false;
     }
 
-    m_profiles.clear();
-
-    QFile file(metadataPath());
-    if (file.exists() && file.open(QIODevice::ReadOnly)) {
-        const auto doc = QJsonDocument::fromJson(file.readAll());
-        const auto obj = doc.object();
-        m_activeId = obj.value(QStringLiteral("activeId")).toString();
-        const auto arr = obj.value(QStringLiteral("profiles")).toArray();
-        for (const auto &value : arr) {
-            const auto profileObj = value.toObject();
-            UserProfile profile;
-            profile.id = profileObj.value(QStringLiteral("id")).toString();
-            if (profile.id.isEmpty()) {
-                continue;
-            }
-            profile.name = profileObj.value(QStringLiteral("name")).toString();
-            profile.createdAt = QDateTime::fromString(profileObj.value(QStringLiteral("created")).toString(), Qt::ISODate);
-            profile.lastActiveAt = QDateTime::fromString(profileObj.value(QStringLiteral("lastActive")).toString(), Qt::ISODate);
-            if (!profile.createdAt.isValid()) {
-                profile.createdAt = QDateTime::currentDateTimeUtc();
-            }
-            if (!profile.lastActiveAt.isValid()) {
-                profile.lastActiveAt = profile.createdAt;
-            }
-            m_profiles.append(profile);
-        }
-    }
+    const MetadataView view = readMetadata(m_rootPath);
+    m_profiles = view.profiles;
+    m_activeId = view.activeId;
+    m_version = view.version;
+    m_logEntries = view.logEntries;
+    m_logBytes = view.logBytes;
+    rebuildIndexes();
+    ++m_revision;
 
     ensureDefaultProfile();
 
-    if (m_activeId.isEmpty() && !m_profiles.isEmpty()) {
+    // a missing or stale active id is only persisted with the next switch
+    if (!m_idIndex.contains(m_activeId) && !m_profiles.isEmpty()) {
         m_activeId = m_profiles.constFirst().id;
     }
-
-    save();
     return true;
 }
 
-bool ProfileManager::save() const
+int ProfileManager::workerCount(int jobs, int profileCount)
 {
-    if (!ensureRoot()) {
+    return qBound(1, jobs > 0 ? jobs : QThread::idealThreadCount(), qMax(1, profileCount));
+}
+
+void ProfileManager::forEachProfile(const QVector<UserProfile> &profiles, int workers,
+                                    const std::function<void(const UserProfile &, int)> &work)
+{
+    QAtomicInt nextProfile(0);
+    auto worker = [&](int index) {
+        forever {
+            const int next = nextProfile.fetchAndAddRelaxed(1);
+            if (next >= profiles.size()) {
+                return;
+            }
+            work(profiles.at(next), index);
+        }
+    };
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int i = 0; i < workers; ++i) {
+        threads.emplace_back(QThread::create([&worker, i]() { worker(i); }));
+        threads.back()->start();
+    }
+    for (auto &thread : threads) {
+        thread->wait();
+    }
+}
+
+QVector<UserProfile> ProfileManager::readProfiles(const QString &rootPath, QString *activeId, int *logEntries)
+{
+    MetadataView view = readMetadata(rootPath);
+    if (activeId) {
+        *activeId = view.activeId;
+    }
+    if (logEntries) {
+        *logEntries = view.logEntries;
+    }
+    return view.profiles;
+}
+
+bool ProfileManager::refresh()
+{
+    if (!metadataChanged()) {
         return false;
     }
+    const MetadataView view = readMetadata(m_rootPath);
+    // keep the newer activity of anything this instance has not written
+    QHash<QString, QDateTime> lastActive;
+    lastActive.reserve(m_profiles.size());
+    for (const auto &profile : m_profiles) {
+        lastActive.insert(profile.id, profile.lastActiveAt);
+    }
+    m_profiles = view.profiles;
+    for (auto &profile : m_profiles) {
+        const QDateTime known = lastActive.value(profile.id);
+        if (known.isValid() && known > profile.lastActiveAt) {
+            profile.lastActiveAt = known;
+        }
+    }
+    m_version = view.version;
+    m_logEntries = view.logEntries;
+    m_logBytes = view.logBytes;
+    rebuildIndexes();
+    ++m_revision;
+    if (!m_idIndex.contains(m_activeId) && !m_profiles.isEmpty()) {
+        m_activeId = m_profiles.constFirst().id;
+    }
+    return true;
+}
+
+bool ProfileManager::save()
+{
+    const auto lock = lockMetadata();
+    return lock && writeSnapshot();
+}
 
+bool ProfileManager::writeSnapshot()
+{
     QJsonArray arr;
     for (const auto &profile : m_profiles) {
-        QJsonObject obj;
-        obj[QStringLiteral("id")] = profile.id;
-        obj[QStringLiteral("name")] = profile.name;
-        obj[QStringLiteral("created")] = profile.createdAt.toString(Qt::ISODate);
-        obj[QStringLiteral("lastActive")] = profile.lastActiveAt.toString(Qt::ISODate);
-        arr.append(obj);
+        arr.append(profileToJson(profile));
     }
 
     QJsonObject root;
+    root[QStringLiteral("version")] = m_version + 1;
     root[QStringLiteral("activeId")] = m_activeId;
     root[QStringLiteral("profiles")] = arr;
 
-    QFile file(metadataPath());
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    QSaveFile file(metadataPath());
+    if (!file.open(QIODevice::WriteOnly)) {
         return false;
     }
     file.write(QJsonDocument(root).toJson());
+    if (!file.commit()) {
+        return false;
+    }
+    ++m_version;
+    QFile::remove(logPath());
+    m_logEntries = 0;
+    m_logBytes = 0;
     return true;
 }
 
@@ -109,6 +323,26 @@ QVector<UserProfile> ProfileManager::profiles() const
     return m_profiles;
 }
 
+int ProfileManager::profileCount() const
+{
+    return static_cast<int>(m_profiles.size());
+}
+
+const UserProfile &ProfileManager::profileAt(int index) const
+{
+    return m_profiles.at(index);
+}
+
+int ProfileManager::indexOfProfile(const QString &id) const
+{
+    return m_idIndex.value(id, -1);
+}
+
+int ProfileManager::revision() const
+{
+    return m_revision;
+}
+
 QString ProfileManager::activeProfileId() const
 {
     return m_activeId;
@@ -125,13 +359,23 @@ UserProfile ProfileManager::activeProfile() const
 
 bool ProfileManager::setActiveProfile(const QString &id)
 {
-    auto *profile = findProfile(id);
-    if (!profile) {
+    const auto lock = lockMetadata();
+    if (!lock || !findProfile(id)) {
         return false;
     }
+    return logActive(id);
+}
+
+bool ProfileManager::logActive(const QString &id)
+{
     m_activeId = id;
     recordLastActive(id);
-    return save();
+
+    QJsonObject entry;
+    entry[QStringLiteral("op")] = QStringLiteral("active");
+    entry[QStringLiteral("id")] = id;
+    entry[QStringLiteral("at")] = findProfile(id)->lastActiveAt.toString(Qt::ISODate);
+    return appendLog(entry);
 }
 
 bool ProfileManager::createProfile(const QString &name, QString *outId)
@@ -139,11 +383,14 @@ bool ProfileManager::createProfile(const QString &name, QString *outId)
     if (!ensureRoot()) {
         return false;
     }
-    const QString sanitizedName = sanitizeName(name, m_profiles.size() + 1);
-    for (const auto &profile : m_profiles) {
-        if (profile.name.compare(sanitizedName, Qt::CaseInsensitive) == 0) {
-            return false;
-        }
+    const auto lock = lockMetadata();
+    if (!lock) {
+        return false;
+    }
+    const QString sanitizedName = sanitizeName(name, profileCount() + 1);
+    const QString foldedName = sanitizedName.toCaseFolded();
+    if (m_nameIndex.contains(foldedName)) {
+        return false;
     }
 
     const QString id = generateId();
@@ -157,55 +404,66 @@ bool ProfileManager::createProfile(const QString &name, QString *outId)
     profile.name = sanitizedName;
     profile.createdAt = QDateTime::currentDateTimeUtc();
     profile.lastActiveAt = profile.createdAt;
+    const int row = profileCount();
+    m_idIndex.insert(id, row);
+    m_nameIndex.insert(foldedName, row);
     m_profiles.append(profile);
+    ++m_revision;
 
     maybeImportLegacyState(id);
 
-    if (m_activeId.isEmpty()) {
-        m_activeId = id;
-    }
-
     if (outId) {
         *outId = id;
     }
 
-    return save();
+    QJsonObject entry = profileToJson(profile);
+    entry[QStringLiteral("op")] = QStringLiteral("add");
+    if (!appendLog(entry)) {
+        return false;
+    }
+    if (m_activeId.isEmpty()) {
+        return logActive(id);
+    }
+    return true;
 }
 
 bool ProfileManager::deleteProfile(const QString &id)
 {
-    if (m_profiles.size() <= 1) {
+    const auto lock = lockMetadata();
+    if (!lock || m_profiles.size() <= 1) {
         return false;
     }
-    for (int i = 0; i < m_profiles.size(); ++i) {
-        if (m_profiles.at(i).id == id) {
-            const QString dirPath = profileDirectory(id);
-            QDir dir(dirPath);
-            if (dir.exists()) {
-                dir.removeRecursively();
-            }
-            m_profiles.removeAt(i);
-            if (m_activeId == id) {
-                m_activeId.clear();
-            }
-            if (m_activeId.isEmpty() && !m_profiles.isEmpty()) {
-                m_activeId = m_profiles.constFirst().id;
-            }
-            return save();
+    const int row = m_idIndex.value(id, -1);
+    if (row < 0) {
+        return false;
+    }
+    const QString dirPath = profileDirectory(id);
+    QDir dir(dirPath);
+    if (dir.exists()) {
+        QLockFile profileLock(TrainingSession::lockPathForProfile(dirPath));
+        profileLock.setStaleLockTime(0);
+        if (!profileLock.tryLock(0)) {
+            return false;
         }
+        dir.removeRecursively();
     }
-    return false;
+    m_profiles.removeAt(row);
+    rebuildIndexes();
+    ++m_revision;
+
+    QJsonObject entry;
+    entry[QStringLiteral("op")] = QStringLiteral("remove");
+    entry[QStringLiteral("id")] = id;
+    bool ok = appendLog(entry);
+    if (m_activeId == id) {
+        ok = logActive(m_profiles.constFirst().id) && ok;
+    }
+    return ok;
 }
 
 bool ProfileManager::profileNameExists(const QString &name) const
 {
-    const QString sanitizedName = sanitizeName(name, m_profiles.size() + 1);
-    for (const auto &profile : m_profiles) {
-        if (profile.name.compare(sanitizedName, Qt::CaseInsensitive) == 0) {
-            return true;
-        }
-    }
-    return false;
+    return m_nameIndex.contains(sanitizeName(name, profileCount() + 1).toCaseFolded());
 }
 
 QString ProfileManager::profileDirectory(const QString &id) const
@@ -242,7 +500,57 @@ bool ProfileManager::ensureRoot() const
 QString ProfileManager::metadataPath() const
 {
     QDir dir(m_rootPath);
-    return dir.filePath(QStringLiteral("profiles.json"));
+    return dir.filePath(kMetadataFile);
+}
+
+QString ProfileManager::logPath() const
+{
+    QDir dir(m_rootPath);
+    return dir.filePath(kLogFile);
+}
+
+std::unique_ptr<QLockFile> ProfileManager::lockMetadata()
+{
+    if (!ensureRoot()) {
+        return nullptr;
+    }
+    std::unique_ptr<QLockFile> lock(new QLockFile(QDir(m_rootPath).filePath(kLockFile)));
+    if (!lock->tryLock(kLockTimeoutMs)) {
+        return nullptr;
+    }
+    refresh();
+    return lock;
+}
+
+bool ProfileManager::metadataChanged() const
+{
+    // another instance either appended to the log or compacted it
+    return QFileInfo(logPath()).size() != m_logBytes || snapshotVersion(metadataPath()) != m_version;
+}
+
+bool ProfileManager::appendLog(const QJsonObject &entry)
+{
+    // the in-memory state already includes this entry
+    if (m_logEntries >= kCompactAfterEntries) {
+        return writeSnapshot();
+    }
+    QFile log(logPath());
+    if (!log.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        return false;
+    }
+    QByteArray line = QJsonDocument(entry).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    // start on a fresh line after a torn write
+    char last = '\n';
+    if (log.size() > 0 && log.seek(log.size() - 1) && log.getChar(&last) && last != '\n') {
+        line.prepend('\n');
+    }
+    if (log.write(line) != line.size()) {
+        return false;
+    }
+    ++m_logEntries;
+    m_logBytes = log.size();
+    return true;
 }
 
 QString ProfileManager::legacyStatePath() const
@@ -258,22 +566,26 @@ QString ProfileManager::generateId() const
 
 UserProfile *ProfileManager::findProfile(const QString &id)
 {
-    for (auto &profile : m_profiles) {
-        if (profile.id == id) {
-            return &profile;
-        }
-    }
-    return nullptr;
+    const int row = m_idIndex.value(id, -1);
+    return row >= 0 ? &m_profiles[row] : nullptr;
 }
 
 const UserProfile *ProfileManager::findProfileConst(const QString &id) const
 {
-    for (const auto &profile : m_profiles) {
-        if (profile.id == id) {
-            return &profile;
-        }
+    const int row = m_idIndex.value(id, -1);
+    return row >= 0 ? &m_profiles.at(row) : nullptr;
+}
+
+void ProfileManager::rebuildIndexes()
+{
+    m_idIndex.clear();
+    m_nameIndex.clear();
+    m_idIndex.reserve(m_profiles.size());
+    m_nameIndex.reserve(m_profiles.size());
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        m_idIndex.insert(m_profiles.at(i).id, i);
+        m_nameIndex.insert(m_profiles.at(i).name.toCaseFolded(), i);
     }
-    return nullptr;
 }
 
 void ProfileManager::ensureDefaultProfile()
@@ -282,9 +594,14 @@ void ProfileManager::ensureDefaultProfile()
         return;
     }
     QString newId;
-    createProfile(QStringLiteral("Player 1"), &newId);
+    if (!createProfile(QStringLiteral("Player 1"), &newId)) {
+        // another instance seeded the root at the same time
+        return;
+    }
     m_activeId = newId;
     seedDebugProfiles();
+    // start the new root from a snapshot rather than a log
+    save();
 }
 
 void ProfileManager::seedDebugProfiles()
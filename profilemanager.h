@@ -5,6 +5,12 @@
 #include <QHash>
 #include <QString>
 #include <QVector>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+class QJsonObject;
+class QLockFile;
 
 struct UserProfile
 {
@@ -14,20 +20,41 @@ struct UserProfile
     QDateTime lastActiveAt;
 };
 
+// Profile metadata lives in profiles.json plus profiles.log, an append-only
+// list of changes since the snapshot was written. Switching, creating and
+// deleting append one line; the log is folded back into the snapshot once it
+// grows past a few hundred entries. Loading never writes.
+//
+// Several instances may share a root. Readers take no lock: each snapshot
+// carries a version, and a read that races a compaction retries. Writers
+// hold profiles.lock for the one change, first catching up with whatever
+// other instances wrote since; lastActiveAt merges to the latest value.
+// Which profile is active stays this instance's own choice.
 class ProfileManager
 {
 public:
     ProfileManager();
+    explicit ProfileManager(const QString &rootPath);
 
     bool load();
-    bool save() const;
+    // rewrites profiles.json and empties the log
+    bool save();
+    // catches up with changes other instances made to the root; true if
+    // there were any
+    bool refresh();
 
     QVector<UserProfile> profiles() const;
+    int profileCount() const;
+    const UserProfile &profileAt(int index) const;
+    int indexOfProfile(const QString &id) const;
+    // bumped whenever a profile is added or removed
+    int revision() const;
     QString activeProfileId() const;
     UserProfile activeProfile() const;
 
     bool setActiveProfile(const QString &id);
     bool createProfile(const QString &name, QString *outId = nullptr);
+    // fails while any instance has the profile open
     bool deleteProfile(const QString &id);
     bool profileNameExists(const QString &name) const;
 
@@ -35,9 +62,42 @@ public:
     QString activeProfileDirectory() const;
     QString rootPath() const;
 
+    // parses profiles.json and replays profiles.log under rootPath without
+    // creating or changing anything
+    static QVector<UserProfile> readProfiles(const QString &rootPath, QString *activeId = nullptr, int *logEntries = nullptr);
+
+    // threads for a pass over profileCount profiles: jobs, or one per core
+    // when jobs is 0, but never more than there are profiles
+    static int workerCount(int jobs, int profileCount);
+    // Hands the profiles out one at a time to that many threads and waits
+    // for them. work gets the profile and its thread's index, so each
+    // thread can reduce into its own partial result.
+    static void forEachProfile(const QVector<UserProfile> &profiles, int workers,
+                               const std::function<void(const UserProfile &, int)> &work);
+    // rows with an id back in profiles.json order, whichever thread made them
+    template <typename Row>
+    static void sortByProfileOrder(const QVector<UserProfile> &profiles, QVector<Row> *rows)
+    {
+        QHash<QString, int> order;
+        for (int i = 0; i < profiles.size(); ++i) {
+            order.insert(profiles.at(i).id, i);
+        }
+        std::sort(rows->begin(), rows->end(), [&order](const Row &a, const Row &b) {
+            return order.value(a.id) < order.value(b.id);
+        });
+    }
+
 private:
     bool ensureRoot() const;
     QString metadataPath() const;
+    QString logPath() const;
+    // held while one change is written; refreshes from disk once locked
+    std::unique_ptr<QLockFile> lockMetadata();
+    bool metadataChanged() const;
+    bool writeSnapshot();
+    bool appendLog(const QJsonObject &entry);
+    bool logActive(const QString &id);
+    void rebuildIndexes();
     QString legacyStatePath() const;
     QString generateId() const;
     UserProfile *findProfile(const QString &id);
@@ -49,8 +109,16 @@ private:
     void seedProfileState(const QString &profileId, int levelIndex, int tokens, double countedHours, int levelsSinceSpecial, bool completed);
 
     QVector<UserProfile> m_profiles;
+    QHash<QString, int> m_idIndex;
+    // keyed by QString::toCaseFolded()
+    QHash<QString, int> m_nameIndex;
     QString m_activeId;
     QString m_rootPath;
+    int m_logEntries = 0;
+    // what this instance last read or wrote, to spot other writers
+    int m_version = 0;
+    qint64 m_logBytes = 0;
+    int m_revision = 0;
 };
 
 #endif // PROFILEMANAGER_H
@@ -0,0 +1,860 @@
+#include "psychometrics.h"
+
+#include "profilemanager.h"
+#include "tableexport.h"
+#include "trainingmodel.h"
+#include "trialjournal.h"
+#include "trialscheduler.h"
+
+#include <QAtomicInt>
+#include <QCborArray>
+#include <QCborValue>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace {
+constexpr int kFormatVersion = 1;
+constexpr int kCategoryCount = PitchStatistics::kCategoryCount;
+constexpr int kReadChunk = 65536;
+// longer pauses inside a level count as this much
+constexpr qint64 kMaxGapMs = 60 * 1000;
+constexpr int kMinFitLevels = 4;
+// per hour for the exponential, the exponent for the power curve
+constexpr double kMinRate = 0.01;
+constexpr double kMaxExponentialRate = 100.0;
+constexpr double kMaxPowerRate = 10.0;
+constexpr int kRateGridSteps = 40;
+constexpr int kRateRefineSteps = 24;
+constexpr quint64 kBootstrapSeed = 0x7073796368ull;
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+// per category and resample: d', criterion, then asymptote and rate of
+// the exponential and the power fit
+constexpr int kReplicateStats = 6;
+
+enum class CurveShape {
+    Exponential,
+    Power
+};
+
+struct CurvePoint {
+    double hours = 0.0;
+    double accuracy = 0.0;
+    double weight = 0.0;
+};
+
+QString categoryName(int category)
+{
+    if (category == PitchStatistics::kOtherCategory) {
+        return QStringLiteral("OUT");
+    }
+    return TrainingSpec::chromaticOrder().value(category);
+}
+
+// Acklam's rational approximation with one Halley step, good to about
+// 1e-15 over (0, 1)
+double inverseNormal(double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                               6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                               3.754408661907416e+00};
+    constexpr double kLow = 0.02425;
+    constexpr double kSqrtTwoPi = 2.5066282746310002;
+
+    double x = 0.0;
+    if (p < kLow) {
+        const double q = std::sqrt(-2.0 * std::log(p));
+        x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+            / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+    } else if (p <= 1.0 - kLow) {
+        const double q = p - 0.5;
+        const double r = q * q;
+        x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q
+            / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.0);
+    } else {
+        const double q = std::sqrt(-2.0 * std::log(1.0 - p));
+        x = -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+            / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+    }
+    const double e = 0.5 * std::erfc(-x / std::sqrt(2.0)) - p;
+    const double u = e * kSqrtTwoPi * std::exp(x * x / 2.0);
+    return x - u / (1.0 + x * u / 2.0);
+}
+
+// d' and c of one category against the rest; hits and false alarms get
+// half a count added so perfect scores stay finite
+void sensitivity(const ResponseCounts &counts, int trials, PitchPsychometrics *result)
+{
+    const int noise = trials - counts.presented;
+    const int falseAlarms = counts.responded - counts.correct;
+    result->hitRate = counts.presented > 0 ? static_cast<double>(counts.correct) / counts.presented : 0.0;
+    result->falseAlarmRate = noise > 0 ? static_cast<double>(falseAlarms) / noise : 0.0;
+    if (counts.presented == 0 || noise <= 0) {
+        result->dPrime = kNaN;
+        result->criterion = kNaN;
+        return;
+    }
+    const double zHit = inverseNormal((counts.correct + 0.5) / (counts.presented + 1.0));
+    const double zFalseAlarm = inverseNormal((falseAlarms + 0.5) / (noise + 1.0));
+    result->dPrime = zHit - zFalseAlarm;
+    result->criterion = -(zHit + zFalseAlarm) / 2.0;
+}
+
+double basis(CurveShape shape, double hours, double rate)
+{
+    return shape == CurveShape::Exponential ? std::exp(-rate * hours) : std::pow(1.0 + hours, -rate);
+}
+
+struct LinearFit {
+    bool valid = false;
+    double asymptote = 0.0;
+    double gain = 0.0;
+    double sse = 0.0;
+};
+
+// For a fixed rate the curve is linear in the asymptote and the gain, so
+// they come from weighted least squares and only the rate is searched.
+LinearFit fitAtRate(const std::vector<CurvePoint> &points, CurveShape shape, double rate)
+{
+    double sw = 0.0;
+    double sf = 0.0;
+    double sy = 0.0;
+    double sff = 0.0;
+    double sfy = 0.0;
+    double syy = 0.0;
+    for (const auto &point : points) {
+        const double f = basis(shape, point.hours, rate);
+        sw += point.weight;
+        sf += point.weight * f;
+        sy += point.weight * point.accuracy;
+        sff += point.weight * f * f;
+        sfy += point.weight * f * point.accuracy;
+        syy += point.weight * point.accuracy * point.accuracy;
+    }
+    LinearFit fit;
+    const double det = sw * sff - sf * sf;
+    if (sw <= 0.0 || det <= 1e-12 * sw * sw) {
+        return fit;
+    }
+    const double slope = (sw * sfy - sf * sy) / det;
+    const double intercept = (sy - slope * sf) / sw;
+    fit.valid = true;
+    fit.asymptote = intercept;
+    fit.gain = -slope;
+    fit.sse = qMax(0.0, syy - intercept * sy - slope * sfy);
+    return fit;
+}
+
+// Grid over log(rate), then a golden-section search around the best grid
+// point. A rate at either end of the range means the data do not pin it.
+CurveFit fitCurve(const std::vector<CurvePoint> &points, CurveShape shape)
+{
+    CurveFit result;
+    if (static_cast<int>(points.size()) < kMinFitLevels) {
+        return result;
+    }
+    const double lo = std::log(kMinRate);
+    const double hi = std::log(shape == CurveShape::Exponential ? kMaxExponentialRate : kMaxPowerRate);
+    const double step = (hi - lo) / (kRateGridSteps - 1);
+    auto cost = [&](double logRate) {
+        const LinearFit fit = fitAtRate(points, shape, std::exp(logRate));
+        return fit.valid ? fit.sse : std::numeric_limits<double>::infinity();
+    };
+
+    int best = -1;
+    double bestCost = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < kRateGridSteps; ++i) {
+        const double value = cost(lo + i * step);
+        if (value < bestCost) {
+            bestCost = value;
+            best = i;
+        }
+    }
+    if (best < 0) {
+        return result;
+    }
+
+    constexpr double kInverseGolden = 0.6180339887498949;
+    double a = lo + qMax(0, best - 1) * step;
+    double b = lo + qMin(kRateGridSteps - 1, best + 1) * step;
+    double x1 = b - kInverseGolden * (b - a);
+    double x2 = a + kInverseGolden * (b - a);
+    double f1 = cost(x1);
+    double f2 = cost(x2);
+    for (int i = 0; i < kRateRefineSteps; ++i) {
+        if (f1 < f2) {
+            b = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = b - kInverseGolden * (b - a);
+            f1 = cost(x1);
+        } else {
+            a = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = a + kInverseGolden * (b - a);
+            f2 = cost(x2);
+        }
+    }
+    double logRate = (a + b) / 2.0;
+    if (cost(logRate) > bestCost) {
+        logRate = lo + best * step;
+    }
+
+    const double rate = std::exp(logRate);
+    const LinearFit fit = fitAtRate(points, shape, rate);
+    double sw = 0.0;
+    double sy = 0.0;
+    double syy = 0.0;
+    for (const auto &point : points) {
+        sw += point.weight;
+        sy += point.weight * point.accuracy;
+        syy += point.weight * point.accuracy * point.accuracy;
+    }
+    const double sst = syy - sy * sy / sw;
+    result.valid = fit.valid;
+    result.asymptote = fit.asymptote;
+    result.initial = fit.asymptote - fit.gain;
+    result.rate = rate;
+    result.r2 = sst > 0.0 ? 1.0 - fit.sse / sst : 0.0;
+    return result;
+}
+
+// the level counts summed, then d' and both fits per category
+struct Estimate {
+    std::array<PitchPsychometrics, kCategoryCount> pitches;
+};
+
+Estimate estimate(const QVector<PsychometricLevel> &levels, const int *picks, int pickCount)
+{
+    Estimate result;
+    int trials = 0;
+    std::array<std::vector<CurvePoint>, kCategoryCount> points;
+    for (int i = 0; i < pickCount; ++i) {
+        const PsychometricLevel &level = levels.at(picks ? picks[i] : i);
+        trials += level.trials;
+        for (int c = 0; c < kCategoryCount; ++c) {
+            const ResponseCounts &counts = level.counts[c];
+            ResponseCounts &totals = result.pitches[c].totals;
+            totals.presented += counts.presented;
+            totals.correct += counts.correct;
+            totals.responded += counts.responded;
+            totals.timeouts += counts.timeouts;
+            totals.semitoneErrors += counts.semitoneErrors;
+            if (counts.presented > 0) {
+                points[c].push_back({level.hours, static_cast<double>(counts.correct) / counts.presented,
+                                     static_cast<double>(counts.presented)});
+            }
+        }
+    }
+    for (int c = 0; c < kCategoryCount; ++c) {
+        PitchPsychometrics &pitch = result.pitches[c];
+        sensitivity(pitch.totals, trials, &pitch);
+        const int wrong = pitch.totals.presented - pitch.totals.correct;
+        pitch.semitoneErrorShare = wrong > 0 ? static_cast<double>(pitch.totals.semitoneErrors) / wrong : 0.0;
+        pitch.exponential = fitCurve(points[c], CurveShape::Exponential);
+        pitch.power = fitCurve(points[c], CurveShape::Power);
+    }
+    return result;
+}
+
+ConfidenceInterval percentileInterval(std::vector<double> values, int samples)
+{
+    ConfidenceInterval interval;
+    values.erase(std::remove_if(values.begin(), values.end(), [](double v) { return !std::isfinite(v); }),
+                 values.end());
+    // an interval over a minority of the resamples would be misleading
+    if (values.empty() || static_cast<int>(values.size()) * 2 < samples) {
+        return interval;
+    }
+    std::sort(values.begin(), values.end());
+    auto at = [&values](double q) {
+        const double position = q * (values.size() - 1);
+        const std::size_t below = static_cast<std::size_t>(position);
+        const std::size_t above = qMin(below + 1, values.size() - 1);
+        return values[below] + (values[above] - values[below]) * (position - below);
+    };
+    interval.low = at(0.025);
+    interval.high = at(0.975);
+    return interval;
+}
+
+QCborArray countsToCbor(const ResponseCounts &counts)
+{
+    return {counts.presented, counts.correct, counts.responded, counts.timeouts, counts.semitoneErrors};
+}
+
+ResponseCounts countsFromCbor(const QCborArray &array)
+{
+    ResponseCounts counts;
+    counts.presented = static_cast<int>(array.at(0).toInteger());
+    counts.correct = static_cast<int>(array.at(1).toInteger());
+    counts.responded = static_cast<int>(array.at(2).toInteger());
+    counts.timeouts = static_cast<int>(array.at(3).toInteger());
+    counts.semitoneErrors = static_cast<int>(array.at(4).toInteger());
+    return counts;
+}
+
+QCborArray levelToCbor(const PsychometricLevel &level)
+{
+    QCborArray array{level.levelIndex, level.trials, level.hours};
+    for (const auto &counts : level.counts) {
+        array.append(countsToCbor(counts));
+    }
+    return array;
+}
+
+PsychometricLevel levelFromCbor(const QCborArray &array)
+{
+    PsychometricLevel level;
+    level.levelIndex = static_cast<int>(array.at(0).toInteger());
+    level.trials = static_cast<int>(array.at(1).toInteger());
+    level.hours = array.at(2).toDouble();
+    for (int c = 0; c < kCategoryCount; ++c) {
+        level.counts[c] = countsFromCbor(array.at(3 + c).toArray());
+    }
+    return level;
+}
+
+// fixed-order numbers, like the trial window in PitchStatistics::toCbor
+void appendInterval(QCborArray *array, const ConfidenceInterval &interval)
+{
+    array->append(interval.low);
+    array->append(interval.high);
+}
+
+ConfidenceInterval readInterval(const QCborArray &array, int at)
+{
+    ConfidenceInterval interval;
+    interval.low = array.at(at).toDouble(kNaN);
+    interval.high = array.at(at + 1).toDouble(kNaN);
+    return interval;
+}
+
+void appendFit(QCborArray *array, const CurveFit &fit)
+{
+    array->append(fit.valid);
+    array->append(fit.asymptote);
+    array->append(fit.initial);
+    array->append(fit.rate);
+    array->append(fit.r2);
+    appendInterval(array, fit.asymptoteCi);
+    appendInterval(array, fit.rateCi);
+}
+
+CurveFit readFit(const QCborArray &array, int at)
+{
+    CurveFit fit;
+    fit.valid = array.at(at).toBool();
+    fit.asymptote = array.at(at + 1).toDouble();
+    fit.initial = array.at(at + 2).toDouble();
+    fit.rate = array.at(at + 3).toDouble();
+    fit.r2 = array.at(at + 4).toDouble();
+    fit.asymptoteCi = readInterval(array, at + 5);
+    fit.rateCi = readInterval(array, at + 7);
+    return fit;
+}
+
+constexpr int kFitCborSize = 9;
+
+QJsonValue intervalJson(const ConfidenceInterval &interval)
+{
+    if (!std::isfinite(interval.low) || !std::isfinite(interval.high)) {
+        return QJsonValue();
+    }
+    return QJsonArray{interval.low, interval.high};
+}
+
+QJsonValue fitJson(const CurveFit &fit)
+{
+    if (!fit.valid) {
+        return QJsonValue();
+    }
+    return QJsonObject{
+        {QStringLiteral("asymptote"), fit.asymptote},
+        {QStringLiteral("asymptoteCi"), intervalJson(fit.asymptoteCi)},
+        {QStringLiteral("initial"), fit.initial},
+        {QStringLiteral("rate"), fit.rate},
+        {QStringLiteral("rateCi"), intervalJson(fit.rateCi)},
+        {QStringLiteral("r2"), fit.r2}
+    };
+}
+
+QJsonValue numberJson(double value)
+{
+    return std::isfinite(value) ? QJsonValue(value) : QJsonValue();
+}
+}
+
+int PsychometricModel::update(const QString &journalPath)
+{
+    const quint16 noAnswers = JournalRecord::Special | JournalRecord::TestBattery;
+    int added = 0;
+    auto addTime = [this](qint64 timestampMs) {
+        m_hours += qBound<qint64>(0, timestampMs - m_lastTimestampMs, kMaxGapMs) / 3600000.0;
+        m_lastTimestampMs = timestampMs;
+    };
+
+    forever {
+        qint64 end = m_consumed;
+        const auto records = TrialJournal::readRange(journalPath, m_consumed, kReadChunk, &end);
+        if (end <= m_consumed) {
+            break;
+        }
+        m_consumed = end;
+        for (const auto &record : records) {
+            switch (record.kind) {
+            case JournalRecord::LevelStarted:
+                m_blockOpen = !record.hasFlag(JournalRecord::TestBattery);
+                m_blockCounted = (record.flags & noAnswers) == 0;
+                m_lastTimestampMs = record.timestampMs;
+                m_pending = PsychometricLevel();
+                m_pending.levelIndex = record.levelIndex;
+                break;
+            case JournalRecord::Trial: {
+                if (!m_blockOpen) {
+                    break;
+                }
+                addTime(record.timestampMs);
+                if (!m_blockCounted) {
+                    break;
+                }
+                const bool outOfBounds = record.hasFlag(JournalRecord::OutOfBounds);
+                const int presented = outOfBounds ? PitchStatistics::kOtherCategory : record.presented;
+                if (presented < 0 || presented >= kCategoryCount) {
+                    break;
+                }
+                ++m_pending.trials;
+                ResponseCounts &counts = m_pending.counts[presented];
+                ++counts.presented;
+                if (record.hasFlag(JournalRecord::Correct)) {
+                    ++counts.correct;
+                } else if (record.hasFlag(JournalRecord::SemitoneError)) {
+                    ++counts.semitoneErrors;
+                }
+                if (record.hasFlag(JournalRecord::TimedOut) || record.response < 0) {
+                    ++counts.timeouts;
+                } else if (record.response < kCategoryCount) {
+                    ++m_pending.counts[record.response].responded;
+                }
+                break;
+            }
+            case JournalRecord::LevelFinished:
+                if (m_blockOpen) {
+                    addTime(record.timestampMs);
+                    if (m_blockCounted && m_pending.trials > 0) {
+                        m_pending.hours = m_hours;
+                        m_levels.append(m_pending);
+                        ++added;
+                    }
+                }
+                m_blockOpen = false;
+                break;
+            default:
+                if (m_blockOpen) {
+                    addTime(record.timestampMs);
+                }
+                m_blockOpen = false;
+                break;
+            }
+        }
+    }
+    return added;
+}
+
+qint64 PsychometricModel::consumedRecords() const
+{
+    return m_consumed;
+}
+
+double PsychometricModel::hours() const
+{
+    return m_hours;
+}
+
+const QVector<PsychometricLevel> &PsychometricModel::levels() const
+{
+    return m_levels;
+}
+
+QVector<PitchPsychometrics> PsychometricModel::analyse(int bootstrapSamples, int jobs) const
+{
+    const int levelCount = static_cast<int>(m_levels.size());
+    const Estimate full = estimate(m_levels, nullptr, levelCount);
+    QVector<PitchPsychometrics> result(full.pitches.begin(), full.pitches.end());
+    if (bootstrapSamples <= 0 || levelCount < 2) {
+        return result;
+    }
+
+    // one slot per resample, so workers never share a write
+    std::vector<double> samples(static_cast<std::size_t>(bootstrapSamples) * kCategoryCount * kReplicateStats);
+    QAtomicInt nextSample(0);
+    auto worker = [&]() {
+        std::vector<int> picks(levelCount);
+        forever {
+            const int sample = nextSample.fetchAndAddRelaxed(1);
+            if (sample >= bootstrapSamples) {
+                return;
+            }
+            ScheduleRng rng(kBootstrapSeed ^ (static_cast<quint64>(sample) * 0xd1342543de82ef95ull));
+            for (int &pick : picks) {
+                pick = rng.bounded(levelCount);
+            }
+            const Estimate resample = estimate(m_levels, picks.data(), levelCount);
+            double *out = samples.data() + static_cast<std::size_t>(sample) * kCategoryCount * kReplicateStats;
+            for (const auto &pitch : resample.pitches) {
+                out[0] = pitch.dPrime;
+                out[1] = pitch.criterion;
+                out[2] = pitch.exponential.valid ? pitch.exponential.asymptote : kNaN;
+                out[3] = pitch.exponential.valid ? pitch.exponential.rate : kNaN;
+                out[4] = pitch.power.valid ? pitch.power.asymptote : kNaN;
+                out[5] = pitch.power.valid ? pitch.power.rate : kNaN;
+                out += kReplicateStats;
+            }
+        }
+    };
+
+    const int threads = qBound(1, jobs > 0 ? jobs : QThread::idealThreadCount(), bootstrapSamples);
+    std::vector<std::unique_ptr<QThread>> pool;
+    for (int i = 1; i < threads; ++i) {
+        pool.emplace_back(QThread::create(worker));
+        pool.back()->start();
+    }
+    worker();
+    for (auto &thread : pool) {
+        thread->wait();
+    }
+
+    std::vector<double> values(bootstrapSamples);
+    auto interval = [&](int category, int stat) {
+        for (int s = 0; s < bootstrapSamples; ++s) {
+            values[s] = samples[(static_cast<std::size_t>(s) * kCategoryCount + category) * kReplicateStats + stat];
+        }
+        return percentileInterval(values, bootstrapSamples);
+    };
+    for (int c = 0; c < kCategoryCount; ++c) {
+        PitchPsychometrics &pitch = result[c];
+        pitch.dPrimeCi = interval(c, 0);
+        pitch.criterionCi = interval(c, 1);
+        pitch.exponential.asymptoteCi = interval(c, 2);
+        pitch.exponential.rateCi = interval(c, 3);
+        pitch.power.asymptoteCi = interval(c, 4);
+        pitch.power.rateCi = interval(c, 5);
+    }
+    return result;
+}
+
+QCborMap PsychometricModel::toCbor() const
+{
+    QCborMap map;
+    map[QStringLiteral("version")] = kFormatVersion;
+    map[QStringLiteral("consumed")] = m_consumed;
+    map[QStringLiteral("hours")] = m_hours;
+    QCborArray levels;
+    for (const auto &level : m_levels) {
+        levels.append(levelToCbor(level));
+    }
+    map[QStringLiteral("levels")] = levels;
+    map[QStringLiteral("blockOpen")] = m_blockOpen;
+    map[QStringLiteral("blockCounted")] = m_blockCounted;
+    map[QStringLiteral("lastTimestamp")] = m_lastTimestampMs;
+    map[QStringLiteral("pending")] = levelToCbor(m_pending);
+    return map;
+}
+
+PsychometricModel PsychometricModel::fromCbor(const QCborMap &map)
+{
+    PsychometricModel model;
+    if (map.value(QStringLiteral("version")).toInteger() != kFormatVersion) {
+        return model;
+    }
+    model.m_consumed = map.value(QStringLiteral("consumed")).toInteger();
+    model.m_hours = map.value(QStringLiteral("hours")).toDouble();
+    const QCborArray levels = map.value(QStringLiteral("levels")).toArray();
+    model.m_levels.reserve(levels.size());
+    for (const auto &value : levels) {
+        model.m_levels.append(levelFromCbor(value.toArray()));
+    }
+    model.m_blockOpen = map.value(QStringLiteral("blockOpen")).toBool();
+    model.m_blockCounted = map.value(QStringLiteral("blockCounted")).toBool();
+    model.m_lastTimestampMs = map.value(QStringLiteral("lastTimestamp")).toInteger();
+    model.m_pending = levelFromCbor(map.value(QStringLiteral("pending")).toArray());
+    return model;
+}
+
+QJsonObject PsychometricProfile::toJson() const
+{
+    QJsonArray rows;
+    for (int c = 0; c < pitches.size(); ++c) {
+        const PitchPsychometrics &pitch = pitches.at(c);
+        rows.append(QJsonObject{
+            {QStringLiteral("pitch"), categoryName(c)},
+            {QStringLiteral("presented"), pitch.totals.presented},
+            {QStringLiteral("correct"), pitch.totals.correct},
+            {QStringLiteral("responded"), pitch.totals.responded},
+            {QStringLiteral("timeouts"), pitch.totals.timeouts},
+            {QStringLiteral("hitRate"), pitch.hitRate},
+            {QStringLiteral("falseAlarmRate"), pitch.falseAlarmRate},
+            {QStringLiteral("dPrime"), numberJson(pitch.dPrime)},
+            {QStringLiteral("dPrimeCi"), intervalJson(pitch.dPrimeCi)},
+            {QStringLiteral("criterion"), numberJson(pitch.criterion)},
+            {QStringLiteral("criterionCi"), intervalJson(pitch.criterionCi)},
+            {QStringLiteral("semitoneErrorShare"), pitch.semitoneErrorShare},
+            {QStringLiteral("exponential"), fitJson(pitch.exponential)},
+            {QStringLiteral("power"), fitJson(pitch.power)}
+        });
+    }
+    return {
+        {QStringLiteral("id"), id},
+        {QStringLiteral("name"), name},
+        {QStringLiteral("levels"), levels},
+        {QStringLiteral("trials"), trials},
+        {QStringLiteral("hours"), hours},
+        {QStringLiteral("bootstrapSamples"), bootstrapSamples},
+        {QStringLiteral("pitches"), rows}
+    };
+}
+
+QCborMap PsychometricProfile::toCbor() const
+{
+    QCborArray rows;
+    for (const auto &pitch : pitches) {
+        QCborArray row = countsToCbor(pitch.totals);
+        row.append(pitch.hitRate);
+        row.append(pitch.falseAlarmRate);
+        row.append(pitch.dPrime);
+        row.append(pitch.criterion);
+        appendInterval(&row, pitch.dPrimeCi);
+        appendInterval(&row, pitch.criterionCi);
+        row.append(pitch.semitoneErrorShare);
+        appendFit(&row, pitch.exponential);
+        appendFit(&row, pitch.power);
+        rows.append(row);
+    }
+    QCborMap map;
+    map[QStringLiteral("levels")] = levels;
+    map[QStringLiteral("trials")] = trials;
+    map[QStringLiteral("hours")] = hours;
+    map[QStringLiteral("bootstrapSamples")] = bootstrapSamples;
+    map[QStringLiteral("pitches")] = rows;
+    return map;
+}
+
+PsychometricProfile PsychometricProfile::fromCbor(const QCborMap &map)
+{
+    PsychometricProfile profile;
+    profile.levels = static_cast<int>(map.value(QStringLiteral("levels")).toInteger());
+    profile.trials = map.value(QStringLiteral("trials")).toInteger();
+    profile.hours = map.value(QStringLiteral("hours")).toDouble();
+    profile.bootstrapSamples = static_cast<int>(map.value(QStringLiteral("bootstrapSamples")).toInteger());
+    const QCborArray rows = map.value(QStringLiteral("pitches")).toArray();
+    for (const auto &value : rows) {
+        const QCborArray row = value.toArray();
+        PitchPsychometrics pitch;
+        pitch.totals = countsFromCbor(row);
+        pitch.hitRate = row.at(5).toDouble();
+        pitch.falseAlarmRate = row.at(6).toDouble();
+        pitch.dPrime = row.at(7).toDouble(kNaN);
+        pitch.criterion = row.at(8).toDouble(kNaN);
+        pitch.dPrimeCi = readInterval(row, 9);
+        pitch.criterionCi = readInterval(row, 11);
+        pitch.semitoneErrorShare = row.at(13).toDouble();
+        pitch.exponential = readFit(row, 14);
+        pitch.power = readFit(row, 14 + kFitCborSize);
+        profile.pitches.append(pitch);
+    }
+    return profile;
+}
+
+PsychometricCache::PsychometricCache(const QString &directory)
+    : m_directory(directory)
+{
+}
+
+QString PsychometricCache::defaultDirectory(const QString &rootPath)
+{
+    return QDir(rootPath).filePath(QStringLiteral("analytics/psychometrics"));
+}
+
+QString PsychometricCache::directory() const
+{
+    return m_directory;
+}
+
+PsychometricProfile PsychometricCache::refresh(const UserProfile &profile, const QString &profileDirectory,
+                                               int bootstrapSamples, int jobs)
+{
+    const QString path = QDir(m_directory).filePath(profile.id + QStringLiteral(".cbor"));
+    QCborMap cached;
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        cached = QCborValue::fromCbor(file.readAll()).toMap();
+        file.close();
+    }
+
+    PsychometricModel model = PsychometricModel::fromCbor(cached.value(QStringLiteral("model")).toMap());
+    const int added = model.update(TrialJournal::pathForProfile(profileDirectory));
+    PsychometricProfile result = PsychometricProfile::fromCbor(cached.value(QStringLiteral("analysis")).toMap());
+    const bool stale = added > 0 || result.levels != static_cast<int>(model.levels().size())
+                       || result.bootstrapSamples != bootstrapSamples
+                       || result.pitches.size() != kCategoryCount;
+    if (stale) {
+        result.levels = static_cast<int>(model.levels().size());
+        result.trials = 0;
+        for (const auto &level : model.levels()) {
+            result.trials += level.trials;
+        }
+        result.bootstrapSamples = bootstrapSamples;
+        result.pitches = model.analyse(bootstrapSamples, jobs);
+    }
+    result.id = profile.id;
+    result.name = profile.name;
+    result.hours = model.hours();
+
+    if (stale || model.consumedRecords() != cached.value(QStringLiteral("model")).toMap()
+                                                  .value(QStringLiteral("consumed")).toInteger()) {
+        // a cache that cannot be written only costs a full read next time
+        QCborMap map;
+        map[QStringLiteral("model")] = model.toCbor();
+        map[QStringLiteral("analysis")] = result.toCbor();
+        if (QDir().mkpath(m_directory)) {
+            writeFileAtomically(path, map.toCborValue().toCbor());
+        }
+    }
+    return result;
+}
+
+int PsychometricReport::profileCount() const
+{
+    return static_cast<int>(m_profiles.size());
+}
+
+const QVector<PsychometricProfile> &PsychometricReport::profiles() const
+{
+    return m_profiles;
+}
+
+QJsonObject PsychometricReport::toJson() const
+{
+    QJsonArray profiles;
+    for (const auto &profile : m_profiles) {
+        profiles.append(profile.toJson());
+    }
+    return {
+        {QStringLiteral("profiles"), profiles}
+    };
+}
+
+QByteArray PsychometricReport::pitchesCsv() const
+{
+    ExportChunk chunk({
+        {QStringLiteral("profile_id"), ExportType::Utf8},
+        {QStringLiteral("pitch"), ExportType::Utf8},
+        {QStringLiteral("presented"), ExportType::Int32},
+        {QStringLiteral("correct"), ExportType::Int32},
+        {QStringLiteral("responded"), ExportType::Int32},
+        {QStringLiteral("timeouts"), ExportType::Int32},
+        {QStringLiteral("hit_rate"), ExportType::Float64},
+        {QStringLiteral("false_alarm_rate"), ExportType::Float64},
+        {QStringLiteral("d_prime"), ExportType::Float64},
+        {QStringLiteral("d_prime_low"), ExportType::Float64},
+        {QStringLiteral("d_prime_high"), ExportType::Float64},
+        {QStringLiteral("criterion"), ExportType::Float64},
+        {QStringLiteral("criterion_low"), ExportType::Float64},
+        {QStringLiteral("criterion_high"), ExportType::Float64},
+        {QStringLiteral("semitone_error_share"), ExportType::Float64},
+        {QStringLiteral("exp_asymptote"), ExportType::Float64},
+        {QStringLiteral("exp_asymptote_low"), ExportType::Float64},
+        {QStringLiteral("exp_asymptote_high"), ExportType::Float64},
+        {QStringLiteral("exp_initial"), ExportType::Float64},
+        {QStringLiteral("exp_rate"), ExportType::Float64},
+        {QStringLiteral("exp_rate_low"), ExportType::Float64},
+        {QStringLiteral("exp_rate_high"), ExportType::Float64},
+        {QStringLiteral("exp_r2"), ExportType::Float64},
+        {QStringLiteral("pow_asymptote"), ExportType::Float64},
+        {QStringLiteral("pow_asymptote_low"), ExportType::Float64},
+        {QStringLiteral("pow_asymptote_high"), ExportType::Float64},
+        {QStringLiteral("pow_initial"), ExportType::Float64},
+        {QStringLiteral("pow_rate"), ExportType::Float64},
+        {QStringLiteral("pow_rate_low"), ExportType::Float64},
+        {QStringLiteral("pow_rate_high"), ExportType::Float64},
+        {QStringLiteral("pow_r2"), ExportType::Float64}
+    });
+    auto addFit = [&chunk](const CurveFit &fit) {
+        chunk.addDouble(fit.valid ? fit.asymptote : kNaN);
+        chunk.addDouble(fit.asymptoteCi.low);
+        chunk.addDouble(fit.asymptoteCi.high);
+        chunk.addDouble(fit.valid ? fit.initial : kNaN);
+        chunk.addDouble(fit.valid ? fit.rate : kNaN);
+        chunk.addDouble(fit.rateCi.low);
+        chunk.addDouble(fit.rateCi.high);
+        chunk.addDouble(fit.valid ? fit.r2 : kNaN);
+    };
+    for (const auto &profile : m_profiles) {
+        for (int c = 0; c < profile.pitches.size(); ++c) {
+            const PitchPsychometrics &pitch = profile.pitches.at(c);
+            chunk.addString(profile.id);
+            chunk.addString(categoryName(c));
+            chunk.addInt(pitch.totals.presented);
+            chunk.addInt(pitch.totals.correct);
+            chunk.addInt(pitch.totals.responded);
+            chunk.addInt(pitch.totals.timeouts);
+            chunk.addDouble(pitch.hitRate);
+            chunk.addDouble(pitch.falseAlarmRate);
+            chunk.addDouble(pitch.dPrime);
+            chunk.addDouble(pitch.dPrimeCi.low);
+            chunk.addDouble(pitch.dPrimeCi.high);
+            chunk.addDouble(pitch.criterion);
+            chunk.addDouble(pitch.criterionCi.low);
+            chunk.addDouble(pitch.criterionCi.high);
+            chunk.addDouble(pitch.semitoneErrorShare);
+            addFit(pitch.exponential);
+            addFit(pitch.power);
+        }
+    }
+    return chunk.toCsv();
+}
+
+PsychometricReport PsychometricReport::build(const PsychometricOptions &options)
+{
+    const QDir root(options.rootPath);
+    const QVector<UserProfile> profiles = ProfileManager::readProfiles(options.rootPath);
+    const int jobs = ProfileManager::workerCount(options.jobs, static_cast<int>(profiles.size()));
+
+    // profiles are the unit of parallel work here, so each bootstrap runs
+    // on its reader's thread
+    PsychometricCache cache(PsychometricCache::defaultDirectory(options.rootPath));
+    std::vector<QVector<PsychometricProfile>> partials(jobs);
+    ProfileManager::forEachProfile(profiles, jobs, [&](const UserProfile &profile, int worker) {
+        partials[worker].append(cache.refresh(profile, root.filePath(profile.id), options.bootstrapSamples, 1));
+    });
+
+    PsychometricReport report;
+    for (const auto &partial : partials) {
+        report.m_profiles += partial;
+    }
+    ProfileManager::sortByProfileOrder(profiles, &report.m_profiles);
+    return report;
+}
+
+bool PsychometricReport::write(const QString &directory) const
+{
+    if (!QDir().mkpath(directory)) {
+        return false;
+    }
+    const QDir dir(directory);
+    return writeFileAtomically(dir.filePath(QStringLiteral("psychometrics.json")), QJsonDocument(toJson()).toJson())
+           && writeFileAtomically(dir.filePath(QStringLiteral("psychometrics_pitches.csv")), pitchesCsv());
+}
@@ -0,0 +1,165 @@
+#ifndef PSYCHOMETRICS_H
+#define PSYCHOMETRICS_H
+
+#include <QByteArray>
+#include <QCborMap>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+#include <array>
+#include <limits>
+
+#include "pitchstatistics.h"
+
+struct UserProfile;
+
+struct PsychometricOptions {
+    QString rootPath;
+    // resamples per confidence interval; 0 leaves the intervals out
+    int bootstrapSamples = 200;
+    // 0 picks one thread per core
+    int jobs = 0;
+};
+
+// One category's answers; categories are those of PitchStatistics, with
+// out-of-bounds tones and the "Other" answer as kOtherCategory.
+struct ResponseCounts {
+    int presented = 0;
+    int correct = 0;
+    // times this category was the answer, right or wrong
+    int responded = 0;
+    int timeouts = 0;
+    int semitoneErrors = 0;
+};
+
+struct PsychometricLevel {
+    int levelIndex = 0;
+    int trials = 0;
+    // time spent in levels up to the end of this one
+    double hours = 0.0;
+    std::array<ResponseCounts, PitchStatistics::kCategoryCount> counts{};
+};
+
+// 2.5th and 97.5th bootstrap percentiles, NaN without enough resamples
+struct ConfidenceInterval {
+    double low = std::numeric_limits<double>::quiet_NaN();
+    double high = std::numeric_limits<double>::quiet_NaN();
+};
+
+// accuracy = asymptote - (asymptote - initial) * f(hours), with
+// f = exp(-rate * hours) or (1 + hours)^-rate
+struct CurveFit {
+    bool valid = false;
+    double asymptote = 0.0;
+    double initial = 0.0;
+    double rate = 0.0;
+    double r2 = 0.0;
+    ConfidenceInterval asymptoteCi;
+    ConfidenceInterval rateCi;
+};
+
+struct PitchPsychometrics {
+    ResponseCounts totals;
+    double hitRate = 0.0;
+    double falseAlarmRate = 0.0;
+    // NaN for a category never presented
+    double dPrime = std::numeric_limits<double>::quiet_NaN();
+    double criterion = std::numeric_limits<double>::quiet_NaN();
+    ConfidenceInterval dPrimeCi;
+    ConfidenceInterval criterionCi;
+    // wrong answers one semitone off, as a share of all wrong answers
+    double semitoneErrorShare = 0.0;
+    CurveFit exponential;
+    CurveFit power;
+};
+
+// One profile's trial journal reduced to response counts per finished
+// level, read incrementally: update() picks up at the record where the
+// last call stopped and keeps a level that is still open for the next
+// call. Special exercises, test batteries and aborted levels add time but
+// no answers. Hours are the time between records inside level blocks,
+// with gaps of more than a minute cut to a minute.
+class PsychometricModel
+{
+public:
+    // returns the number of levels finished since the last update
+    int update(const QString &journalPath);
+
+    qint64 consumedRecords() const;
+    double hours() const;
+    const QVector<PsychometricLevel> &levels() const;
+
+    // Yes/no sensitivity and criterion of each category against all
+    // others, with the log-linear correction, and both learning curves of
+    // its accuracy per level over hours. The intervals resample whole
+    // levels; resample i always draws from the same seed, so the result
+    // does not depend on the thread count.
+    QVector<PitchPsychometrics> analyse(int bootstrapSamples, int jobs) const;
+
+    QCborMap toCbor() const;
+    static PsychometricModel fromCbor(const QCborMap &map);
+
+private:
+    qint64 m_consumed = 0;
+    double m_hours = 0.0;
+    QVector<PsychometricLevel> m_levels;
+
+    // the level block being read when the journal ran out
+    bool m_blockOpen = false;
+    bool m_blockCounted = false;
+    qint64 m_lastTimestampMs = 0;
+    PsychometricLevel m_pending;
+};
+
+struct PsychometricProfile {
+    QString id;
+    QString name;
+    int levels = 0;
+    qint64 trials = 0;
+    double hours = 0.0;
+    int bootstrapSamples = 0;
+    QVector<PitchPsychometrics> pitches;
+
+    QJsonObject toJson() const;
+    QCborMap toCbor() const;
+    static PsychometricProfile fromCbor(const QCborMap &map);
+};
+
+// Per-profile cache of the level counts and the last analysis, one CBOR
+// file per profile. refresh() reads only the journal records added since
+// and re-runs the analysis only when a level has finished since.
+class PsychometricCache
+{
+public:
+    explicit PsychometricCache(const QString &directory);
+
+    static QString defaultDirectory(const QString &rootPath);
+    QString directory() const;
+
+    PsychometricProfile refresh(const UserProfile &profile, const QString &profileDirectory, int bootstrapSamples,
+                                int jobs);
+
+private:
+    QString m_directory;
+};
+
+// Refreshes every profile's cache in parallel, one bootstrap thread per
+// profile, and collects the results in profiles.json order.
+class PsychometricReport
+{
+public:
+    int profileCount() const;
+    const QVector<PsychometricProfile> &profiles() const;
+
+    QJsonObject toJson() const;
+    QByteArray pitchesCsv() const;
+
+    static PsychometricReport build(const PsychometricOptions &options);
+    // psychometrics.json plus psychometrics_pitches.csv
+    bool write(const QString &directory) const;
+
+private:
+    QVector<PsychometricProfile> m_profiles;
+};
+
+#endif // PSYCHOMETRICS_H
@@ -0,0 +1,399 @@
+#include "replayengine.h"
+
+#include "profilemanager.h"
+#include "tableexport.h"
+#include "trainingmodel.h"
+#include "trialjournal.h"
+
+#include <QDir>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <vector>
+
+namespace {
+// journal records decoded per read
+constexpr int kReadChunk = 65536;
+constexpr quint8 kAnswerCorrect = 0x01;
+constexpr quint8 kAnswerBonus = 0x02;
+
+// one finished level attempt as the journal recorded it
+struct Attempt {
+    int levelIndex = 0;
+    int trialCount = 0;
+    bool passed = false;
+    std::vector<quint8> answers;
+};
+
+// one attempt scored at a run's current level
+struct LadderStep {
+    // false when the attempt ended early and the answers it has do not
+    // settle the level under this run's rules
+    bool replayable = false;
+    int played = 0;
+    LevelDecision decision;
+};
+
+// a walk up one protocol's ladder
+struct LadderRun {
+    const TrainingProtocol *protocol = nullptr;
+    int level = 0;
+    ReplayTally tally;
+
+    LadderStep evaluate(const Attempt &attempt) const
+    {
+        LadderStep step;
+        const int required = attempt.trialCount;
+        int correct = 0;
+        double bonus = 0.0;
+        const bool early = protocol->earlyDecision();
+        // a double only counts where this run's level allows tokens
+        const bool doubles = protocol->spec(level).tokensAllowed;
+        for (quint8 answer : attempt.answers) {
+            if (step.played >= required
+                || (early && protocol->outcomeSettled(level, required, step.played, correct, bonus))) {
+                break;
+            }
+            ++step.played;
+            if (answer & kAnswerCorrect) {
+                ++correct;
+            }
+            if (doubles && (answer & kAnswerBonus)) {
+                bonus += 1.0;
+            }
+        }
+        step.replayable = step.played >= required
+                          || (early && protocol->outcomeSettled(level, required, step.played, correct, bonus));
+        step.decision = protocol->decideLevel(level, required, correct, bonus);
+        return step;
+    }
+
+    void commit(const LadderStep &step, int required)
+    {
+        if (protocol->earlyDecision()) {
+            tally.trialsSkipped += qMax(0, required - step.played);
+        }
+        if (step.decision.passed) {
+            ++tally.passes;
+        }
+        tally.tokens += step.decision.tokensEarned;
+        if (step.decision.nextLevelIndex > level + 1) {
+            ++tally.skips;
+        }
+        level = step.decision.nextLevelIndex;
+    }
+
+    void moveTo(int next)
+    {
+        level = qBound(0, next, protocol->finalLevelIndex());
+    }
+
+    void finish()
+    {
+        tally.finalLevelIndex = level;
+        tally.finalStage = protocol->spec(level).stageIndex;
+    }
+};
+
+// the profile's own protocol, resolved as the session does but without
+// touching its state
+const TrainingProtocol &recordedProtocol(const QString &rootPath, const QString &id,
+                                         QHash<QString, TrainingProtocol> *cache)
+{
+    const TrainingProtocol &standard = TrainingProtocol::standard();
+    if (id.isEmpty() || id == standard.id()) {
+        return standard;
+    }
+    auto it = cache->find(id);
+    if (it == cache->end()) {
+        TrainingProtocol custom;
+        if (!TrainingProtocol::load(TrainingProtocol::pathFor(rootPath, id), &custom) || custom.id() != id) {
+            custom = standard;
+        }
+        it = cache->insert(id, custom);
+    }
+    return it.value();
+}
+
+QJsonObject tallyJson(const ReplayTally &tally)
+{
+    return {
+        {QStringLiteral("passes"), tally.passes},
+        {QStringLiteral("tokens"), tally.tokens},
+        {QStringLiteral("skips"), tally.skips},
+        {QStringLiteral("trialsSkipped"), tally.trialsSkipped}
+    };
+}
+}
+
+void ReplayReport::addProfile(const UserProfile &profile, const QString &profileDirectory,
+                              const TrainingProtocol &recorded, const TrainingProtocol &replayed)
+{
+    ReplayProfileRow row;
+    row.id = profile.id;
+    row.name = profile.name;
+    row.protocolId = recorded.id();
+
+    LadderRun before;
+    before.protocol = &recorded;
+    LadderRun after;
+    after.protocol = &replayed;
+
+    Attempt attempt;
+    bool open = false;
+    auto replay = [&]() {
+        if (row.levels == 0) {
+            // both walks start where the first attempt was played
+            before.level = recorded.spec(attempt.levelIndex).globalIndex;
+            after.level = replayed.spec(attempt.levelIndex).globalIndex;
+        }
+        if (before.level != attempt.levelIndex) {
+            ++row.divergedLevels;
+        }
+        row.trials += static_cast<qint64>(attempt.answers.size());
+        ++row.levels;
+        const LadderStep stepBefore = before.evaluate(attempt);
+        const LadderStep stepAfter = after.evaluate(attempt);
+        if (stepBefore.replayable && stepAfter.replayable) {
+            before.commit(stepBefore, attempt.trialCount);
+            after.commit(stepAfter, attempt.trialCount);
+            row.passToFail += stepBefore.decision.passed && !stepAfter.decision.passed ? 1 : 0;
+            row.failToPass += !stepBefore.decision.passed && stepAfter.decision.passed ? 1 : 0;
+            return;
+        }
+        // an early-decided attempt that one rule set cannot settle from
+        // the answers played is left out of the comparison; both walks
+        // move on as the recording did
+        ++row.unreplayable;
+        const int from = before.level;
+        before.moveTo(stepBefore.replayable ? stepBefore.decision.nextLevelIndex
+                                            : before.level + (attempt.passed ? 1 : 0));
+        after.moveTo(after.level + before.level - from);
+    };
+
+    const QString journal = TrialJournal::pathForProfile(profileDirectory);
+    const quint16 skipped = JournalRecord::Special | JournalRecord::TestBattery;
+    qint64 next = 0;
+    forever {
+        qint64 end = next;
+        const auto records = TrialJournal::readRange(journal, next, kReadChunk, &end);
+        if (end <= next) {
+            break;
+        }
+        next = end;
+        for (const auto &record : records) {
+            switch (record.kind) {
+            case JournalRecord::LevelStarted:
+                open = (record.flags & skipped) == 0;
+                attempt.levelIndex = record.levelIndex;
+                attempt.trialCount = record.trialNumber;
+                attempt.answers.clear();
+                break;
+            case JournalRecord::Trial:
+                if (open) {
+                    quint8 answer = 0;
+                    if (record.hasFlag(JournalRecord::Correct)) {
+                        answer |= kAnswerCorrect;
+                    }
+                    if (record.hasFlag(JournalRecord::UsedDouble) || record.hasFlag(JournalRecord::LuckyDouble)) {
+                        answer |= kAnswerBonus;
+                    }
+                    attempt.answers.push_back(answer);
+                }
+                break;
+            case JournalRecord::LevelFinished:
+                if (open) {
+                    attempt.passed = record.hasFlag(JournalRecord::Passed);
+                    replay();
+                }
+                open = false;
+                break;
+            default:
+                open = false;
+                break;
+            }
+        }
+    }
+
+    before.finish();
+    after.finish();
+    row.recorded = before.tally;
+    row.replayed = after.tally;
+    m_profiles.append(row);
+}
+
+void ReplayReport::merge(const ReplayReport &other)
+{
+    m_profiles += other.m_profiles;
+}
+
+int ReplayReport::profileCount() const
+{
+    return static_cast<int>(m_profiles.size());
+}
+
+qint64 ReplayReport::trialCount() const
+{
+    qint64 trials = 0;
+    for (const auto &row : m_profiles) {
+        trials += row.trials;
+    }
+    return trials;
+}
+
+const QVector<ReplayProfileRow> &ReplayReport::profiles() const
+{
+    return m_profiles;
+}
+
+ReplayTotals ReplayReport::totals() const
+{
+    ReplayTotals totals;
+    qint64 levelDelta = 0;
+    for (const auto &row : m_profiles) {
+        totals.levels += row.levels;
+        totals.passToFail += row.passToFail;
+        totals.failToPass += row.failToPass;
+        totals.divergedLevels += row.divergedLevels;
+        totals.unreplayable += row.unreplayable;
+        totals.finalStageChanged += row.recorded.finalStage != row.replayed.finalStage ? 1 : 0;
+        levelDelta += row.replayed.finalLevelIndex - row.recorded.finalLevelIndex;
+        const ReplayTally *from[2] = {&row.recorded, &row.replayed};
+        ReplayTally *to[2] = {&totals.recorded, &totals.replayed};
+        for (int i = 0; i < 2; ++i) {
+            to[i]->passes += from[i]->passes;
+            to[i]->tokens += from[i]->tokens;
+            to[i]->skips += from[i]->skips;
+            to[i]->trialsSkipped += from[i]->trialsSkipped;
+        }
+    }
+    totals.finalLevelDeltaMean = m_profiles.isEmpty() ? 0.0 : double(levelDelta) / m_profiles.size();
+    return totals;
+}
+
+QJsonObject ReplayReport::toJson() const
+{
+    const ReplayTotals sums = totals();
+    QJsonArray profiles;
+    for (const auto &row : m_profiles) {
+        if (row.passToFail == 0 && row.failToPass == 0
+            && row.recorded.finalLevelIndex == row.replayed.finalLevelIndex) {
+            continue;
+        }
+        profiles.append(QJsonObject{
+            {QStringLiteral("id"), row.id},
+            {QStringLiteral("levels"), row.levels},
+            {QStringLiteral("passToFail"), row.passToFail},
+            {QStringLiteral("failToPass"), row.failToPass},
+            {QStringLiteral("recordedFinalLevel"), row.recorded.finalLevelIndex + 1},
+            {QStringLiteral("replayedFinalLevel"), row.replayed.finalLevelIndex + 1}
+        });
+    }
+
+    return {
+        {QStringLiteral("protocol"), m_protocolId},
+        {QStringLiteral("protocolHash"), m_protocolHash},
+        {QStringLiteral("profiles"), profileCount()},
+        {QStringLiteral("trials"), trialCount()},
+        {QStringLiteral("levels"), sums.levels},
+        {QStringLiteral("recorded"), tallyJson(sums.recorded)},
+        {QStringLiteral("replayed"), tallyJson(sums.replayed)},
+        {QStringLiteral("passToFail"), sums.passToFail},
+        {QStringLiteral("failToPass"), sums.failToPass},
+        {QStringLiteral("finalStageChanged"), sums.finalStageChanged},
+        {QStringLiteral("finalLevelDeltaMean"), sums.finalLevelDeltaMean},
+        {QStringLiteral("divergedLevels"), sums.divergedLevels},
+        {QStringLiteral("unreplayable"), sums.unreplayable},
+        // profiles whose outcome changed
+        {QStringLiteral("changed"), profiles}
+    };
+}
+
+QByteArray ReplayReport::profilesCsv() const
+{
+    ExportChunk chunk({
+        {QStringLiteral("profile_id"), ExportType::Utf8},
+        {QStringLiteral("profile_name"), ExportType::Utf8},
+        {QStringLiteral("recorded_protocol"), ExportType::Utf8},
+        {QStringLiteral("trials"), ExportType::Int64},
+        {QStringLiteral("levels"), ExportType::Int32},
+        {QStringLiteral("recorded_passes"), ExportType::Int32},
+        {QStringLiteral("replayed_passes"), ExportType::Int32},
+        {QStringLiteral("pass_to_fail"), ExportType::Int32},
+        {QStringLiteral("fail_to_pass"), ExportType::Int32},
+        {QStringLiteral("recorded_tokens"), ExportType::Int32},
+        {QStringLiteral("replayed_tokens"), ExportType::Int32},
+        {QStringLiteral("recorded_skips"), ExportType::Int32},
+        {QStringLiteral("replayed_skips"), ExportType::Int32},
+        {QStringLiteral("recorded_trials_skipped"), ExportType::Int32},
+        {QStringLiteral("replayed_trials_skipped"), ExportType::Int32},
+        {QStringLiteral("recorded_final_level"), ExportType::Int32},
+        {QStringLiteral("replayed_final_level"), ExportType::Int32},
+        {QStringLiteral("recorded_final_stage"), ExportType::Int32},
+        {QStringLiteral("replayed_final_stage"), ExportType::Int32},
+        {QStringLiteral("diverged_levels"), ExportType::Int32},
+        {QStringLiteral("unreplayable"), ExportType::Int32}
+    });
+    for (const auto &row : m_profiles) {
+        chunk.addString(row.id);
+        chunk.addString(row.name);
+        chunk.addString(row.protocolId);
+        chunk.addInt(row.trials);
+        chunk.addInt(row.levels);
+        chunk.addInt(row.recorded.passes);
+        chunk.addInt(row.replayed.passes);
+        chunk.addInt(row.passToFail);
+        chunk.addInt(row.failToPass);
+        chunk.addInt(row.recorded.tokens);
+        chunk.addInt(row.replayed.tokens);
+        chunk.addInt(row.recorded.skips);
+        chunk.addInt(row.replayed.skips);
+        chunk.addInt(row.recorded.trialsSkipped);
+        chunk.addInt(row.replayed.trialsSkipped);
+        chunk.addInt(row.recorded.finalLevelIndex + 1);
+        chunk.addInt(row.replayed.finalLevelIndex + 1);
+        chunk.addInt(row.recorded.finalStage);
+        chunk.addInt(row.replayed.finalStage);
+        chunk.addInt(row.divergedLevels);
+        chunk.addInt(row.unreplayable);
+    }
+    return chunk.toCsv();
+}
+
+ReplayReport ReplayReport::build(const ReplayOptions &options)
+{
+    const QDir root(options.rootPath);
+    const QVector<UserProfile> profiles = ProfileManager::readProfiles(options.rootPath);
+    const int jobs = ProfileManager::workerCount(options.jobs, static_cast<int>(profiles.size()));
+
+    // each worker reduces into its own report and keeps its own protocols
+    std::vector<ReplayReport> partials(jobs);
+    std::vector<QHash<QString, TrainingProtocol>> protocols(jobs);
+    ProfileManager::forEachProfile(profiles, jobs, [&](const UserProfile &profile, int worker) {
+        const QString directory = root.filePath(profile.id);
+        // only the protocol id is needed, so the state is not loaded
+        const QString protocolId = TrainingState::readProtocolId(directory);
+        partials[worker].addProfile(profile, directory,
+                                    recordedProtocol(options.rootPath, protocolId, &protocols[worker]),
+                                    options.protocol);
+    });
+
+    ReplayReport report;
+    report.m_protocolId = options.protocol.id();
+    report.m_protocolHash = options.protocol.hash();
+    for (const auto &partial : partials) {
+        report.merge(partial);
+    }
+    ProfileManager::sortByProfileOrder(profiles, &report.m_profiles);
+    return report;
+}
+
+bool ReplayReport::write(const QString &directory) const
+{
+    if (!QDir().mkpath(directory)) {
+        return false;
+    }
+    const QDir dir(directory);
+    return writeFileAtomically(dir.filePath(QStringLiteral("replay.json")), QJsonDocument(toJson()).toJson())
+           && writeFileAtomically(dir.filePath(QStringLiteral("replay_profiles.csv")), profilesCsv());
+}
@@ -0,0 +1,104 @@
+#ifndef REPLAYENGINE_H
+#define REPLAYENGINE_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include "trainingprotocol.h"
+
+struct UserProfile;
+
+struct ReplayOptions {
+    QString rootPath;
+    // the rules to replay under
+    TrainingProtocol protocol;
+    // 0 picks one reader per core
+    int jobs = 0;
+};
+
+// How one run of the ladder went: the recorded one is the profile's own
+// protocol replayed, the other the substituted one.
+struct ReplayTally {
+    int passes = 0;
+    int tokens = 0;
+    // passes that moved on by more than one level
+    int skips = 0;
+    int trialsSkipped = 0;
+    int finalLevelIndex = 0;
+    int finalStage = 0;
+};
+
+struct ReplayProfileRow {
+    QString id;
+    QString name;
+    QString protocolId;
+    qint64 trials = 0;
+    int levels = 0;
+    ReplayTally recorded;
+    ReplayTally replayed;
+    // the same level attempt passed under one rule set and failed under
+    // the other
+    int passToFail = 0;
+    int failToPass = 0;
+    // levels where replaying the profile's own protocol did not land on
+    // the recorded level, e.g. after a protocol or state edit
+    int divergedLevels = 0;
+    // early-decided attempts one rule set could not settle from the
+    // answers played; they count towards neither tally
+    int unreplayable = 0;
+};
+
+// summed over profiles; the final-level fields of the tallies stay 0
+struct ReplayTotals {
+    qint64 levels = 0;
+    ReplayTally recorded;
+    ReplayTally replayed;
+    int passToFail = 0;
+    int failToPass = 0;
+    int divergedLevels = 0;
+    int unreplayable = 0;
+    int finalStageChanged = 0;
+    // replayed minus recorded, per profile
+    double finalLevelDeltaMean = 0.0;
+};
+
+// Streams every profile's journaled level attempts through the level
+// rules twice, once under the protocol the profile trained with and once
+// under a substituted one, and reports how passes, tokens, skips and the
+// level reached would have differed. Both runs walk the ladder from the
+// first attempt's level and apply each recorded attempt's answers at
+// whatever level that run has reached, so only the rules differ; a
+// substituted trial count cannot be replayed and the recorded one is kept.
+// An attempt that ended early is compared only if both rule sets settle it
+// from the answers played. Doubles count only where the level being
+// replayed allows tokens.
+// Special exercises, test batteries and aborted levels are left out.
+class ReplayReport
+{
+public:
+    void addProfile(const UserProfile &profile, const QString &profileDirectory, const TrainingProtocol &recorded,
+                    const TrainingProtocol &replayed);
+    void merge(const ReplayReport &other);
+
+    int profileCount() const;
+    qint64 trialCount() const;
+    const QVector<ReplayProfileRow> &profiles() const;
+    ReplayTotals totals() const;
+
+    QJsonObject toJson() const;
+    QByteArray profilesCsv() const;
+
+    // reads every profile under options.rootPath in parallel
+    static ReplayReport build(const ReplayOptions &options);
+    // replay.json plus replay_profiles.csv
+    bool write(const QString &directory) const;
+
+private:
+    QString m_protocolId;
+    QString m_protocolHash;
+    QVector<ReplayProfileRow> m_profiles;
+};
+
+#endif // REPLAYENGINE_H
@@ -0,0 +1,308 @@
+#include "responsepad.h"
+
+#include "theme.h"
+#include "trainingmodel.h"
+
+#include <QColor>
+#include <QEvent>
+#include <QFont>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+
+namespace {
+constexpr int kMargin = 8;
+constexpr int kSpacing = 8;
+constexpr int kWhiteKeyCount = 7;
+constexpr std::array<int, kWhiteKeyCount> kWhiteKeys = {0, 2, 4, 5, 7, 9, 11};
+// black key index -> white key it sits to the right of
+constexpr std::array<int, 5> kBlackKeys = {1, 3, 6, 8, 10};
+constexpr std::array<int, 5> kBlackAfterWhite = {0, 1, 3, 4, 5};
+
+bool isBlackKey(int index)
+{
+    return index == 1 || index == 3 || index == 6 || index == 8 || index == 10;
+}
+}
+
+ResponsePad::ResponsePad(QWidget *parent)
+    : QWidget(parent)
+{
+    setMouseTracking(true);
+    setFocusPolicy(Qt::NoFocus);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+
+    const auto &order = TrainingSpec::chromaticOrder();
+    for (int i = 0; i < kPitchCount && i < order.size(); ++i) {
+        m_labels[i] = order.at(i);
+    }
+    m_labels[kOtherIndex] = tr("Other");
+}
+
+void ResponsePad::setActiveMask(quint16 mask)
+{
+    if (mask == m_activeMask) {
+        return;
+    }
+    m_activeMask = mask;
+    m_pressedIndex = -1;
+    m_checkedIndex = -1;
+    update();
+}
+
+quint16 ResponsePad::activeMask() const
+{
+    return m_activeMask;
+}
+
+bool ResponsePad::isKeyActive(int index) const
+{
+    return index >= 0 && index < kKeyCount && (m_activeMask & (1u << index));
+}
+
+bool ResponsePad::trigger(int index)
+{
+    if (!isEnabled() || !isKeyActive(index)) {
+        return false;
+    }
+    setCheckedIndex(index);
+    emit responseChosen(index);
+    return true;
+}
+
+void ResponsePad::clearSelection()
+{
+    setPressedIndex(-1);
+    setCheckedIndex(-1);
+}
+
+QSize ResponsePad::sizeHint() const
+{
+    return QSize(480, 180);
+}
+
+QSize ResponsePad::minimumSizeHint() const
+{
+    return QSize(280, 160);
+}
+
+void ResponsePad::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    layoutKeys();
+}
+
+void ResponsePad::layoutKeys()
+{
+    const QRect content = rect().adjusted(kMargin, kMargin, -kMargin, -kMargin);
+    const int otherHeight = qMax(30, content.height() / 5);
+    const int keysHeight = qMax(0, content.height() - otherHeight - kSpacing);
+    const int whiteWidth = content.width() / kWhiteKeyCount;
+
+    for (int w = 0; w < kWhiteKeyCount; ++w) {
+        const int left = content.left() + w * whiteWidth;
+        const int width = (w == kWhiteKeyCount - 1) ? content.right() + 1 - left : whiteWidth;
+        m_keyRects[kWhiteKeys[w]] = QRect(left, content.top(), width, keysHeight);
+    }
+
+    const int blackWidth = whiteWidth * 3 / 5;
+    const int blackHeight = keysHeight * 3 / 5;
+    for (int b = 0; b < static_cast<int>(kBlackKeys.size()); ++b) {
+        const int boundary = content.left() + (kBlackAfterWhite[b] + 1) * whiteWidth;
+        m_keyRects[kBlackKeys[b]] = QRect(boundary - blackWidth / 2, content.top(), blackWidth, blackHeight);
+    }
+
+    m_keyRects[kOtherIndex] = QRect(content.left(), content.top() + keysHeight + kSpacing, content.width(), otherHeight);
+}
+
+int ResponsePad::keyAt(const QPoint &pos) const
+{
+    for (int index : kBlackKeys) {
+        if (m_keyRects[index].contains(pos)) {
+            return index;
+        }
+    }
+    for (int index : kWhiteKeys) {
+        if (m_keyRects[index].contains(pos)) {
+            return index;
+        }
+    }
+    if (m_keyRects[kOtherIndex].contains(pos)) {
+        return kOtherIndex;
+    }
+    return -1;
+}
+
+void ResponsePad::updateKey(int index)
+{
+    if (index < 0 || index >= kKeyCount) {
+        return;
+    }
+    // white keys sit under their black neighbours, so the dirty rect is
+    // enough: paintEvent redraws everything that intersects it
+    update(m_keyRects[index].adjusted(-1, -1, 1, 1));
+}
+
+void ResponsePad::setHoverIndex(int index)
+{
+    if (index == m_hoverIndex) {
+        return;
+    }
+    updateKey(m_hoverIndex);
+    m_hoverIndex = index;
+    updateKey(m_hoverIndex);
+}
+
+void ResponsePad::setPressedIndex(int index)
+{
+    if (index == m_pressedIndex) {
+        return;
+    }
+    updateKey(m_pressedIndex);
+    m_pressedIndex = index;
+    updateKey(m_pressedIndex);
+}
+
+void ResponsePad::setCheckedIndex(int index)
+{
+    if (index == m_checkedIndex) {
+        return;
+    }
+    updateKey(m_checkedIndex);
+    m_checkedIndex = index;
+    updateKey(m_checkedIndex);
+}
+
+void ResponsePad::mouseMoveEvent(QMouseEvent *event)
+{
+    const int index = keyAt(event->pos());
+    setHoverIndex(isKeyActive(index) ? index : -1);
+    QWidget::mouseMoveEvent(event);
+}
+
+void ResponsePad::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        QWidget::mousePressEvent(event);
+        return;
+    }
+    const int index = keyAt(event->pos());
+    if (isKeyActive(index)) {
+        setPressedIndex(index);
+        setCheckedIndex(index);
+    }
+    event->accept();
+}
+
+void ResponsePad::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        QWidget::mouseReleaseEvent(event);
+        return;
+    }
+    const int pressed = m_pressedIndex;
+    setPressedIndex(-1);
+    if (pressed >= 0 && keyAt(event->pos()) == pressed) {
+        trigger(pressed);
+    } else if (pressed >= 0) {
+        setCheckedIndex(-1);
+    }
+    event->accept();
+}
+
+void ResponsePad::leaveEvent(QEvent *event)
+{
+    setHoverIndex(-1);
+    QWidget::leaveEvent(event);
+}
+
+void ResponsePad::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::EnabledChange) {
+        m_hoverIndex = -1;
+        m_pressedIndex = -1;
+        update();
+    }
+    QWidget::changeEvent(event);
+}
+
+void ResponsePad::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    painter.setClipRegion(event->region());
+
+    const auto &theme = Theme::current();
+    painter.setPen(theme.padBorder);
+    painter.setBrush(theme.padBackground);
+    painter.drawRoundedRect(QRectF(rect()).adjusted(0.5, 0.5, -0.5, -0.5), 10, 10);
+
+    QFont keyFont = font();
+    keyFont.setPixelSize(15);
+    keyFont.setWeight(QFont::DemiBold);
+    painter.setFont(keyFont);
+
+    for (int index : kWhiteKeys) {
+        if (event->region().intersects(m_keyRects[index])) {
+            paintKey(painter, index);
+        }
+    }
+    for (int index : kBlackKeys) {
+        if (event->region().intersects(m_keyRects[index])) {
+            paintKey(painter, index);
+        }
+    }
+    if (event->region().intersects(m_keyRects[kOtherIndex])) {
+        paintKey(painter, kOtherIndex);
+    }
+}
+
+void ResponsePad::paintKey(QPainter &painter, int index)
+{
+    const QRect keyRect = m_keyRects[index];
+    if (keyRect.isEmpty()) {
+        return;
+    }
+    const bool black = isBlackKey(index);
+    const bool active = isKeyActive(index);
+    const bool enabled = isEnabled() && active;
+    const bool checked = enabled && (index == m_checkedIndex || index == m_pressedIndex);
+    const bool hovered = enabled && index == m_hoverIndex;
+
+    const auto &theme = Theme::current();
+    QColor fill;
+    QColor border;
+    QColor text;
+    if (checked) {
+        fill = theme.padAccent;
+        border = theme.padAccent;
+        text = theme.padWhiteKey;
+    } else if (!enabled) {
+        fill = black ? theme.padMutedBlackKey : theme.padMutedWhiteKey;
+        border = theme.padMutedBorder;
+        text = theme.textMuted;
+    } else if (black) {
+        fill = hovered ? theme.padBlackKeyHover : theme.padBlackKey;
+        border = theme.padBlackKey;
+        text = theme.padWhiteKey;
+    } else {
+        fill = hovered ? theme.padWhiteKeyHover : theme.padWhiteKey;
+        border = theme.padAccent;
+        text = theme.textPrimary;
+    }
+
+    painter.setPen(border);
+    painter.setBrush(fill);
+    painter.drawRoundedRect(QRectF(keyRect).adjusted(0.5, 0.5, -0.5, -0.5), 6, 6);
+
+    if (!active && index != kOtherIndex) {
+        return;
+    }
+    painter.setPen(text);
+    if (index == kOtherIndex) {
+        painter.drawText(keyRect, Qt::AlignCenter, m_labels[index]);
+    } else {
+        const QRect labelRect = keyRect.adjusted(2, 0, -2, -6);
+        painter.drawText(labelRect, Qt::AlignHCenter | Qt::AlignBottom, m_labels[index]);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef RESPONSEPAD_H
+#define RESPONSEPAD_H
+
+#include <QRect>
+#include <QString>
+#include <QWidget>
+#include <array>
+
+// One-octave piano used to answer level trials. Keys are painted and
+// hit-tested by hand; which pitch classes can be answered is driven by a
+// bitmask (bit i = chromatic index i, bit kOtherIndex = the "Other" bar).
+class ResponsePad : public QWidget
+{
+    Q_OBJECT
+public:
+    static constexpr int kPitchCount = 12;
+    static constexpr int kOtherIndex = 12;
+    static constexpr int kKeyCount = 13;
+
+    explicit ResponsePad(QWidget *parent = nullptr);
+
+    void setActiveMask(quint16 mask);
+    quint16 activeMask() const;
+    bool isKeyActive(int index) const;
+
+    bool trigger(int index);
+    void clearSelection();
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+signals:
+    void responseChosen(int index);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
+private:
+    void layoutKeys();
+    int keyAt(const QPoint &pos) const;
+    void setHoverIndex(int index);
+    void setPressedIndex(int index);
+    void setCheckedIndex(int index);
+    void updateKey(int index);
+    void paintKey(QPainter &painter, int index);
+
+    std::array<QRect, kKeyCount> m_keyRects;
+    std::array<QString, kKeyCount> m_labels;
+    quint16 m_activeMask = 0;
+    int m_hoverIndex = -1;
+    int m_pressedIndex = -1;
+    int m_checkedIndex = -1;
+};
+
+#endif // RESPONSEPAD_H
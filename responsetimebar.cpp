@@ -0,0 +1,159 @@
+#include "responsetimebar.h"
+
+#include "theme.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+#include <QVariantAnimation>
+#include <QtMath>
+
+namespace {
+constexpr int kBarHeight = 21;
+constexpr int kTrackPadding = 2;
+}
+
+ResponseTimeBar::ResponseTimeBar(QWidget *parent)
+    : QWidget(parent)
+    , m_idleLabel(tr("Time left"))
+{
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+
+    m_animation = new QVariantAnimation(this);
+    m_animation->setEasingCurve(QEasingCurve::Linear);
+    connect(m_animation, &QVariantAnimation::valueChanged, this, &ResponseTimeBar::handleFrame);
+}
+
+void ResponseTimeBar::start(int windowMs, int elapsedMs)
+{
+    m_animation->stop();
+    if (windowMs <= 0) {
+        stop();
+        return;
+    }
+    if (windowMs != m_labelWindowMs) {
+        rebuildLabels(windowMs);
+    }
+    m_windowMs = windowMs;
+    m_remainingMs = qMax(0, windowMs - elapsedMs);
+    m_fillWidth = fillWidthFor(m_remainingMs);
+    m_shownTenths = (m_remainingMs + 99) / 100;
+    update();
+
+    m_animation->setStartValue(windowMs);
+    m_animation->setEndValue(0);
+    m_animation->setDuration(windowMs);
+    m_animation->start();
+    m_animation->setCurrentTime(qBound(0, elapsedMs, windowMs));
+}
+
+void ResponseTimeBar::stop()
+{
+    m_animation->stop();
+    if (m_windowMs == 0 && m_remainingMs == 0) {
+        return;
+    }
+    m_windowMs = 0;
+    m_remainingMs = 0;
+    m_fillWidth = 0;
+    m_shownTenths = -1;
+    update();
+}
+
+bool ResponseTimeBar::isRunning() const
+{
+    return m_animation->state() == QAbstractAnimation::Running;
+}
+
+QSize ResponseTimeBar::sizeHint() const
+{
+    return QSize(200, kBarHeight);
+}
+
+QSize ResponseTimeBar::minimumSizeHint() const
+{
+    return QSize(60, kBarHeight);
+}
+
+void ResponseTimeBar::handleFrame(const QVariant &value)
+{
+    if (m_windowMs <= 0) {
+        return;
+    }
+    const int remaining = value.toInt();
+    const int width = fillWidthFor(remaining);
+    const int tenths = (remaining + 99) / 100;
+    m_remainingMs = remaining;
+    if (tenths != m_shownTenths) {
+        m_shownTenths = tenths;
+        m_fillWidth = width;
+        update();
+        return;
+    }
+    if (width == m_fillWidth) {
+        return;
+    }
+    // only the strip between the old and new chunk edge changes
+    const QRect track = trackRect();
+    const int left = track.left() + qMin(width, m_fillWidth) - 1;
+    const int span = qAbs(width - m_fillWidth) + 2;
+    m_fillWidth = width;
+    update(QRect(left, track.top(), span, track.height()));
+}
+
+void ResponseTimeBar::rebuildLabels(int windowMs)
+{
+    const int steps = (windowMs + 99) / 100;
+    m_labels.clear();
+    m_labels.reserve(steps + 1);
+    for (int tenths = 0; tenths <= steps; ++tenths) {
+        m_labels.append(tr("Time left: %1 s").arg(tenths / 10.0, 0, 'f', 1));
+    }
+    m_labelWindowMs = windowMs;
+}
+
+QRect ResponseTimeBar::trackRect() const
+{
+    return rect().adjusted(kTrackPadding + 1, kTrackPadding + 1, -kTrackPadding - 1, -kTrackPadding - 1);
+}
+
+int ResponseTimeBar::fillWidthFor(int remainingMs) const
+{
+    if (m_windowMs <= 0 || remainingMs <= 0) {
+        return 0;
+    }
+    const int available = trackRect().width();
+    return static_cast<int>(static_cast<qint64>(available) * qMin(remainingMs, m_windowMs) / m_windowMs);
+}
+
+void ResponseTimeBar::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    m_fillWidth = fillWidthFor(m_remainingMs);
+}
+
+void ResponseTimeBar::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+
+    const auto &theme = Theme::current();
+    const QRectF outer = QRectF(rect()).adjusted(0.5, 0.5, -0.5, -0.5);
+    painter.setPen(theme.barBorder);
+    painter.setBrush(theme.barTrack);
+    painter.drawRoundedRect(outer, 5, 5);
+
+    const QRect track = trackRect();
+    if (m_fillWidth > 0) {
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(theme.barChunk);
+        painter.drawRoundedRect(QRect(track.left(), track.top(), m_fillWidth, track.height()), 4, 4);
+    }
+
+    const QString *label = &m_idleLabel;
+    if (m_windowMs > 0 && m_shownTenths >= 0 && m_shownTenths < m_labels.size()) {
+        label = &m_labels.at(m_shownTenths);
+    }
+    painter.setPen(theme.textPrimary);
+    painter.drawText(rect(), Qt::AlignCenter, *label);
+}
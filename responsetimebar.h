@@ -0,0 +1,45 @@
+#ifndef RESPONSETIMEBAR_H
+#define RESPONSETIMEBAR_H
+
+#include <QString>
+#include <QVector>
+#include <QWidget>
+
+class QVariantAnimation;
+
+// Countdown bar for the response window. It is painted directly and driven by
+// the animation frame clock, so it only wakes up while a trial is running.
+class ResponseTimeBar : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit ResponseTimeBar(QWidget *parent = nullptr);
+
+    void start(int windowMs, int elapsedMs = 0);
+    void stop();
+    bool isRunning() const;
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    void handleFrame(const QVariant &value);
+    void rebuildLabels(int windowMs);
+    QRect trackRect() const;
+    int fillWidthFor(int remainingMs) const;
+
+    QVariantAnimation *m_animation = nullptr;
+    int m_windowMs = 0;
+    int m_remainingMs = 0;
+    int m_fillWidth = 0;
+    int m_shownTenths = -1;
+    int m_labelWindowMs = -1;
+    QVector<QString> m_labels;
+    QString m_idleLabel;
+};
+
+#endif // RESPONSETIMEBAR_H
@@ -0,0 +1,326 @@
+#include "responsetimesketch.h"
+
+#include <QCborArray>
+#include <QtAlgorithms>
+#include <cmath>
+
+namespace {
+constexpr int kFormatVersion = 1;
+// log2 of kSubBuckets and kExactLimit
+constexpr int kSubBucketBits = 5;
+constexpr int kExactBits = 6;
+
+const ResponseTimeSketch &emptySketch()
+{
+    static const ResponseTimeSketch s_empty;
+    return s_empty;
+}
+
+template <std::size_t N>
+QCborArray sketchesToCbor(const std::array<ResponseTimeSketch, N> &sketches)
+{
+    QCborArray array;
+    for (const auto &sketch : sketches) {
+        array.append(sketch.toCbor());
+    }
+    return array;
+}
+
+template <std::size_t N>
+void sketchesFromCbor(const QCborValue &value, std::array<ResponseTimeSketch, N> *sketches)
+{
+    const QCborArray array = value.toArray();
+    for (std::size_t i = 0; i < N; ++i) {
+        (*sketches)[i] = ResponseTimeSketch::fromCbor(array.at(static_cast<qsizetype>(i)).toMap());
+    }
+}
+}
+
+ResponseTimeSketch::ResponseTimeSketch() = default;
+
+void ResponseTimeSketch::clear()
+{
+    *this = ResponseTimeSketch();
+}
+
+int ResponseTimeSketch::bucketIndex(int value)
+{
+    value = qBound(0, value, kMaxValue);
+    if (value < kExactLimit) {
+        return value;
+    }
+    const int bit = 31 - qCountLeadingZeroBits(static_cast<quint32>(value));
+    const int shift = bit - kSubBucketBits;
+    const int sub = (value >> shift) - kSubBuckets;
+    return kExactLimit + (bit - kExactBits) * kSubBuckets + sub;
+}
+
+int ResponseTimeSketch::bucketLowerBound(int index)
+{
+    if (index < kExactLimit) {
+        return index;
+    }
+    const int octave = (index - kExactLimit) / kSubBuckets;
+    const int sub = (index - kExactLimit) % kSubBuckets;
+    return (kSubBuckets + sub) << (octave + kExactBits - kSubBucketBits);
+}
+
+int ResponseTimeSketch::bucketUpperBound(int index)
+{
+    if (index < kExactLimit) {
+        return index;
+    }
+    const int octave = (index - kExactLimit) / kSubBuckets;
+    return bucketLowerBound(index) + (1 << (octave + kExactBits - kSubBucketBits)) - 1;
+}
+
+void ResponseTimeSketch::add(int value, quint32 count)
+{
+    if (count == 0) {
+        return;
+    }
+    value = qBound(0, value, kMaxValue);
+    m_buckets[bucketIndex(value)] += count;
+    m_count += count;
+    m_sum += static_cast<quint64>(value) * count;
+    m_minimum = qMin(m_minimum, value);
+    m_maximum = qMax(m_maximum, value);
+}
+
+void ResponseTimeSketch::merge(const ResponseTimeSketch &other)
+{
+    if (other.isEmpty()) {
+        return;
+    }
+    for (int i = 0; i < kBucketCount; ++i) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_minimum = qMin(m_minimum, other.m_minimum);
+    m_maximum = qMax(m_maximum, other.m_maximum);
+}
+
+bool ResponseTimeSketch::isEmpty() const
+{
+    return m_count == 0;
+}
+
+quint64 ResponseTimeSketch::count() const
+{
+    return m_count;
+}
+
+int ResponseTimeSketch::minimum() const
+{
+    return isEmpty() ? -1 : m_minimum;
+}
+
+int ResponseTimeSketch::maximum() const
+{
+    return isEmpty() ? -1 : m_maximum;
+}
+
+double ResponseTimeSketch::mean() const
+{
+    return isEmpty() ? -1.0 : static_cast<double>(m_sum) / static_cast<double>(m_count);
+}
+
+int ResponseTimeSketch::quantile(double q) const
+{
+    if (isEmpty()) {
+        return -1;
+    }
+    const quint64 rank = qBound<quint64>(1, static_cast<quint64>(std::ceil(qBound(0.0, q, 1.0) * m_count)), m_count);
+    quint64 seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            const int middle = (bucketLowerBound(i) + bucketUpperBound(i) + 1) / 2;
+            return qBound(m_minimum, middle, m_maximum);
+        }
+    }
+    return m_maximum;
+}
+
+double ResponseTimeSketch::fractionAtOrBelow(int value) const
+{
+    if (isEmpty()) {
+        return 0.0;
+    }
+    const int last = bucketIndex(value);
+    quint64 seen = 0;
+    for (int i = 0; i <= last; ++i) {
+        seen += m_buckets[i];
+    }
+    return static_cast<double>(seen) / static_cast<double>(m_count);
+}
+
+QCborMap ResponseTimeSketch::toCbor() const
+{
+    QCborMap map;
+    if (isEmpty()) {
+        return map;
+    }
+    map[QStringLiteral("version")] = kFormatVersion;
+    map[QStringLiteral("sum")] = static_cast<qint64>(m_sum);
+    map[QStringLiteral("min")] = m_minimum;
+    map[QStringLiteral("max")] = m_maximum;
+    // sparse: bucket index followed by its count
+    QCborArray buckets;
+    for (int i = 0; i < kBucketCount; ++i) {
+        if (m_buckets[i] != 0) {
+            buckets.append(i);
+            buckets.append(static_cast<qint64>(m_buckets[i]));
+        }
+    }
+    map[QStringLiteral("buckets")] = buckets;
+    return map;
+}
+
+ResponseTimeSketch ResponseTimeSketch::fromCbor(const QCborMap &map)
+{
+    ResponseTimeSketch sketch;
+    if (map.value(QStringLiteral("version")).toInteger() != kFormatVersion) {
+        return sketch;
+    }
+    const QCborArray buckets = map.value(QStringLiteral("buckets")).toArray();
+    for (qsizetype i = 0; i + 1 < buckets.size(); i += 2) {
+        const qint64 index = buckets.at(i).toInteger();
+        const qint64 count = buckets.at(i + 1).toInteger();
+        if (index < 0 || index >= kBucketCount || count <= 0) {
+            continue;
+        }
+        sketch.m_buckets[index] += static_cast<quint32>(count);
+        sketch.m_count += static_cast<quint64>(count);
+    }
+    if (sketch.m_count == 0) {
+        return ResponseTimeSketch();
+    }
+    sketch.m_sum = static_cast<quint64>(qMax<qint64>(0, map.value(QStringLiteral("sum")).toInteger()));
+    sketch.m_minimum = qBound(0, static_cast<int>(map.value(QStringLiteral("min")).toInteger()), kMaxValue);
+    sketch.m_maximum = qBound(sketch.m_minimum, static_cast<int>(map.value(QStringLiteral("max")).toInteger()), kMaxValue);
+    return sketch;
+}
+
+ResponseTimeProfile::ResponseTimeProfile() = default;
+
+void ResponseTimeProfile::clear()
+{
+    *this = ResponseTimeProfile();
+}
+
+int ResponseTimeProfile::stageSlot(int stageIndex, bool feedback)
+{
+    if (stageIndex < 1 || stageIndex > kStageCount) {
+        return -1;
+    }
+    return (stageIndex - 1) * 2 + (feedback ? 1 : 0);
+}
+
+void ResponseTimeProfile::record(int category, int stageIndex, bool feedback, int responseTimeMs, int responseWindowMs, bool timedOut)
+{
+    const int slot = stageSlot(stageIndex, feedback);
+    if (timedOut) {
+        if (slot >= 0) {
+            ++m_timeouts[slot];
+        }
+        return;
+    }
+    if (category >= 0 && category < kCategoryCount) {
+        m_pitch[category].add(responseTimeMs);
+    }
+    if (slot >= 0) {
+        m_stage[slot].add(responseTimeMs);
+    }
+    if (responseWindowMs > 0) {
+        const qint64 perMille = static_cast<qint64>(qMax(0, responseTimeMs)) * 1000 / responseWindowMs;
+        m_windowUsage[feedback ? 1 : 0].add(static_cast<int>(qMin<qint64>(perMille, ResponseTimeSketch::kMaxValue)));
+    }
+}
+
+void ResponseTimeProfile::merge(const ResponseTimeProfile &other)
+{
+    for (int i = 0; i < kCategoryCount; ++i) {
+        m_pitch[i].merge(other.m_pitch[i]);
+    }
+    for (int i = 0; i < kStageCount * 2; ++i) {
+        m_stage[i].merge(other.m_stage[i]);
+        m_timeouts[i] += other.m_timeouts[i];
+    }
+    for (int i = 0; i < 2; ++i) {
+        m_windowUsage[i].merge(other.m_windowUsage[i]);
+    }
+}
+
+const ResponseTimeSketch &ResponseTimeProfile::byPitch(int category) const
+{
+    if (category < 0 || category >= kCategoryCount) {
+        return emptySketch();
+    }
+    return m_pitch[category];
+}
+
+const ResponseTimeSketch &ResponseTimeProfile::byStage(int stageIndex, bool feedback) const
+{
+    const int slot = stageSlot(stageIndex, feedback);
+    return slot >= 0 ? m_stage[slot] : emptySketch();
+}
+
+ResponseTimeSketch ResponseTimeProfile::byStage(int stageIndex) const
+{
+    ResponseTimeSketch merged = byStage(stageIndex, false);
+    merged.merge(byStage(stageIndex, true));
+    return merged;
+}
+
+const ResponseTimeSketch &ResponseTimeProfile::windowUsage(bool feedback) const
+{
+    return m_windowUsage[feedback ? 1 : 0];
+}
+
+ResponseTimeSketch ResponseTimeProfile::overall() const
+{
+    ResponseTimeSketch merged;
+    for (const auto &sketch : m_pitch) {
+        merged.merge(sketch);
+    }
+    return merged;
+}
+
+quint64 ResponseTimeProfile::timeouts(int stageIndex, bool feedback) const
+{
+    const int slot = stageSlot(stageIndex, feedback);
+    return slot >= 0 ? m_timeouts[slot] : 0;
+}
+
+QCborMap ResponseTimeProfile::toCbor() const
+{
+    QCborMap map;
+    map[QStringLiteral("version")] = kFormatVersion;
+    map[QStringLiteral("pitch")] = sketchesToCbor(m_pitch);
+    map[QStringLiteral("stage")] = sketchesToCbor(m_stage);
+    map[QStringLiteral("windowUsage")] = sketchesToCbor(m_windowUsage);
+    QCborArray timeouts;
+    for (const auto count : m_timeouts) {
+        timeouts.append(static_cast<qint64>(count));
+    }
+    map[QStringLiteral("timeouts")] = timeouts;
+    return map;
+}
+
+ResponseTimeProfile ResponseTimeProfile::fromCbor(const QCborMap &map)
+{
+    ResponseTimeProfile profile;
+    if (map.value(QStringLiteral("version")).toInteger() != kFormatVersion) {
+        return profile;
+    }
+    sketchesFromCbor(map.value(QStringLiteral("pitch")), &profile.m_pitch);
+    sketchesFromCbor(map.value(QStringLiteral("stage")), &profile.m_stage);
+    sketchesFromCbor(map.value(QStringLiteral("windowUsage")), &profile.m_windowUsage);
+    const QCborArray timeouts = map.value(QStringLiteral("timeouts")).toArray();
+    for (int i = 0; i < kStageCount * 2; ++i) {
+        profile.m_timeouts[i] = static_cast<quint64>(qMax<qint64>(0, timeouts.at(i).toInteger()));
+    }
+    return profile;
+}
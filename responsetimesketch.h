@@ -0,0 +1,89 @@
+#ifndef RESPONSETIMESKETCH_H
+#define RESPONSETIMESKETCH_H
+
+#include <QCborMap>
+#include <QtGlobal>
+#include <array>
+
+// Log-linear histogram of millisecond values in the style of an HDR
+// histogram. Values below kExactLimit get a bucket each; every power of two
+// above that is split into kSubBuckets buckets, so a quantile is reported
+// within about 1.6% of the true sample. Sketches of the same shape merge
+// by adding bucket counts, which keeps them exact under merging.
+class ResponseTimeSketch
+{
+public:
+    static constexpr int kExactLimit = 64;
+    static constexpr int kSubBuckets = 32;
+    static constexpr int kMaxValue = 0xffff;
+    static constexpr int kBucketCount = kExactLimit + 10 * kSubBuckets;
+
+    ResponseTimeSketch();
+
+    void clear();
+    void add(int value, quint32 count = 1);
+    void merge(const ResponseTimeSketch &other);
+
+    bool isEmpty() const;
+    quint64 count() const;
+    int minimum() const;
+    int maximum() const;
+    double mean() const;
+    // q in [0, 1]; -1 when the sketch is empty
+    int quantile(double q) const;
+    // share of samples at or below value
+    double fractionAtOrBelow(int value) const;
+
+    QCborMap toCbor() const;
+    static ResponseTimeSketch fromCbor(const QCborMap &map);
+
+    static int bucketIndex(int value);
+    static int bucketLowerBound(int index);
+    static int bucketUpperBound(int index);
+
+private:
+    std::array<quint32, kBucketCount> m_buckets{};
+    quint64 m_count = 0;
+    quint64 m_sum = 0;
+    int m_minimum = kMaxValue;
+    int m_maximum = 0;
+};
+
+// The response-time sketches kept for one profile: one per pitch category,
+// one per stage and feedback mode, and one per feedback mode holding the
+// answer time as a share of the response window (in per mille), which
+// shows how close answers come to the deadline across levels whose
+// windows differ. Timeouts carry no response time and are only counted.
+class ResponseTimeProfile
+{
+public:
+    static constexpr int kCategoryCount = 13;
+    static constexpr int kStageCount = 12;
+
+    ResponseTimeProfile();
+
+    void clear();
+    // stageIndex is 1-based as in LevelSpec
+    void record(int category, int stageIndex, bool feedback, int responseTimeMs, int responseWindowMs, bool timedOut);
+    void merge(const ResponseTimeProfile &other);
+
+    const ResponseTimeSketch &byPitch(int category) const;
+    const ResponseTimeSketch &byStage(int stageIndex, bool feedback) const;
+    ResponseTimeSketch byStage(int stageIndex) const;
+    const ResponseTimeSketch &windowUsage(bool feedback) const;
+    ResponseTimeSketch overall() const;
+    quint64 timeouts(int stageIndex, bool feedback) const;
+
+    QCborMap toCbor() const;
+    static ResponseTimeProfile fromCbor(const QCborMap &map);
+
+private:
+    static int stageSlot(int stageIndex, bool feedback);
+
+    std::array<ResponseTimeSketch, kCategoryCount> m_pitch;
+    std::array<ResponseTimeSketch, kStageCount * 2> m_stage;
+    std::array<ResponseTimeSketch, 2> m_windowUsage;
+    std::array<quint64, kStageCount * 2> m_timeouts{};
+};
+
+#endif // RESPONSETIMESKETCH_H
@@ -0,0 +1,93 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// Fixed-capacity FIFO over preallocated storage. Index 0 is the oldest
+// element; pushing into a full buffer overwrites it.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity = 0)
+    {
+        setCapacity(capacity);
+    }
+
+    void setCapacity(int capacity)
+    {
+        m_capacity = qMax(0, capacity);
+        m_storage = QVector<T>(m_capacity);
+        m_head = 0;
+        m_size = 0;
+    }
+
+    int capacity() const { return m_capacity; }
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    bool isFull() const { return m_size == m_capacity; }
+
+    const T &at(int index) const
+    {
+        Q_ASSERT(index >= 0 && index < m_size);
+        return m_storage.at(slot(index));
+    }
+
+    T &operator[](int index)
+    {
+        Q_ASSERT(index >= 0 && index < m_size);
+        return m_storage[slot(index)];
+    }
+
+    const T &first() const { return at(0); }
+    const T &last() const { return at(m_size - 1); }
+
+    // Returns true when the oldest element was overwritten.
+    bool push(const T &value)
+    {
+        if (m_capacity == 0) {
+            return false;
+        }
+        if (isFull()) {
+            m_storage[m_head] = value;
+            m_head = (m_head + 1) % m_capacity;
+            return true;
+        }
+        m_storage[slot(m_size)] = value;
+        ++m_size;
+        return false;
+    }
+
+    T takeFirst()
+    {
+        Q_ASSERT(m_size > 0);
+        T value = m_storage.at(m_head);
+        m_storage[m_head] = T();
+        m_head = (m_head + 1) % m_capacity;
+        --m_size;
+        return value;
+    }
+
+    void clear()
+    {
+        for (int i = 0; i < m_size; ++i) {
+            m_storage[slot(i)] = T();
+        }
+        m_head = 0;
+        m_size = 0;
+    }
+
+private:
+    int slot(int index) const
+    {
+        return (m_head + index) % m_capacity;
+    }
+
+    QVector<T> m_storage;
+    int m_capacity = 0;
+    int m_head = 0;
+    int m_size = 0;
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,165 @@
+#include "statewriter.h"
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+namespace {
+// a short settle window lets a save burst (level end, summary, tokens)
+// land as one write
+constexpr unsigned long kCoalesceWindowMs = 40;
+}
+
+StateWriter::StateWriter() = default;
+
+StateWriter::~StateWriter()
+{
+    if (!m_thread) {
+        return;
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+    }
+    m_wake.wakeAll();
+    m_thread->wait();
+    delete m_thread;
+}
+
+void StateWriter::submit(const QString &path, Encoder encoder)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        // the replacement moves to the back so jobs keep the order of
+        // their latest submission
+        for (int i = 0; i < m_pending.size(); ++i) {
+            if (m_pending.at(i).path == path) {
+                m_pending.removeAt(i);
+                break;
+            }
+        }
+        m_pending.append(Job{path, std::move(encoder), QByteArray(), -1});
+        startThread();
+        // a thread inside the coalesce window is left to sleep it out
+        if (!m_waitingForWork) {
+            return;
+        }
+    }
+    m_wake.wakeOne();
+}
+
+void StateWriter::writeAt(const QString &path, qint64 offset, const QByteArray &data)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        bool joined = false;
+        for (auto &job : m_pending) {
+            if (job.path == path && job.offset >= 0 && job.offset + job.data.size() == offset) {
+                job.data += data;
+                joined = true;
+                break;
+            }
+        }
+        if (!joined) {
+            m_pending.append(Job{path, Encoder(), data, offset});
+        }
+        startThread();
+        if (!m_waitingForWork) {
+            return;
+        }
+    }
+    m_wake.wakeOne();
+}
+
+void StateWriter::startThread()
+{
+    if (!m_thread) {
+        m_thread = QThread::create([this]() { run(); });
+        m_thread->start(QThread::LowPriority);
+    }
+}
+
+void StateWriter::waitForIdle()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_pending.isEmpty() || m_busy) {
+        m_wake.wakeOne();
+        m_idle.wait(&m_mutex);
+    }
+}
+
+int StateWriter::failedWrites() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_failedWrites;
+}
+
+void StateWriter::run()
+{
+    forever {
+        QVector<Job> jobs;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_pending.isEmpty() && !m_stopping) {
+                m_waitingForWork = true;
+                m_wake.wait(&m_mutex);
+                m_waitingForWork = false;
+            }
+            if (m_pending.isEmpty() && m_stopping) {
+                return;
+            }
+            if (!m_stopping) {
+                m_wake.wait(&m_mutex, kCoalesceWindowMs);
+            }
+            jobs.swap(m_pending);
+            m_busy = true;
+        }
+
+        int failures = 0;
+        bool succeeded = false;
+        for (const auto &job : jobs) {
+            const bool written = job.offset < 0 ? writeFile(job.path, job.encoder())
+                                                : writeFileAt(job.path, job.offset, job.data);
+            if (written) {
+                failures = 0;
+                succeeded = true;
+            } else {
+                ++failures;
+            }
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_failedWrites = succeeded ? failures : m_failedWrites + failures;
+        m_busy = false;
+        if (m_pending.isEmpty()) {
+            m_idle.wakeAll();
+        }
+    }
+}
+
+bool StateWriter::writeFile(const QString &path, const QByteArray &data)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool StateWriter::writeFileAt(const QString &path, qint64 offset, const QByteArray &data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    // a gap would read as records; the reader pads it on the next open
+    if (file.size() < offset) {
+        return false;
+    }
+    return file.resize(offset) && file.seek(offset) && file.write(data) == data.size() && file.flush();
+}
@@ -0,0 +1,61 @@
+#ifndef STATEWRITER_H
+#define STATEWRITER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+#include <functional>
+
+class QThread;
+
+// Background writer for profile files. Callers hand over an encoder that
+// owns an immutable snapshot; encoding and the atomic QSaveFile replace
+// happen on the writer thread. A newer submission for the same path
+// replaces one that has not been written yet, so bursts collapse into a
+// single write. Jobs run in the order they were (last) submitted.
+// writeAt() instead patches a file in place for append-only files.
+class StateWriter
+{
+public:
+    using Encoder = std::function<QByteArray()>;
+
+    StateWriter();
+    ~StateWriter();
+
+    void submit(const QString &path, Encoder encoder);
+    // cuts the file at offset and writes data there, so a write repeated
+    // after a crash lands on the same bytes; a write that continues one
+    // still pending for the path joins it
+    void writeAt(const QString &path, qint64 offset, const QByteArray &data);
+    void waitForIdle();
+    // writes that failed since the last one that succeeded
+    int failedWrites() const;
+
+private:
+    struct Job {
+        QString path;
+        Encoder encoder;
+        // in-place writes carry their bytes and an offset of zero or more
+        QByteArray data;
+        qint64 offset = -1;
+    };
+
+    void startThread();
+    void run();
+    static bool writeFile(const QString &path, const QByteArray &data);
+    static bool writeFileAt(const QString &path, qint64 offset, const QByteArray &data);
+
+    QThread *m_thread = nullptr;
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_idle;
+    QVector<Job> m_pending;
+    bool m_busy = false;
+    bool m_waitingForWork = false;
+    bool m_stopping = false;
+    int m_failedWrites = 0;
+};
+
+#endif // STATEWRITER_H
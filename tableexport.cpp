@@ -0,0 +1,566 @@
+#include "tableexport.h"
+
+#include <QDateTime>
+#include <QIODevice>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+constexpr char kArrowMagic[] = "ARROW1";
+constexpr quint32 kContinuation = 0xffffffffu;
+constexpr qint16 kMetadataV5 = 4;
+
+// flatbuffer union tags from Message.fbs and Schema.fbs
+constexpr quint8 kHeaderSchema = 1;
+constexpr quint8 kHeaderRecordBatch = 3;
+constexpr quint8 kTypeInt = 2;
+constexpr quint8 kTypeFloatingPoint = 3;
+constexpr quint8 kTypeUtf8 = 5;
+constexpr quint8 kTypeBool = 6;
+constexpr quint8 kTypeTimestamp = 10;
+constexpr qint16 kPrecisionDouble = 2;
+constexpr qint16 kUnitMillisecond = 1;
+
+int valueWidth(ExportType type)
+{
+    switch (type) {
+    case ExportType::Int32:
+    case ExportType::Utf8:
+        return 4;
+    case ExportType::Int64:
+    case ExportType::Float64:
+    case ExportType::TimestampMs:
+        return 8;
+    case ExportType::Bool:
+        return 0;
+    }
+    return 0;
+}
+
+int paddingTo8(qint64 size)
+{
+    return static_cast<int>((8 - size % 8) % 8);
+}
+
+template <typename T>
+void appendLittleEndian(QByteArray *out, T value)
+{
+    uchar bytes[sizeof(T)];
+    qToLittleEndian<T>(value, bytes);
+    out->append(reinterpret_cast<const char *>(bytes), sizeof(T));
+}
+
+// Just enough of a flatbuffers builder for the Arrow metadata. Like the
+// reference builder it writes back to front, so children are created
+// before the objects that point at them and every offset points forward.
+// Positions are distances from the end of the buffer.
+class FlatBuilder
+{
+public:
+    quint32 size() const
+    {
+        return static_cast<quint32>(m_buffer.size());
+    }
+
+    template <typename T>
+    void addScalar(int field, T value)
+    {
+        prependScalar(value);
+        m_fields.append({field, size()});
+    }
+
+    void addOffset(int field, quint32 target)
+    {
+        prependOffset(target);
+        m_fields.append({field, size()});
+    }
+
+    quint32 createString(const QByteArray &utf8)
+    {
+        align(utf8.size() + 1, 4);
+        m_buffer.prepend('\0');
+        m_buffer.prepend(utf8);
+        prependRaw<quint32>(static_cast<quint32>(utf8.size()));
+        return size();
+    }
+
+    quint32 createOffsetVector(const QVector<quint32> &targets)
+    {
+        align(static_cast<int>(targets.size()) * 4, 4);
+        for (int i = static_cast<int>(targets.size()) - 1; i >= 0; --i) {
+            prependOffset(targets.at(i));
+        }
+        prependRaw<quint32>(static_cast<quint32>(targets.size()));
+        return size();
+    }
+
+    quint32 createStructVector(const QByteArray &packed, int count, int alignment)
+    {
+        align(packed.size(), qMax(4, alignment));
+        m_buffer.prepend(packed);
+        prependRaw<quint32>(static_cast<quint32>(count));
+        return size();
+    }
+
+    void startTable()
+    {
+        m_fields.clear();
+        m_tableStart = size();
+    }
+
+    quint32 endTable()
+    {
+        prependScalar<qint32>(0);
+        const quint32 table = size();
+        int slotCount = 0;
+        for (const auto &field : m_fields) {
+            slotCount = qMax(slotCount, field.id + 1);
+        }
+        QVector<quint16> slots(slotCount, 0);
+        for (const auto &field : m_fields) {
+            slots[field.id] = static_cast<quint16>(table - field.position);
+        }
+        for (int i = slotCount - 1; i >= 0; --i) {
+            prependRaw<quint16>(slots.at(i));
+        }
+        prependRaw<quint16>(static_cast<quint16>(table - m_tableStart));
+        prependRaw<quint16>(static_cast<quint16>(4 + 2 * slotCount));
+        const quint32 vtable = size();
+        // the table starts with the distance back to its vtable
+        qToLittleEndian<qint32>(static_cast<qint32>(vtable - table),
+                                reinterpret_cast<uchar *>(m_buffer.data()) + (size() - table));
+        m_fields.clear();
+        return table;
+    }
+
+    QByteArray finish(quint32 root)
+    {
+        align(4, m_maxAlign);
+        prependOffset(root);
+        return m_buffer;
+    }
+
+private:
+    struct FieldSlot {
+        int id;
+        quint32 position;
+    };
+
+    void align(int bytes, int alignment)
+    {
+        m_maxAlign = qMax(m_maxAlign, alignment);
+        const int remainder = static_cast<int>((size() + static_cast<quint32>(bytes)) % static_cast<quint32>(alignment));
+        if (remainder != 0) {
+            m_buffer.prepend(QByteArray(alignment - remainder, '\0'));
+        }
+    }
+
+    template <typename T>
+    void prependRaw(T value)
+    {
+        uchar bytes[sizeof(T)];
+        qToLittleEndian<T>(value, bytes);
+        m_buffer.prepend(reinterpret_cast<const char *>(bytes), sizeof(T));
+    }
+
+    template <typename T>
+    void prependScalar(T value)
+    {
+        align(sizeof(T), sizeof(T));
+        prependRaw(value);
+    }
+
+    void prependOffset(quint32 target)
+    {
+        align(4, 4);
+        prependRaw<quint32>(size() + 4 - target);
+    }
+
+    QByteArray m_buffer;
+    QVector<FieldSlot> m_fields;
+    quint32 m_tableStart = 0;
+    int m_maxAlign = 8;
+};
+
+quint32 buildSchema(FlatBuilder &builder, const ExportSchema &schema)
+{
+    QVector<quint32> fields;
+    for (const auto &field : schema) {
+        const quint32 name = builder.createString(field.name.toUtf8());
+        quint8 typeTag = kTypeInt;
+        quint32 type = 0;
+        switch (field.type) {
+        case ExportType::Int32:
+        case ExportType::Int64:
+            builder.startTable();
+            builder.addScalar<qint32>(0, field.type == ExportType::Int32 ? 32 : 64);
+            builder.addScalar<quint8>(1, 1);
+            type = builder.endTable();
+            break;
+        case ExportType::Float64:
+            typeTag = kTypeFloatingPoint;
+            builder.startTable();
+            builder.addScalar<qint16>(0, kPrecisionDouble);
+            type = builder.endTable();
+            break;
+        case ExportType::Bool:
+            typeTag = kTypeBool;
+            builder.startTable();
+            type = builder.endTable();
+            break;
+        case ExportType::Utf8:
+            typeTag = kTypeUtf8;
+            builder.startTable();
+            type = builder.endTable();
+            break;
+        case ExportType::TimestampMs: {
+            typeTag = kTypeTimestamp;
+            const quint32 timezone = builder.createString(QByteArrayLiteral("UTC"));
+            builder.startTable();
+            builder.addScalar<qint16>(0, kUnitMillisecond);
+            builder.addOffset(1, timezone);
+            type = builder.endTable();
+            break;
+        }
+        }
+        const quint32 children = builder.createOffsetVector({});
+        builder.startTable();
+        builder.addOffset(0, name);
+        builder.addScalar<quint8>(1, 0);
+        builder.addScalar<quint8>(2, typeTag);
+        builder.addOffset(3, type);
+        builder.addOffset(5, children);
+        fields.append(builder.endTable());
+    }
+    const quint32 fieldVector = builder.createOffsetVector(fields);
+    builder.startTable();
+    builder.addScalar<qint16>(0, 0);
+    builder.addOffset(1, fieldVector);
+    return builder.endTable();
+}
+
+QByteArray encodeMessage(const QByteArray &metadata, const QByteArray &body)
+{
+    QByteArray message;
+    appendLittleEndian<quint32>(&message, kContinuation);
+    const int padding = paddingTo8(metadata.size());
+    appendLittleEndian<qint32>(&message, metadata.size() + padding);
+    message.append(metadata);
+    message.append(QByteArray(padding, '\0'));
+    message.append(body);
+    return message;
+}
+
+QByteArray messageMetadata(FlatBuilder &builder, quint8 headerType, quint32 header, qint64 bodyLength)
+{
+    builder.startTable();
+    builder.addScalar<qint64>(3, bodyLength);
+    builder.addOffset(2, header);
+    builder.addScalar<qint16>(0, kMetadataV5);
+    builder.addScalar<quint8>(1, headerType);
+    return builder.finish(builder.endTable());
+}
+
+QByteArray csvEscaped(const QByteArray &text)
+{
+    if (!text.contains(',') && !text.contains('"') && !text.contains('\n') && !text.contains('\r')) {
+        return text;
+    }
+    QByteArray quoted = text;
+    quoted.replace("\"", "\"\"");
+    return '"' + quoted + '"';
+}
+}
+
+ExportChunk::ExportChunk(const ExportSchema &schema)
+    : m_schema(schema)
+{
+    m_columns.resize(schema.size());
+    for (int i = 0; i < schema.size(); ++i) {
+        m_columns[i].type = schema.at(i).type;
+    }
+    clear();
+}
+
+void ExportChunk::clear()
+{
+    for (auto &column : m_columns) {
+        column.values.clear();
+        column.text.clear();
+        if (column.type == ExportType::Utf8) {
+            appendLittleEndian<qint32>(&column.values, 0);
+        }
+    }
+    m_rows = 0;
+    m_nextColumn = 0;
+}
+
+int ExportChunk::rowCount() const
+{
+    return m_rows;
+}
+
+bool ExportChunk::isEmpty() const
+{
+    return m_rows == 0;
+}
+
+const ExportSchema &ExportChunk::schema() const
+{
+    return m_schema;
+}
+
+const ExportChunk::Column &ExportChunk::column(int index) const
+{
+    return m_columns.at(index);
+}
+
+ExportChunk::Column &ExportChunk::nextColumn()
+{
+    Column &column = m_columns[m_nextColumn];
+    if (++m_nextColumn == m_columns.size()) {
+        m_nextColumn = 0;
+        ++m_rows;
+    }
+    return column;
+}
+
+void ExportChunk::addInt(qint64 value)
+{
+    Column &column = nextColumn();
+    Q_ASSERT(column.type == ExportType::Int32 || column.type == ExportType::Int64);
+    if (column.type == ExportType::Int32) {
+        appendLittleEndian<qint32>(&column.values, static_cast<qint32>(value));
+    } else {
+        appendLittleEndian<qint64>(&column.values, value);
+    }
+}
+
+void ExportChunk::addDouble(double value)
+{
+    Column &column = nextColumn();
+    Q_ASSERT(column.type == ExportType::Float64);
+    quint64 bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    appendLittleEndian<quint64>(&column.values, bits);
+}
+
+void ExportChunk::addBool(bool value)
+{
+    // the row index is still the current row while its columns fill up
+    const int row = m_rows;
+    Column &column = nextColumn();
+    Q_ASSERT(column.type == ExportType::Bool);
+    if (row % 8 == 0) {
+        column.values.append('\0');
+    }
+    if (value) {
+        column.values.data()[row / 8] = static_cast<char>(column.values.at(row / 8) | (1 << (row % 8)));
+    }
+}
+
+void ExportChunk::addString(const QString &value)
+{
+    Column &column = nextColumn();
+    Q_ASSERT(column.type == ExportType::Utf8);
+    column.text.append(value.toUtf8());
+    appendLittleEndian<qint32>(&column.values, static_cast<qint32>(column.text.size()));
+}
+
+void ExportChunk::addTimestamp(qint64 msecsSinceEpoch)
+{
+    Column &column = nextColumn();
+    Q_ASSERT(column.type == ExportType::TimestampMs);
+    appendLittleEndian<qint64>(&column.values, msecsSinceEpoch);
+}
+
+QByteArray ExportChunk::csvHeader(const ExportSchema &schema)
+{
+    QByteArray header;
+    for (int i = 0; i < schema.size(); ++i) {
+        if (i > 0) {
+            header.append(',');
+        }
+        header.append(csvEscaped(schema.at(i).name.toUtf8()));
+    }
+    header.append('\n');
+    return header;
+}
+
+QByteArray ExportChunk::toCsv() const
+{
+    QByteArray csv = csvHeader(m_schema);
+    appendCsv(&csv);
+    return csv;
+}
+
+void ExportChunk::appendCsv(QByteArray *out) const
+{
+    for (int row = 0; row < m_rows; ++row) {
+        for (int c = 0; c < m_columns.size(); ++c) {
+            if (c > 0) {
+                out->append(',');
+            }
+            const Column &column = m_columns.at(c);
+            const uchar *values = reinterpret_cast<const uchar *>(column.values.constData());
+            switch (column.type) {
+            case ExportType::Int32:
+                out->append(QByteArray::number(qFromLittleEndian<qint32>(values + row * 4)));
+                break;
+            case ExportType::Int64:
+                out->append(QByteArray::number(qFromLittleEndian<qint64>(values + row * 8)));
+                break;
+            case ExportType::Float64: {
+                const quint64 bits = qFromLittleEndian<quint64>(values + row * 8);
+                double value = 0.0;
+                memcpy(&value, &bits, sizeof(value));
+                out->append(QByteArray::number(value, 'g', 10));
+                break;
+            }
+            case ExportType::Bool:
+                out->append((values[row / 8] >> (row % 8)) & 1 ? "true" : "false");
+                break;
+            case ExportType::Utf8: {
+                const qint32 begin = qFromLittleEndian<qint32>(values + row * 4);
+                const qint32 end = qFromLittleEndian<qint32>(values + (row + 1) * 4);
+                out->append(csvEscaped(column.text.mid(begin, end - begin)));
+                break;
+            }
+            case ExportType::TimestampMs: {
+                const qint64 msecs = qFromLittleEndian<qint64>(values + row * 8);
+                out->append(QDateTime::fromMSecsSinceEpoch(msecs, Qt::UTC).toString(Qt::ISODateWithMs).toUtf8());
+                break;
+            }
+            }
+        }
+        out->append('\n');
+    }
+}
+
+ArrowIpcWriter::ArrowIpcWriter(QIODevice *device, const ExportSchema &schema)
+    : m_device(device)
+    , m_schema(schema)
+{
+}
+
+bool ArrowIpcWriter::write(const QByteArray &bytes)
+{
+    if (m_device->write(bytes) != bytes.size()) {
+        return false;
+    }
+    m_position += bytes.size();
+    return true;
+}
+
+bool ArrowIpcWriter::begin()
+{
+    QByteArray magic(kArrowMagic, 6);
+    magic.append(QByteArray(2, '\0'));
+    FlatBuilder builder;
+    const quint32 schema = buildSchema(builder, m_schema);
+    return write(magic) && write(encodeMessage(messageMetadata(builder, kHeaderSchema, schema, 0), QByteArray()));
+}
+
+QByteArray ArrowIpcWriter::encodeBatch(const ExportChunk &chunk)
+{
+    const qint64 rows = chunk.rowCount();
+    QByteArray body;
+    QByteArray nodes;
+    QByteArray buffers;
+    auto addBuffer = [&](const QByteArray &bytes) {
+        appendLittleEndian<qint64>(&buffers, body.size());
+        appendLittleEndian<qint64>(&buffers, bytes.size());
+        body.append(bytes);
+        body.append(QByteArray(paddingTo8(bytes.size()), '\0'));
+    };
+
+    for (int c = 0; c < chunk.schema().size(); ++c) {
+        const auto &column = chunk.column(c);
+        appendLittleEndian<qint64>(&nodes, rows);
+        appendLittleEndian<qint64>(&nodes, 0);
+        // no nulls, so every validity bitmap is empty
+        addBuffer(QByteArray());
+        if (column.type == ExportType::Utf8) {
+            addBuffer(column.values.left(static_cast<int>((rows + 1) * 4)));
+            addBuffer(column.text);
+        } else if (column.type == ExportType::Bool) {
+            addBuffer(column.values.left(static_cast<int>((rows + 7) / 8)));
+        } else {
+            addBuffer(column.values.left(static_cast<int>(rows * valueWidth(column.type))));
+        }
+    }
+
+    FlatBuilder builder;
+    const quint32 bufferVector = builder.createStructVector(buffers, static_cast<int>(buffers.size() / 16), 8);
+    const quint32 nodeVector = builder.createStructVector(nodes, static_cast<int>(nodes.size() / 16), 8);
+    builder.startTable();
+    builder.addScalar<qint64>(0, rows);
+    builder.addOffset(1, nodeVector);
+    builder.addOffset(2, bufferVector);
+    const quint32 batch = builder.endTable();
+    return encodeMessage(messageMetadata(builder, kHeaderRecordBatch, batch, body.size()), body);
+}
+
+bool ArrowIpcWriter::writeChunk(const ExportChunk &chunk)
+{
+    return writeEncodedBatch(encodeBatch(chunk));
+}
+
+bool ArrowIpcWriter::writeEncodedBatch(const QByteArray &message)
+{
+    if (message.size() < 8) {
+        return false;
+    }
+    Block block;
+    block.offset = m_position;
+    block.metadataLength = 8 + qFromLittleEndian<qint32>(reinterpret_cast<const uchar *>(message.constData()) + 4);
+    block.bodyLength = message.size() - block.metadataLength;
+    if (!write(message)) {
+        return false;
+    }
+    m_batches.append(block);
+    return true;
+}
+
+bool ArrowIpcWriter::finish()
+{
+    QByteArray endOfStream;
+    appendLittleEndian<quint32>(&endOfStream, kContinuation);
+    appendLittleEndian<qint32>(&endOfStream, 0);
+    if (!write(endOfStream)) {
+        return false;
+    }
+
+    FlatBuilder builder;
+    QByteArray blocks;
+    for (const auto &block : m_batches) {
+        appendLittleEndian<qint64>(&blocks, block.offset);
+        appendLittleEndian<qint32>(&blocks, block.metadataLength);
+        appendLittleEndian<qint32>(&blocks, 0);
+        appendLittleEndian<qint64>(&blocks, block.bodyLength);
+    }
+    const quint32 batchVector = builder.createStructVector(blocks, static_cast<int>(m_batches.size()), 8);
+    const quint32 dictionaryVector = builder.createStructVector(QByteArray(), 0, 8);
+    const quint32 schema = buildSchema(builder, m_schema);
+    builder.startTable();
+    builder.addOffset(1, schema);
+    builder.addOffset(2, dictionaryVector);
+    builder.addOffset(3, batchVector);
+    builder.addScalar<qint16>(0, kMetadataV5);
+    const QByteArray footer = builder.finish(builder.endTable());
+
+    QByteArray tail = footer;
+    appendLittleEndian<qint32>(&tail, footer.size());
+    tail.append(kArrowMagic, 6);
+    return write(tail);
+}
+
+bool writeFileAtomically(const QString &path, const QByteArray &data)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        return false;
+    }
+    return file.commit();
+}
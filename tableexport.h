@@ -0,0 +1,103 @@
+#ifndef TABLEEXPORT_H
+#define TABLEEXPORT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+class QIODevice;
+
+enum class ExportType : quint8 {
+    Int32,
+    Int64,
+    Float64,
+    Bool,
+    Utf8,
+    // milliseconds since the epoch, UTC
+    TimestampMs
+};
+
+struct ExportField {
+    QString name;
+    ExportType type = ExportType::Int32;
+};
+
+using ExportSchema = QVector<ExportField>;
+
+// A run of rows kept column by column in Arrow's little-endian memory
+// layout, so the Arrow writer can emit the buffers as they are. Values are
+// added in schema order, one row after the other.
+class ExportChunk
+{
+public:
+    struct Column {
+        ExportType type = ExportType::Int32;
+        // fixed-width values, packed bits for Bool, int32 offsets for Utf8
+        QByteArray values;
+        QByteArray text;
+    };
+
+    explicit ExportChunk(const ExportSchema &schema);
+
+    void clear();
+    int rowCount() const;
+    bool isEmpty() const;
+    const ExportSchema &schema() const;
+    const Column &column(int index) const;
+
+    void addInt(qint64 value);
+    void addDouble(double value);
+    void addBool(bool value);
+    void addString(const QString &value);
+    void addTimestamp(qint64 msecsSinceEpoch);
+
+    static QByteArray csvHeader(const ExportSchema &schema);
+    void appendCsv(QByteArray *out) const;
+    // the header and every row, for a table written in one go
+    QByteArray toCsv() const;
+
+private:
+    Column &nextColumn();
+
+    ExportSchema m_schema;
+    QVector<Column> m_columns;
+    int m_rows = 0;
+    int m_nextColumn = 0;
+};
+
+// replaces path with data through QSaveFile, so readers never see half a file
+bool writeFileAtomically(const QString &path, const QByteArray &data);
+
+// Writes the Arrow IPC file format (metadata version 5): the schema
+// message, one record batch per chunk, the end-of-stream marker and the
+// footer that indexes the batches. Batches can be encoded on any thread
+// and handed to writeEncodedBatch() in any order.
+class ArrowIpcWriter
+{
+public:
+    ArrowIpcWriter(QIODevice *device, const ExportSchema &schema);
+
+    bool begin();
+    bool writeChunk(const ExportChunk &chunk);
+    bool writeEncodedBatch(const QByteArray &message);
+    bool finish();
+
+    static QByteArray encodeBatch(const ExportChunk &chunk);
+
+private:
+    struct Block {
+        qint64 offset = 0;
+        qint32 metadataLength = 0;
+        qint64 bodyLength = 0;
+    };
+
+    bool write(const QByteArray &bytes);
+
+    QIODevice *m_device = nullptr;
+    ExportSchema m_schema;
+    qint64 m_position = 0;
+    QVector<Block> m_batches;
+};
+
+#endif // TABLEEXPORT_H
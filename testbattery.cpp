@@ -0,0 +1,343 @@
+#include "testbattery.h"
+
+#include "tonesynth.h"
+#include "trainingmodel.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QJsonArray>
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr int kPitchCount = 12;
+constexpr int kOctaves[] = {4, 5, 6};
+constexpr int kOctaveCount = int(sizeof(kOctaves) / sizeof(kOctaves[0]));
+constexpr int kItemCount = kPitchCount * kOctaveCount;
+// orders dead-ended by a search are retried from the next draw; a path
+// over three octaves turns up within a few hundred steps
+constexpr int kSearchSteps = 20000;
+
+// fixed for good: changing either changes every later test's order
+constexpr quint32 kPreSeed = 0x70726531u;
+constexpr quint32 kPostSeed = 0x706f7331u;
+
+int itemPitch(int item)
+{
+    return item % kPitchCount;
+}
+
+int itemOctave(int item)
+{
+    return kOctaves[item / kPitchCount];
+}
+
+int itemMidi(int item)
+{
+    return 60 + itemPitch(item) + (itemOctave(item) - 4) * 12;
+}
+
+bool canFollow(int previous, int next)
+{
+    return itemPitch(previous) != itemPitch(next)
+           && std::abs(itemMidi(next) - itemMidi(previous)) >= TestBattery::kMinIntervalSemitones;
+}
+
+struct OrderSearch {
+    std::array<int, kItemCount> path{};
+    std::array<bool, kItemCount> used{};
+    int steps = 0;
+    ScheduleRng *rng = nullptr;
+
+    int onwardCount(int item) const
+    {
+        int count = 0;
+        for (int other = 0; other < kItemCount; ++other) {
+            if (!used[other] && other != item && canFollow(item, other)) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // depth-first, trying the most constrained followers first in a random
+    // order among equals
+    bool extend(int depth)
+    {
+        if (depth == kItemCount) {
+            return true;
+        }
+        if (++steps > kSearchSteps) {
+            return false;
+        }
+        std::array<int, kItemCount> candidates{};
+        int count = 0;
+        for (int item = 0; item < kItemCount; ++item) {
+            if (!used[item] && canFollow(path[depth - 1], item)) {
+                candidates[count++] = item;
+            }
+        }
+        for (int i = count - 1; i > 0; --i) {
+            std::swap(candidates[i], candidates[rng->bounded(i + 1)]);
+        }
+        std::array<int, kItemCount> onward{};
+        for (int i = 0; i < count; ++i) {
+            used[candidates[i]] = true;
+            onward[candidates[i]] = onwardCount(candidates[i]);
+            used[candidates[i]] = false;
+        }
+        std::stable_sort(candidates.begin(), candidates.begin() + count,
+                         [&onward](int a, int b) { return onward[a] < onward[b]; });
+        for (int i = 0; i < count; ++i) {
+            const int item = candidates[i];
+            used[item] = true;
+            path[depth] = item;
+            if (extend(depth + 1)) {
+                return true;
+            }
+            used[item] = false;
+            if (steps > kSearchSteps) {
+                return false;
+            }
+        }
+        return false;
+    }
+};
+
+QVector<ScheduledTrial> buildOrder(quint32 seed)
+{
+    ScheduleRng rng(seed);
+    OrderSearch search;
+    search.rng = &rng;
+    bool found = false;
+    while (!found) {
+        search.used.fill(false);
+        search.steps = 0;
+        search.path[0] = rng.bounded(kItemCount);
+        search.used[search.path[0]] = true;
+        found = search.extend(1);
+    }
+    QVector<ScheduledTrial> trials(kItemCount);
+    for (int i = 0; i < kItemCount; ++i) {
+        trials[i].pitch = static_cast<qint8>(itemPitch(search.path[i]));
+        trials[i].octave = static_cast<qint8>(itemOctave(search.path[i]));
+    }
+    return trials;
+}
+
+int toneKey(const ScheduledTrial &trial)
+{
+    return trial.pitch * 16 + trial.octave;
+}
+
+} // namespace
+
+TestBattery::TestBattery(Form form)
+    : m_form(form)
+{
+    // the same two orders every run, so build each once
+    static const QVector<ScheduledTrial> preOrder = buildOrder(kPreSeed);
+    static const QVector<ScheduledTrial> postOrder = buildOrder(kPostSeed);
+    m_trials = form == Form::Pre ? preOrder : postOrder;
+}
+
+bool TestBattery::formFromName(const QString &name, Form *form)
+{
+    if (name == QLatin1String("pre")) {
+        *form = Form::Pre;
+        return true;
+    }
+    if (name == QLatin1String("post")) {
+        *form = Form::Post;
+        return true;
+    }
+    return false;
+}
+
+TestBattery::Form TestBattery::form() const
+{
+    return m_form;
+}
+
+QString TestBattery::formName() const
+{
+    return m_form == Form::Pre ? QStringLiteral("pre") : QStringLiteral("post");
+}
+
+quint32 TestBattery::seed() const
+{
+    return m_form == Form::Pre ? kPreSeed : kPostSeed;
+}
+
+quint16 TestBattery::octaveMask()
+{
+    quint16 mask = 0;
+    for (int octave : kOctaves) {
+        mask |= static_cast<quint16>(1u << octave);
+    }
+    return mask;
+}
+
+int TestBattery::trialCount() const
+{
+    return static_cast<int>(m_trials.size());
+}
+
+const QVector<ScheduledTrial> &TestBattery::trials() const
+{
+    return m_trials;
+}
+
+qint64 TestBattery::framesForMs(qint64 ms)
+{
+    return ms * ToneSynth::kSampleRate / 1000;
+}
+
+qint64 TestBattery::msForFrames(qint64 frames)
+{
+    return frames * 1000 / ToneSynth::kSampleRate;
+}
+
+qint64 TestBattery::onsetFrame(int trial) const
+{
+    return framesForMs(kLeadInMs) + trial * framesForMs(kInterOnsetMs);
+}
+
+qint64 TestBattery::responseEndFrame(int trial) const
+{
+    return onsetFrame(trial) + framesForMs(kResponseLimitMs);
+}
+
+qint64 TestBattery::frameCount() const
+{
+    return onsetFrame(trialCount());
+}
+
+int TestBattery::trialAt(qint64 frame) const
+{
+    const qint64 offset = frame - framesForMs(kLeadInMs);
+    if (offset < 0) {
+        return -1;
+    }
+    const qint64 trial = offset / framesForMs(kInterOnsetMs);
+    if (trial >= trialCount() || frame >= responseEndFrame(static_cast<int>(trial))) {
+        return -1;
+    }
+    return static_cast<int>(trial);
+}
+
+QString TestBattery::timelineHash() const
+{
+    QByteArray canonical;
+    QDataStream stream(&canonical, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << seed() << qint32(ToneSynth::kSampleRate) << qint32(ToneSynth::kToneDurationMs);
+    for (int i = 0; i < trialCount(); ++i) {
+        stream << onsetFrame(i) << responseEndFrame(i) << qint8(m_trials.at(i).pitch) << qint8(m_trials.at(i).octave);
+    }
+    return QString::fromLatin1(QCryptographicHash::hash(canonical, QCryptographicHash::Sha256).toHex());
+}
+
+QJsonObject TestBattery::toJson() const
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    QJsonArray trials;
+    for (int i = 0; i < trialCount(); ++i) {
+        const ScheduledTrial &trial = m_trials.at(i);
+        trials.append(QJsonObject{
+            {QStringLiteral("pitch"), order.value(trial.pitch)},
+            {QStringLiteral("octave"), trial.octave},
+            {QStringLiteral("onsetFrame"), onsetFrame(i)},
+            {QStringLiteral("onsetMs"), msForFrames(onsetFrame(i))}
+        });
+    }
+    return {
+        {QStringLiteral("form"), formName()},
+        {QStringLiteral("seed"), static_cast<qint64>(seed())},
+        {QStringLiteral("sampleRate"), ToneSynth::kSampleRate},
+        {QStringLiteral("interOnsetFrames"), framesForMs(kInterOnsetMs)},
+        {QStringLiteral("responseLimitMs"), kResponseLimitMs},
+        {QStringLiteral("frames"), frameCount()},
+        {QStringLiteral("hash"), timelineHash()},
+        {QStringLiteral("trials"), trials}
+    };
+}
+
+BatteryTimeline::BatteryTimeline(const TestBattery &battery, QObject *parent)
+    : QIODevice(parent)
+    , m_battery(battery)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    for (const ScheduledTrial &trial : battery.trials()) {
+        const int key = toneKey(trial);
+        if (!m_tones.contains(key)) {
+            m_tones.insert(key, ToneSynth::tone(ToneSynth::frequencyFor(order.value(trial.pitch), trial.octave)));
+        }
+    }
+}
+
+const TestBattery &BatteryTimeline::battery() const
+{
+    return m_battery;
+}
+
+bool BatteryTimeline::isSequential() const
+{
+    return false;
+}
+
+qint64 BatteryTimeline::size() const
+{
+    return m_battery.frameCount() * kBytesPerFrame;
+}
+
+QByteArray BatteryTimeline::render() const
+{
+    QByteArray pcm(static_cast<int>(size()), '\0');
+    for (int i = 0; i < m_battery.trialCount(); ++i) {
+        const QByteArray tone = m_tones.value(toneKey(m_battery.trials().at(i)));
+        const qint64 start = m_battery.onsetFrame(i) * kBytesPerFrame;
+        std::memcpy(pcm.data() + start, tone.constData(), static_cast<size_t>(qMin<qint64>(tone.size(), pcm.size() - start)));
+    }
+    return pcm;
+}
+
+qint64 BatteryTimeline::readData(char *data, qint64 maxSize)
+{
+    const qint64 start = pos();
+    // whole frames only, so a read never splits a sample
+    const qint64 length = qMin(maxSize, size() - start) / kBytesPerFrame * kBytesPerFrame;
+    if (length <= 0) {
+        return 0;
+    }
+    std::memset(data, 0, static_cast<size_t>(length));
+    const qint64 end = start + length;
+    const qint64 interOnset = TestBattery::framesForMs(TestBattery::kInterOnsetMs) * kBytesPerFrame;
+    const qint64 leadIn = TestBattery::framesForMs(TestBattery::kLeadInMs) * kBytesPerFrame;
+    // a tone is shorter than the inter-onset interval, so only the trial
+    // before the first byte can reach into this read
+    int trial = static_cast<int>(qMax<qint64>(0, (start - leadIn) / interOnset));
+    for (; trial < m_battery.trialCount(); ++trial) {
+        const qint64 toneStart = m_battery.onsetFrame(trial) * kBytesPerFrame;
+        if (toneStart >= end) {
+            break;
+        }
+        const QByteArray tone = m_tones.value(toneKey(m_battery.trials().at(trial)));
+        const qint64 from = qMax(start, toneStart);
+        const qint64 to = qMin(end, toneStart + tone.size());
+        if (from < to) {
+            std::memcpy(data + (from - start), tone.constData() + (from - toneStart), static_cast<size_t>(to - from));
+        }
+    }
+    return length;
+}
+
+qint64 BatteryTimeline::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
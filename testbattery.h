@@ -0,0 +1,93 @@
+#ifndef TESTBATTERY_H
+#define TESTBATTERY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include "trialscheduler.h"
+
+// The paper's pre/post test: every pitch class in each test octave once, no
+// feedback, a 5 s response limit and each tone more than an octave and a
+// pitch class away from the one before. Both forms are drawn from fixed
+// seeds, so every participant hears the same order on every machine, and
+// the whole run is laid out up front as a timeline in sample frames: tone
+// i starts exactly at onsetFrame(i), and the inter-onset interval is a
+// whole number of frames. Responses are scored against the same frames.
+class TestBattery
+{
+public:
+    enum class Form {
+        Pre,
+        Post
+    };
+
+    static constexpr int kLeadInMs = 2000;
+    static constexpr int kResponseLimitMs = 5000;
+    // onset to onset: the response window plus a short silence
+    static constexpr int kInterOnsetMs = 6000;
+    static constexpr int kMinIntervalSemitones = 13;
+
+    explicit TestBattery(Form form = Form::Pre);
+
+    static bool formFromName(const QString &name, Form *form);
+    Form form() const;
+    QString formName() const;
+    quint32 seed() const;
+    // a bit per test octave, as in ScheduleConstraints::octaveMask
+    static quint16 octaveMask();
+
+    int trialCount() const;
+    const QVector<ScheduledTrial> &trials() const;
+
+    static qint64 framesForMs(qint64 ms);
+    static qint64 msForFrames(qint64 frames);
+    qint64 onsetFrame(int trial) const;
+    // first frame after the trial's response window
+    qint64 responseEndFrame(int trial) const;
+    qint64 frameCount() const;
+    // the trial whose response window holds this frame, or -1
+    int trialAt(qint64 frame) const;
+
+    // SHA-256 over the seed, the sample rate and every trial's onset, pitch
+    // and octave; equal hashes mean sample-identical timing
+    QString timelineHash() const;
+    QJsonObject toJson() const;
+
+private:
+    Form m_form;
+    QVector<ScheduledTrial> m_trials;
+};
+
+// Pull-mode 16-bit mono PCM of a whole battery: silence with each trial's
+// synthesised tone copied in at its onset frame. The audio device reads it
+// at its own clock, so the spacing between tones does not depend on when
+// the GUI thread gets to run. Tones are rendered once per pitch and octave.
+class BatteryTimeline : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit BatteryTimeline(const TestBattery &battery, QObject *parent = nullptr);
+
+    const TestBattery &battery() const;
+    bool isSequential() const override;
+    qint64 size() const override;
+    // the whole run in one buffer, for writing it out
+    QByteArray render() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    static constexpr qint64 kBytesPerFrame = 2;
+
+    TestBattery m_battery;
+    // keyed by pitch * 16 + octave
+    QHash<int, QByteArray> m_tones;
+};
+
+#endif // TESTBATTERY_H
@@ -0,0 +1,269 @@
+#include "theme.h"
+
+namespace {
+
+Theme buildTheme()
+{
+    Theme theme;
+    theme.styleSheet = QStringLiteral(R"(
+QMainWindow#PitchTraining {
+    background-color: #f4f6fb;
+}
+QWidget#mainSurface {
+    background-color: #f4f6fb;
+}
+QScrollArea {
+    background-color: transparent;
+    border: none;
+}
+QScrollArea > QWidget > QWidget {
+    background-color: transparent;
+}
+QLabel {
+    color: #0f172a;
+    font-size: 13px;
+}
+QLabel#heroCaption {
+    color: #475569;
+    font-size: 11px;
+    font-weight: 600;
+}
+QLabel#heroAboutLink {
+    color: #0a58ca;
+    font-size: 14px;
+}
+QLabel#heroAboutLink:hover {
+    color: #0a58ca;
+    text-decoration: underline;
+}
+QLabel#levelLabel {
+    font-size: 22px;
+    font-weight: 700;
+    color: #0b1120;
+}
+QLabel#requirementLabel {
+    color: #1f2933;
+    font-size: 13px;
+}
+QFrame#heroFrame,
+QFrame#sectionFrame,
+QFrame#statCard,
+QFrame#specialCard {
+    border-radius: 12px;
+    border: 1px solid #cfd8e3;
+    background-color: #ffffff;
+}
+QLabel#sectionTitle {
+    font-size: 16px;
+    font-weight: 600;
+    color: #0f172a;
+}
+QLabel#sectionSubtitle {
+    font-size: 12px;
+    color: #475569;
+}
+QLabel#statusLabel {
+    font-size: 14px;
+}
+QLabel#statTitle {
+    font-size: 11px;
+    color: #64748b;
+    letter-spacing: 0.05em;
+}
+QLabel#statValue {
+    font-size: 13px;
+    font-weight: 600;
+    color: #0f172a;
+}
+QLabel#hintLabel {
+    font-size: 13px;
+    color: #0f172a;
+    padding: 8px 12px;
+    border-radius: 6px;
+    background-color: #e0f2fe;
+}
+QProgressBar {
+    background-color: #e5e7eb;
+    border: 1px solid #cfd8e3;
+    border-radius: 5px;
+    padding: 2px;
+    color: #0f172a;
+    height: 17px;
+}
+QProgressBar::chunk {
+    border-radius: 4px;
+    background-color: #2563eb;
+}
+QPushButton {
+    background-color: #f9fafb;
+    border: 1px solid #94a3b8;
+    border-radius: 4px;
+    color: #0f172a;
+    font-weight: 600;
+    font-size: 13px;
+    padding: 6px 12px;
+}
+QPushButton:hover:!disabled {
+    background-color: #e2e8f0;
+}
+QPushButton:disabled {
+    color: #94a3b8;
+    border-color: #e2e8f0;
+    background-color: #f4f4f5;
+}
+QPushButton[sessionRequired="true"]:disabled {
+    background-color: #dfe3ea;
+    border-color: #cbd5f5;
+    color: #94a3b8;
+}
+QPushButton[primary="true"] {
+    background-color: #1d4ed8;
+    color: #ffffff;
+    border-color: #1d4ed8;
+    padding: 6px 14px;
+}
+QPushButton[primary="true"]:hover {
+    background-color: #1e40af;
+}
+QPushButton[accent="true"] {
+    background-color: #047857;
+    color: #ffffff;
+    border-color: #047857;
+}
+QPushButton[accent="true"]:hover {
+    background-color: #036749;
+}
+QPushButton[outline="true"] {
+    background-color: transparent;
+    border-color: #0f172a;
+    color: #0f172a;
+}
+QPushButton[outline="true"]:hover {
+    background-color: #e2e8f0;
+}
+QPushButton[link="true"] {
+    background-color: transparent;
+    border: none;
+    color: #0a58ca;
+    font-size: 14px;
+    font-weight: 600;
+    padding: 0;
+}
+QPushButton[link="true"]:hover {
+    text-decoration: underline;
+}
+QComboBox {
+    background-color: #ffffff;
+    border: 1px solid #94a3b8;
+    border-radius: 5px;
+    padding: 5px 26px 5px 10px;
+    color: #0f172a;
+    font-size: 13px;
+}
+QComboBox::drop-down {
+    border: none;
+    width: 20px;
+}
+QComboBox QAbstractItemView {
+    background-color: #ffffff;
+    color: #0f172a;
+    selection-background-color: #e0f2fe;
+    selection-color: #0c4a6e;
+    border: 1px solid #cbd5f5;
+    font-size: 13px;
+}
+QListView#trialLog {
+    background-color: #ffffff;
+    border: 1px solid #d1d5db;
+    border-radius: 8px;
+    padding: 8px;
+    color: #111827;
+}
+QScrollBar:vertical, QScrollBar:horizontal {
+    background: transparent;
+    width: 10px;
+    margin: 4px;
+}
+QScrollBar::handle {
+    background: #cbd5f5;
+    border-radius: 5px;
+}
+QScrollBar::handle:hover {
+    background: #94a3b8;
+}
+QScrollBar::add-line, QScrollBar::sub-line {
+    width: 0px;
+    height: 0px;
+}
+QTabWidget#interactionTabs::pane {
+    border: none;
+}
+QTabWidget#interactionTabs > QTabBar {
+    alignment: center;
+}
+QTabBar::tab {
+    background: transparent;
+    border: none;
+    color: #4b5563;
+    padding: 8px 16px;
+    margin: 0 6px;
+    font-weight: 500;
+}
+QTabBar::tab:selected {
+    color: #1d4ed8;
+    border-bottom: 2px solid #1d4ed8;
+}
+QTabBar::tab:hover:!selected {
+    color: #111827;
+}
+)");
+
+    theme.textPrimary = QColor(0x0f, 0x17, 0x2a);
+    theme.textMuted = QColor(0x94, 0xa3, 0xb8);
+
+    theme.feedbackNeutral = {QColor(0xff, 0xf7, 0xe6), QColor(0xfb, 0xbf, 0x24), QColor(0x92, 0x40, 0x0e)};
+    theme.feedbackPositive = {QColor(0xec, 0xfd, 0xf5), QColor(0x34, 0xd3, 0x99), QColor(0x06, 0x5f, 0x46)};
+    theme.feedbackNegative = {QColor(0xfe, 0xf2, 0xf2), QColor(0xfc, 0xa5, 0xa5), QColor(0x99, 0x1b, 0x1b)};
+
+    theme.logPositive = QColor(0x1b, 0x5e, 0x20);
+    theme.logNegative = QColor(0xb7, 0x1c, 0x1c);
+    theme.logPlaceholder = QColor(0x94, 0xa3, 0xb8);
+    theme.logAlternateRow = QColor(0xf3, 0xf4, 0xf6);
+
+    theme.barTrack = QColor(0xe5, 0xe7, 0xeb);
+    theme.barBorder = QColor(0xcf, 0xd8, 0xe3);
+    theme.barChunk = QColor(0xdc, 0x26, 0x26);
+
+    theme.padBackground = QColor(0xee, 0xf2, 0xff);
+    theme.padBorder = QColor(0xcb, 0xd5, 0xf5);
+    theme.padAccent = QColor(0x1d, 0x4e, 0xd8);
+    theme.padWhiteKey = QColor(0xff, 0xff, 0xff);
+    theme.padWhiteKeyHover = QColor(0xe0, 0xf2, 0xfe);
+    theme.padBlackKey = QColor(0x0f, 0x17, 0x2a);
+    theme.padBlackKeyHover = QColor(0x1e, 0x29, 0x3b);
+    theme.padMutedWhiteKey = QColor(0xf1, 0xf5, 0xf9);
+    theme.padMutedBlackKey = QColor(0xcb, 0xd5, 0xe1);
+    theme.padMutedBorder = QColor(0xcb, 0xd5, 0xf5);
+    return theme;
+}
+
+} // namespace
+
+const FeedbackStyle &Theme::feedback(FeedbackTone tone) const
+{
+    switch (tone) {
+    case FeedbackTone::Positive:
+        return feedbackPositive;
+    case FeedbackTone::Negative:
+        return feedbackNegative;
+    case FeedbackTone::Neutral:
+        break;
+    }
+    return feedbackNeutral;
+}
+
+const Theme &Theme::current()
+{
+    static const Theme s_theme = buildTheme();
+    return s_theme;
+}
@@ -0,0 +1,57 @@
+#ifndef THEME_H
+#define THEME_H
+
+#include <QColor>
+#include <QString>
+
+enum class FeedbackTone {
+    Neutral,
+    Positive,
+    Negative
+};
+
+struct FeedbackStyle {
+    QColor background;
+    QColor border;
+    QColor text;
+};
+
+// Colours and the window stylesheet, built once. Widgets that change state
+// on every trial paint themselves from these values instead of going
+// through stylesheet property selectors.
+struct Theme {
+    QString styleSheet;
+
+    QColor textPrimary;
+    QColor textMuted;
+
+    FeedbackStyle feedbackNeutral;
+    FeedbackStyle feedbackPositive;
+    FeedbackStyle feedbackNegative;
+
+    QColor logPositive;
+    QColor logNegative;
+    QColor logPlaceholder;
+    QColor logAlternateRow;
+
+    QColor barTrack;
+    QColor barBorder;
+    QColor barChunk;
+
+    QColor padBackground;
+    QColor padBorder;
+    QColor padAccent;
+    QColor padWhiteKey;
+    QColor padWhiteKeyHover;
+    QColor padBlackKey;
+    QColor padBlackKeyHover;
+    QColor padMutedWhiteKey;
+    QColor padMutedBlackKey;
+    QColor padMutedBorder;
+
+    const FeedbackStyle &feedback(FeedbackTone tone) const;
+
+    static const Theme &current();
+};
+
+#endif // THEME_H
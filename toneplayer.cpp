@@ -1,13 +1,12 @@
 #include "toneplayer.h"
 
-#include "trainingmodel.h"
+#include "tonesynth.h"
 
 #include <QCoreApplication>
 #include <QDir>
 #include <QFile>
 #include <QUrl>
-#include <QtMath>
-#include <cmath>
+#include <utility>
 
 TonePlayer::TonePlayer(QObject *parent)
     : QObject(parent)
@@ -21,9 +20,11 @@ TonePlayer::TonePlayer(QObject *parent)
     QObject::connect(m_audioOutput.get(), &QAudioSink::stateChanged, this, &TonePlayer::handleStateChanged);
 
     m_mediaOutput = std::make_unique<QAudioOutput>();
-    m_mediaPlayer = new QMediaPlayer(this);
+    m_standbyOutput = std::make_unique<QAudioOutput>();
+    m_mediaPlayer = createMediaPlayer();
     m_mediaPlayer->setAudioOutput(m_mediaOutput.get());
-    QObject::connect(m_mediaPlayer, &QMediaPlayer::playbackStateChanged, this, &TonePlayer::handleMediaStateChanged);
+    m_standbyPlayer = createMediaPlayer();
+    m_standbyPlayer->setAudioOutput(m_standbyOutput.get());
 #else
     m_format.setSampleSize(16);
     m_format.setSampleType(QAudioFormat::SignedInt);
@@ -31,11 +32,22 @@ TonePlayer::TonePlayer(QObject *parent)
     m_audioOutput = std::make_unique<QAudioOutput>(m_format, parent);
     QObject::connect(m_audioOutput.get(), SIGNAL(stateChanged(QAudio::State)), this, SLOT(handleStateChanged(QAudio::State)));
 
-    m_mediaPlayer = new QMediaPlayer(this);
-    QObject::connect(m_mediaPlayer, SIGNAL(stateChanged(QMediaPlayer::State)), this, SLOT(handleMediaStateChanged(QMediaPlayer::State)));
+    m_mediaPlayer = createMediaPlayer();
+    m_standbyPlayer = createMediaPlayer();
 #endif
 }
 
+QMediaPlayer *TonePlayer::createMediaPlayer()
+{
+    auto *player = new QMediaPlayer(this);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    QObject::connect(player, &QMediaPlayer::playbackStateChanged, this, &TonePlayer::handleMediaStateChanged);
+#else
+    QObject::connect(player, SIGNAL(stateChanged(QMediaPlayer::State)), this, SLOT(handleMediaStateChanged(QMediaPlayer::State)));
+#endif
+    return player;
+}
+
 
 
 void TonePlayer::playSample(const ToneSample &sample)
@@ -70,6 +82,59 @@ void TonePlayer::playPcm(const QByteArray &data)
 #endif
 }
 
+void TonePlayer::playStream(QIODevice *device)
+{
+    if (!m_audioOutput || !device) {
+        return;
+    }
+    stop();
+    m_pcmPlaying = true;
+    m_audioOutput->start(device);
+}
+
+qint64 TonePlayer::playedUSecs() const
+{
+    if (!m_audioOutput) {
+        return 0;
+    }
+    // what the device has taken but not yet played is still in its buffer
+    const qint64 buffered = qMax<qint64>(0, m_audioOutput->bufferSize() - m_audioOutput->bytesFree());
+    return qMax<qint64>(0, m_audioOutput->processedUSecs() - m_format.durationForBytes(static_cast<int>(buffered)));
+}
+
+void TonePlayer::prepareSample(const ToneSample &sample)
+{
+    m_prepared = sample;
+    m_standbyLoaded = false;
+    if (!sample.filePath.isEmpty() && QFile::exists(sample.filePath) && m_standbyPlayer) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        m_standbyPlayer->setSource(QUrl::fromLocalFile(sample.filePath));
+#else
+        m_standbyPlayer->setMedia(QUrl::fromLocalFile(sample.filePath));
+#endif
+        m_standbyLoaded = true;
+    }
+}
+
+void TonePlayer::playPrepared()
+{
+    const ToneSample sample = m_prepared;
+    m_prepared = ToneSample{};
+    if (!m_standbyLoaded) {
+        playSample(sample);
+        return;
+    }
+    m_standbyLoaded = false;
+    stop();
+    // the loaded standby becomes the active player
+    std::swap(m_mediaPlayer, m_standbyPlayer);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    std::swap(m_mediaOutput, m_standbyOutput);
+#endif
+    m_mediaPlaying = true;
+    m_mediaPlayer->play();
+}
+
 void TonePlayer::playFile(const QString &path)
 {
     if (!m_mediaPlayer) {
@@ -121,6 +186,9 @@ void TonePlayer::handleStateChanged(QAudio::State state)
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 void TonePlayer::handleMediaStateChanged(QMediaPlayer::PlaybackState state)
 {
+    if (sender() != m_mediaPlayer) {
+        return;
+    }
     if (state == QMediaPlayer::PlaybackState::StoppedState && m_mediaPlaying) {
         m_mediaPlaying = false;
         emit playbackFinished();
@@ -129,6 +197,9 @@ void TonePlayer::handleMediaStateChanged(QMediaPlayer::PlaybackState state)
 #else
 void TonePlayer::handleMediaStateChanged(QMediaPlayer::State state)
 {
+    if (sender() != m_mediaPlayer) {
+        return;
+    }
     if (state == QMediaPlayer::StoppedState && m_mediaPlaying) {
         m_mediaPlaying = false;
         emit playbackFinished();
@@ -172,8 +243,7 @@ ToneSample ToneLibrary::toneFor(const QString &pitch, int octave)
         return sample;
     }
 
-    const double freq = frequencyFor(pitch, octave);
-    const QByteArray pcm = generateTone(freq, 800);
+    const QByteArray pcm = ToneSynth::tone(ToneSynth::frequencyFor(pitch, octave));
     m_pcmCache.insert(key, pcm);
     sample.pcmData = pcm;
     return sample;
@@ -198,7 +268,7 @@ ToneSample ToneLibrary::shepardTone()
             }
         }
         if (m_shepardSample.filePath.isEmpty()) {
-            m_shepardSample.pcmData = generateShepard(20000);
+            m_shepardSample.pcmData = ToneSynth::shepard();
         }
     }
     return m_shepardSample;
@@ -258,64 +328,3 @@ QString ToneLibrary::sampleNameForPitch(const QString &pitch) const
     formatted[0] = formatted[0].toUpper();
     return formatted;
 }
-
-double ToneLibrary::frequencyFor(const QString &pitch, int octave) const
-{
-    const auto &order = TrainingSpec::chromaticOrder();
-    const int index = order.indexOf(pitch);
-    if (index < 0) {
-        return 440.0;
-    }
-    const int midi = 60 + index + (octave - 4) * 12;
-    return 440.0 * std::pow(2.0, (midi - 69) / 12.0);
-}
-
-QByteArray ToneLibrary::generateTone(double frequency, int durationMs) const
-{
-    const int sampleRate = 44100;
-    const int sampleCount = durationMs * sampleRate / 1000;
-    QByteArray buffer(sampleCount * static_cast<int>(sizeof(qint16)), Qt::Uninitialized);
-    qint16 *samples = reinterpret_cast<qint16 *>(buffer.data());
-    const int rampSamples = sampleRate / 10; // 100 ms ramp
-
-    double phase = 0.0;
-    for (int i = 0; i < sampleCount; ++i) {
-        double envelope = 1.0;
-        if (i < rampSamples) {
-            envelope = static_cast<double>(i) / rampSamples;
-        } else if (i > sampleCount - rampSamples) {
-            envelope = static_cast<double>(sampleCount - i) / rampSamples;
-        }
-        const double sampleValue = (qSin(phase) + 0.4 * qSin(phase * 2.0) + 0.2 * qSin(phase * 3.0)) * envelope * 0.4;
-        const double limited = qBound(-1.0, sampleValue, 1.0);
-        samples[i] = static_cast<qint16>(limited * 32767.0);
-        phase += 2.0 * M_PI * frequency / sampleRate;
-    }
-    return buffer;
-}
-
-QByteArray ToneLibrary::generateShepard(int durationMs) const
-{
-    const int sampleRate = 44100;
-    const int sampleCount = durationMs * sampleRate / 1000;
-    QByteArray buffer(sampleCount * static_cast<int>(sizeof(qint16)), Qt::Uninitialized);
-    qint16 *samples = reinterpret_cast<qint16 *>(buffer.data());
-
-    const double cycles = 5.0;
-    const double samplesPerCycle = sampleCount / cycles;
-    double phase = 0.0;
-    double phase2 = 0.0;
-
-    for (int i = 0; i < sampleCount; ++i) {
-        const double cyclePos = std::fmod(static_cast<double>(i) / samplesPerCycle, 1.0);
-        const double freq = 80.0 * std::pow(2.0, (1.0 - cyclePos) * 5.0);
-        const double env = 0.3 + 0.7 * (1.0 - cyclePos);
-        phase += 2.0 * M_PI * freq / sampleRate;
-        phase2 += 2.0 * M_PI * freq * 0.5 / sampleRate;
-        const double wave = std::sin(phase) + 0.6 * std::sin(phase2) + 0.3 * std::sin(phase * 0.5);
-        const double limited = qBound(-1.0, wave * env * 0.4, 1.0);
-        samples[i] = static_cast<qint16>(limited * 32767.0);
-    }
-
-    return buffer;
-}
@@ -35,6 +35,16 @@ public:
 
     void playSample(const ToneSample &sample);
     void playPcm(const QByteArray &data);
+    // loads the next tone into a standby player while the current one
+    // keeps sounding, so playPrepared() starts it without decode latency
+    void prepareSample(const ToneSample &sample);
+    void playPrepared();
+    // plays PCM in the player's format pulled from the device until it
+    // runs out; the caller keeps the device open meanwhile
+    void playStream(QIODevice *device);
+    // microseconds of the stream that have reached the speaker, going by
+    // the audio device's clock rather than the event loop
+    qint64 playedUSecs() const;
     void stop();
     bool isPlaying() const;
 
@@ -51,16 +61,21 @@ private slots:
 
 private:
     void playFile(const QString &path);
+    QMediaPlayer *createMediaPlayer();
 
     QAudioFormat m_format;
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     QAudioDevice m_device;
     std::unique_ptr<QAudioSink> m_audioOutput;
     std::unique_ptr<QAudioOutput> m_mediaOutput;
+    std::unique_ptr<QAudioOutput> m_standbyOutput;
 #else
     std::unique_ptr<QAudioOutput> m_audioOutput;
 #endif
     QMediaPlayer *m_mediaPlayer = nullptr;
+    QMediaPlayer *m_standbyPlayer = nullptr;
+    ToneSample m_prepared;
+    bool m_standbyLoaded = false;
     QByteArray m_currentData;
     QScopedPointer<QBuffer> m_buffer;
     bool m_pcmPlaying = false;
@@ -97,9 +112,6 @@ private:
     QString resolveSampleRoot() const;
     QString samplePathFor(const QString &pitch, int octave) const;
     QString sampleNameForPitch(const QString &pitch) const;
-    QByteArray generateTone(double frequency, int durationMs) const;
-    QByteArray generateShepard(int durationMs) const;
-    double frequencyFor(const QString &pitch, int octave) const;
 
     QString m_sampleRoot;
     QHash<ToneSampleKey, QByteArray> m_pcmCache;
@@ -0,0 +1,67 @@
+#include "tonesynth.h"
+
+#include "trainingmodel.h"
+
+#include <QtMath>
+#include <cmath>
+
+double ToneSynth::frequencyFor(const QString &pitch, int octave)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    const int index = order.indexOf(pitch);
+    if (index < 0) {
+        return 440.0;
+    }
+    const int midi = 60 + index + (octave - 4) * 12;
+    return 440.0 * std::pow(2.0, (midi - 69) / 12.0);
+}
+
+QByteArray ToneSynth::tone(double frequency, int durationMs)
+{
+    const int sampleRate = kSampleRate;
+    const int sampleCount = durationMs * sampleRate / 1000;
+    QByteArray buffer(sampleCount * static_cast<int>(sizeof(qint16)), Qt::Uninitialized);
+    qint16 *samples = reinterpret_cast<qint16 *>(buffer.data());
+    const int rampSamples = sampleRate / 10; // 100 ms ramp
+
+    double phase = 0.0;
+    for (int i = 0; i < sampleCount; ++i) {
+        double envelope = 1.0;
+        if (i < rampSamples) {
+            envelope = static_cast<double>(i) / rampSamples;
+        } else if (i > sampleCount - rampSamples) {
+            envelope = static_cast<double>(sampleCount - i) / rampSamples;
+        }
+        const double sampleValue = (qSin(phase) + 0.4 * qSin(phase * 2.0) + 0.2 * qSin(phase * 3.0)) * envelope * 0.4;
+        const double limited = qBound(-1.0, sampleValue, 1.0);
+        samples[i] = static_cast<qint16>(limited * 32767.0);
+        phase += 2.0 * M_PI * frequency / sampleRate;
+    }
+    return buffer;
+}
+
+QByteArray ToneSynth::shepard(int durationMs)
+{
+    const int sampleRate = kSampleRate;
+    const int sampleCount = durationMs * sampleRate / 1000;
+    QByteArray buffer(sampleCount * static_cast<int>(sizeof(qint16)), Qt::Uninitialized);
+    qint16 *samples = reinterpret_cast<qint16 *>(buffer.data());
+
+    const double cycles = 5.0;
+    const double samplesPerCycle = sampleCount / cycles;
+    double phase = 0.0;
+    double phase2 = 0.0;
+
+    for (int i = 0; i < sampleCount; ++i) {
+        const double cyclePos = std::fmod(static_cast<double>(i) / samplesPerCycle, 1.0);
+        const double freq = 80.0 * std::pow(2.0, (1.0 - cyclePos) * 5.0);
+        const double env = 0.3 + 0.7 * (1.0 - cyclePos);
+        phase += 2.0 * M_PI * freq / sampleRate;
+        phase2 += 2.0 * M_PI * freq * 0.5 / sampleRate;
+        const double wave = std::sin(phase) + 0.6 * std::sin(phase2) + 0.3 * std::sin(phase * 0.5);
+        const double limited = qBound(-1.0, wave * env * 0.4, 1.0);
+        samples[i] = static_cast<qint16>(limited * 32767.0);
+    }
+
+    return buffer;
+}
@@ -0,0 +1,21 @@
+#ifndef TONESYNTH_H
+#define TONESYNTH_H
+
+#include <QByteArray>
+#include <QString>
+
+// Synthesised fallback tones as 16-bit mono PCM at kSampleRate, for when no
+// piano sample is installed and for clients the session server streams to.
+class ToneSynth
+{
+public:
+    static constexpr int kSampleRate = 44100;
+    static constexpr int kToneDurationMs = 800;
+    static constexpr int kShepardDurationMs = 20000;
+
+    static double frequencyFor(const QString &pitch, int octave);
+    static QByteArray tone(double frequency, int durationMs = kToneDurationMs);
+    static QByteArray shepard(int durationMs = kShepardDurationMs);
+};
+
+#endif // TONESYNTH_H
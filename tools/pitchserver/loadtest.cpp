@@ -0,0 +1,165 @@
+#include "loadtest.h"
+
+#include "profilemanager.h"
+#include "trainingmodel.h"
+
+#include <QJsonDocument>
+#include <QLocalSocket>
+
+namespace {
+const QString kProfilePrefix = QStringLiteral("Load test ");
+}
+
+LoadTest::LoadTest(const QString &serverName, qint64 responses, QObject *parent)
+    : QObject(parent)
+    , m_serverName(serverName)
+    , m_budget(responses)
+    , m_random(QRandomGenerator::securelySeeded())
+{
+}
+
+QStringList LoadTest::prepareProfiles(const QString &rootPath, int count)
+{
+    ProfileManager manager(rootPath);
+    if (!manager.load()) {
+        return {};
+    }
+    QStringList ids;
+    for (int i = 1; i <= count; ++i) {
+        const QString name = kProfilePrefix + QString::number(i);
+        QString id;
+        const auto profiles = manager.profiles();
+        for (const auto &profile : profiles) {
+            if (profile.name == name) {
+                id = profile.id;
+                break;
+            }
+        }
+        if (id.isEmpty() && !manager.createProfile(name, &id)) {
+            return {};
+        }
+        ids.append(id);
+    }
+    return ids;
+}
+
+void LoadTest::start(const QStringList &profileIds)
+{
+    m_report = LoadTestReport{};
+    m_report.sessions = static_cast<int>(profileIds.size());
+    m_clients.resize(profileIds.size());
+    m_running = static_cast<int>(profileIds.size());
+    m_timer.start();
+    for (int i = 0; i < m_clients.size(); ++i) {
+        Client &client = m_clients[i];
+        client.profileId = profileIds.at(i);
+        client.socket = new QLocalSocket(this);
+        connect(client.socket, &QLocalSocket::connected, this, [this, i]() {
+            send(i, {{QStringLiteral("op"), QStringLiteral("open")},
+                     {QStringLiteral("profile"), m_clients.at(i).profileId}});
+        });
+        connect(client.socket, &QLocalSocket::readyRead, this, [this, i]() { readReplies(i); });
+        auto failed = [this, i]() {
+            if (!m_clients.at(i).done) {
+                ++m_report.errors;
+                finishClient(i);
+            }
+        };
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        connect(client.socket, &QLocalSocket::errorOccurred, this, failed);
+#else
+        connect(client.socket, QOverload<QLocalSocket::LocalSocketError>::of(&QLocalSocket::error), this, failed);
+#endif
+        client.socket->connectToServer(m_serverName);
+    }
+    if (m_clients.isEmpty()) {
+        emit finished();
+    }
+}
+
+LoadTestReport LoadTest::report() const
+{
+    LoadTestReport report = m_report;
+    report.meanRoundTripUs = m_roundTrips ? static_cast<double>(m_roundTripSumUs) / m_roundTrips : 0.0;
+    return report;
+}
+
+void LoadTest::send(int index, const QJsonObject &request)
+{
+    Client &client = m_clients[index];
+    client.pendingOp = request.value(QStringLiteral("op")).toString();
+    client.sentAt.start();
+    client.socket->write(QJsonDocument(request).toJson(QJsonDocument::Compact));
+    client.socket->write("\n", 1);
+}
+
+void LoadTest::readReplies(int index)
+{
+    QLocalSocket *socket = m_clients.at(index).socket;
+    while (!m_clients.at(index).done && socket->canReadLine()) {
+        const QJsonObject reply = QJsonDocument::fromJson(socket->readLine()).object();
+        const qint64 roundTripUs = m_clients.at(index).sentAt.nsecsElapsed() / 1000;
+        m_roundTripSumUs += roundTripUs;
+        ++m_roundTrips;
+        m_report.maxRoundTripUs = qMax(m_report.maxRoundTripUs, roundTripUs);
+        handleReply(index, reply);
+    }
+}
+
+void LoadTest::handleReply(int index, const QJsonObject &reply)
+{
+    Client &client = m_clients[index];
+    const QString op = client.pendingOp;
+    if (!reply.value(QStringLiteral("ok")).toBool()) {
+        // a cooldown or a finished profile ends this terminal's run
+        ++m_report.errors;
+        finishClient(index);
+        return;
+    }
+    if (op == QLatin1String("close")) {
+        finishClient(index);
+        return;
+    }
+    if (m_report.responses >= m_budget) {
+        send(index, {{QStringLiteral("op"), QStringLiteral("close")}});
+        return;
+    }
+
+    if (op == QLatin1String("open")) {
+        send(index, {{QStringLiteral("op"), QStringLiteral("start")}});
+    } else if (op == QLatin1String("start")) {
+        send(index, {{QStringLiteral("op"), QStringLiteral("next")}});
+    } else if (op == QLatin1String("next")) {
+        client.windowMs = reply.value(QStringLiteral("windowMs")).toInt();
+        const auto &order = TrainingSpec::chromaticOrder();
+        const int choice = m_random.bounded(static_cast<int>(order.size()) + 1);
+        const QString response = choice < order.size() ? order.at(choice) : QStringLiteral("OUT");
+        send(index, {{QStringLiteral("op"), QStringLiteral("respond")},
+                     {QStringLiteral("response"), response},
+                     {QStringLiteral("rtMs"), m_random.bounded(qMax(1, client.windowMs))}});
+    } else if (op == QLatin1String("respond")) {
+        ++m_report.responses;
+        const bool levelOver = reply.contains(QStringLiteral("outcome"))
+                               || reply.value(QStringLiteral("special")).toObject().value(QStringLiteral("done")).toBool();
+        if (levelOver) {
+            ++m_report.levelsResolved;
+            send(index, {{QStringLiteral("op"), QStringLiteral("start")}});
+        } else {
+            send(index, {{QStringLiteral("op"), QStringLiteral("next")}});
+        }
+    }
+}
+
+void LoadTest::finishClient(int index)
+{
+    Client &client = m_clients[index];
+    if (client.done) {
+        return;
+    }
+    client.done = true;
+    client.socket->disconnectFromServer();
+    if (--m_running == 0) {
+        m_report.elapsedMs = m_timer.elapsed();
+        emit finished();
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef LOADTEST_H
+#define LOADTEST_H
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QLocalSocket;
+
+struct LoadTestReport {
+    int sessions = 0;
+    qint64 responses = 0;
+    qint64 levelsResolved = 0;
+    qint64 errors = 0;
+    qint64 elapsedMs = 0;
+    double meanRoundTripUs = 0.0;
+    qint64 maxRoundTripUs = 0;
+};
+
+// Simulated terminals for the session server: each opens its own profile
+// and answers trials at random, one request in flight at a time, until
+// the shared response budget is spent.
+class LoadTest : public QObject
+{
+    Q_OBJECT
+public:
+    LoadTest(const QString &serverName, qint64 responses, QObject *parent = nullptr);
+
+    // makes sure rootPath holds count load-test profiles and returns their ids
+    static QStringList prepareProfiles(const QString &rootPath, int count);
+
+    void start(const QStringList &profileIds);
+    LoadTestReport report() const;
+
+signals:
+    void finished();
+
+private:
+    struct Client {
+        QLocalSocket *socket = nullptr;
+        QString profileId;
+        QString pendingOp;
+        QElapsedTimer sentAt;
+        int windowMs = 0;
+        bool done = false;
+    };
+
+    void send(int index, const QJsonObject &request);
+    void readReplies(int index);
+    void handleReply(int index, const QJsonObject &reply);
+    void finishClient(int index);
+
+    QString m_serverName;
+    qint64 m_budget = 0;
+    QVector<Client> m_clients;
+    QRandomGenerator m_random;
+    QElapsedTimer m_timer;
+    LoadTestReport m_report;
+    qint64 m_roundTripSumUs = 0;
+    qint64 m_roundTrips = 0;
+    int m_running = 0;
+};
+
+#endif // LOADTEST_H
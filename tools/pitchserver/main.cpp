@@ -0,0 +1,91 @@
+#include "loadtest.h"
+#include "profilemanager.h"
+#include "sessionserver.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("pitchserver"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Run training sessions for many terminals over a local socket."));
+    parser.addHelpOption();
+    const QCommandLineOption nameOption(QStringLiteral("name"), QStringLiteral("Local socket name (default: pitchtraining)."), QStringLiteral("name"));
+    const QCommandLineOption rootOption(QStringLiteral("root"), QStringLiteral("Profiles directory."), QStringLiteral("dir"));
+    const QCommandLineOption workersOption(QStringLiteral("workers"), QStringLiteral("Worker threads (default: one per core)."), QStringLiteral("n"));
+    const QCommandLineOption loadTestOption(QStringLiteral("load-test"), QStringLiteral("Serve n simulated terminals in-process, report throughput and exit."), QStringLiteral("n"));
+    const QCommandLineOption responsesOption(QStringLiteral("responses"), QStringLiteral("Responses the load test submits in total (default 100000)."), QStringLiteral("n"));
+    parser.addOptions({nameOption, rootOption, workersOption, loadTestOption, responsesOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    const bool loadTest = parser.isSet(loadTestOption);
+    QString name = parser.isSet(nameOption) ? parser.value(nameOption) : QStringLiteral("pitchtraining");
+    const int workers = parser.isSet(workersOption) ? parser.value(workersOption).toInt() : QThread::idealThreadCount();
+
+    // a load test must not wear out real profiles, so it defaults to a scratch root
+    QTemporaryDir scratch;
+    QString root;
+    if (parser.isSet(rootOption)) {
+        root = parser.value(rootOption);
+    } else if (loadTest) {
+        if (!scratch.isValid()) {
+            err << "cannot create a scratch profiles directory" << Qt::endl;
+            return 1;
+        }
+        root = scratch.path();
+    } else {
+        root = ProfileManager().rootPath();
+    }
+
+    QStringList loadProfiles;
+    if (loadTest) {
+        loadProfiles = LoadTest::prepareProfiles(root, qMax(1, parser.value(loadTestOption).toInt()));
+        if (loadProfiles.isEmpty()) {
+            err << "cannot create load-test profiles under " << root << Qt::endl;
+            return 1;
+        }
+        if (!parser.isSet(nameOption)) {
+            name += QStringLiteral("-load-%1").arg(QCoreApplication::applicationPid());
+        }
+    }
+
+    SessionServer server(root, workers, 0);
+    server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!server.listen(name)) {
+        // a server that died leaves its socket file behind on Unix
+        QLocalServer::removeServer(name);
+        if (!server.listen(name)) {
+            err << "cannot listen on " << name << ": " << server.errorString() << Qt::endl;
+            return 1;
+        }
+    }
+
+    if (!loadTest) {
+        err << "serving " << root << " on " << server.fullServerName() << " with "
+            << qMax(1, workers) << " workers" << Qt::endl;
+        return app.exec();
+    }
+
+    const qint64 responses = parser.isSet(responsesOption) ? parser.value(responsesOption).toLongLong() : 100000;
+    LoadTest test(name, responses);
+    QObject::connect(&test, &LoadTest::finished, &app, &QCoreApplication::quit);
+    test.start(loadProfiles);
+    app.exec();
+
+    const LoadTestReport report = test.report();
+    const double seconds = qMax<qint64>(1, report.elapsedMs) / 1000.0;
+    err << report.sessions << " sessions submitted " << report.responses << " responses and resolved "
+        << report.levelsResolved << " levels in " << report.elapsedMs << " ms: "
+        << QString::number(report.responses / seconds, 'f', 0) << " responses/s, round trip mean "
+        << QString::number(report.meanRoundTripUs, 'f', 0) << " us, max " << report.maxRoundTripUs << " us, "
+        << report.errors << " errors" << Qt::endl;
+    return report.responses > 0 ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+QT       += core network
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = pitchserver
+
+include(../../core.pri)
+
+SOURCES += \
+    loadtest.cpp \
+    main.cpp \
+    sessionserver.cpp
+
+HEADERS += \
+    loadtest.h \
+    sessionserver.h
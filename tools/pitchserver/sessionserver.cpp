@@ -0,0 +1,490 @@
+#include "sessionserver.h"
+
+#include "profilemanager.h"
+#include "tonesynth.h"
+#include "trainingsession.h"
+
+#include <QDir>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalSocket>
+#include <QMutexLocker>
+#include <QThread>
+
+namespace {
+constexpr int kMaxRequestBytes = 64 * 1024;
+
+QJsonObject success()
+{
+    return {{QStringLiteral("ok"), true}};
+}
+
+QJsonObject failure(const QString &error)
+{
+    return {{QStringLiteral("ok"), false}, {QStringLiteral("error"), error}};
+}
+
+QString sampleId(const QString &pitch, int octave)
+{
+    return QStringLiteral("%1@%2").arg(pitch).arg(octave);
+}
+
+bool isValidResponse(const QString &response)
+{
+    return response == QLatin1String("OUT") || TrainingSpec::chromaticOrder().contains(response);
+}
+
+// only the ids a trial can present: "shepard", or a chromatic pitch at an
+// octave the server plays, in the exact form sampleId() writes
+bool isServedSample(const QString &sample, quint16 octaveMask)
+{
+    if (sample == QLatin1String("shepard")) {
+        return true;
+    }
+    const int at = sample.indexOf(QLatin1Char('@'));
+    if (at < 0) {
+        return false;
+    }
+    const QString pitch = sample.left(at);
+    bool ok = false;
+    const int octave = sample.mid(at + 1).toInt(&ok);
+    return ok && octave >= 0 && octave < 16 && (octaveMask & (1u << octave))
+           && TrainingSpec::chromaticOrder().contains(pitch) && sample == sampleId(pitch, octave);
+}
+
+// base64 PCM per sample id; each worker thread renders its own copy so
+// streaming terminals never wait on each other. Ids are checked before
+// the cache, so it holds at most one entry per sample the server plays.
+QString encodedSample(const QString &sample, quint16 octaveMask)
+{
+    if (!isServedSample(sample, octaveMask)) {
+        return QString();
+    }
+    thread_local QHash<QString, QString> cache;
+    const auto it = cache.constFind(sample);
+    if (it != cache.constEnd()) {
+        return it.value();
+    }
+    QByteArray pcm;
+    if (sample == QLatin1String("shepard")) {
+        pcm = ToneSynth::shepard();
+    } else {
+        const int at = sample.indexOf(QLatin1Char('@'));
+        pcm = ToneSynth::tone(ToneSynth::frequencyFor(sample.left(at), sample.mid(at + 1).toInt()));
+    }
+    const QString encoded = QString::fromLatin1(pcm.toBase64());
+    cache.insert(sample, encoded);
+    return encoded;
+}
+}
+
+ProfileRegistry::ProfileRegistry(const QString &rootPath)
+    : m_rootPath(rootPath)
+{
+    reload();
+}
+
+QString ProfileRegistry::rootPath() const
+{
+    return m_rootPath;
+}
+
+bool ProfileRegistry::acquire(const QString &profileId)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_known.contains(profileId)) {
+        // profiles created since the server started
+        reload();
+    }
+    if (!m_known.contains(profileId) || m_held.contains(profileId)) {
+        return false;
+    }
+    m_held.insert(profileId);
+    return true;
+}
+
+void ProfileRegistry::release(const QString &profileId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_held.remove(profileId);
+}
+
+void ProfileRegistry::reload()
+{
+    m_known.clear();
+    const auto profiles = ProfileManager::readProfiles(m_rootPath);
+    for (const auto &profile : profiles) {
+        m_known.insert(profile.id);
+    }
+}
+
+SessionConnection::SessionConnection(ProfileRegistry *registry, quint16 octaveMask, QObject *parent)
+    : QObject(parent)
+    , m_registry(registry)
+    , m_octaveMask(octaveMask ? octaveMask : TrainingSession::kDefaultOctaveMask)
+{
+}
+
+SessionConnection::~SessionConnection()
+{
+    closeProfile();
+}
+
+bool SessionConnection::adopt(quintptr socketDescriptor)
+{
+    m_socket = new QLocalSocket(this);
+    if (!m_socket->setSocketDescriptor(socketDescriptor)) {
+        return false;
+    }
+    connect(m_socket, &QLocalSocket::readyRead, this, &SessionConnection::readRequests);
+    connect(m_socket, &QLocalSocket::disconnected, this, &QObject::deleteLater);
+    return true;
+}
+
+void SessionConnection::readRequests()
+{
+    while (m_socket->canReadLine()) {
+        const QByteArray line = m_socket->readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        QJsonParseError error;
+        const QJsonDocument document = QJsonDocument::fromJson(line, &error);
+        QJsonObject reply;
+        if (error.error != QJsonParseError::NoError || !document.isObject()) {
+            reply = failure(QStringLiteral("malformed request"));
+        } else {
+            const QJsonObject request = document.object();
+            reply = handle(request);
+            if (request.contains(QStringLiteral("id"))) {
+                reply.insert(QStringLiteral("id"), request.value(QStringLiteral("id")));
+            }
+        }
+        m_socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact));
+        m_socket->write("\n", 1);
+    }
+    if (m_socket->bytesAvailable() > kMaxRequestBytes) {
+        // no request is this long; drop the terminal rather than buffer forever
+        m_socket->abort();
+    }
+}
+
+QJsonObject SessionConnection::handle(const QJsonObject &request)
+{
+    const QString op = request.value(QStringLiteral("op")).toString();
+    if (op == QLatin1String("open")) {
+        return openProfile(request);
+    }
+    if (op == QLatin1String("audio")) {
+        return audio(request);
+    }
+    if (!m_session) {
+        return failure(QStringLiteral("no profile open"));
+    }
+    if (op == QLatin1String("start")) {
+        return startLevel();
+    }
+    if (op == QLatin1String("next")) {
+        return nextTrial();
+    }
+    if (op == QLatin1String("respond")) {
+        return respond(request);
+    }
+    if (op == QLatin1String("double")) {
+        return armDouble();
+    }
+    if (op == QLatin1String("stats")) {
+        return stats();
+    }
+    if (op == QLatin1String("close")) {
+        closeProfile();
+        return success();
+    }
+    return failure(QStringLiteral("unknown op"));
+}
+
+QJsonObject SessionConnection::openProfile(const QJsonObject &request)
+{
+    const QString profileId = request.value(QStringLiteral("profile")).toString();
+    if (profileId == m_profileId && m_session) {
+        return stats();
+    }
+    closeProfile();
+    if (profileId.isEmpty() || !m_registry->acquire(profileId)) {
+        return failure(QStringLiteral("profile unknown or in use"));
+    }
+    m_profileId = profileId;
+    m_session.reset(new TrainingSession);
+    m_session->setOctaveMask(m_octaveMask);
+    m_session->open(QDir(m_registry->rootPath()).filePath(profileId));
+    if (m_session->isReadOnly()) {
+        closeProfile();
+        return failure(QStringLiteral("profile is open in another instance"));
+    }
+    m_streamPcm = request.value(QStringLiteral("audio")).toString() == QLatin1String("pcm");
+    return stats();
+}
+
+QJsonObject SessionConnection::startLevel()
+{
+    QJsonObject reply;
+    switch (m_session->startLevel()) {
+    case TrainingSession::StartResult::Busy:
+        return failure(QStringLiteral("a level is already running"));
+    case TrainingSession::StartResult::FinalCooldown:
+        return failure(QStringLiteral("final level cooldown"));
+    case TrainingSession::StartResult::ReadOnly:
+        return failure(QStringLiteral("profile is open in another instance"));
+    case TrainingSession::StartResult::ProtocolUnavailable:
+        return failure(QStringLiteral("profile's protocol is unavailable"));
+    case TrainingSession::StartResult::Resumed:
+        reply = blockInfo();
+        reply.insert(QStringLiteral("resumed"), true);
+        break;
+    case TrainingSession::StartResult::Started:
+    case TrainingSession::StartResult::SpecialExercise:
+        reply = blockInfo();
+        break;
+    }
+    m_trialPending = false;
+    return reply;
+}
+
+QJsonObject SessionConnection::blockInfo() const
+{
+    QJsonObject reply = success();
+    const LevelSpec &spec = m_session->currentSpec();
+    reply.insert(QStringLiteral("trials"), m_session->blockLength());
+    reply.insert(QStringLiteral("completed"), m_session->trialsCompleted());
+    reply.insert(QStringLiteral("windowMs"), spec.responseWindowMs);
+    if (m_session->specialActive()) {
+        const SpecialContext &special = m_session->special();
+        reply.insert(QStringLiteral("mode"), QStringLiteral("special"));
+        reply.insert(QStringLiteral("target"), special.targetPitch);
+        reply.insert(QStringLiteral("feedback"), special.feedbackPhase);
+        return reply;
+    }
+    reply.insert(QStringLiteral("mode"), QStringLiteral("level"));
+    reply.insert(QStringLiteral("level"), spec.globalIndex);
+    reply.insert(QStringLiteral("stage"), spec.stageIndex);
+    reply.insert(QStringLiteral("levelInStage"), spec.levelInStage);
+    reply.insert(QStringLiteral("feedback"), spec.feedback);
+    reply.insert(QStringLiteral("tokensAllowed"), spec.tokensAllowed);
+    // levels without feedback open with the memory-reset tone
+    reply.insert(QStringLiteral("shepard"), !spec.feedback);
+    return reply;
+}
+
+QJsonObject SessionConnection::nextTrial()
+{
+    if (!m_session->isRunning()) {
+        return failure(QStringLiteral("no level running"));
+    }
+    if (m_trialPending) {
+        return failure(QStringLiteral("the current trial has not been answered"));
+    }
+    const TrialData &trial = m_session->nextTrial();
+    m_trialPending = true;
+    m_trialTimer.start();
+
+    QJsonObject reply = success();
+    const QString sample = sampleId(trial.presentedPitch, trial.octave);
+    reply.insert(QStringLiteral("trial"), m_session->trialsCompleted() + 1);
+    reply.insert(QStringLiteral("sample"), sample);
+    reply.insert(QStringLiteral("windowMs"), m_session->currentSpec().responseWindowMs);
+    reply.insert(QStringLiteral("luckyDouble"), m_session->luckyDoubleReady());
+    if (m_streamPcm) {
+        reply.insert(QStringLiteral("sampleRate"), ToneSynth::kSampleRate);
+        reply.insert(QStringLiteral("pcm"), encodedSample(sample, m_octaveMask));
+    }
+    return reply;
+}
+
+QJsonObject SessionConnection::respond(const QJsonObject &request)
+{
+    if (!m_trialPending) {
+        return failure(QStringLiteral("no trial to answer"));
+    }
+    const QString response = request.value(QStringLiteral("response")).toString();
+    bool timedOut = request.value(QStringLiteral("timedOut")).toBool();
+    if (!timedOut && !isValidResponse(response)) {
+        return failure(QStringLiteral("unknown response"));
+    }
+    // terminals that time the tone themselves report rtMs; otherwise the
+    // time since "next" stands in for it
+    const int window = m_session->currentSpec().responseWindowMs;
+    int responseTimeMs = request.contains(QStringLiteral("rtMs"))
+                             ? request.value(QStringLiteral("rtMs")).toInt()
+                             : static_cast<int>(m_trialTimer.elapsed());
+    if (responseTimeMs >= window) {
+        timedOut = true;
+    }
+    if (timedOut) {
+        responseTimeMs = qMin(responseTimeMs, window);
+    }
+    m_trialPending = false;
+    const TrialData trial = m_session->finishTrial(timedOut ? QString() : response,
+                                                   qMax(0, responseTimeMs), timedOut);
+
+    QJsonObject reply = success();
+    reply.insert(QStringLiteral("correct"), trial.correct);
+    reply.insert(QStringLiteral("presented"), trial.outOfBounds ? QStringLiteral("OUT") : trial.presentedPitch);
+    reply.insert(QStringLiteral("timedOut"), trial.timedOut);
+    reply.insert(QStringLiteral("semitoneError"), trial.semitoneError);
+    reply.insert(QStringLiteral("usedDouble"), trial.usedDouble);
+    reply.insert(QStringLiteral("completed"), m_session->trialsCompleted());
+    reply.insert(QStringLiteral("trials"), m_session->blockLength());
+    if (!m_session->blockComplete()) {
+        // terminals that advance on their own ask for the next tone then
+        reply.insert(QStringLiteral("nextInMs"), m_session->nextInterTrialMs());
+        return reply;
+    }
+
+    if (m_session->specialActive()) {
+        QJsonObject special;
+        if (m_session->resolveSpecialExercise()) {
+            special.insert(QStringLiteral("phase"), 2);
+            special.insert(QStringLiteral("trials"), m_session->blockLength());
+        } else {
+            special.insert(QStringLiteral("done"), true);
+        }
+        reply.insert(QStringLiteral("special"), special);
+        return reply;
+    }
+
+    const LevelOutcome outcome = m_session->resolveLevel();
+    reply.insert(QStringLiteral("outcome"), QJsonObject{
+        {QStringLiteral("accuracy"), outcome.accuracy},
+        {QStringLiteral("effectiveAccuracy"), outcome.effectiveAccuracy},
+        {QStringLiteral("playedAccuracy"), outcome.playedAccuracy},
+        {QStringLiteral("passed"), outcome.passed},
+        {QStringLiteral("tokensEarned"), outcome.tokensEarned},
+        {QStringLiteral("nextLevel"), outcome.nextLevelIndex},
+        {QStringLiteral("trialsSkipped"), outcome.trialsSkipped},
+        {QStringLiteral("finalCooldown"), outcome.finalCooldownStarted},
+        {QStringLiteral("trainingCompleted"), outcome.trainingCompleted}
+    });
+    return reply;
+}
+
+QJsonObject SessionConnection::armDouble()
+{
+    if (!m_session->levelActive() || !m_session->currentSpec().tokensAllowed) {
+        return failure(QStringLiteral("the double bonus is not available in this level"));
+    }
+    if (!m_session->doubleArmed() && !m_session->armDouble()) {
+        return failure(QStringLiteral("not enough tokens"));
+    }
+    QJsonObject reply = success();
+    reply.insert(QStringLiteral("tokens"), m_session->state().tokens());
+    return reply;
+}
+
+QJsonObject SessionConnection::stats() const
+{
+    const TrainingState &state = m_session->state();
+    const LevelSpec spec = m_session->protocol().spec(state.currentLevelIndex());
+    QJsonObject reply = success();
+    reply.insert(QStringLiteral("profile"), m_profileId);
+    reply.insert(QStringLiteral("protocol"), m_session->protocol().id());
+    reply.insert(QStringLiteral("level"), state.currentLevelIndex());
+    reply.insert(QStringLiteral("stage"), spec.stageIndex);
+    reply.insert(QStringLiteral("levelInStage"), spec.levelInStage);
+    reply.insert(QStringLiteral("tokens"), state.tokens());
+    reply.insert(QStringLiteral("streak"), state.streakCount());
+    reply.insert(QStringLiteral("hours"), state.countedTrainingHours());
+    reply.insert(QStringLiteral("attempts"), state.totalLevelAttempts());
+    reply.insert(QStringLiteral("sessionTrials"), m_session->cadenceTrials());
+    reply.insert(QStringLiteral("trialsPerMinute"), m_session->trialsPerMinute());
+    reply.insert(QStringLiteral("trainingCompleted"), state.trainingCompleted());
+    reply.insert(QStringLiteral("weakestPitch"), state.leastAccuratePitch());
+    reply.insert(QStringLiteral("running"), m_session->isRunning());
+    reply.insert(QStringLiteral("journalFailing"), m_session->journalFailing());
+
+    const PitchStatistics &statistics = state.statistics();
+    const auto &order = TrainingSpec::chromaticOrder();
+    QJsonArray pitches;
+    for (int category = 0; category < PitchStatistics::kCategoryCount; ++category) {
+        const auto window = PitchStatistics::Window::AllTime;
+        pitches.append(QJsonObject{
+            {QStringLiteral("pitch"), category == PitchStatistics::kOtherCategory ? QStringLiteral("OUT") : order.at(category)},
+            {QStringLiteral("trials"), static_cast<qint64>(statistics.total(window, category))},
+            {QStringLiteral("correct"), static_cast<qint64>(statistics.correct(window, category))},
+            {QStringLiteral("meanRtMs"), statistics.meanResponseTimeMs(window, category)}
+        });
+    }
+    reply.insert(QStringLiteral("pitches"), pitches);
+    return reply;
+}
+
+QJsonObject SessionConnection::audio(const QJsonObject &request) const
+{
+    const QString sample = request.value(QStringLiteral("sample")).toString();
+    const QString pcm = encodedSample(sample, m_octaveMask);
+    if (pcm.isEmpty()) {
+        return failure(QStringLiteral("unknown sample"));
+    }
+    QJsonObject reply = success();
+    reply.insert(QStringLiteral("sample"), sample);
+    reply.insert(QStringLiteral("sampleRate"), ToneSynth::kSampleRate);
+    reply.insert(QStringLiteral("pcm"), pcm);
+    return reply;
+}
+
+void SessionConnection::closeProfile()
+{
+    if (!m_session) {
+        return;
+    }
+    // a client that leaves mid-level does not come back to resume it
+    m_session->abort();
+    m_session->close();
+    m_session.reset();
+    m_registry->release(m_profileId);
+    m_profileId.clear();
+    m_trialPending = false;
+}
+
+SessionServer::SessionServer(const QString &rootPath, int workers, quint16 octaveMask, QObject *parent)
+    : QLocalServer(parent)
+    , m_registry(rootPath)
+    , m_octaveMask(octaveMask)
+{
+    const int count = qMax(1, workers);
+    for (int i = 0; i < count; ++i) {
+        auto *thread = new QThread;
+        auto *context = new QObject;
+        context->moveToThread(thread);
+        connect(thread, &QThread::finished, context, &QObject::deleteLater);
+        thread->start();
+        m_threads.append(thread);
+        m_contexts.append(context);
+    }
+}
+
+SessionServer::~SessionServer()
+{
+    close();
+    // contexts, and with them every connection, are deleted as their
+    // threads finish, which closes the open profiles
+    for (QThread *thread : m_threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+}
+
+void SessionServer::incomingConnection(quintptr socketDescriptor)
+{
+    QObject *context = m_contexts.at(m_nextWorker);
+    m_nextWorker = (m_nextWorker + 1) % m_contexts.size();
+    ProfileRegistry *registry = &m_registry;
+    const quint16 octaveMask = m_octaveMask;
+    QMetaObject::invokeMethod(context, [context, registry, octaveMask, socketDescriptor]() {
+        auto *connection = new SessionConnection(registry, octaveMask, context);
+        if (!connection->adopt(socketDescriptor)) {
+            delete connection;
+        }
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,95 @@
+#ifndef SESSIONSERVER_H
+#define SESSIONSERVER_H
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+class QLocalSocket;
+class QThread;
+class TrainingSession;
+
+// Profiles under the server's root and which of them a connection holds.
+// Only open and close take the lock; trials run on the connection's own
+// session and never touch it.
+class ProfileRegistry
+{
+public:
+    explicit ProfileRegistry(const QString &rootPath);
+
+    QString rootPath() const;
+    // false if the profile is unknown or already held by another connection
+    bool acquire(const QString &profileId);
+    void release(const QString &profileId);
+
+private:
+    void reload();
+
+    QString m_rootPath;
+    QMutex m_mutex;
+    QSet<QString> m_known;
+    QSet<QString> m_held;
+};
+
+// One terminal: newline-delimited JSON requests in, one JSON reply per
+// request out. The connection owns the TrainingSession of the profile it
+// opened and lives on one worker thread for its whole life.
+class SessionConnection : public QObject
+{
+    Q_OBJECT
+public:
+    SessionConnection(ProfileRegistry *registry, quint16 octaveMask, QObject *parent = nullptr);
+    ~SessionConnection() override;
+
+    bool adopt(quintptr socketDescriptor);
+
+private:
+    void readRequests();
+    QJsonObject handle(const QJsonObject &request);
+    QJsonObject openProfile(const QJsonObject &request);
+    QJsonObject startLevel();
+    QJsonObject nextTrial();
+    QJsonObject respond(const QJsonObject &request);
+    QJsonObject armDouble();
+    QJsonObject stats() const;
+    QJsonObject blockInfo() const;
+    QJsonObject audio(const QJsonObject &request) const;
+    void closeProfile();
+
+    ProfileRegistry *m_registry = nullptr;
+    quint16 m_octaveMask = 0;
+    QLocalSocket *m_socket = nullptr;
+    std::unique_ptr<TrainingSession> m_session;
+    QString m_profileId;
+    bool m_streamPcm = false;
+    bool m_trialPending = false;
+    QElapsedTimer m_trialTimer;
+};
+
+// Accepts terminals on a local socket and deals them round-robin to a
+// fixed pool of worker threads.
+class SessionServer : public QLocalServer
+{
+    Q_OBJECT
+public:
+    SessionServer(const QString &rootPath, int workers, quint16 octaveMask, QObject *parent = nullptr);
+    ~SessionServer() override;
+
+protected:
+    void incomingConnection(quintptr socketDescriptor) override;
+
+private:
+    ProfileRegistry m_registry;
+    quint16 m_octaveMask = 0;
+    QVector<QThread *> m_threads;
+    // one context object per thread; connections are its children
+    QVector<QObject *> m_contexts;
+    int m_nextWorker = 0;
+};
+
+#endif // SESSIONSERVER_H
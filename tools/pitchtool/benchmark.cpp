@@ -0,0 +1,163 @@
+#include "benchmark.h"
+
+#include "trainingmodel.h"
+#include "trialscheduler.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+namespace {
+class TimingSeries
+{
+public:
+    explicit TimingSeries(const QString &name)
+    {
+        m_timing.name = name;
+    }
+
+    void add(qint64 nsecs)
+    {
+        const double us = nsecs / 1000.0;
+        ++m_timing.runs;
+        m_totalUs += us;
+        m_timing.maxUs = qMax(m_timing.maxUs, us);
+    }
+
+    BenchmarkTiming result() const
+    {
+        BenchmarkTiming timing = m_timing;
+        timing.meanUs = timing.runs > 0 ? m_totalUs / timing.runs : 0.0;
+        return timing;
+    }
+
+private:
+    BenchmarkTiming m_timing;
+    double m_totalUs = 0.0;
+};
+
+LevelSummary benchmarkSummary(int index)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    LevelSummary summary;
+    summary.levelIndex = index % TrainingSpec::totalLevelCount();
+    summary.accuracy = 0.5 + (index % 50) / 100.0;
+    summary.passed = index % 3 != 0;
+    summary.seed = static_cast<quint32>(index) * 2654435761u;
+    summary.completedAt = QDateTime::fromMSecsSinceEpoch(1700000000000ll + index * 60000ll, Qt::UTC);
+    for (int pitch = 0; pitch < 3; ++pitch) {
+        summary.perPitch.insert(order.at((index + pitch) % order.size()), PitchSummary{7, 5});
+    }
+    return summary;
+}
+}
+
+QVector<BenchmarkTiming> Benchmark::stateSaves(const QString &scratchDirectory, const QVector<int> &historySizes,
+                                               int runs)
+{
+    QVector<BenchmarkTiming> timings;
+    for (const int size : historySizes) {
+        const QString directory = QDir(scratchDirectory).filePath(QStringLiteral("history-%1").arg(size));
+        QDir(directory).removeRecursively();
+        QDir().mkpath(directory);
+        {
+            TrainingState state;
+            state.setProfileDirectory(directory);
+            state.load();
+            for (int i = 0; i < size; ++i) {
+                state.recordLevelSummary(benchmarkSummary(i));
+            }
+            state.flush();
+        }
+
+        const QString suffix = QStringLiteral(" (%1 summaries)").arg(size);
+        TrainingState state;
+        state.setProfileDirectory(directory);
+        QElapsedTimer timer;
+        TimingSeries load(QStringLiteral("load") + suffix);
+        timer.start();
+        state.load();
+        load.add(timer.nsecsElapsed());
+
+        // the writer is drained between runs, so each save is timed on
+        // its own rather than joining a pending write
+        TimingSeries progress(QStringLiteral("progress save") + suffix);
+        TimingSeries levelEnd(QStringLiteral("level-end save") + suffix);
+        for (int run = 0; run < runs; ++run) {
+            state.addCountedSeconds(1.0);
+            timer.start();
+            state.save();
+            progress.add(timer.nsecsElapsed());
+            state.flush();
+
+            const LevelSummary summary = benchmarkSummary(size + run);
+            timer.start();
+            state.recordLevelSummary(summary);
+            state.save();
+            levelEnd.add(timer.nsecsElapsed());
+            state.flush();
+        }
+        timings << load.result() << progress.result() << levelEnd.result();
+    }
+    return timings;
+}
+
+QVector<BenchmarkTiming> Benchmark::schedules(int runs)
+{
+    // octaves 4 to 6, as the bundled samples cover
+    constexpr quint16 kOctaves = (1u << 4) | (1u << 5) | (1u << 6);
+    struct Case {
+        const char *name;
+        ScheduleConstraints constraints;
+    };
+    QVector<Case> cases;
+
+    Case early{"schedule: 20 trials, 3 pitches", ScheduleConstraints{}};
+    early.constraints.trialCount = 20;
+    early.constraints.pitchMask = 0x0007;
+    early.constraints.octaveMask = kOctaves;
+    early.constraints.maxRepeats = 3;
+    early.constraints.luckyDoubleOdds = 10;
+    cases << early;
+
+    Case outside{"schedule: 40 trials, 6 pitches, 20% others", early.constraints};
+    outside.constraints.trialCount = 40;
+    outside.constraints.pitchMask = 0x003f;
+    outside.constraints.outOfBoundsMask = 0x0fc0;
+    outside.constraints.outOfBoundsProportion = 0.2;
+    cases << outside;
+
+    Case spaced{"schedule: 36 trials, 12 pitches, > 1 octave apart", early.constraints};
+    spaced.constraints.trialCount = 36;
+    spaced.constraints.pitchMask = 0x0fff;
+    spaced.constraints.minIntervalSemitones = 13;
+    cases << spaced;
+
+    QVector<BenchmarkTiming> timings;
+    QVector<ScheduledTrial> trials;
+    QElapsedTimer timer;
+    for (const auto &entry : cases) {
+        TimingSeries series(QString::fromLatin1(entry.name));
+        for (int run = 0; run < runs; ++run) {
+            timer.start();
+            TrialScheduler::generate(entry.constraints, static_cast<quint32>(run) * 2654435761u, &trials);
+            series.add(timer.nsecsElapsed());
+        }
+        timings << series.result();
+    }
+    return timings;
+}
+
+void Benchmark::print(QTextStream &out, const QVector<BenchmarkTiming> &timings)
+{
+    int width = 0;
+    for (const auto &timing : timings) {
+        width = qMax(width, static_cast<int>(timing.name.size()));
+    }
+    for (const auto &timing : timings) {
+        out << timing.name.leftJustified(width) << "  " << qSetFieldWidth(6) << timing.runs << qSetFieldWidth(0)
+            << " runs  mean " << qSetFieldWidth(10) << QString::number(timing.meanUs, 'f', 1) << qSetFieldWidth(0)
+            << " us  max " << qSetFieldWidth(10) << QString::number(timing.maxUs, 'f', 1) << qSetFieldWidth(0)
+            << " us" << Qt::endl;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+class QTextStream;
+
+struct BenchmarkTiming {
+    QString name;
+    int runs = 0;
+    double meanUs = 0.0;
+    double maxUs = 0.0;
+};
+
+// Micro-benchmarks of work the GUI thread does per trial or per level.
+// Every timing is taken on the calling thread, as the window would see it.
+class Benchmark
+{
+public:
+    // TrainingState::load() and save() of a profile holding each number
+    // of level summaries, built in a scratch directory first. A progress
+    // save follows a change of counted time; a level-end save follows a
+    // new summary, which may spill one to the archive.
+    static QVector<BenchmarkTiming> stateSaves(const QString &scratchDirectory, const QVector<int> &historySizes,
+                                               int runs);
+    // TrialScheduler::generate() into a reused vector, as a level start
+    // builds its block, for a few typical constraint sets
+    static QVector<BenchmarkTiming> schedules(int runs);
+
+    static void print(QTextStream &out, const QVector<BenchmarkTiming> &timings);
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,491 @@
+#include "analyticsstore.h"
+#include "benchmark.h"
+#include "cohortreport.h"
+#include "dataexporter.h"
+#include "profilemanager.h"
+#include "psychometrics.h"
+#include "replayengine.h"
+#include "testbattery.h"
+#include "trainingmodel.h"
+#include "trainingprotocol.h"
+#include "trainingsession.h"
+#include "tonesynth.h"
+#include "trialjournal.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <limits>
+
+namespace {
+QString formatKey(AnalyticsKey key, qint64 value, const QStringList &profileIds)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    switch (key) {
+    case AnalyticsKey::Profile:
+        return profileIds.value(static_cast<int>(value), QString::number(value));
+    case AnalyticsKey::Pitch:
+    case AnalyticsKey::Response:
+        if (value == JournalRecord::kOtherResponse) {
+            return QStringLiteral("OUT");
+        }
+        return value >= 0 && value < order.size() ? order.at(static_cast<int>(value)) : QStringLiteral("-");
+    case AnalyticsKey::Day:
+    case AnalyticsKey::Week:
+        return QDateTime::fromMSecsSinceEpoch(value, Qt::UTC).date().toString(Qt::ISODate);
+    default:
+        return QString::number(value);
+    }
+}
+
+bool parseDay(const QString &text, qint64 *msecs)
+{
+    const QDate date = QDate::fromString(text, Qt::ISODate);
+    if (!date.isValid()) {
+        return false;
+    }
+    *msecs = QDateTime(date, QTime(0, 0), Qt::UTC).toMSecsSinceEpoch();
+    return true;
+}
+
+// 16-bit mono PCM at the synth's rate in a RIFF/WAVE container
+bool writeWav(const QString &path, const QByteArray &pcm)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    const quint32 rate = ToneSynth::kSampleRate;
+    stream.writeRawData("RIFF", 4);
+    stream << quint32(36 + pcm.size());
+    stream.writeRawData("WAVEfmt ", 8);
+    stream << quint32(16) << quint16(1) << quint16(1) << rate << quint32(rate * 2) << quint16(2) << quint16(16);
+    stream.writeRawData("data", 4);
+    stream << quint32(pcm.size());
+    stream.writeRawData(pcm.constData(), pcm.size());
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool parseRange(const QString &text, qint64 *minimum, qint64 *maximum)
+{
+    const QStringList parts = text.split(QLatin1Char(':'));
+    bool okMin = true;
+    bool okMax = true;
+    *minimum = parts.value(0).toLongLong(&okMin);
+    *maximum = parts.size() > 1 ? parts.at(1).toLongLong(&okMax) : *minimum;
+    return parts.size() <= 2 && okMin && okMax;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("pitchtool"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Ingest, query and export trial data of all profiles, report on the whole cohort or manage training protocols."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("command"), QStringLiteral("ingest, query, export, cohort, replay <protocol file>, psychometrics, protocol (show [file], check <file>, assign <file> --profile <id>), battery (show pre|post, render pre|post --out <file.wav>) or bench [save|schedule]"));
+    const QCommandLineOption rootOption(QStringLiteral("root"), QStringLiteral("Profiles directory."), QStringLiteral("dir"));
+    const QCommandLineOption storeOption(QStringLiteral("store"), QStringLiteral("Analytics store directory (default: <root>/analytics)."), QStringLiteral("dir"));
+    const QCommandLineOption groupOption(QStringLiteral("group-by"), QStringLiteral("Comma-separated keys: profile, level, stage, pitch, octave, response, day, week."), QStringLiteral("keys"));
+    const QCommandLineOption levelOption(QStringLiteral("level"), QStringLiteral("Level index or range min:max (0-based)."), QStringLiteral("range"));
+    const QCommandLineOption stageOption(QStringLiteral("stage"), QStringLiteral("Stage number (1-based)."), QStringLiteral("stage"));
+    const QCommandLineOption profileOption(QStringLiteral("profile"), QStringLiteral("Profile id."), QStringLiteral("id"));
+    const QCommandLineOption fromOption(QStringLiteral("from"), QStringLiteral("First day (YYYY-MM-DD, UTC)."), QStringLiteral("date"));
+    const QCommandLineOption toOption(QStringLiteral("to"), QStringLiteral("Last day (YYYY-MM-DD, UTC)."), QStringLiteral("date"));
+    const QCommandLineOption feedbackOption(QStringLiteral("feedback"), QStringLiteral("Only trials with (yes) or without (no) feedback."), QStringLiteral("yes|no"));
+    const QCommandLineOption specialOption(QStringLiteral("include-special"), QStringLiteral("Include special-exercise trials."));
+    const QCommandLineOption batteryOption(QStringLiteral("include-battery"), QStringLiteral("Include pre/post test trials."));
+    const QCommandLineOption outOption(QStringLiteral("out"), QStringLiteral("Export, cohort, replay or psychometrics report directory, or the rendered battery file."), QStringLiteral("path"));
+    const QCommandLineOption formatOption(QStringLiteral("format"), QStringLiteral("Export format: csv, arrow or both (default)."), QStringLiteral("format"));
+    const QCommandLineOption chunkOption(QStringLiteral("chunk-rows"), QStringLiteral("Rows per export chunk (default 65536)."), QStringLiteral("rows"));
+    const QCommandLineOption jobsOption(QStringLiteral("jobs"), QStringLiteral("Parallel profile readers (default: one per core)."), QStringLiteral("n"));
+    const QCommandLineOption samplesOption(QStringLiteral("samples"), QStringLiteral("Bootstrap resamples per confidence interval (default 200, 0 for none)."), QStringLiteral("n"));
+    const QCommandLineOption runsOption(QStringLiteral("runs"), QStringLiteral("Timed runs per benchmark (default 200)."), QStringLiteral("n"));
+    parser.addOptions({rootOption, storeOption, groupOption, levelOption, stageOption, profileOption,
+                       fromOption, toOption, feedbackOption, specialOption, batteryOption, outOption, formatOption,
+                       chunkOption, jobsOption, samplesOption, runsOption});
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    const QStringList positional = parser.positionalArguments();
+    const QString command = positional.value(0);
+    if (command != QLatin1String("ingest") && command != QLatin1String("query") && command != QLatin1String("export")
+        && command != QLatin1String("cohort") && command != QLatin1String("replay") && command != QLatin1String("protocol")
+        && command != QLatin1String("battery") && command != QLatin1String("psychometrics")
+        && command != QLatin1String("bench")) {
+        parser.showHelp(1);
+    }
+
+    if (command == QLatin1String("bench")) {
+        const int runs = parser.isSet(runsOption) ? qMax(1, parser.value(runsOption).toInt()) : 200;
+        QTemporaryDir scratch;
+        if (!scratch.isValid()) {
+            err << "cannot create a scratch directory" << Qt::endl;
+            return 1;
+        }
+        const QString which = positional.value(1);
+        if (which.isEmpty() || which == QLatin1String("save")) {
+            Benchmark::print(out, Benchmark::stateSaves(scratch.path(), {80, 10000, 100000}, runs));
+        }
+        if (which.isEmpty() || which == QLatin1String("schedule")) {
+            Benchmark::print(out, Benchmark::schedules(runs));
+        }
+        return 0;
+    }
+
+    const QString root = parser.isSet(rootOption) ? parser.value(rootOption) : ProfileManager().rootPath();
+    if (command == QLatin1String("export")) {
+        if (!parser.isSet(outOption)) {
+            err << "export needs --out" << Qt::endl;
+            return 1;
+        }
+        ExportOptions options;
+        options.rootPath = root;
+        options.outputDirectory = parser.value(outOption);
+        const QString format = parser.value(formatOption);
+        options.csv = format.isEmpty() || format == QLatin1String("both") || format == QLatin1String("csv");
+        options.arrow = format.isEmpty() || format == QLatin1String("both") || format == QLatin1String("arrow");
+        if (parser.isSet(chunkOption)) {
+            options.chunkRows = parser.value(chunkOption).toInt();
+        }
+        if (parser.isSet(jobsOption)) {
+            options.jobs = parser.value(jobsOption).toInt();
+        }
+        QElapsedTimer exportTimer;
+        exportTimer.start();
+        const ExportReport report = DataExporter(options).run();
+        if (!report.ok) {
+            err << "export to " << options.outputDirectory << " failed" << Qt::endl;
+            return 1;
+        }
+        err << "exported " << report.trialRows << " trials and " << report.summaryRows << " summaries from "
+            << report.profiles << " profiles in " << exportTimer.elapsed() << " ms" << Qt::endl;
+        return 0;
+    }
+
+    if (command == QLatin1String("cohort")) {
+        if (!parser.isSet(outOption)) {
+            err << "cohort needs --out" << Qt::endl;
+            return 1;
+        }
+        CohortOptions options;
+        options.rootPath = root;
+        if (parser.isSet(jobsOption)) {
+            options.jobs = parser.value(jobsOption).toInt();
+        }
+        QElapsedTimer cohortTimer;
+        cohortTimer.start();
+        const CohortReport report = CohortReport::build(options);
+        if (!report.write(parser.value(outOption))) {
+            err << "cohort report to " << parser.value(outOption) << " failed" << Qt::endl;
+            return 1;
+        }
+        err << "reported on " << report.profileCount() << " profiles in " << cohortTimer.elapsed() << " ms" << Qt::endl;
+        return 0;
+    }
+
+    if (command == QLatin1String("replay")) {
+        if (!parser.isSet(outOption) || positional.size() < 2) {
+            err << "replay needs a protocol file and --out" << Qt::endl;
+            return 1;
+        }
+        ReplayOptions options;
+        options.rootPath = root;
+        QString error;
+        if (!TrainingProtocol::load(positional.at(1), &options.protocol, &error)) {
+            err << "invalid protocol: " << error << Qt::endl;
+            return 1;
+        }
+        if (parser.isSet(jobsOption)) {
+            options.jobs = parser.value(jobsOption).toInt();
+        }
+        QElapsedTimer replayTimer;
+        replayTimer.start();
+        const ReplayReport report = ReplayReport::build(options);
+        const qint64 elapsed = replayTimer.elapsed();
+        if (!report.write(parser.value(outOption))) {
+            err << "replay report to " << parser.value(outOption) << " failed" << Qt::endl;
+            return 1;
+        }
+        // recorded and replayed side by side, tab-separated like query
+        const ReplayTotals totals = report.totals();
+        out << "passes\t" << totals.recorded.passes << '\t' << totals.replayed.passes << Qt::endl;
+        out << "tokens\t" << totals.recorded.tokens << '\t' << totals.replayed.tokens << Qt::endl;
+        out << "skips\t" << totals.recorded.skips << '\t' << totals.replayed.skips << Qt::endl;
+        out << "trials_skipped\t" << totals.recorded.trialsSkipped << '\t' << totals.replayed.trialsSkipped << Qt::endl;
+        out << "pass_to_fail\t" << totals.passToFail << Qt::endl;
+        out << "fail_to_pass\t" << totals.failToPass << Qt::endl;
+        out << "final_stage_changed\t" << totals.finalStageChanged << Qt::endl;
+        out << "unreplayable\t" << totals.unreplayable << Qt::endl;
+        err << "replayed " << report.trialCount() << " trials of " << report.profileCount() << " profiles in "
+            << elapsed << " ms" << Qt::endl;
+        return 0;
+    }
+
+    if (command == QLatin1String("psychometrics")) {
+        PsychometricOptions options;
+        options.rootPath = root;
+        if (parser.isSet(jobsOption)) {
+            options.jobs = parser.value(jobsOption).toInt();
+        }
+        if (parser.isSet(samplesOption)) {
+            options.bootstrapSamples = qMax(0, parser.value(samplesOption).toInt());
+        }
+        QElapsedTimer psychometricTimer;
+        psychometricTimer.start();
+        if (parser.isSet(profileOption)) {
+            // one participant: refresh the cache and print the table
+            const QString profileId = parser.value(profileOption);
+            for (const UserProfile &profile : ProfileManager::readProfiles(root)) {
+                if (profile.id != profileId) {
+                    continue;
+                }
+                PsychometricCache cache(PsychometricCache::defaultDirectory(root));
+                const PsychometricProfile result = cache.refresh(profile, QDir(root).filePath(profile.id),
+                                                                 options.bootstrapSamples, options.jobs);
+                out << "pitch\tpresented\td_prime\tcriterion\texp_asymptote\texp_rate\tpow_asymptote\tpow_rate" << Qt::endl;
+                for (int c = 0; c < result.pitches.size(); ++c) {
+                    const PitchPsychometrics &pitch = result.pitches.at(c);
+                    out << formatKey(AnalyticsKey::Pitch, c, QStringList()) << '\t'
+                        << pitch.totals.presented << '\t' << pitch.dPrime << '\t' << pitch.criterion << '\t'
+                        << (pitch.exponential.valid ? QString::number(pitch.exponential.asymptote) : QStringLiteral("-")) << '\t'
+                        << (pitch.exponential.valid ? QString::number(pitch.exponential.rate) : QStringLiteral("-")) << '\t'
+                        << (pitch.power.valid ? QString::number(pitch.power.asymptote) : QStringLiteral("-")) << '\t'
+                        << (pitch.power.valid ? QString::number(pitch.power.rate) : QStringLiteral("-")) << Qt::endl;
+                }
+                err << "analysed " << result.levels << " levels in " << psychometricTimer.elapsed() << " ms" << Qt::endl;
+                return 0;
+            }
+            err << "no profile " << profileId << " under " << root << Qt::endl;
+            return 1;
+        }
+        if (!parser.isSet(outOption)) {
+            err << "psychometrics needs --profile or --out" << Qt::endl;
+            return 1;
+        }
+        const PsychometricReport report = PsychometricReport::build(options);
+        if (!report.write(parser.value(outOption))) {
+            err << "psychometrics report to " << parser.value(outOption) << " failed" << Qt::endl;
+            return 1;
+        }
+        err << "analysed " << report.profileCount() << " profiles in " << psychometricTimer.elapsed() << " ms" << Qt::endl;
+        return 0;
+    }
+
+    if (command == QLatin1String("battery")) {
+        const QString action = positional.value(1, QStringLiteral("show"));
+        TestBattery::Form form = TestBattery::Form::Pre;
+        if (!TestBattery::formFromName(positional.value(2, QStringLiteral("pre")), &form)) {
+            parser.showHelp(1);
+        }
+        const TestBattery battery(form);
+        if (action == QLatin1String("show")) {
+            out << QJsonDocument(battery.toJson()).toJson(QJsonDocument::Indented);
+            return 0;
+        }
+        if (action != QLatin1String("render") || !parser.isSet(outOption)) {
+            parser.showHelp(1);
+        }
+        const BatteryTimeline timeline(battery);
+        if (!writeWav(parser.value(outOption), timeline.render())) {
+            err << "cannot write " << parser.value(outOption) << Qt::endl;
+            return 1;
+        }
+        out << battery.formName() << " test: " << battery.trialCount() << " tones, " << battery.frameCount()
+            << " frames at " << ToneSynth::kSampleRate << " Hz, timeline " << battery.timelineHash() << Qt::endl;
+        return 0;
+    }
+
+    if (command == QLatin1String("protocol")) {
+        const QString action = positional.value(1, QStringLiteral("show"));
+        const QString file = positional.value(2);
+        TrainingProtocol protocol = TrainingProtocol::standard();
+        QString error;
+        if (!file.isEmpty() && !TrainingProtocol::load(file, &protocol, &error)) {
+            err << "invalid protocol: " << error << Qt::endl;
+            return 1;
+        }
+        if (action == QLatin1String("show")) {
+            out << QJsonDocument(protocol.toJson()).toJson(QJsonDocument::Indented);
+            return 0;
+        }
+        if (file.isEmpty()) {
+            err << "protocol " << action << " needs a file" << Qt::endl;
+            return 1;
+        }
+        if (action == QLatin1String("check")) {
+            out << protocol.id() << " v" << protocol.version() << ": " << protocol.stageCount() << " stages, "
+                << protocol.levelCount() << " levels, hash " << protocol.hash() << Qt::endl;
+            return 0;
+        }
+        if (action != QLatin1String("assign") || !parser.isSet(profileOption)) {
+            parser.showHelp(1);
+        }
+        const QString profileId = parser.value(profileOption);
+        bool known = false;
+        for (const UserProfile &profile : ProfileManager::readProfiles(root)) {
+            known = known || profile.id == profileId;
+        }
+        if (!known) {
+            err << "no profile " << profileId << " under " << root << Qt::endl;
+            return 1;
+        }
+        if (protocol.id() == TrainingProtocol::standard().id() && !protocol.isStandard()) {
+            err << "the id " << protocol.id() << " is reserved for the built-in protocol" << Qt::endl;
+            return 1;
+        }
+        // the profile resolves its protocol from <root>/protocols by id
+        const QString target = TrainingProtocol::pathFor(root, protocol.id());
+        if (!protocol.isStandard() && QFileInfo(file).absoluteFilePath() != QFileInfo(target).absoluteFilePath()) {
+            QDir().mkpath(TrainingProtocol::directoryForRoot(root));
+            QFile::remove(target);
+            if (!QFile::copy(file, target)) {
+                err << "cannot install " << file << " as " << target << Qt::endl;
+                return 1;
+            }
+        }
+        TrainingSession session;
+        session.open(QDir(root).filePath(profileId));
+        if (session.isReadOnly()) {
+            err << "profile " << profileId << " is open elsewhere" << Qt::endl;
+            return 1;
+        }
+        if (!session.setProtocol(protocol)) {
+            err << "cannot record the protocol in " << session.profileDirectory() << Qt::endl;
+            return 1;
+        }
+        out << profileId << " now trains under " << protocol.id() << " v" << protocol.version()
+            << " (level " << session.state().currentLevelIndex() + 1 << " of " << protocol.levelCount() << ")" << Qt::endl;
+        return 0;
+    }
+
+    AnalyticsStore store(parser.isSet(storeOption) ? parser.value(storeOption) : AnalyticsStore::defaultDirectory(root));
+
+    QElapsedTimer timer;
+    timer.start();
+    if (command == QLatin1String("ingest")) {
+        const qint64 added = store.ingest(root);
+        if (added < 0) {
+            err << "ingest failed for " << store.directory() << Qt::endl;
+            return 1;
+        }
+        err << "added " << added << " rows (" << store.rowCount() << " total) in " << timer.elapsed() << " ms" << Qt::endl;
+        return 0;
+    }
+
+    if (!store.open()) {
+        err << "cannot open analytics store " << store.directory() << Qt::endl;
+        return 1;
+    }
+
+    AnalyticsQuery query;
+    if (!parser.isSet(specialOption)) {
+        query.excludedFlags |= JournalRecord::Special;
+    }
+    if (!parser.isSet(batteryOption)) {
+        query.excludedFlags |= JournalRecord::TestBattery;
+    }
+    if (parser.isSet(feedbackOption)) {
+        if (parser.value(feedbackOption) == QLatin1String("yes")) {
+            query.requiredFlags |= JournalRecord::Feedback;
+        } else {
+            query.excludedFlags |= JournalRecord::Feedback;
+        }
+    }
+    if (parser.isSet(levelOption)) {
+        AnalyticsRange range;
+        range.column = AnalyticsColumn::Level;
+        if (!parseRange(parser.value(levelOption), &range.minimum, &range.maximum)) {
+            err << "bad level range" << Qt::endl;
+            return 1;
+        }
+        query.ranges.append(range);
+    }
+    if (parser.isSet(stageOption)) {
+        const int stage = parser.value(stageOption).toInt();
+        AnalyticsRange range;
+        range.column = AnalyticsColumn::Level;
+        range.minimum = TrainingSpec::totalLevelCount();
+        range.maximum = -1;
+        for (const auto &spec : TrainingSpec::levelSpecs()) {
+            if (spec.stageIndex == stage) {
+                range.minimum = qMin<qint64>(range.minimum, spec.globalIndex);
+                range.maximum = qMax<qint64>(range.maximum, spec.globalIndex);
+            }
+        }
+        query.ranges.append(range);
+    }
+    if (parser.isSet(profileOption)) {
+        AnalyticsRange range;
+        range.column = AnalyticsColumn::Profile;
+        range.minimum = range.maximum = store.profileIndex(parser.value(profileOption));
+        query.ranges.append(range);
+    }
+    if (parser.isSet(fromOption) || parser.isSet(toOption)) {
+        AnalyticsRange range;
+        range.column = AnalyticsColumn::Timestamp;
+        range.minimum = std::numeric_limits<qint64>::min();
+        range.maximum = std::numeric_limits<qint64>::max();
+        qint64 day = 0;
+        if (parser.isSet(fromOption)) {
+            if (!parseDay(parser.value(fromOption), &day)) {
+                err << "bad --from date" << Qt::endl;
+                return 1;
+            }
+            range.minimum = day;
+        }
+        if (parser.isSet(toOption)) {
+            if (!parseDay(parser.value(toOption), &day)) {
+                err << "bad --to date" << Qt::endl;
+                return 1;
+            }
+            range.maximum = day + 24 * 60 * 60 * 1000 - 1;
+        }
+        query.ranges.append(range);
+    }
+    if (parser.isSet(groupOption)) {
+        const QStringList names = parser.value(groupOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+        for (const auto &name : names) {
+            AnalyticsKey key;
+            if (!AnalyticsStore::parseKey(name.trimmed(), &key)) {
+                err << "unknown group key " << name << Qt::endl;
+                return 1;
+            }
+            query.groupBy.append(key);
+        }
+    }
+
+    const auto groups = store.run(query);
+    const qint64 elapsed = timer.elapsed();
+    const QStringList profileIds = store.profileIds();
+
+    for (const auto key : query.groupBy) {
+        out << AnalyticsStore::keyName(key) << '\t';
+    }
+    out << "trials\tcorrect\taccuracy\ttimeouts\tmean_rt_ms\n";
+    for (const auto &group : groups) {
+        for (int k = 0; k < query.groupBy.size(); ++k) {
+            out << formatKey(query.groupBy.at(k), group.key.at(k), profileIds) << '\t';
+        }
+        out << group.trials << '\t' << group.correct << '\t'
+            << QString::number(group.accuracy(), 'f', 4) << '\t' << group.timeouts << '\t'
+            << QString::number(group.meanResponseTimeMs(), 'f', 1) << '\n';
+    }
+    out.flush();
+    err << groups.size() << " groups over " << store.rowCount() << " rows in " << elapsed << " ms" << Qt::endl;
+    return 0;
+}
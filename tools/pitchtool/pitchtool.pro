@@ -0,0 +1,16 @@
+QT       += core
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = pitchtool
+
+include(../../core.pri)
+
+SOURCES += \
+    benchmark.cpp \
+    main.cpp
+
+HEADERS += \
+    benchmark.h
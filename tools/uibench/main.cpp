@@ -0,0 +1,158 @@
+#include "feedbackbanner.h"
+#include "theme.h"
+#include "triallogmodel.h"
+#include "trainingmodel.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QLabel>
+#include <QListView>
+#include <QListWidget>
+#include <QStyle>
+#include <QTextStream>
+#include <QVBoxLayout>
+#include <functional>
+
+namespace {
+// the feedback rules the window stylesheet carried before the banner
+// painted itself
+const QString kPolishedFeedbackRules = QStringLiteral(R"(
+QLabel#feedbackLabel {
+    border-radius: 5px;
+    padding: 10px 12px;
+    font-weight: 600;
+    border: 1px solid #fbbf24;
+    background-color: #fff7e6;
+    color: #92400e;
+}
+QLabel#feedbackLabel[positive="true"] {
+    background-color: #ecfdf5;
+    color: #065f46;
+    border-color: #34d399;
+}
+QLabel#feedbackLabel[positive="false"] {
+    background-color: #fef2f2;
+    color: #991b1b;
+    border-color: #fca5a5;
+}
+)");
+
+TrialLogRecord benchmarkRecord(int trial)
+{
+    TrialLogRecord record;
+    record.trialNumber = static_cast<quint16>(trial);
+    record.presented = static_cast<qint8>(trial % 12);
+    record.response = static_cast<qint8>((trial * 7) % 12);
+    if (trial % 3 != 0) {
+        record.flags |= TrialLogRecord::Correct;
+        record.response = record.presented;
+    } else if (trial % 7 == 0) {
+        record.flags |= TrialLogRecord::TimedOut;
+        record.response = TrialLogRecord::kNoResponse;
+    }
+    return record;
+}
+
+QString describeForWidget(const TrialLogRecord &record)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    const QString target = order.value(record.presented);
+    if (record.flags & TrialLogRecord::TimedOut) {
+        return QStringLiteral("Time expired (target %1)").arg(target);
+    }
+    if (record.flags & TrialLogRecord::Correct) {
+        return QStringLiteral("Correct (%1)").arg(target);
+    }
+    return QStringLiteral("Incorrect (target %1, answered %2)").arg(target, order.value(record.response));
+}
+
+// runs update once per trial and lets the event loop lay out and paint,
+// as the window does before the next tone
+void timeUpdates(QTextStream &out, const QString &name, int trials, const std::function<void(int)> &update)
+{
+    QElapsedTimer timer;
+    double totalUs = 0.0;
+    double maxUs = 0.0;
+    for (int trial = 1; trial <= trials; ++trial) {
+        timer.start();
+        update(trial);
+        QCoreApplication::processEvents();
+        const double us = timer.nsecsElapsed() / 1000.0;
+        totalUs += us;
+        maxUs = qMax(maxUs, us);
+    }
+    out << name.leftJustified(28) << "  " << trials << " trials  mean " << QString::number(totalUs / trials, 'f', 1)
+        << " us  max " << QString::number(maxUs, 'f', 1) << " us" << Qt::endl;
+}
+}
+
+// Per-trial cost of the feedback strip and the trial log in a window
+// styled like the app, the way they were updated before the theme and
+// the ring-buffer model (re-polished QLabel, growing QListWidget) and the
+// way they are now.
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("uibench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Time the window's per-trial feedback and trial-log updates, before and after the painted theme."));
+    parser.addHelpOption();
+    const QCommandLineOption trialsOption(QStringLiteral("trials"), QStringLiteral("Trials per run (default 2000)."), QStringLiteral("n"));
+    parser.addOption(trialsOption);
+    parser.process(app);
+    const int trials = parser.isSet(trialsOption) ? qMax(1, parser.value(trialsOption).toInt()) : 2000;
+
+    QWidget window;
+    window.setStyleSheet(Theme::current().styleSheet + kPolishedFeedbackRules);
+    auto *layout = new QVBoxLayout(&window);
+    auto *label = new QLabel(&window);
+    label->setObjectName(QStringLiteral("feedbackLabel"));
+    label->setWordWrap(true);
+    label->setProperty("positive", true);
+    auto *banner = new FeedbackBanner(&window);
+    auto *logWidget = new QListWidget(&window);
+    logWidget->setAlternatingRowColors(true);
+    auto *logModel = new TrialLogModel(500, &window);
+    auto *logView = new QListView(&window);
+    logView->setObjectName(QStringLiteral("trialLog"));
+    logView->setSelectionMode(QAbstractItemView::NoSelection);
+    logView->setUniformItemSizes(true);
+    logView->setItemDelegate(new TrialLogDelegate(logView));
+    logView->setModel(logModel);
+    layout->addWidget(label);
+    layout->addWidget(banner);
+    layout->addWidget(logWidget);
+    layout->addWidget(logView);
+    window.resize(640, 900);
+    window.show();
+    QCoreApplication::processEvents();
+
+    QTextStream out(stdout);
+    const QString message = QStringLiteral("Correct! That was the target pitch.");
+    timeUpdates(out, QStringLiteral("feedback: polished QLabel"), trials, [label, &message](int trial) {
+        label->setText(message);
+        label->setProperty("positive", trial % 2 == 0);
+        label->style()->unpolish(label);
+        label->style()->polish(label);
+        label->update();
+    });
+    timeUpdates(out, QStringLiteral("feedback: FeedbackBanner"), trials, [banner, &message](int trial) {
+        banner->setMessage(message, trial % 2 == 0 ? FeedbackTone::Positive : FeedbackTone::Negative);
+    });
+
+    const auto &theme = Theme::current();
+    timeUpdates(out, QStringLiteral("trial log: QListWidget"), trials, [logWidget, &theme](int trial) {
+        const TrialLogRecord record = benchmarkRecord(trial);
+        auto *item = new QListWidgetItem(QStringLiteral("Trial %1: %2").arg(trial).arg(describeForWidget(record)));
+        item->setForeground(record.positive() ? theme.logPositive : theme.logNegative);
+        logWidget->addItem(item);
+        logWidget->scrollToBottom();
+    });
+    timeUpdates(out, QStringLiteral("trial log: TrialLogModel"), trials, [logModel, logView](int trial) {
+        logModel->append(benchmarkRecord(trial));
+        logView->scrollToBottom();
+    });
+    return 0;
+}
@@ -0,0 +1,19 @@
+QT       += core gui widgets
+
+CONFIG += c++17
+CONFIG -= app_bundle
+
+TARGET = uibench
+
+include(../../core.pri)
+
+SOURCES += \
+    ../../theme.cpp \
+    ../../feedbackbanner.cpp \
+    ../../triallogmodel.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../theme.h \
+    ../../feedbackbanner.h \
+    ../../triallogmodel.h
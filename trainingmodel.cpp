@@ -1,23 +1,258 @@
 #include "trainingmodel.h"
 
+#include <QCborStreamReader>
+#include <QCborValue>
 #include <QDir>
 #include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
+#include <QSaveFile>
 #include <QStandardPaths>
 #include <QtMath>
 #include <algorithm>
 
 namespace {
 
-constexpr int kLevelsPerStage = 24;
-constexpr int kTotalPitches = 12;
+constexpr char kStateFormat[] = "pitchtraining-state";
+constexpr int kStateVersion = 1;
+
+QString readCborString(QCborStreamReader &reader)
+{
+    if (!reader.isString()) {
+        reader.next();
+        return {};
+    }
+    QString result;
+    auto chunk = reader.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        result += chunk.data;
+        chunk = reader.readString();
+    }
+    return result;
+}
+
+QByteArray readCborBytes(QCborStreamReader &reader)
+{
+    QByteArray result;
+    auto chunk = reader.readByteArray();
+    while (chunk.status == QCborStreamReader::Ok) {
+        result += chunk.data;
+        chunk = reader.readByteArray();
+    }
+    return result;
+}
+
+QJsonObject sketchSummaryJson(const ResponseTimeSketch &sketch)
+{
+    QJsonObject obj;
+    obj["count"] = static_cast<double>(sketch.count());
+    if (!sketch.isEmpty()) {
+        obj["p50"] = sketch.quantile(0.5);
+        obj["p90"] = sketch.quantile(0.9);
+        obj["p99"] = sketch.quantile(0.99);
+        obj["max"] = sketch.maximum();
+    }
+    return obj;
+}
+
+QJsonObject responseTimesJson(const ResponseTimeProfile &profile)
+{
+    QJsonObject pitch;
+    const auto &order = TrainingSpec::chromaticOrder();
+    for (int i = 0; i < ResponseTimeProfile::kCategoryCount; ++i) {
+        pitch[i < order.size() ? order.at(i) : QStringLiteral("OUT")] = sketchSummaryJson(profile.byPitch(i));
+    }
+    QJsonArray stages;
+    for (int stage = 1; stage <= ResponseTimeProfile::kStageCount; ++stage) {
+        for (const bool feedback : {true, false}) {
+            QJsonObject entry = sketchSummaryJson(profile.byStage(stage, feedback));
+            entry["stage"] = stage;
+            entry["feedback"] = feedback;
+            entry["timeouts"] = static_cast<double>(profile.timeouts(stage, feedback));
+            stages.append(entry);
+        }
+    }
+    QJsonObject usage;
+    usage["feedback"] = sketchSummaryJson(profile.windowUsage(true));
+    usage["noFeedback"] = sketchSummaryJson(profile.windowUsage(false));
+
+    QJsonObject obj;
+    obj["pitch"] = pitch;
+    obj["stage"] = stages;
+    obj["windowUsagePerMille"] = usage;
+    return obj;
+}
 
 QVector<QString> buildChromaticOrder()
 {
     return {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
 }
 
+constexpr int kPitchCount = TrainingSpec::kStageCount;
+// stage 1 trains F alone
+constexpr int kFirstPitch = 5;
+using MaskTable = std::array<quint16, TrainingSpec::kStageCount + 1>;
+
+// grows the trained range from F one semitone at a time, alternating
+// below and above, and keeps to one side once the other hits the edge
+constexpr TrainingSpec::PitchOrder buildIntroductionOrder()
+{
+    TrainingSpec::PitchOrder order{};
+    int count = 0;
+    order[count++] = kFirstPitch;
+    int lowest = kFirstPitch;
+    int highest = kFirstPitch;
+    bool pickLower = true;
+    while (count < kPitchCount && (lowest > 0 || highest < kPitchCount - 1)) {
+        if (pickLower && lowest > 0) {
+            order[count++] = --lowest;
+        } else if (!pickLower && highest < kPitchCount - 1) {
+            order[count++] = ++highest;
+        } else if (lowest > 0) {
+            order[count++] = --lowest;
+        } else {
+            order[count++] = ++highest;
+        }
+        pickLower = !pickLower;
+    }
+    return order;
+}
+
+constexpr TrainingSpec::PitchOrder kIntroductionOrder = buildIntroductionOrder();
+
+// indexed by stage; stage 0 trains nothing
+constexpr MaskTable buildStageMasks()
+{
+    MaskTable masks{};
+    quint16 mask = 0;
+    for (int stage = 1; stage <= TrainingSpec::kStageCount; ++stage) {
+        mask = static_cast<quint16>(mask | (1u << kIntroductionOrder[stage - 1]));
+        masks[stage] = mask;
+    }
+    return masks;
+}
+
+constexpr MaskTable kStageMasks = buildStageMasks();
+
+// the two semitones either side of the trained range, where they exist
+constexpr MaskTable buildOutOfBoundsMasks()
+{
+    MaskTable masks{};
+    for (int stage = 1; stage <= TrainingSpec::kStageCount; ++stage) {
+        int lowest = kPitchCount;
+        int highest = -1;
+        for (int pitch = 0; pitch < kPitchCount; ++pitch) {
+            if (kStageMasks[stage] & (1u << pitch)) {
+                lowest = pitch < lowest ? pitch : lowest;
+                highest = pitch;
+            }
+        }
+        quint16 mask = 0;
+        for (int pitch : {lowest - 2, lowest - 1, highest + 1, highest + 2}) {
+            if (pitch >= 0 && pitch < kPitchCount) {
+                mask = static_cast<quint16>(mask | (1u << pitch));
+            }
+        }
+        masks[stage] = mask;
+    }
+    return masks;
+}
+
+constexpr MaskTable kOutOfBoundsMasks = buildOutOfBoundsMasks();
+
+constexpr TrainingSpec::LevelTable buildLevelSpecs()
+{
+    constexpr double accuracyTargets[TrainingSpec::kLevelsPerStage] = {
+        0.20, 0.30, 0.40, 0.50, 0.60, 0.65, 0.70, 0.75, 0.80, 0.85, 0.88, 0.90,
+        0.60, 0.65, 0.70, 0.75, 0.80, 0.82, 0.85, 0.88, 0.90, 0.90, 0.90, 0.90 };
+
+    TrainingSpec::LevelTable specs{};
+    int index = 0;
+    for (int stage = 1; stage <= TrainingSpec::kStageCount; ++stage) {
+        const int baseRt = 2028 - (stage - 1) * 80;
+        for (int level = 1; level <= TrainingSpec::kLevelsPerStage; ++level) {
+            LevelSpec &spec = specs[index];
+            spec.globalIndex = index;
+            spec.stageIndex = stage;
+            spec.levelInStage = level;
+            spec.passAccuracy = accuracyTargets[level - 1];
+            spec.trialCount = 20;
+            int rtAdjustment = (level - 1) * 15;
+            if (level > 12) {
+                rtAdjustment += 70;
+            }
+            spec.responseWindowMs = qMax(1183, baseRt - rtAdjustment);
+            spec.feedback = level <= 12;
+            spec.tokensAllowed = level != TrainingSpec::kLevelsPerStage;
+            ++index;
+        }
+    }
+    return specs;
+}
+
+constexpr TrainingSpec::LevelTable kLevelSpecs = buildLevelSpecs();
+
+constexpr bool introducesEveryPitchOnce()
+{
+    quint16 seen = 0;
+    for (int pitch : kIntroductionOrder) {
+        if (pitch < 0 || pitch >= kPitchCount || (seen & (1u << pitch))) {
+            return false;
+        }
+        seen = static_cast<quint16>(seen | (1u << pitch));
+    }
+    return true;
+}
+
+constexpr bool stagesAreContiguous()
+{
+    for (int stage = 1; stage <= TrainingSpec::kStageCount; ++stage) {
+        const quint16 mask = kStageMasks[stage];
+        int count = 0;
+        int lowest = kPitchCount;
+        int highest = -1;
+        for (int pitch = 0; pitch < kPitchCount; ++pitch) {
+            if (mask & (1u << pitch)) {
+                ++count;
+                lowest = pitch < lowest ? pitch : lowest;
+                highest = pitch;
+            }
+        }
+        if (count != stage || highest - lowest + 1 != stage || (kOutOfBoundsMasks[stage] & mask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool ladderIsConsistent()
+{
+    for (int i = 0; i < TrainingSpec::kLevelCount; ++i) {
+        const LevelSpec &spec = kLevelSpecs[i];
+        const bool lastInStage = spec.levelInStage == TrainingSpec::kLevelsPerStage;
+        if (spec.globalIndex != i
+            || spec.stageIndex != i / TrainingSpec::kLevelsPerStage + 1
+            || spec.feedback != (spec.levelInStage <= TrainingSpec::kLevelsPerStage / 2)
+            || spec.tokensAllowed == lastInStage
+            || spec.passAccuracy <= 0.0 || spec.passAccuracy > 1.0
+            || spec.trialCount <= 0 || spec.responseWindowMs < 1183) {
+            return false;
+        }
+        // windows never widen within a stage
+        if (spec.levelInStage > 1 && spec.responseWindowMs > kLevelSpecs[i - 1].responseWindowMs) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(kIntroductionOrder[0] == kFirstPitch, "stage 1 trains F");
+static_assert(introducesEveryPitchOnce(), "each pitch is introduced exactly once");
+static_assert(kStageMasks[TrainingSpec::kStageCount] == 0x0fff, "the last stage trains all twelve pitches");
+static_assert(stagesAreContiguous(), "stage n trains n adjacent pitches with distinct out-of-bounds neighbours");
+static_assert(kOutOfBoundsMasks[TrainingSpec::kStageCount] == 0, "nothing lies outside the full chromatic range");
+static_assert(ladderIsConsistent(), "level ladder breaks the protocol");
+
 } // namespace
 
 QJsonObject LevelSummary::toJson() const
@@ -27,6 +262,18 @@ QJsonObject LevelSummary::toJson() const
     obj["accuracy"] = accuracy;
     obj["passed"] = passed;
     obj["special"] = specialExercise;
+    if (seed != 0) {
+        obj["seed"] = static_cast<double>(seed);
+    }
+    if (octaveMask != 0) {
+        obj["octaveMask"] = octaveMask;
+    }
+    if (outOfBoundsProportion != 0.0) {
+        obj["outOfBoundsProportion"] = outOfBoundsProportion;
+    }
+    if (trialsSkipped != 0) {
+        obj["trialsSkipped"] = trialsSkipped;
+    }
     obj["completedAt"] = completedAt.toString(Qt::ISODate);
 
     QJsonObject perPitchObj;
@@ -47,6 +294,10 @@ LevelSummary LevelSummary::fromJson(const QJsonObject &obj)
     summary.accuracy = obj.value("accuracy").toDouble();
     summary.passed = obj.value("passed").toBool();
     summary.specialExercise = obj.value("special").toBool();
+    summary.seed = static_cast<quint32>(obj.value("seed").toDouble());
+    summary.octaveMask = static_cast<quint16>(obj.value("octaveMask").toInt());
+    summary.outOfBoundsProportion = obj.value("outOfBoundsProportion").toDouble();
+    summary.trialsSkipped = obj.value("trialsSkipped").toInt();
     summary.completedAt = QDateTime::fromString(obj.value("completedAt").toString(), Qt::ISODate);
 
     const auto perPitchObj = obj.value("perPitch").toObject();
@@ -60,51 +311,84 @@ LevelSummary LevelSummary::fromJson(const QJsonObject &obj)
     return summary;
 }
 
-const QVector<QString> &TrainingSpec::chromaticOrder()
+QCborMap LevelSummary::toCbor() const
 {
-    static QVector<QString> order = buildChromaticOrder();
-    return order;
+    QCborMap map;
+    map[QStringLiteral("levelIndex")] = levelIndex;
+    map[QStringLiteral("accuracy")] = accuracy;
+    map[QStringLiteral("passed")] = passed;
+    map[QStringLiteral("special")] = specialExercise;
+    if (seed != 0) {
+        map[QStringLiteral("seed")] = static_cast<qint64>(seed);
+    }
+    if (octaveMask != 0) {
+        map[QStringLiteral("octaveMask")] = octaveMask;
+    }
+    if (outOfBoundsProportion != 0.0) {
+        map[QStringLiteral("outOfBoundsProportion")] = outOfBoundsProportion;
+    }
+    if (trialsSkipped != 0) {
+        map[QStringLiteral("trialsSkipped")] = trialsSkipped;
+    }
+    map[QStringLiteral("completedAt")] = completedAt.isValid() ? completedAt.toMSecsSinceEpoch() : 0;
+
+    QCborMap perPitchMap;
+    for (auto it = perPitch.constBegin(); it != perPitch.constEnd(); ++it) {
+        QCborArray stats;
+        stats.append(it.value().totalTrials);
+        stats.append(it.value().correctTrials);
+        perPitchMap[it.key()] = stats;
+    }
+    map[QStringLiteral("perPitch")] = perPitchMap;
+    return map;
 }
 
-QVector<QString> TrainingSpec::stagePitchSet(int stageIndex)
+LevelSummary LevelSummary::fromCbor(const QCborMap &map)
 {
-    const auto &order = chromaticOrder();
-    if (stageIndex <= 0) {
-        return {};
+    LevelSummary summary;
+    summary.levelIndex = static_cast<int>(map.value(QStringLiteral("levelIndex")).toInteger());
+    summary.accuracy = map.value(QStringLiteral("accuracy")).toDouble();
+    summary.passed = map.value(QStringLiteral("passed")).toBool();
+    summary.specialExercise = map.value(QStringLiteral("special")).toBool();
+    summary.seed = static_cast<quint32>(map.value(QStringLiteral("seed")).toInteger());
+    summary.octaveMask = static_cast<quint16>(map.value(QStringLiteral("octaveMask")).toInteger());
+    summary.outOfBoundsProportion = map.value(QStringLiteral("outOfBoundsProportion")).toDouble();
+    summary.trialsSkipped = static_cast<int>(map.value(QStringLiteral("trialsSkipped")).toInteger());
+    const qint64 completedMs = map.value(QStringLiteral("completedAt")).toInteger();
+    if (completedMs > 0) {
+        summary.completedAt = QDateTime::fromMSecsSinceEpoch(completedMs);
     }
 
-    QVector<int> indices;
-    indices.reserve(stageIndex);
+    const auto perPitchMap = map.value(QStringLiteral("perPitch")).toMap();
+    for (auto it = perPitchMap.constBegin(); it != perPitchMap.constEnd(); ++it) {
+        const auto stats = it.value().toArray();
+        PitchSummary pitch;
+        pitch.totalTrials = static_cast<int>(stats.at(0).toInteger());
+        pitch.correctTrials = static_cast<int>(stats.at(1).toInteger());
+        summary.perPitch.insert(it.key().toString(), pitch);
+    }
+    return summary;
+}
 
-    const int startIndex = order.indexOf("F");
-    indices.append(startIndex);
-    int lowest = startIndex;
-    int highest = startIndex;
-    bool pickLower = true;
+const QVector<QString> &TrainingSpec::chromaticOrder()
+{
+    static QVector<QString> order = buildChromaticOrder();
+    return order;
+}
 
-    while (indices.size() < stageIndex && (lowest > 0 || highest < order.size() - 1)) {
-        if (pickLower && lowest > 0) {
-            --lowest;
-            indices.append(lowest);
-        } else if (!pickLower && highest < order.size() - 1) {
-            ++highest;
-            indices.append(highest);
-        } else if (lowest > 0) {
-            --lowest;
-            indices.append(lowest);
-        } else if (highest < order.size() - 1) {
-            ++highest;
-            indices.append(highest);
-        }
-        pickLower = !pickLower;
-    }
+const TrainingSpec::PitchOrder &TrainingSpec::introductionOrder()
+{
+    return kIntroductionOrder;
+}
 
+QVector<QString> TrainingSpec::stagePitchSet(int stageIndex)
+{
+    const auto &order = chromaticOrder();
+    const int count = qBound(0, stageIndex, kStageCount);
     QVector<QString> result;
-    result.reserve(indices.size());
-    for (int idx : indices) {
-        if (idx >= 0 && idx < order.size()) {
-            result.append(order.at(idx));
-        }
+    result.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        result.append(order.at(kIntroductionOrder[i]));
     }
     return result;
 }
@@ -112,116 +396,123 @@ QVector<QString> TrainingSpec::stagePitchSet(int stageIndex)
 QVector<QString> TrainingSpec::outOfBoundsForStage(int stageIndex)
 {
     const auto &order = chromaticOrder();
-    auto trained = stagePitchSet(stageIndex);
-    if (trained.isEmpty()) {
-        return {};
-    }
-
-    QVector<int> trainedIdx;
-    trainedIdx.reserve(trained.size());
-    for (const auto &name : trained) {
-        trainedIdx.append(order.indexOf(name));
-    }
-    std::sort(trainedIdx.begin(), trainedIdx.end());
-
-    int lowest = trainedIdx.front();
-    int highest = trainedIdx.back();
-
-    QVector<QString> bounds;
-
-    // lower side
-    if (lowest > 0) {
-        const int lowerOne = lowest - 1;
-        bounds.append(order.at(lowerOne));
-        if (lowerOne > 0) {
-            bounds.append(order.at(lowerOne - 1));
-        }
-    }
-
-    // upper side
-    if (highest < order.size() - 1) {
-        const int upperOne = highest + 1;
-        bounds.append(order.at(upperOne));
-        if (upperOne < order.size() - 1) {
-            bounds.append(order.at(upperOne + 1));
-        }
-    }
-
-    // remove duplicates (can happen when approaching edges)
-    QSet<QString> unique;
-    QVector<QString> filtered;
-    for (const auto &name : bounds) {
-        if (!unique.contains(name)) {
-            unique.insert(name);
-            filtered.append(name);
+    const quint16 mask = outOfBoundsMask(stageIndex);
+    QVector<QString> result;
+    for (int pitch = 0; pitch < kPitchCount; ++pitch) {
+        if (mask & (1u << pitch)) {
+            result.append(order.at(pitch));
         }
     }
-
-    return filtered;
+    return result;
 }
 
-QVector<LevelSpec> TrainingSpec::buildLevelSpecs()
+quint16 TrainingSpec::stagePitchMask(int stageIndex)
 {
-    QVector<LevelSpec> specs;
-    specs.reserve(kLevelsPerStage * kTotalPitches);
-
-    const QVector<double> accuracyTargets = {
-        0.20, 0.30, 0.40, 0.50, 0.60, 0.65, 0.70, 0.75, 0.80, 0.85, 0.88, 0.90,
-        0.60, 0.65, 0.70, 0.75, 0.80, 0.82, 0.85, 0.88, 0.90, 0.90, 0.90, 0.90 };
-
-    for (int stage = 1; stage <= kTotalPitches; ++stage) {
-        const int baseRt = 2028 - (stage - 1) * 80;
-        for (int level = 1; level <= kLevelsPerStage; ++level) {
-            LevelSpec spec;
-            spec.globalIndex = static_cast<int>(specs.size());
-            spec.stageIndex = stage;
-            spec.levelInStage = level;
-            spec.passAccuracy = accuracyTargets.at(level - 1);
-            spec.trialCount = 20;
-            int rtAdjustment = (level - 1) * 15;
-            if (level > 12) {
-                rtAdjustment += 70;
-            }
-            spec.responseWindowMs = qMax(1183, baseRt - rtAdjustment);
-            spec.feedback = level <= 12;
-            spec.tokensAllowed = level != kLevelsPerStage;
-            specs.append(spec);
-        }
-    }
-
-    return specs;
+    return stageIndex > 0 && stageIndex <= kStageCount ? kStageMasks[stageIndex] : 0;
 }
 
-const QVector<LevelSpec> &TrainingSpec::levelSpecs()
+quint16 TrainingSpec::outOfBoundsMask(int stageIndex)
 {
-    static QVector<LevelSpec> s_specs = buildLevelSpecs();
-    return s_specs;
+    return stageIndex > 0 && stageIndex <= kStageCount ? kOutOfBoundsMasks[stageIndex] : 0;
 }
 
-LevelSpec TrainingSpec::specForIndex(int idx)
+const TrainingSpec::LevelTable &TrainingSpec::levelSpecs()
 {
-    const auto &specs = levelSpecs();
-    if (idx < 0) {
-        return specs.front();
-    }
-    if (idx >= specs.size()) {
-        return specs.back();
-    }
-    return specs.at(idx);
+    return kLevelSpecs;
 }
 
-int TrainingSpec::totalLevelCount()
+const LevelSpec &TrainingSpec::specForIndex(int idx)
 {
-    return kLevelsPerStage * kTotalPitches;
+    return kLevelSpecs[qBound(0, idx, kLevelCount - 1)];
 }
 
-TrainingState::TrainingState() = default;
+TrainingState::TrainingState()
+{
+    m_history.setWriter(&m_writer);
+}
 
 bool TrainingState::load()
 {
+    // a queued write may still target the file we are about to read
+    m_writer.waitForIdle();
     resetState();
+    m_history.setArchiveDirectory(QDir(resolvedProfileDir()).filePath(QStringLiteral("history")));
 
     QFile file(stateFilePath());
+    if (!file.exists()) {
+        return migrateLegacyJson();
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    // the history stays encoded until something asks for it
+    const QByteArray data = file.readAll();
+    QCborStreamReader reader(data);
+    if (!reader.isMap()) {
+        return false;
+    }
+    reader.enterContainer();
+    QCborMap progress;
+    bool recognised = false;
+    m_statisticsSeeded = false;
+    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+        const QString key = readCborString(reader);
+        if (key == QLatin1String("format")) {
+            recognised = readCborString(reader) == QLatin1String(kStateFormat);
+        } else if (key == QLatin1String("progress")) {
+            progress = QCborValue::fromCbor(reader).toMap();
+        } else if (key == QLatin1String("history") && reader.isByteArray()) {
+            m_historyRaw = readCborBytes(reader);
+            m_historyDecoded = m_historyRaw.isEmpty();
+        } else if (key == QLatin1String("statistics")) {
+            m_statisticsCbor = QCborValue::fromCbor(reader).toMap();
+            m_statistics = PitchStatistics::fromCbor(m_statisticsCbor);
+            m_statisticsSeeded = true;
+        } else if (key == QLatin1String("responseTimes")) {
+            m_responseTimesCbor = QCborValue::fromCbor(reader).toMap();
+            m_responseTimes = ResponseTimeProfile::fromCbor(m_responseTimesCbor);
+        } else if (key == QLatin1String("archivedCount") && reader.isInteger()) {
+            m_history.setArchivedCount(reader.toInteger());
+            reader.next();
+        } else {
+            reader.next();
+        }
+    }
+    if (!recognised || reader.lastError() != QCborError::NoError) {
+        resetState();
+        return false;
+    }
+    applyProgress(progress);
+    m_progressCbor = progressCbor();
+    return true;
+}
+
+QString TrainingState::readProtocolId(const QString &profileDirectory)
+{
+    QFile file(QDir(profileDirectory).filePath(QStringLiteral("state.cbor")));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+    QCborStreamReader reader(&file);
+    if (!reader.isMap()) {
+        return QString();
+    }
+    reader.enterContainer();
+    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+        const QString key = readCborString(reader);
+        if (key == QLatin1String("progress")) {
+            return QCborValue::fromCbor(reader).toMap().value(QStringLiteral("protocol")).toString();
+        }
+        // the history and statistics are skipped without decoding
+        reader.next();
+    }
+    return QString();
+}
+
+bool TrainingState::migrateLegacyJson()
+{
+    QFile file(legacyStateFilePath());
     if (!file.exists()) {
         return true;
     }
@@ -229,66 +520,172 @@ bool TrainingState::load()
         return false;
     }
 
-    const auto doc = QJsonDocument::fromJson(file.readAll());
-    const auto obj = doc.object();
+    const auto obj = QJsonDocument::fromJson(file.readAll()).object();
+    applyProgress(QCborMap::fromJsonObject(obj));
+    const auto historyArray = obj.value("history").toArray();
+    for (const auto &value : historyArray) {
+        const auto summary = LevelSummary::fromJson(value.toObject());
+        m_history.append(summary);
+    }
+    m_statisticsSeeded = false;
+    ensureStatisticsSeeded();
 
-    m_currentLevelIndex = obj.value("currentLevel").toInt();
-    m_tokens = obj.value("tokens").toInt();
-    m_countedSeconds = obj.value("countedSeconds").toDouble();
-    m_streakCount = obj.value("streak").toInt();
-    m_levelsSinceSpecial = obj.value("levelsSinceSpecial").toInt();
-    m_trainingCompleted = obj.value("trainingCompleted").toBool();
-    m_finalLevelConsecutivePasses = obj.value("finalLevelPasses").toInt();
-    m_totalLevelAttempts = obj.value("totalLevelAttempts").toInt();
-    m_tokensSpent = obj.value("tokensSpent").toInt();
+    // write the binary file right away; state.json is left as it was
+    markDirty(ProgressSection);
+    markDirty(HistorySection);
+    save();
+    return true;
+}
 
-    const auto lastDateStr = obj.value("lastActivityDate").toString();
+void TrainingState::applyProgress(const QCborMap &progress)
+{
+    m_currentLevelIndex = static_cast<int>(progress.value(QStringLiteral("currentLevel")).toInteger());
+    m_tokens = static_cast<int>(progress.value(QStringLiteral("tokens")).toInteger());
+    m_countedSeconds = progress.value(QStringLiteral("countedSeconds")).toDouble();
+    m_streakCount = static_cast<int>(progress.value(QStringLiteral("streak")).toInteger());
+    m_levelsSinceSpecial = static_cast<int>(progress.value(QStringLiteral("levelsSinceSpecial")).toInteger());
+    m_trainingCompleted = progress.value(QStringLiteral("trainingCompleted")).toBool();
+    m_finalLevelConsecutivePasses = static_cast<int>(progress.value(QStringLiteral("finalLevelPasses")).toInteger());
+    m_totalLevelAttempts = static_cast<int>(progress.value(QStringLiteral("totalLevelAttempts")).toInteger());
+    m_tokensSpent = static_cast<int>(progress.value(QStringLiteral("tokensSpent")).toInteger());
+
+    const auto lastDateStr = progress.value(QStringLiteral("lastActivityDate")).toString();
     if (!lastDateStr.isEmpty()) {
         m_lastActivityDate = QDate::fromString(lastDateStr, Qt::ISODate);
     }
 
-    const auto cooldownStr = obj.value("finalLevelCooldown").toString();
+    const auto cooldownStr = progress.value(QStringLiteral("finalLevelCooldown")).toString();
     if (!cooldownStr.isEmpty()) {
         m_finalLevelCooldownStart = QDateTime::fromString(cooldownStr, Qt::ISODate);
     }
+    m_protocolId = progress.value(QStringLiteral("protocol")).toString();
+    m_protocolHash = progress.value(QStringLiteral("protocolHash")).toString();
+}
 
-    const auto historyArray = obj.value("history").toArray();
-    for (const auto &value : historyArray) {
-        m_history.append(LevelSummary::fromJson(value.toObject()));
+void TrainingState::ensureHistoryDecoded() const
+{
+    if (m_historyDecoded) {
+        return;
     }
-
-    return true;
+    const QCborArray encoded = QCborValue::fromCbor(m_historyRaw).toArray();
+    for (const auto &value : encoded) {
+        m_history.append(LevelSummary::fromCbor(value.toMap()));
+    }
+    // the bytes stay as the encoded section until the history changes
+    m_historyDecoded = true;
 }
 
-bool TrainingState::save() const
+bool TrainingState::save()
 {
-    QFile file(stateFilePath());
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    if (m_readOnly) {
         return false;
     }
+    if (m_dirty == 0) {
+        return true;
+    }
+    // only the sections that changed are encoded again; the rest go to
+    // the writer as they were
+    if (m_dirty & ProgressSection) {
+        m_progressCbor = progressCbor();
+    }
+    if (m_dirty & HistorySection) {
+        QCborArray encoded;
+        const auto &recent = m_history.recent();
+        for (int i = 0; i < recent.size(); ++i) {
+            encoded.append(recent.at(i).toCbor());
+        }
+        m_historyRaw = encoded.toCborValue().toCbor();
+    }
+    if ((m_dirty & StatisticsSection) && m_statisticsSeeded) {
+        m_statisticsCbor = m_statistics.toCbor();
+    }
+    if (m_dirty & ResponseTimeSection) {
+        m_responseTimesCbor = m_responseTimes.toCbor();
+    }
+    m_dirty = 0;
+
+    const QCborMap progress = m_progressCbor;
+    const QByteArray history = m_historyRaw;
+    const qint64 archived = m_history.archivedCount();
+    const QCborMap statistics = m_statisticsSeeded ? m_statisticsCbor : QCborMap();
+    const QCborMap responseTimes = m_responseTimesCbor;
+    m_writer.submit(stateFilePath(), [progress, history, archived, statistics, responseTimes]() {
+        QCborMap root;
+        root[QStringLiteral("format")] = QLatin1String(kStateFormat);
+        root[QStringLiteral("version")] = kStateVersion;
+        root[QStringLiteral("progress")] = progress;
+        root[QStringLiteral("archivedCount")] = archived;
+        if (!statistics.isEmpty()) {
+            root[QStringLiteral("statistics")] = statistics;
+        }
+        root[QStringLiteral("responseTimes")] = responseTimes;
+        root[QStringLiteral("history")] = history;
+        return root.toCborValue().toCbor();
+    });
+    return m_writer.failedWrites() == 0;
+}
 
-    QJsonObject obj;
-    obj["currentLevel"] = m_currentLevelIndex;
-    obj["tokens"] = m_tokens;
-    obj["countedSeconds"] = m_countedSeconds;
-    obj["streak"] = m_streakCount;
-    obj["levelsSinceSpecial"] = m_levelsSinceSpecial;
-    obj["trainingCompleted"] = m_trainingCompleted;
-    obj["finalLevelPasses"] = m_finalLevelConsecutivePasses;
-    obj["totalLevelAttempts"] = m_totalLevelAttempts;
-    obj["tokensSpent"] = m_tokensSpent;
-    obj["lastActivityDate"] = m_lastActivityDate.toString(Qt::ISODate);
-    obj["finalLevelCooldown"] = m_finalLevelCooldownStart.toString(Qt::ISODate);
+void TrainingState::flush()
+{
+    save();
+    m_writer.waitForIdle();
+}
 
+QJsonObject TrainingState::toJson() const
+{
+    ensureHistoryDecoded();
+    QJsonObject obj = progressCbor().toJsonObject();
     QJsonArray historyArray;
-    for (const auto &summary : m_history) {
+    HistoryCursor cursor = m_history.archiveCursor();
+    LevelSummary summary;
+    while (cursor.next(&summary)) {
         historyArray.append(summary.toJson());
     }
+    const auto &recent = m_history.recent();
+    for (int i = 0; i < recent.size(); ++i) {
+        historyArray.append(recent.at(i).toJson());
+    }
     obj["history"] = historyArray;
+    obj["responseTimes"] = responseTimesJson(m_responseTimes);
+    return obj;
+}
 
-    QJsonDocument doc(obj);
-    file.write(doc.toJson());
-    return true;
+bool TrainingState::exportJson(const QString &path)
+{
+    // archived segments may still be queued
+    flush();
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(toJson()).toJson());
+    return file.commit();
+}
+
+QCborMap TrainingState::progressCbor() const
+{
+    QCborMap map;
+    map[QStringLiteral("currentLevel")] = m_currentLevelIndex;
+    map[QStringLiteral("tokens")] = m_tokens;
+    map[QStringLiteral("countedSeconds")] = m_countedSeconds;
+    map[QStringLiteral("streak")] = m_streakCount;
+    map[QStringLiteral("levelsSinceSpecial")] = m_levelsSinceSpecial;
+    map[QStringLiteral("trainingCompleted")] = m_trainingCompleted;
+    map[QStringLiteral("finalLevelPasses")] = m_finalLevelConsecutivePasses;
+    map[QStringLiteral("totalLevelAttempts")] = m_totalLevelAttempts;
+    map[QStringLiteral("tokensSpent")] = m_tokensSpent;
+    map[QStringLiteral("lastActivityDate")] = m_lastActivityDate.toString(Qt::ISODate);
+    map[QStringLiteral("finalLevelCooldown")] = m_finalLevelCooldownStart.toString(Qt::ISODate);
+    if (!m_protocolId.isEmpty()) {
+        map[QStringLiteral("protocol")] = m_protocolId;
+        map[QStringLiteral("protocolHash")] = m_protocolHash;
+    }
+    return map;
+}
+
+void TrainingState::markDirty(DirtySection section)
+{
+    m_dirty |= section;
 }
 
 int TrainingState::currentLevelIndex() const
@@ -298,7 +695,9 @@ int TrainingState::currentLevelIndex() const
 
 void TrainingState::setCurrentLevelIndex(int idx)
 {
-    m_currentLevelIndex = qBound(0, idx, TrainingSpec::totalLevelCount() - 1);
+    markDirty(ProgressSection);
+    // the session keeps the index inside its protocol's ladder
+    m_currentLevelIndex = qMax(0, idx);
 }
 
 int TrainingState::tokens() const
@@ -308,6 +707,7 @@ int TrainingState::tokens() const
 
 void TrainingState::addTokens(int amount)
 {
+    markDirty(ProgressSection);
     m_tokens = qMax(0, m_tokens + amount);
 }
 
@@ -331,6 +731,7 @@ double TrainingState::countedTrainingHours() const
 
 void TrainingState::addCountedSeconds(double seconds)
 {
+    markDirty(ProgressSection);
     m_countedSeconds = qMax(0.0, m_countedSeconds + seconds);
 }
 
@@ -346,16 +747,19 @@ int TrainingState::levelsSinceSpecial() const
 
 void TrainingState::resetLevelsSinceSpecial()
 {
+    markDirty(ProgressSection);
     m_levelsSinceSpecial = 0;
 }
 
 void TrainingState::incrementLevelsSinceSpecial()
 {
+    markDirty(ProgressSection);
     ++m_levelsSinceSpecial;
 }
 
 void TrainingState::markActivity()
 {
+    markDirty(ProgressSection);
     const QDate today = QDate::currentDate();
     if (!m_lastActivityDate.isValid()) {
         m_streakCount = 1;
@@ -379,24 +783,44 @@ void TrainingState::markActivity()
 
 void TrainingState::recordLevelSummary(const LevelSummary &summary)
 {
+    ensureHistoryDecoded();
     m_history.append(summary);
-    trimHistory();
+    if (!summary.specialExercise) {
+        ensureStatisticsSeeded();
+        m_statistics.commitLevel();
+        markDirty(StatisticsSection);
+    }
+    markDirty(HistorySection);
 }
 
 QVector<LevelSummary> TrainingState::recentSummaries(int limit) const
 {
-    if (limit <= 0 || m_history.isEmpty()) {
+    ensureHistoryDecoded();
+    const auto &recent = m_history.recent();
+    if (limit <= 0 || recent.isEmpty()) {
         return {};
     }
-    const int take = qMin(limit, m_history.size());
+    const int take = qMin(limit, recent.size());
     QVector<LevelSummary> subset;
     subset.reserve(take);
-    for (int i = m_history.size() - take; i < m_history.size(); ++i) {
-        subset.append(m_history.at(i));
+    for (int i = recent.size() - take; i < recent.size(); ++i) {
+        subset.append(recent.at(i));
     }
     return subset;
 }
 
+qint64 TrainingState::totalSummaryCount() const
+{
+    ensureHistoryDecoded();
+    return m_history.totalCount();
+}
+
+HistoryCursor TrainingState::archiveCursor()
+{
+    m_writer.waitForIdle();
+    return m_history.archiveCursor();
+}
+
 bool TrainingState::trainingCompleted() const
 {
     return m_trainingCompleted;
@@ -404,6 +828,7 @@ bool TrainingState::trainingCompleted() const
 
 void TrainingState::setTrainingCompleted(bool done)
 {
+    markDirty(ProgressSection);
     m_trainingCompleted = done;
 }
 
@@ -414,6 +839,7 @@ int TrainingState::finalLevelConsecutivePasses() const
 
 void TrainingState::setFinalLevelConsecutivePasses(int passes)
 {
+    markDirty(ProgressSection);
     m_finalLevelConsecutivePasses = qMax(0, passes);
 }
 
@@ -424,6 +850,7 @@ QDateTime TrainingState::finalLevelCooldownStart() const
 
 void TrainingState::setFinalLevelCooldownStart(const QDateTime &dt)
 {
+    markDirty(ProgressSection);
     m_finalLevelCooldownStart = dt;
 }
 
@@ -434,6 +861,7 @@ int TrainingState::totalLevelAttempts() const
 
 void TrainingState::incrementLevelAttempts()
 {
+    markDirty(ProgressSection);
     ++m_totalLevelAttempts;
 }
 
@@ -444,42 +872,85 @@ int TrainingState::tokensSpent() const
 
 void TrainingState::incrementTokensSpent(int amount)
 {
+    markDirty(ProgressSection);
     m_tokensSpent = qMax(0, m_tokensSpent + amount);
 }
 
+QString TrainingState::protocolId() const
+{
+    return m_protocolId;
+}
+
+QString TrainingState::protocolHash() const
+{
+    return m_protocolHash;
+}
+
+void TrainingState::setProtocol(const QString &id, const QString &hash)
+{
+    markDirty(ProgressSection);
+    m_protocolId = id;
+    m_protocolHash = hash;
+}
+
 QString TrainingState::leastAccuratePitch() const
 {
-    const int window = qMin(15, m_history.size());
-    if (window == 0) {
-        return {};
-    }
-    QHash<QString, PitchSummary> aggregates;
-    for (int i = m_history.size() - window; i < m_history.size(); ++i) {
-        const auto &summary = m_history.at(i);
-        if (summary.specialExercise) {
-            continue;
-        }
-        for (auto it = summary.perPitch.constBegin(); it != summary.perPitch.constEnd(); ++it) {
-            auto stats = aggregates.value(it.key());
-            stats.totalTrials += it.value().totalTrials;
-            stats.correctTrials += it.value().correctTrials;
-            aggregates.insert(it.key(), stats);
-        }
+    const int weakest = statistics().weakestPitch(PitchStatistics::Window::RecentLevels);
+    return weakest >= 0 ? TrainingSpec::chromaticOrder().value(weakest) : QString();
+}
+
+const PitchStatistics &TrainingState::statistics() const
+{
+    ensureStatisticsSeeded();
+    return m_statistics;
+}
+
+void TrainingState::recordTrialStatistics(int expected, int answered, bool correct, int responseTimeMs)
+{
+    ensureStatisticsSeeded();
+    m_statistics.recordTrial(expected, answered, correct, responseTimeMs);
+    markDirty(StatisticsSection);
+}
+
+void TrainingState::beginLevelStatistics()
+{
+    ensureStatisticsSeeded();
+    if (m_statistics.pendingLevelTrials() > 0) {
+        m_statistics.beginLevel();
+        markDirty(StatisticsSection);
     }
+}
 
-    QString leastPitch;
-    double lowestAccuracy = 2.0;
-    for (auto it = aggregates.constBegin(); it != aggregates.constEnd(); ++it) {
-        if (it.value().totalTrials == 0) {
-            continue;
-        }
-        const double acc = static_cast<double>(it.value().correctTrials) / static_cast<double>(it.value().totalTrials);
-        if (acc < lowestAccuracy) {
-            lowestAccuracy = acc;
-            leastPitch = it.key();
-        }
+const ResponseTimeProfile &TrainingState::responseTimes() const
+{
+    return m_responseTimes;
+}
+
+void TrainingState::recordResponseTime(int category, const LevelSpec &spec, int responseTimeMs, bool timedOut)
+{
+    m_responseTimes.record(category, spec.stageIndex, spec.feedback, responseTimeMs, spec.responseWindowMs, timedOut);
+    markDirty(ResponseTimeSection);
+}
+
+void TrainingState::ensureStatisticsSeeded() const
+{
+    if (m_statisticsSeeded) {
+        return;
+    }
+    // profiles saved before statistics existed get counts rebuilt from
+    // their summaries once; trial windows and confusions start empty
+    m_statisticsSeeded = true;
+    ensureHistoryDecoded();
+    HistoryCursor cursor = m_history.archiveCursor();
+    LevelSummary summary;
+    while (cursor.next(&summary)) {
+        m_statistics.seedFromSummary(summary);
+    }
+    const auto &recent = m_history.recent();
+    for (int i = 0; i < recent.size(); ++i) {
+        m_statistics.seedFromSummary(recent.at(i));
     }
-    return leastPitch;
+    m_dirty |= StatisticsSection;
 }
 
 QString TrainingState::stateFilePath() const
@@ -489,7 +960,12 @@ QString TrainingState::stateFilePath() const
     if (!dir.exists()) {
         dir.mkpath(".");
     }
-    return dir.filePath(QStringLiteral("state.json"));
+    return dir.filePath(QStringLiteral("state.cbor"));
+}
+
+QString TrainingState::legacyStateFilePath() const
+{
+    return QDir(resolvedProfileDir()).filePath(QStringLiteral("state.json"));
 }
 
 void TrainingState::setProfileDirectory(const QString &path)
@@ -502,6 +978,19 @@ QString TrainingState::profileDirectory() const
     return resolvedProfileDir();
 }
 
+void TrainingState::setReadOnly(bool readOnly)
+{
+    m_readOnly = readOnly;
+    // history segments are written as summaries spill, not on save(), so
+    // a migration in a read-only state must not reach them either
+    m_history.setWriter(readOnly ? nullptr : &m_writer);
+}
+
+bool TrainingState::isReadOnly() const
+{
+    return m_readOnly;
+}
+
 QString TrainingState::resolvedProfileDir() const
 {
     if (!m_profileDirectory.isEmpty()) {
@@ -514,14 +1003,6 @@ QString TrainingState::resolvedProfileDir() const
     return dir.absolutePath();
 }
 
-void TrainingState::trimHistory()
-{
-    constexpr int kMaxHistory = 80;
-    while (m_history.size() > kMaxHistory) {
-        m_history.removeFirst();
-    }
-}
-
 void TrainingState::resetState()
 {
     m_currentLevelIndex = 0;
@@ -536,4 +1017,15 @@ void TrainingState::resetState()
     m_finalLevelCooldownStart = QDateTime();
     m_totalLevelAttempts = 0;
     m_tokensSpent = 0;
+    m_protocolId.clear();
+    m_protocolHash.clear();
+    m_historyRaw.clear();
+    m_historyDecoded = true;
+    m_statistics.clear();
+    m_statisticsSeeded = true;
+    m_responseTimes.clear();
+    m_progressCbor = progressCbor();
+    m_statisticsCbor = m_statistics.toCbor();
+    m_responseTimesCbor = m_responseTimes.toCbor();
+    m_dirty = 0;
 }
@@ -1,29 +1,22 @@
 #ifndef TRAININGMODEL_H
 #define TRAININGMODEL_H
 
+#include <QCborArray>
+#include <QCborMap>
 #include <QDate>
 #include <QDateTime>
 #include <QHash>
+#include <QJsonArray>
 #include <QJsonObject>
 #include <QString>
 #include <QVector>
+#include <array>
 
-struct PitchSummary {
-    int totalTrials = 0;
-    int correctTrials = 0;
-};
-
-struct LevelSummary {
-    int levelIndex = 0;
-    double accuracy = 0.0;
-    bool passed = false;
-    bool specialExercise = false;
-    QDateTime completedAt;
-    QHash<QString, PitchSummary> perPitch;
-
-    QJsonObject toJson() const;
-    static LevelSummary fromJson(const QJsonObject &obj);
-};
+#include "levelhistory.h"
+#include "levelsummary.h"
+#include "pitchstatistics.h"
+#include "responsetimesketch.h"
+#include "statewriter.h"
 
 struct LevelSpec {
     int globalIndex = 0;
@@ -36,16 +29,28 @@ struct LevelSpec {
     bool tokensAllowed = true;
 };
 
+// The level ladder and the stage pitch sets are fixed by the protocol, so
+// they are computed at compile time; every query is a table lookup.
 class TrainingSpec {
 public:
+    static constexpr int kStageCount = 12;
+    static constexpr int kLevelsPerStage = 24;
+    static constexpr int kLevelCount = kStageCount * kLevelsPerStage;
+    using LevelTable = std::array<LevelSpec, kLevelCount>;
+    using PitchOrder = std::array<int, kStageCount>;
+
     static const QVector<QString> &chromaticOrder();
+    // chromatic indices in the order stages introduce them; stage n trains
+    // the first n
+    static const PitchOrder &introductionOrder();
+    // names in introduction order; prefer the masks where a set will do
     static QVector<QString> stagePitchSet(int stageIndex);
     static QVector<QString> outOfBoundsForStage(int stageIndex);
-    static const QVector<LevelSpec> &levelSpecs();
-    static LevelSpec specForIndex(int idx);
-    static int totalLevelCount();
-private:
-    static QVector<LevelSpec> buildLevelSpecs();
+    static quint16 stagePitchMask(int stageIndex);
+    static quint16 outOfBoundsMask(int stageIndex);
+    static const LevelTable &levelSpecs();
+    static const LevelSpec &specForIndex(int idx);
+    static constexpr int totalLevelCount() { return kLevelCount; }
 };
 
 class TrainingState {
@@ -53,10 +58,22 @@ public:
     TrainingState();
 
     bool load();
-    bool save() const;
+    // queues the changed sections for the writer thread; false while the
+    // writes before this one keep failing, since this one has not run yet
+    bool save();
+    void flush();
+    // the protocol id from a profile's state file without loading the rest;
+    // empty for the standard protocol or a profile not yet converted
+    static QString readProtocolId(const QString &profileDirectory);
+
+    QJsonObject toJson() const;
+    bool exportJson(const QString &path);
 
     void setProfileDirectory(const QString &path);
     QString profileDirectory() const;
+    // a read-only state keeps its changes in memory and never writes
+    void setReadOnly(bool readOnly);
+    bool isReadOnly() const;
 
     int currentLevelIndex() const;
     void setCurrentLevelIndex(int idx);
@@ -77,6 +94,8 @@ public:
 
     void recordLevelSummary(const LevelSummary &summary);
     QVector<LevelSummary> recentSummaries(int limit) const;
+    qint64 totalSummaryCount() const;
+    HistoryCursor archiveCursor();
 
     bool trainingCompleted() const;
     void setTrainingCompleted(bool done);
@@ -92,13 +111,36 @@ public:
     int tokensSpent() const;
     void incrementTokensSpent(int amount);
 
+    // the protocol this profile trains under; empty means the standard one
+    QString protocolId() const;
+    QString protocolHash() const;
+    void setProtocol(const QString &id, const QString &hash);
+
     QString leastAccuratePitch() const;
+    const PitchStatistics &statistics() const;
+    void recordTrialStatistics(int expected, int answered, bool correct, int responseTimeMs);
+    void beginLevelStatistics();
+    const ResponseTimeProfile &responseTimes() const;
+    void recordResponseTime(int category, const LevelSpec &spec, int responseTimeMs, bool timedOut);
 
     QString stateFilePath() const;
+    QString legacyStateFilePath() const;
 
 private:
-    void trimHistory();
+    enum DirtySection : quint8 {
+        ProgressSection = 0x1,
+        HistorySection = 0x2,
+        StatisticsSection = 0x4,
+        ResponseTimeSection = 0x8
+    };
+
     void resetState();
+    void markDirty(DirtySection section);
+    bool migrateLegacyJson();
+    void applyProgress(const QCborMap &progress);
+    void ensureHistoryDecoded() const;
+    void ensureStatisticsSeeded() const;
+    QCborMap progressCbor() const;
 
     QString resolvedProfileDir() const;
 
@@ -108,13 +150,32 @@ private:
     int m_streakCount = 0;
     QDate m_lastActivityDate;
     int m_levelsSinceSpecial = 0;
-    QVector<LevelSummary> m_history;
+    // the recent window is decoded on first access; m_historyRaw holds it
+    // encoded until then, and afterwards until the history changes
+    mutable LevelHistory m_history;
+    mutable QByteArray m_historyRaw;
+    mutable bool m_historyDecoded = true;
+    mutable PitchStatistics m_statistics;
+    mutable bool m_statisticsSeeded = true;
+    ResponseTimeProfile m_responseTimes;
     bool m_trainingCompleted = false;
     int m_finalLevelConsecutivePasses = 0;
     QDateTime m_finalLevelCooldownStart;
     int m_totalLevelAttempts = 0;
     int m_tokensSpent = 0;
+    QString m_protocolId;
+    QString m_protocolHash;
     QString m_profileDirectory;
+    bool m_readOnly = false;
+
+    // CBOR of each section, rebuilt by save() only when its bit is set, so
+    // a save hands the writer implicitly shared copies; the history's is
+    // m_historyRaw
+    mutable quint8 m_dirty = 0;
+    QCborMap m_progressCbor;
+    QCborMap m_statisticsCbor;
+    QCborMap m_responseTimesCbor;
+    StateWriter m_writer;
 };
 
 #endif // TRAININGMODEL_H
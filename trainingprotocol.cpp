@@ -0,0 +1,561 @@
+#include "trainingprotocol.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QtGlobal>
+
+namespace {
+
+const QString kFormat = QStringLiteral("pitchtraining-protocol");
+const QString kStandardId = QStringLiteral("standard");
+constexpr int kStandardVersion = 2;
+// "more than an octave apart"
+constexpr int kPaperMinIntervalSemitones = 13;
+constexpr int kMaxTrials = 1000;
+constexpr int kMinWindowMs = 200;
+constexpr int kMaxWindowMs = 60000;
+constexpr int kDefaultTrials = 20;
+// journal records store the level index in 16 bits
+constexpr int kMaxLevels = 0xffff;
+
+bool fail(QString *error, const QString &message)
+{
+    if (error) {
+        *error = message;
+    }
+    return false;
+}
+
+bool validId(const QString &id)
+{
+    if (id.isEmpty() || id.size() > 64) {
+        return false;
+    }
+    for (const QChar ch : id) {
+        if (!ch.isLetterOrNumber() && ch != QLatin1Char('-') && ch != QLatin1Char('_') && ch != QLatin1Char('.')) {
+            return false;
+        }
+    }
+    return id.at(0) != QLatin1Char('.');
+}
+
+struct LevelRule {
+    double passAccuracy = 0.0;
+    int trials = kDefaultTrials;
+    int windowOffsetMs = 0;
+    bool feedback = true;
+    bool tokens = true;
+};
+
+bool parseLevelRules(const QJsonValue &value, const QString &where, QVector<LevelRule> *rules, QString *error)
+{
+    const QJsonArray array = value.toArray();
+    if (!value.isArray() || array.isEmpty()) {
+        return fail(error, QStringLiteral("%1: levels must be a non-empty array").arg(where));
+    }
+    rules->clear();
+    for (int i = 0; i < array.size(); ++i) {
+        const QJsonObject obj = array.at(i).toObject();
+        LevelRule rule;
+        rule.passAccuracy = obj.value(QStringLiteral("passAccuracy")).toDouble(-1.0);
+        rule.trials = obj.value(QStringLiteral("trials")).toInt(kDefaultTrials);
+        rule.windowOffsetMs = obj.value(QStringLiteral("windowOffsetMs")).toInt(0);
+        rule.feedback = obj.value(QStringLiteral("feedback")).toBool(true);
+        rule.tokens = obj.value(QStringLiteral("tokens")).toBool(true);
+        if (rule.passAccuracy <= 0.0 || rule.passAccuracy > 1.0) {
+            return fail(error, QStringLiteral("%1 level %2: passAccuracy must be in (0, 1]").arg(where).arg(i + 1));
+        }
+        if (rule.trials < 1 || rule.trials > kMaxTrials) {
+            return fail(error, QStringLiteral("%1 level %2: trials must be 1-%3").arg(where).arg(i + 1).arg(kMaxTrials));
+        }
+        rules->append(rule);
+    }
+    return true;
+}
+
+} // namespace
+
+TrainingProtocol::TrainingProtocol()
+    : TrainingProtocol(standard())
+{
+}
+
+TrainingProtocol::TrainingProtocol(Uncompiled)
+{
+}
+
+const TrainingProtocol &TrainingProtocol::standard()
+{
+    static const TrainingProtocol protocol = compileStandard();
+    return protocol;
+}
+
+TrainingProtocol TrainingProtocol::compileStandard()
+{
+    TrainingProtocol protocol{Uncompiled{}};
+    const bool compiled = fromJson(standardDefinition(), &protocol);
+    Q_ASSERT(compiled);
+    Q_UNUSED(compiled);
+    // the definition is written out from the compile-time tables and must
+    // compile straight back to them
+    Q_ASSERT(protocol.levelCount() == TrainingSpec::kLevelCount);
+    for (int i = 0; i < protocol.levelCount(); ++i) {
+        const LevelSpec &ours = protocol.m_levels.at(i);
+        const LevelSpec &spec = TrainingSpec::specForIndex(i);
+        Q_ASSERT(ours.stageIndex == spec.stageIndex && ours.responseWindowMs == spec.responseWindowMs
+                 && ours.passAccuracy == spec.passAccuracy && ours.feedback == spec.feedback
+                 && ours.tokensAllowed == spec.tokensAllowed && ours.trialCount == spec.trialCount);
+        Q_UNUSED(ours);
+        Q_UNUSED(spec);
+    }
+    for (int stage = 1; stage <= TrainingSpec::kStageCount; ++stage) {
+        Q_ASSERT(protocol.stagePitchMask(stage) == TrainingSpec::stagePitchMask(stage));
+        Q_ASSERT(protocol.outOfBoundsMask(stage) == TrainingSpec::outOfBoundsMask(stage));
+    }
+    return protocol;
+}
+
+QJsonObject TrainingProtocol::standardDefinition()
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    QJsonArray expansion;
+    for (int pitch : TrainingSpec::introductionOrder()) {
+        expansion.append(order.at(pitch));
+    }
+
+    QJsonArray stages;
+    for (int stage = 1; stage <= TrainingSpec::kStageCount; ++stage) {
+        QJsonObject entry;
+        entry[QStringLiteral("pitches")] = stage;
+        entry[QStringLiteral("windowMs")] = TrainingSpec::specForIndex((stage - 1) * TrainingSpec::kLevelsPerStage).responseWindowMs;
+        stages.append(entry);
+    }
+
+    // every stage shares the first stage's ladder, relative to its window
+    const int firstWindow = TrainingSpec::specForIndex(0).responseWindowMs;
+    QJsonArray levels;
+    for (int level = 0; level < TrainingSpec::kLevelsPerStage; ++level) {
+        const LevelSpec &spec = TrainingSpec::specForIndex(level);
+        QJsonObject entry;
+        entry[QStringLiteral("passAccuracy")] = spec.passAccuracy;
+        entry[QStringLiteral("trials")] = spec.trialCount;
+        entry[QStringLiteral("windowOffsetMs")] = firstWindow - spec.responseWindowMs;
+        entry[QStringLiteral("feedback")] = spec.feedback;
+        entry[QStringLiteral("tokens")] = spec.tokensAllowed;
+        levels.append(entry);
+    }
+
+    int minimumWindow = firstWindow;
+    for (const LevelSpec &spec : TrainingSpec::levelSpecs()) {
+        minimumWindow = qMin(minimumWindow, spec.responseWindowMs);
+    }
+
+    const SpecialExerciseRule special;
+    QJsonObject specialObj;
+    specialObj[QStringLiteral("everyLevels")] = special.everyLevels;
+    specialObj[QStringLiteral("fromStage")] = special.fromStage;
+    specialObj[QStringLiteral("feedbackTrials")] = special.feedbackTrials;
+    specialObj[QStringLiteral("testTrials")] = special.testTrials;
+
+    const FinalLevelRule finalLevel;
+    QJsonObject finalObj;
+    finalObj[QStringLiteral("clears")] = finalLevel.clears;
+    finalObj[QStringLiteral("cooldownHours")] = finalLevel.cooldownSecs / 3600.0;
+
+    QJsonObject selectionObj;
+    selectionObj[QStringLiteral("minIntervalSemitones")] = kPaperMinIntervalSemitones;
+
+    QJsonObject definition;
+    definition[QStringLiteral("format")] = kFormat;
+    definition[QStringLiteral("formatVersion")] = kFormatVersion;
+    definition[QStringLiteral("id")] = kStandardId;
+    definition[QStringLiteral("version")] = kStandardVersion;
+    definition[QStringLiteral("expansionOrder")] = expansion;
+    definition[QStringLiteral("outOfBoundsSemitones")] = 2;
+    definition[QStringLiteral("stages")] = stages;
+    definition[QStringLiteral("minimumWindowMs")] = minimumWindow;
+    definition[QStringLiteral("levels")] = levels;
+    definition[QStringLiteral("specialExercise")] = specialObj;
+    definition[QStringLiteral("finalLevel")] = finalObj;
+    definition[QStringLiteral("selection")] = selectionObj;
+    return definition;
+}
+
+bool TrainingProtocol::fromJson(const QJsonObject &definition, TrainingProtocol *protocol, QString *error)
+{
+    if (definition.value(QStringLiteral("format")).toString() != kFormat) {
+        return fail(error, QStringLiteral("not a protocol definition"));
+    }
+    const int formatVersion = definition.value(QStringLiteral("formatVersion")).toInt();
+    if (formatVersion < 1 || formatVersion > kFormatVersion) {
+        return fail(error, QStringLiteral("unsupported protocol format version %1").arg(formatVersion));
+    }
+    TrainingProtocol compiled{Uncompiled{}};
+    compiled.m_id = definition.value(QStringLiteral("id")).toString();
+    compiled.m_version = definition.value(QStringLiteral("version")).toInt();
+    if (!validId(compiled.m_id)) {
+        return fail(error, QStringLiteral("id must be letters, digits, '-', '_' or '.'"));
+    }
+    if (compiled.m_version < 1) {
+        return fail(error, QStringLiteral("version must be a positive integer"));
+    }
+
+    // pitch expansion
+    const auto &order = TrainingSpec::chromaticOrder();
+    const QJsonArray expansion = definition.value(QStringLiteral("expansionOrder")).toArray();
+    quint16 seen = 0;
+    for (const QJsonValue &value : expansion) {
+        const int pitch = order.indexOf(value.toString());
+        if (pitch < 0 || (seen & (1u << pitch))) {
+            return fail(error, QStringLiteral("expansionOrder must list distinct pitch names"));
+        }
+        seen = static_cast<quint16>(seen | (1u << pitch));
+        compiled.m_introductionOrder.append(pitch);
+    }
+    if (compiled.m_introductionOrder.isEmpty()) {
+        return fail(error, QStringLiteral("expansionOrder is empty"));
+    }
+    const int semitones = definition.value(QStringLiteral("outOfBoundsSemitones")).toInt(2);
+    if (semitones < 0 || semitones >= order.size()) {
+        return fail(error, QStringLiteral("outOfBoundsSemitones must be 0-%1").arg(order.size() - 1));
+    }
+    const int minimumWindow = definition.value(QStringLiteral("minimumWindowMs")).toInt(kMinWindowMs);
+    if (minimumWindow < kMinWindowMs || minimumWindow > kMaxWindowMs) {
+        return fail(error, QStringLiteral("minimumWindowMs must be %1-%2").arg(kMinWindowMs).arg(kMaxWindowMs));
+    }
+
+    QVector<LevelRule> sharedRules;
+    if (definition.contains(QStringLiteral("levels"))
+        && !parseLevelRules(definition.value(QStringLiteral("levels")), QStringLiteral("protocol"), &sharedRules, error)) {
+        return false;
+    }
+
+    // stages compile straight into the flat tables
+    const QJsonArray stages = definition.value(QStringLiteral("stages")).toArray();
+    if (stages.isEmpty()) {
+        return fail(error, QStringLiteral("stages is empty"));
+    }
+    compiled.m_stageMasks.append(0);
+    compiled.m_outOfBoundsMasks.append(0);
+    int previousPitches = 0;
+    for (int s = 0; s < stages.size(); ++s) {
+        const int stage = s + 1;
+        const QString where = QStringLiteral("stage %1").arg(stage);
+        const QJsonObject stageObj = stages.at(s).toObject();
+        const int pitches = stageObj.value(QStringLiteral("pitches")).toInt();
+        if (pitches <= previousPitches || pitches > compiled.m_introductionOrder.size()) {
+            return fail(error, QStringLiteral("%1: pitches must grow and stay within expansionOrder").arg(where));
+        }
+        previousPitches = pitches;
+        const int windowMs = stageObj.value(QStringLiteral("windowMs")).toInt();
+        if (windowMs < kMinWindowMs || windowMs > kMaxWindowMs) {
+            return fail(error, QStringLiteral("%1: windowMs must be %2-%3").arg(where).arg(kMinWindowMs).arg(kMaxWindowMs));
+        }
+
+        quint16 mask = 0;
+        for (int i = 0; i < pitches; ++i) {
+            mask = static_cast<quint16>(mask | (1u << compiled.m_introductionOrder.at(i)));
+        }
+        int lowest = order.size();
+        int highest = -1;
+        for (int pitch = 0; pitch < order.size(); ++pitch) {
+            if (mask & (1u << pitch)) {
+                lowest = qMin(lowest, pitch);
+                highest = pitch;
+            }
+        }
+        quint16 outside = 0;
+        for (int step = 1; step <= semitones; ++step) {
+            for (int pitch : {lowest - step, highest + step}) {
+                if (pitch >= 0 && pitch < order.size() && !(mask & (1u << pitch))) {
+                    outside = static_cast<quint16>(outside | (1u << pitch));
+                }
+            }
+        }
+        compiled.m_stageMasks.append(mask);
+        compiled.m_outOfBoundsMasks.append(outside);
+
+        QVector<LevelRule> stageRules;
+        const QVector<LevelRule> *rules = &sharedRules;
+        if (stageObj.contains(QStringLiteral("levels"))) {
+            if (!parseLevelRules(stageObj.value(QStringLiteral("levels")), where, &stageRules, error)) {
+                return false;
+            }
+            rules = &stageRules;
+        } else if (sharedRules.isEmpty()) {
+            return fail(error, QStringLiteral("%1 has no levels and the protocol lists none").arg(where));
+        }
+        if (compiled.m_levels.size() + rules->size() > kMaxLevels) {
+            return fail(error, QStringLiteral("more than %1 levels").arg(kMaxLevels));
+        }
+        for (int level = 0; level < rules->size(); ++level) {
+            const LevelRule &rule = rules->at(level);
+            LevelSpec spec;
+            spec.globalIndex = static_cast<int>(compiled.m_levels.size());
+            spec.stageIndex = stage;
+            spec.levelInStage = level + 1;
+            spec.passAccuracy = rule.passAccuracy;
+            spec.trialCount = rule.trials;
+            spec.responseWindowMs = qBound(minimumWindow, windowMs - rule.windowOffsetMs, kMaxWindowMs);
+            spec.feedback = rule.feedback;
+            spec.tokensAllowed = rule.tokens;
+            compiled.m_levels.append(spec);
+        }
+    }
+
+    const QJsonObject specialObj = definition.value(QStringLiteral("specialExercise")).toObject();
+    SpecialExerciseRule &special = compiled.m_special;
+    special.everyLevels = specialObj.value(QStringLiteral("everyLevels")).toInt(special.everyLevels);
+    special.fromStage = specialObj.value(QStringLiteral("fromStage")).toInt(special.fromStage);
+    special.feedbackTrials = specialObj.value(QStringLiteral("feedbackTrials")).toInt(special.feedbackTrials);
+    special.testTrials = specialObj.value(QStringLiteral("testTrials")).toInt(special.testTrials);
+    // everyLevels 0 turns special exercises off
+    if (special.everyLevels < 0 || special.fromStage < 1
+        || special.feedbackTrials < 1 || special.feedbackTrials > kMaxTrials
+        || special.testTrials < 1 || special.testTrials > kMaxTrials) {
+        return fail(error, QStringLiteral("specialExercise: everyLevels >= 0, fromStage >= 1 and trials 1-%1").arg(kMaxTrials));
+    }
+
+    const QJsonObject finalObj = definition.value(QStringLiteral("finalLevel")).toObject();
+    FinalLevelRule &finalLevel = compiled.m_final;
+    finalLevel.clears = finalObj.value(QStringLiteral("clears")).toInt(finalLevel.clears);
+    const double cooldownHours = finalObj.value(QStringLiteral("cooldownHours")).toDouble(finalLevel.cooldownSecs / 3600.0);
+    if (finalLevel.clears < 1 || cooldownHours < 0.0 || cooldownHours > 24.0 * 365) {
+        return fail(error, QStringLiteral("finalLevel: clears >= 1 and cooldownHours 0-8760"));
+    }
+    finalLevel.cooldownSecs = qRound(cooldownHours * 3600.0);
+
+    // absent means uniform, which keeps older definitions and their hashes
+    const QJsonObject selectionObj = definition.value(QStringLiteral("selection")).toObject();
+    const QString mode = selectionObj.value(QStringLiteral("mode")).toString(QStringLiteral("uniform"));
+    SelectionRule &selection = compiled.m_selection;
+    if (mode != QLatin1String("uniform") && mode != QLatin1String("adaptive")) {
+        return fail(error, QStringLiteral("selection: mode must be uniform or adaptive"));
+    }
+    selection.adaptive = mode == QLatin1String("adaptive");
+    SelectionWeights &weights = selection.weights;
+    weights.minWeight = selectionObj.value(QStringLiteral("minWeight")).toDouble(weights.minWeight);
+    weights.maxWeight = selectionObj.value(QStringLiteral("maxWeight")).toDouble(weights.maxWeight);
+    weights.decay = selectionObj.value(QStringLiteral("decay")).toDouble(weights.decay);
+    if (weights.minWeight <= 0.0 || weights.maxWeight < weights.minWeight || weights.maxWeight > 100.0
+        || weights.decay <= 0.0 || weights.decay > 1.0) {
+        return fail(error, QStringLiteral("selection: 0 < minWeight <= maxWeight <= 100 and 0 < decay <= 1"));
+    }
+    selection.minIntervalSemitones = selectionObj.value(QStringLiteral("minIntervalSemitones")).toInt(0);
+    if (selection.minIntervalSemitones < 0 || selection.minIntervalSemitones > 24) {
+        return fail(error, QStringLiteral("selection: minIntervalSemitones 0-24"));
+    }
+
+    const QJsonValue earlyDecision = definition.value(QStringLiteral("earlyDecision"));
+    if (!earlyDecision.isUndefined() && !earlyDecision.isBool()) {
+        return fail(error, QStringLiteral("earlyDecision must be true or false"));
+    }
+    compiled.m_earlyDecision = earlyDecision.toBool(false);
+
+    const QJsonObject interTrialObj = definition.value(QStringLiteral("interTrial")).toObject();
+    InterTrialRule &interTrial = compiled.m_interTrial;
+    interTrial.autoAdvance = interTrialObj.value(QStringLiteral("autoAdvance")).toBool(interTrial.autoAdvance);
+    interTrial.intervalMs = interTrialObj.value(QStringLiteral("intervalMs")).toInt(interTrial.intervalMs);
+    interTrial.jitterMs = interTrialObj.value(QStringLiteral("jitterMs")).toInt(interTrial.jitterMs);
+    if (interTrial.intervalMs < 0 || interTrial.intervalMs > kMaxWindowMs
+        || interTrial.jitterMs < 0 || interTrial.jitterMs > interTrial.intervalMs) {
+        return fail(error, QStringLiteral("interTrial: intervalMs 0-%1 and jitterMs 0-intervalMs").arg(kMaxWindowMs));
+    }
+
+    const QJsonObject progressionObj = definition.value(QStringLiteral("progression")).toObject();
+    ProgressionRule &progression = compiled.m_progression;
+    progression.skipAhead = progressionObj.value(QStringLiteral("skipAhead")).toBool(progression.skipAhead);
+    if (progressionObj.contains(QStringLiteral("tokenThresholds"))) {
+        progression.tokenThresholds.clear();
+        double previous = 0.0;
+        for (const QJsonValue &value : progressionObj.value(QStringLiteral("tokenThresholds")).toArray()) {
+            const double threshold = value.toDouble(-1.0);
+            if (threshold <= previous || threshold > 1.0) {
+                return fail(error, QStringLiteral("progression: tokenThresholds must rise within (0, 1]"));
+            }
+            progression.tokenThresholds.append(threshold);
+            previous = threshold;
+        }
+    }
+
+    compiled.m_definition = definition;
+    compiled.m_hash = QString::fromLatin1(
+        QCryptographicHash::hash(QJsonDocument(definition).toJson(QJsonDocument::Compact), QCryptographicHash::Sha256).toHex());
+    *protocol = compiled;
+    return true;
+}
+
+bool TrainingProtocol::load(const QString &path, TrainingProtocol *protocol, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(error, QStringLiteral("cannot read %1").arg(path));
+    }
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        return fail(error, QStringLiteral("%1: %2").arg(path, parseError.errorString()));
+    }
+    return fromJson(doc.object(), protocol, error);
+}
+
+QString TrainingProtocol::directoryForRoot(const QString &rootPath)
+{
+    return QDir(rootPath).filePath(QStringLiteral("protocols"));
+}
+
+QString TrainingProtocol::pathFor(const QString &rootPath, const QString &id)
+{
+    return QDir(directoryForRoot(rootPath)).filePath(id + QStringLiteral(".json"));
+}
+
+QJsonObject TrainingProtocol::toJson() const
+{
+    return m_definition;
+}
+
+QString TrainingProtocol::id() const
+{
+    return m_id;
+}
+
+int TrainingProtocol::version() const
+{
+    return m_version;
+}
+
+QString TrainingProtocol::hash() const
+{
+    return m_hash;
+}
+
+bool TrainingProtocol::isStandard() const
+{
+    return m_hash == standard().m_hash;
+}
+
+int TrainingProtocol::stageCount() const
+{
+    return static_cast<int>(m_stageMasks.size()) - 1;
+}
+
+int TrainingProtocol::levelCount() const
+{
+    return static_cast<int>(m_levels.size());
+}
+
+const LevelSpec &TrainingProtocol::spec(int idx) const
+{
+    return m_levels.at(qBound(0, idx, levelCount() - 1));
+}
+
+const QVector<LevelSpec> &TrainingProtocol::levels() const
+{
+    return m_levels;
+}
+
+int TrainingProtocol::finalLevelIndex() const
+{
+    return levelCount() - 1;
+}
+
+const QVector<int> &TrainingProtocol::introductionOrder() const
+{
+    return m_introductionOrder;
+}
+
+quint16 TrainingProtocol::stagePitchMask(int stageIndex) const
+{
+    return m_stageMasks.value(stageIndex);
+}
+
+quint16 TrainingProtocol::outOfBoundsMask(int stageIndex) const
+{
+    return m_outOfBoundsMasks.value(stageIndex);
+}
+
+const SpecialExerciseRule &TrainingProtocol::specialExercise() const
+{
+    return m_special;
+}
+
+const FinalLevelRule &TrainingProtocol::finalLevel() const
+{
+    return m_final;
+}
+
+const SelectionRule &TrainingProtocol::selection() const
+{
+    return m_selection;
+}
+
+bool TrainingProtocol::earlyDecision() const
+{
+    return m_earlyDecision;
+}
+
+const InterTrialRule &TrainingProtocol::interTrial() const
+{
+    return m_interTrial;
+}
+
+const ProgressionRule &TrainingProtocol::progression() const
+{
+    return m_progression;
+}
+
+LevelDecision TrainingProtocol::decideLevel(int levelIndex, int trialCount, int correct, double bonus) const
+{
+    LevelDecision decision;
+    const LevelSpec &current = spec(levelIndex);
+    const double accuracy = trialCount == 0 ? 0.0 : static_cast<double>(correct) / trialCount;
+    const double effective = trialCount == 0 ? 0.0 : qMin(1.0, (correct + bonus) / trialCount);
+    decision.passed = effective >= current.passAccuracy;
+
+    for (double threshold : m_progression.tokenThresholds) {
+        if (accuracy >= threshold) {
+            ++decision.tokensEarned;
+        }
+    }
+
+    int nextLevel = current.globalIndex;
+    if (decision.passed) {
+        nextLevel = qMin(current.globalIndex + 1, finalLevelIndex());
+        for (int idx = current.globalIndex + 1; m_progression.skipAhead && idx < levelCount(); ++idx) {
+            const auto &candidate = m_levels.at(idx);
+            if (candidate.stageIndex != current.stageIndex) {
+                nextLevel = idx;
+                break;
+            }
+            if (candidate.feedback != current.feedback) {
+                break;
+            }
+            nextLevel = idx;
+            if (accuracy < candidate.passAccuracy) {
+                break;
+            }
+        }
+    }
+    decision.nextLevelIndex = nextLevel;
+    return decision;
+}
+
+// Pass, tokens and the level skip only grow with the correct count and the
+// bonuses, so the level is settled once the worst case (every remaining
+// trial missed) and the best case (every one right and doubled) agree.
+bool TrainingProtocol::outcomeSettled(int levelIndex, int trialCount, int played, int correct, double bonus) const
+{
+    const int remaining = trialCount - played;
+    if (remaining <= 0) {
+        return true;
+    }
+    const LevelDecision worst = decideLevel(levelIndex, trialCount, correct, bonus);
+    const double maxBonus = spec(levelIndex).tokensAllowed ? remaining : 0.0;
+    const LevelDecision best = decideLevel(levelIndex, trialCount, correct + remaining, bonus + maxBonus);
+    return worst.passed == best.passed && worst.tokensEarned == best.tokensEarned
+           && worst.nextLevelIndex == best.nextLevelIndex;
+}
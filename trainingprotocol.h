@@ -0,0 +1,133 @@
+#ifndef TRAININGPROTOCOL_H
+#define TRAININGPROTOCOL_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include "trainingmodel.h"
+#include "trialscheduler.h"
+
+struct SpecialExerciseRule {
+    // levels since the last special exercise before the next one is due
+    int everyLevels = 15;
+    int fromStage = 5;
+    int feedbackTrials = 12;
+    int testTrials = 22;
+};
+
+struct FinalLevelRule {
+    // clears in a row before the wait, then one more after it
+    int clears = 3;
+    int cooldownSecs = 12 * 3600;
+};
+
+struct SelectionRule {
+    // off keeps the paper's balanced, uniformly dealt blocks
+    bool adaptive = false;
+    SelectionWeights weights;
+    // smallest distance between consecutive tones, as far as the octaves
+    // allow; the paper keeps them more than an octave apart
+    int minIntervalSemitones = 0;
+};
+
+struct InterTrialRule {
+    // whether the window starts out advancing on its own
+    bool autoAdvance = false;
+    // from a response or timeout to the next tone
+    int intervalMs = 1500;
+    // the interval varies uniformly by up to this much either way
+    int jitterMs = 0;
+};
+
+struct ProgressionRule {
+    // a pass moves on past later levels of the stage whose target the
+    // accuracy also met
+    bool skipAhead = true;
+    // one token per threshold the level's plain accuracy reaches
+    QVector<double> tokenThresholds = {0.60, 0.75, 0.90};
+};
+
+struct LevelDecision {
+    bool passed = false;
+    int tokensEarned = 0;
+    int nextLevelIndex = 0;
+};
+
+// A training protocol: the stages, their pitch sets, the level ladder and
+// the special-exercise and final-level rules. The built-in one is the
+// compile-time TrainingSpec ladder; others are versioned JSON files under
+// <root>/protocols that are validated and compiled on load into the same
+// flat level and mask tables, so the engine does the same lookups for
+// either. The hash is taken over the canonical compact definition and is
+// what a profile records next to the protocol id.
+class TrainingProtocol
+{
+public:
+    static constexpr int kFormatVersion = 1;
+
+    // a copy of the standard protocol
+    TrainingProtocol();
+
+    static const TrainingProtocol &standard();
+    static bool fromJson(const QJsonObject &definition, TrainingProtocol *protocol, QString *error = nullptr);
+    static bool load(const QString &path, TrainingProtocol *protocol, QString *error = nullptr);
+    static QString directoryForRoot(const QString &rootPath);
+    static QString pathFor(const QString &rootPath, const QString &id);
+
+    QJsonObject toJson() const;
+    QString id() const;
+    int version() const;
+    QString hash() const;
+    bool isStandard() const;
+
+    int stageCount() const;
+    int levelCount() const;
+    // clamped to the ladder
+    const LevelSpec &spec(int idx) const;
+    const QVector<LevelSpec> &levels() const;
+    int finalLevelIndex() const;
+    // chromatic indices in the order stages introduce them
+    const QVector<int> &introductionOrder() const;
+    quint16 stagePitchMask(int stageIndex) const;
+    quint16 outOfBoundsMask(int stageIndex) const;
+
+    const SpecialExerciseRule &specialExercise() const;
+    const FinalLevelRule &finalLevel() const;
+    const SelectionRule &selection() const;
+    // a level ends as soon as its remaining trials cannot change the outcome
+    bool earlyDecision() const;
+    const InterTrialRule &interTrial() const;
+    const ProgressionRule &progression() const;
+
+    // pass, tokens and next level for a level of trialCount trials with
+    // this many correct answers and double bonuses; trials not played
+    // count as missed
+    LevelDecision decideLevel(int levelIndex, int trialCount, int correct, double bonus) const;
+    // whether the trials still to come could change that decision
+    bool outcomeSettled(int levelIndex, int trialCount, int played, int correct, double bonus) const;
+
+private:
+    struct Uncompiled {};
+    explicit TrainingProtocol(Uncompiled);
+    static QJsonObject standardDefinition();
+    static TrainingProtocol compileStandard();
+
+    QJsonObject m_definition;
+    QString m_id;
+    int m_version = 0;
+    QString m_hash;
+    QVector<LevelSpec> m_levels;
+    QVector<int> m_introductionOrder;
+    // indexed by stage; [0] trains nothing
+    QVector<quint16> m_stageMasks;
+    QVector<quint16> m_outOfBoundsMasks;
+    SpecialExerciseRule m_special;
+    FinalLevelRule m_final;
+    SelectionRule m_selection;
+    bool m_earlyDecision = false;
+    InterTrialRule m_interTrial;
+    ProgressionRule m_progression;
+};
+
+#endif // TRAININGPROTOCOL_H
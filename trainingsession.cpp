@@ -0,0 +1,848 @@
+#include "trainingsession.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QLockFile>
+#include <QRandomGenerator>
+#include <QtAlgorithms>
+#include <cmath>
+
+namespace {
+const QString kLockFile = QStringLiteral("session.lock");
+}
+
+TrainingSession::TrainingSession()
+    : m_octaveMask(kDefaultOctaveMask)
+{
+}
+
+TrainingSession::~TrainingSession()
+{
+    close();
+}
+
+bool TrainingSession::open(const QString &profileDirectory)
+{
+    // switching profiles ends the level for good; only a close leaves it
+    // open for the next run to resume
+    abort();
+    close();
+    m_lock.reset(new QLockFile(lockPathForProfile(profileDirectory)));
+    // held for as long as the profile is open, so only a dead owner makes it stale
+    m_lock->setStaleLockTime(0);
+    m_readOnly = !m_lock->tryLock(0);
+    m_state.setReadOnly(m_readOnly);
+    m_state.setProfileDirectory(profileDirectory);
+    const bool loaded = m_state.load();
+    resolveProtocol(profileDirectory);
+    resetCadence();
+    if (!m_readOnly && !m_journal.open(TrialJournal::pathForProfile(profileDirectory))) {
+        qWarning() << "trial journal of" << profileDirectory << "cannot be opened; trials are not recorded";
+    }
+    resetLevelState();
+    m_mode = Mode::Idle;
+    m_specialContext = SpecialContext{};
+    return loaded;
+}
+
+void TrainingSession::close()
+{
+    // the running level's block stays open in the journal, so the next
+    // open of this profile resumes it
+    resetLevelState();
+    m_mode = Mode::Idle;
+    m_specialContext = SpecialContext{};
+    m_state.flush();
+    m_journal.close();
+    m_lock.reset();
+}
+
+void TrainingSession::resolveProtocol(const QString &profileDirectory)
+{
+    m_protocol = TrainingProtocol::standard();
+    m_protocolUnavailable = false;
+    const QString id = m_state.protocolId();
+    if (id.isEmpty() || (id == m_protocol.id() && m_state.protocolHash() != m_protocol.hash())) {
+        // new profiles, and standard ones after the built-in protocol changed
+        m_state.setProtocol(m_protocol.id(), m_protocol.hash());
+    } else if (id != m_protocol.id()) {
+        // protocols sit next to the profiles, under <root>/protocols
+        const QString root = QDir::cleanPath(QDir(profileDirectory).absoluteFilePath(QStringLiteral("..")));
+        TrainingProtocol custom;
+        QString error;
+        if (TrainingProtocol::load(TrainingProtocol::pathFor(root, id), &custom, &error) && custom.id() == id) {
+            if (custom.hash() != m_state.protocolHash()) {
+                qWarning() << "protocol" << id << "changed since the profile last trained under it";
+                m_state.setProtocol(id, custom.hash());
+            }
+            m_protocol = custom;
+        } else {
+            // the recorded id and level are kept so the profile picks its
+            // protocol back up once the file is restored; until then it
+            // cannot train
+            qWarning() << "protocol" << id << "unavailable, the profile cannot train:" << error;
+            m_protocolUnavailable = true;
+            return;
+        }
+    }
+    if (m_state.currentLevelIndex() > m_protocol.finalLevelIndex()) {
+        m_state.setCurrentLevelIndex(m_protocol.finalLevelIndex());
+    }
+}
+
+QString TrainingSession::profileDirectory() const
+{
+    return m_state.profileDirectory();
+}
+
+bool TrainingSession::isReadOnly() const
+{
+    return m_readOnly;
+}
+
+bool TrainingSession::protocolUnavailable() const
+{
+    return m_protocolUnavailable;
+}
+
+bool TrainingSession::journalFailing() const
+{
+    return !m_readOnly && (!m_journal.isOpen() || m_journal.failedRecords() > 0);
+}
+
+QString TrainingSession::lockPathForProfile(const QString &profileDirectory)
+{
+    return QDir(profileDirectory).filePath(kLockFile);
+}
+
+TrainingState &TrainingSession::state()
+{
+    return m_state;
+}
+
+const TrainingState &TrainingSession::state() const
+{
+    return m_state;
+}
+
+const TrainingProtocol &TrainingSession::protocol() const
+{
+    return m_protocol;
+}
+
+bool TrainingSession::setProtocol(const TrainingProtocol &protocol)
+{
+    if (isRunning() || m_readOnly) {
+        return false;
+    }
+    m_protocol = protocol;
+    m_protocolUnavailable = false;
+    m_state.setProtocol(protocol.id(), protocol.hash());
+    if (m_state.currentLevelIndex() > m_protocol.finalLevelIndex()) {
+        m_state.setCurrentLevelIndex(m_protocol.finalLevelIndex());
+    }
+    return m_state.save();
+}
+
+void TrainingSession::setOctaveMask(quint16 mask)
+{
+    m_octaveMask = mask ? mask : kDefaultOctaveMask;
+}
+
+quint16 TrainingSession::octaveMask() const
+{
+    return m_octaveMask;
+}
+
+TrainingSession::Mode TrainingSession::mode() const
+{
+    return m_mode;
+}
+
+bool TrainingSession::isRunning() const
+{
+    return m_mode != Mode::Idle;
+}
+
+bool TrainingSession::levelActive() const
+{
+    return m_mode == Mode::Level;
+}
+
+bool TrainingSession::specialActive() const
+{
+    return m_mode == Mode::SpecialExercise;
+}
+
+bool TrainingSession::batteryActive() const
+{
+    return m_mode == Mode::TestBattery;
+}
+
+const LevelSpec &TrainingSession::currentSpec() const
+{
+    return m_currentSpec;
+}
+
+quint16 TrainingSession::trainingPitchMask() const
+{
+    return m_protocol.stagePitchMask(m_currentSpec.stageIndex);
+}
+
+quint16 TrainingSession::outOfBoundsMask() const
+{
+    return m_protocol.outOfBoundsMask(m_currentSpec.stageIndex);
+}
+
+const SpecialContext &TrainingSession::special() const
+{
+    return m_specialContext;
+}
+
+quint32 TrainingSession::scheduleSeed() const
+{
+    return m_scheduleSeed;
+}
+
+int TrainingSession::trialsCompleted() const
+{
+    return m_trialsCompleted;
+}
+
+int TrainingSession::correctTrials() const
+{
+    return m_correctTrials;
+}
+
+int TrainingSession::blockLength() const
+{
+    return m_mode == Mode::SpecialExercise ? m_specialContext.totalTrials : m_requiredTrials;
+}
+
+bool TrainingSession::blockComplete() const
+{
+    return isRunning() && (m_trialsCompleted >= blockLength() || m_outcomeDecided);
+}
+
+const QVector<TrialData> &TrainingSession::blockTrials() const
+{
+    return m_trialLog;
+}
+
+bool TrainingSession::shouldRunSpecialExercise() const
+{
+    const SpecialExerciseRule &rule = m_protocol.specialExercise();
+    const LevelSpec &spec = m_protocol.spec(m_state.currentLevelIndex());
+    return rule.everyLevels > 0 && m_state.levelsSinceSpecial() >= rule.everyLevels && spec.stageIndex >= rule.fromStage;
+}
+
+TrainingSession::StartResult TrainingSession::startLevel()
+{
+    if (isRunning()) {
+        return StartResult::Busy;
+    }
+    if (m_readOnly) {
+        return StartResult::ReadOnly;
+    }
+    if (m_protocolUnavailable) {
+        return StartResult::ProtocolUnavailable;
+    }
+    if (shouldRunSpecialExercise()) {
+        startSpecialExercise();
+        return StartResult::SpecialExercise;
+    }
+
+    const LevelSpec &spec = m_protocol.spec(m_state.currentLevelIndex());
+    const FinalLevelRule &finalRule = m_protocol.finalLevel();
+    if (spec.globalIndex == m_protocol.finalLevelIndex() &&
+        m_state.finalLevelConsecutivePasses() >= finalRule.clears &&
+        !m_state.trainingCompleted()) {
+        const auto last = m_state.finalLevelCooldownStart();
+        if (!last.isValid() || last.secsTo(QDateTime::currentDateTimeUtc()) < finalRule.cooldownSecs) {
+            return StartResult::FinalCooldown;
+        }
+    }
+
+    bool resumed = false;
+    startLevelInternal(&resumed);
+    return resumed ? StartResult::Resumed : StartResult::Started;
+}
+
+TrainingSession::StartResult TrainingSession::startTestBattery(const TestBattery &battery)
+{
+    if (isRunning()) {
+        return StartResult::Busy;
+    }
+    if (m_readOnly) {
+        return StartResult::ReadOnly;
+    }
+    if (m_protocolUnavailable) {
+        return StartResult::ProtocolUnavailable;
+    }
+    // the records carry the level the participant had reached
+    m_currentSpec = m_protocol.spec(m_state.currentLevelIndex());
+    resetLevelState();
+    // an interrupted level is not picked up across a test
+    journalInterruptedAborted(m_journal.openBlock());
+    m_journal.clearOpenBlock();
+    m_schedule = battery.trials();
+    m_scheduleSeed = battery.seed();
+    m_requiredTrials = battery.trialCount();
+    m_adaptive = false;
+    m_mode = Mode::TestBattery;
+    journalLevelStarted(m_requiredTrials);
+    return StartResult::Started;
+}
+
+void TrainingSession::abort()
+{
+    if (!isRunning()) {
+        return;
+    }
+    journalLevelEnded(JournalRecord::LevelAborted, 0.0, false);
+    resetLevelState();
+    m_mode = Mode::Idle;
+    m_specialContext = SpecialContext{};
+}
+
+void TrainingSession::startLevelInternal(bool *resumed)
+{
+    m_currentSpec = m_protocol.spec(m_state.currentLevelIndex());
+    resetLevelState();
+
+    // the old uniform pool drew every listed pitch equally often, so the
+    // out-of-bounds share stays at their fraction of it
+    ScheduleConstraints constraints;
+    constraints.trialCount = m_currentSpec.trialCount;
+    constraints.pitchMask = m_protocol.stagePitchMask(m_currentSpec.stageIndex);
+    constraints.outOfBoundsMask = m_protocol.outOfBoundsMask(m_currentSpec.stageIndex);
+    const int trained = qPopulationCount(constraints.pitchMask);
+    const int outside = qPopulationCount(constraints.outOfBoundsMask);
+    constraints.outOfBoundsProportion = trained + outside > 0 ? double(outside) / (trained + outside) : 0.0;
+    constraints.maxRepeats = 1;
+    constraints.minIntervalSemitones = m_protocol.selection().minIntervalSemitones;
+    constraints.luckyDoubleOdds = m_currentSpec.tokensAllowed ? 80 : 0;
+    // a level cut short by a crash or close picks up where the journal
+    // left it, as long as the same level is started again
+    const JournalBlock interrupted = m_journal.openBlock();
+    m_journal.clearOpenBlock();
+    const bool resumable = interrupted.valid &&
+                           !interrupted.start.hasFlag(JournalRecord::Special) &&
+                           !interrupted.start.hasFlag(JournalRecord::TestBattery) &&
+                           interrupted.start.levelIndex == m_currentSpec.globalIndex &&
+                           interrupted.start.trialNumber == m_currentSpec.trialCount &&
+                           interrupted.trials.size() < m_currentSpec.trialCount;
+    m_scheduleSeed = resumable ? interrupted.start.value : TrialScheduler::newSeed();
+    buildSchedule(constraints, m_scheduleSeed);
+    m_mode = Mode::Level;
+    m_requiredTrials = m_currentSpec.trialCount;
+    *resumed = resumable && resumeJournaledLevel(interrupted);
+    if (!*resumed) {
+        journalInterruptedAborted(interrupted);
+        m_state.beginLevelStatistics();
+        journalLevelStarted(m_currentSpec.trialCount);
+    } else {
+        m_outcomeDecided = m_protocol.earlyDecision() && outcomeSettled();
+    }
+
+    // skill starts from the recent trials, which by now include any
+    // restored from the journal
+    const SelectionRule &selection = m_protocol.selection();
+    m_adaptive = selection.adaptive;
+    if (m_adaptive) {
+        constraints.octaveMask = m_octaveMask;
+        m_selector.reset(constraints, selection.weights, m_scheduleSeed + static_cast<quint32>(m_trialsCompleted));
+        const PitchStatistics &stats = m_state.statistics();
+        for (int item = 0; item < AdaptiveSelector::kItemCount; ++item) {
+            m_selector.setPrior(item, stats.correct(PitchStatistics::Window::RecentTrials, item),
+                                stats.total(PitchStatistics::Window::RecentTrials, item));
+        }
+    }
+}
+
+void TrainingSession::startSpecialExercise()
+{
+    m_currentSpec = m_protocol.spec(m_state.currentLevelIndex());
+    m_specialContext = SpecialContext{};
+    m_specialContext.active = true;
+    m_specialContext.feedbackPhase = true;
+    m_specialContext.totalTrials = m_protocol.specialExercise().feedbackTrials;
+    m_specialContext.secondPhasePending = true;
+    m_mode = Mode::SpecialExercise;
+
+    const QString weakest = m_state.leastAccuratePitch();
+    if (!weakest.isEmpty()) {
+        m_specialContext.targetPitch = weakest;
+    } else {
+        m_specialContext.targetPitch = TrainingSpec::chromaticOrder().at(m_protocol.introductionOrder().front());
+    }
+
+    resetLevelState();
+    m_scheduleSeed = TrialScheduler::newSeed();
+    buildSchedule(specialConstraints(), m_scheduleSeed);
+    journalInterruptedAborted(m_journal.openBlock());
+    m_journal.clearOpenBlock();
+    journalLevelStarted(m_specialContext.totalTrials);
+}
+
+void TrainingSession::resetLevelState()
+{
+    m_trialLog.clear();
+    m_schedule.clear();
+    m_trialsCompleted = 0;
+    m_correctTrials = 0;
+    m_effectiveBonus = 0.0;
+    m_outcomeDecided = false;
+    m_doubleArmed = false;
+    m_randomDouble = false;
+    m_currentTrial = TrialData{};
+}
+
+void TrainingSession::buildSchedule(ScheduleConstraints constraints, quint32 seed)
+{
+    constraints.octaveMask = m_octaveMask;
+    m_scheduleConstraints = constraints;
+    TrialScheduler::generate(constraints, seed, &m_schedule);
+}
+
+ScheduleConstraints TrainingSession::specialConstraints() const
+{
+    const int target = TrainingSpec::chromaticOrder().indexOf(m_specialContext.targetPitch);
+    ScheduleConstraints constraints;
+    constraints.trialCount = m_specialContext.totalTrials;
+    constraints.pitchMask = target >= 0 ? static_cast<quint16>(1u << target) : 0;
+    constraints.outOfBoundsMask = m_protocol.outOfBoundsMask(m_currentSpec.stageIndex);
+    constraints.outOfBoundsProportion = 0.5;
+    constraints.maxRepeats = 3;
+    constraints.minIntervalSemitones = m_protocol.selection().minIntervalSemitones;
+    return constraints;
+}
+
+bool TrainingSession::resumeJournaledLevel(const JournalBlock &block)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    for (int i = 0; i < block.trials.size(); ++i) {
+        const auto &record = block.trials.at(i);
+        if (record.trialNumber != i + 1 || record.presented < 0 || record.presented >= order.size()) {
+            return false;
+        }
+    }
+
+    for (const auto &record : block.trials) {
+        TrialData trial;
+        trial.presentedPitch = order.at(record.presented);
+        trial.octave = record.octave;
+        trial.outOfBounds = record.hasFlag(JournalRecord::OutOfBounds);
+        if (record.response == JournalRecord::kOtherResponse) {
+            trial.response = QStringLiteral("OUT");
+        } else {
+            trial.response = order.value(record.response);
+        }
+        trial.correct = record.hasFlag(JournalRecord::Correct);
+        trial.semitoneError = record.hasFlag(JournalRecord::SemitoneError);
+        trial.timedOut = record.hasFlag(JournalRecord::TimedOut);
+        trial.responseTimeMs = static_cast<int>(record.value);
+        trial.usedDouble = record.hasFlag(JournalRecord::UsedDouble);
+        trial.luckyDouble = record.hasFlag(JournalRecord::LuckyDouble);
+
+        if (trial.correct) {
+            ++m_correctTrials;
+            if (trial.usedDouble || trial.luckyDouble) {
+                m_effectiveBonus += 1.0;
+            }
+        }
+        m_trialLog.append(trial);
+    }
+    // the statistics hold the trials up to the last state save before the
+    // interruption; the rest come back from the journal
+    const auto unsaved = m_trialLog.mid(m_state.statistics().pendingLevelTrials());
+    for (const auto &trial : unsaved) {
+        recordTrialStatistics(trial);
+    }
+    m_trialsCompleted = static_cast<int>(block.trials.size());
+    return true;
+}
+
+const TrialData &TrainingSession::nextTrial()
+{
+    m_currentTrial = TrialData{};
+    if (m_trialsCompleted < m_schedule.size()) {
+        ScheduledTrial planned = m_schedule.at(m_trialsCompleted);
+        if (m_mode == Mode::Level && m_adaptive) {
+            const ScheduledTrial drawn = m_selector.next();
+            planned.pitch = drawn.pitch;
+            planned.octave = drawn.octave;
+            planned.outOfBounds = drawn.outOfBounds;
+        }
+        m_currentTrial.presentedPitch = TrainingSpec::chromaticOrder().value(planned.pitch);
+        m_currentTrial.outOfBounds = planned.outOfBounds;
+        m_currentTrial.octave = planned.octave;
+        if (m_mode == Mode::Level) {
+            m_randomDouble = m_currentSpec.tokensAllowed && planned.luckyDouble;
+        }
+    }
+    return m_currentTrial;
+}
+
+bool TrainingSession::luckyDoubleReady() const
+{
+    return m_randomDouble;
+}
+
+bool TrainingSession::doubleArmed() const
+{
+    return m_doubleArmed;
+}
+
+bool TrainingSession::armDouble()
+{
+    if (!levelActive() || !m_currentSpec.tokensAllowed || !m_state.consumeTokens(kDoubleTokenCost)) {
+        return false;
+    }
+    m_doubleArmed = true;
+    return true;
+}
+
+TrialData TrainingSession::finishTrial(const QString &response, int responseTimeMs, bool timedOut)
+{
+    if (!isRunning()) {
+        return {};
+    }
+    m_currentTrial.response = timedOut ? QString() : response;
+    m_currentTrial.timedOut = timedOut;
+    m_currentTrial.responseTimeMs = responseTimeMs;
+    const int trialNumber = m_trialsCompleted + 1;
+
+    bool correct = false;
+    if (!timedOut) {
+        if (m_mode == Mode::SpecialExercise) {
+            const bool targetTone = !m_currentTrial.outOfBounds;
+            const bool answeredTarget = (m_currentTrial.response == m_specialContext.targetPitch);
+            correct = (targetTone && answeredTarget) || (!targetTone && m_currentTrial.response == QStringLiteral("OUT"));
+        } else {
+            if (m_currentTrial.outOfBounds) {
+                correct = m_currentTrial.response == QStringLiteral("OUT");
+            } else {
+                correct = m_currentTrial.response == m_currentTrial.presentedPitch;
+                if (!correct) {
+                    const auto &order = TrainingSpec::chromaticOrder();
+                    const int played = order.indexOf(m_currentTrial.presentedPitch);
+                    const int answered = order.indexOf(m_currentTrial.response);
+                    if (played >= 0 && answered >= 0 && std::abs(played - answered) == 1) {
+                        m_currentTrial.semitoneError = true;
+                    }
+                }
+            }
+        }
+    }
+
+    m_currentTrial.correct = correct;
+    if (correct && m_mode != Mode::SpecialExercise) {
+        ++m_correctTrials;
+    }
+
+    if (correct) {
+        bool appliedBonus = false;
+        if (m_doubleArmed) {
+            m_effectiveBonus += 1.0;
+            appliedBonus = true;
+            m_currentTrial.usedDouble = true;
+            m_doubleArmed = false;
+        }
+        if (m_randomDouble && m_currentSpec.tokensAllowed && !appliedBonus) {
+            m_effectiveBonus += 1.0;
+            appliedBonus = true;
+            m_currentTrial.luckyDouble = true;
+        }
+    } else {
+        m_doubleArmed = false;
+    }
+    m_randomDouble = false;
+
+    journalTrial(m_currentTrial, trialNumber);
+    m_trialLog.append(m_currentTrial);
+    ++m_trialsCompleted;
+    if (!m_cadenceTimer.isValid()) {
+        m_cadenceTimer.start();
+    }
+    ++m_cadenceTrials;
+    if (m_mode == Mode::Level) {
+        m_outcomeDecided = m_protocol.earlyDecision() && outcomeSettled();
+        recordTrialStatistics(m_currentTrial);
+        if (m_adaptive) {
+            const int item = m_currentTrial.outOfBounds ? AdaptiveSelector::kOutOfBoundsItem
+                                                        : TrainingSpec::chromaticOrder().indexOf(m_currentTrial.presentedPitch);
+            m_selector.record(item, correct);
+        }
+    }
+    return m_currentTrial;
+}
+
+int TrainingSession::nextInterTrialMs() const
+{
+    const InterTrialRule &rule = m_protocol.interTrial();
+    if (rule.jitterMs <= 0) {
+        return rule.intervalMs;
+    }
+    const int offset = QRandomGenerator::global()->bounded(2 * rule.jitterMs + 1) - rule.jitterMs;
+    return qMax(0, rule.intervalMs + offset);
+}
+
+void TrainingSession::resetCadence()
+{
+    m_cadenceTimer.start();
+    m_cadenceTrials = 0;
+}
+
+int TrainingSession::cadenceTrials() const
+{
+    return m_cadenceTrials;
+}
+
+double TrainingSession::trialsPerMinute() const
+{
+    const qint64 elapsedMs = m_cadenceTimer.isValid() ? m_cadenceTimer.elapsed() : 0;
+    return elapsedMs > 0 ? m_cadenceTrials * 60000.0 / elapsedMs : 0.0;
+}
+
+LevelDecision TrainingSession::decideLevel(int correct, double bonus) const
+{
+    return m_protocol.decideLevel(m_currentSpec.globalIndex, m_requiredTrials, correct, bonus);
+}
+
+bool TrainingSession::outcomeSettled() const
+{
+    return m_protocol.outcomeSettled(m_currentSpec.globalIndex, m_requiredTrials, m_trialsCompleted,
+                                     m_correctTrials, m_effectiveBonus);
+}
+
+LevelOutcome TrainingSession::resolveLevel()
+{
+    LevelOutcome outcome;
+    if (m_mode != Mode::Level) {
+        return outcome;
+    }
+    // a settled level decides as if the skipped trials were missed, which
+    // by construction is the same as any other way they could have gone
+    const LevelDecision decision = decideLevel(m_correctTrials, m_effectiveBonus);
+    const int played = m_trialsCompleted;
+    const int required = qMax(1, m_requiredTrials);
+    outcome.trialsSkipped = qMax(0, m_requiredTrials - played);
+    outcome.accuracy = static_cast<double>(m_correctTrials) / required;
+    outcome.effectiveAccuracy = qMin(1.0, (m_correctTrials + m_effectiveBonus) / required);
+    outcome.playedAccuracy = played == 0 ? 0.0 : static_cast<double>(m_correctTrials) / played;
+    outcome.passed = decision.passed;
+    outcome.tokensEarned = decision.tokensEarned;
+    if (outcome.tokensEarned > 0) {
+        m_state.addTokens(outcome.tokensEarned);
+    }
+
+    m_state.incrementLevelAttempts();
+    recordSummary(false, outcome.accuracy, outcome.passed, outcome.trialsSkipped);
+    m_state.incrementLevelsSinceSpecial();
+    m_state.markActivity();
+    m_mode = Mode::Idle;
+
+    const int nextLevel = decision.nextLevelIndex;
+    m_state.setCurrentLevelIndex(nextLevel);
+    outcome.nextLevelIndex = nextLevel;
+
+    if (m_currentSpec.globalIndex == m_protocol.finalLevelIndex()) {
+        const FinalLevelRule &finalRule = m_protocol.finalLevel();
+        if (outcome.passed) {
+            auto passes = m_state.finalLevelConsecutivePasses() + 1;
+            m_state.setFinalLevelConsecutivePasses(passes);
+            if (passes == finalRule.clears) {
+                m_state.setFinalLevelCooldownStart(QDateTime::currentDateTimeUtc());
+                outcome.finalCooldownStarted = true;
+            } else if (passes > finalRule.clears) {
+                const auto last = m_state.finalLevelCooldownStart();
+                if (last.isValid() && last.secsTo(QDateTime::currentDateTimeUtc()) >= finalRule.cooldownSecs) {
+                    m_state.setTrainingCompleted(true);
+                    outcome.trainingCompleted = true;
+                }
+            }
+        } else {
+            m_state.setFinalLevelConsecutivePasses(0);
+            m_state.setFinalLevelCooldownStart(QDateTime());
+        }
+    }
+
+    m_state.save();
+    return outcome;
+}
+
+bool TrainingSession::resolveSpecialExercise()
+{
+    if (m_mode != Mode::SpecialExercise) {
+        return false;
+    }
+    if (m_specialContext.feedbackPhase && m_specialContext.secondPhasePending) {
+        m_specialContext.feedbackPhase = false;
+        m_specialContext.totalTrials = m_protocol.specialExercise().testTrials;
+        m_specialContext.secondPhasePending = false;
+        m_trialsCompleted = 0;
+        m_trialLog.clear();
+        buildSchedule(specialConstraints(), m_scheduleSeed + 1);
+        journalLevelEnded(JournalRecord::LevelFinished, 0.0, true);
+        journalLevelStarted(m_specialContext.totalTrials);
+        return true;
+    }
+
+    recordSummary(true, 0.0, true, 0);
+    m_specialContext = SpecialContext{};
+    m_mode = Mode::Idle;
+    m_state.resetLevelsSinceSpecial();
+    m_state.save();
+    return false;
+}
+
+double TrainingSession::resolveTestBattery()
+{
+    if (m_mode != Mode::TestBattery) {
+        return 0.0;
+    }
+    const double accuracy = m_trialsCompleted > 0 ? double(m_correctTrials) / m_trialsCompleted : 0.0;
+    journalLevelEnded(JournalRecord::LevelFinished, accuracy, false);
+    resetLevelState();
+    m_mode = Mode::Idle;
+    return accuracy;
+}
+
+void TrainingSession::recordSummary(bool specialExercise, double accuracy, bool passed, int trialsSkipped)
+{
+    LevelSummary summary;
+    summary.levelIndex = m_currentSpec.globalIndex;
+    summary.accuracy = accuracy;
+    summary.passed = passed;
+    summary.trialsSkipped = trialsSkipped;
+    summary.specialExercise = specialExercise;
+    summary.seed = m_scheduleSeed;
+    summary.octaveMask = m_scheduleConstraints.octaveMask;
+    summary.outOfBoundsProportion = m_scheduleConstraints.outOfBoundsProportion;
+    summary.completedAt = QDateTime::currentDateTime();
+
+    for (const auto &trial : m_trialLog) {
+        const QString key = trial.outOfBounds ? QStringLiteral("OUT") : trial.presentedPitch;
+        auto stats = summary.perPitch.value(key);
+        ++stats.totalTrials;
+        if (trial.correct) {
+            ++stats.correctTrials;
+        }
+        summary.perPitch.insert(key, stats);
+    }
+
+    m_state.recordLevelSummary(summary);
+    m_trialLog.clear();
+    journalLevelEnded(JournalRecord::LevelFinished, accuracy, passed);
+}
+
+void TrainingSession::recordTrialStatistics(const TrialData &trial)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    const int expected = trial.outOfBounds ? PitchStatistics::kOtherCategory : order.indexOf(trial.presentedPitch);
+    int answered = -1;
+    if (trial.response == QStringLiteral("OUT")) {
+        answered = PitchStatistics::kOtherCategory;
+    } else if (!trial.timedOut) {
+        answered = order.indexOf(trial.response);
+    }
+    m_state.recordTrialStatistics(expected, answered, trial.correct, trial.responseTimeMs);
+    m_state.recordResponseTime(expected, m_currentSpec, trial.responseTimeMs, trial.timedOut);
+}
+
+void TrainingSession::journalLevelStarted(int trialCount)
+{
+    JournalRecord record;
+    record.kind = JournalRecord::LevelStarted;
+    record.levelIndex = static_cast<quint16>(m_currentSpec.globalIndex);
+    record.trialNumber = static_cast<quint16>(trialCount);
+    record.value = m_scheduleSeed;
+    if (m_mode == Mode::SpecialExercise) {
+        record.flags |= JournalRecord::Special;
+        if (m_specialContext.feedbackPhase) {
+            record.flags |= JournalRecord::Feedback;
+        }
+    } else if (m_mode == Mode::TestBattery) {
+        record.flags |= JournalRecord::TestBattery;
+    } else if (m_currentSpec.feedback) {
+        record.flags |= JournalRecord::Feedback;
+    }
+    m_journal.append(record);
+}
+
+// ends a block the previous run left open and that is not resumed, so a
+// reader never sees one level's start run into the next
+void TrainingSession::journalInterruptedAborted(const JournalBlock &block)
+{
+    if (!block.valid) {
+        return;
+    }
+    JournalRecord record;
+    record.kind = JournalRecord::LevelAborted;
+    record.levelIndex = block.start.levelIndex;
+    record.trialNumber = static_cast<quint16>(block.trials.size());
+    record.flags = block.start.flags & (JournalRecord::Special | JournalRecord::TestBattery);
+    m_journal.append(record);
+}
+
+void TrainingSession::journalTrial(const TrialData &trial, int trialNumber)
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    JournalRecord record;
+    record.kind = JournalRecord::Trial;
+    record.levelIndex = static_cast<quint16>(m_currentSpec.globalIndex);
+    record.trialNumber = static_cast<quint16>(trialNumber);
+    record.presented = static_cast<qint8>(order.indexOf(trial.presentedPitch));
+    if (trial.response == QStringLiteral("OUT")) {
+        record.response = JournalRecord::kOtherResponse;
+    } else if (!trial.response.isEmpty()) {
+        record.response = static_cast<qint8>(order.indexOf(trial.response));
+    }
+    record.octave = static_cast<qint8>(trial.octave);
+    record.value = static_cast<quint32>(qMax(0, trial.responseTimeMs));
+    if (m_mode == Mode::SpecialExercise) {
+        record.flags |= JournalRecord::Special;
+    } else if (m_mode == Mode::TestBattery) {
+        record.flags |= JournalRecord::TestBattery;
+    }
+    if (trial.correct) {
+        record.flags |= JournalRecord::Correct;
+    }
+    if (trial.timedOut) {
+        record.flags |= JournalRecord::TimedOut;
+    }
+    if (trial.outOfBounds) {
+        record.flags |= JournalRecord::OutOfBounds;
+    }
+    if (trial.semitoneError) {
+        record.flags |= JournalRecord::SemitoneError;
+    }
+    if (trial.usedDouble) {
+        record.flags |= JournalRecord::UsedDouble;
+    }
+    if (trial.luckyDouble) {
+        record.flags |= JournalRecord::LuckyDouble;
+    }
+    m_journal.append(record);
+}
+
+void TrainingSession::journalLevelEnded(JournalRecord::Kind kind, double accuracy, bool passed)
+{
+    JournalRecord record;
+    record.kind = kind;
+    record.levelIndex = static_cast<quint16>(m_currentSpec.globalIndex);
+    record.trialNumber = static_cast<quint16>(m_trialsCompleted);
+    record.value = static_cast<quint32>(qRound(qBound(0.0, accuracy, 1.0) * 10000));
+    if (m_mode == Mode::SpecialExercise) {
+        record.flags |= JournalRecord::Special;
+    } else if (m_mode == Mode::TestBattery) {
+        record.flags |= JournalRecord::TestBattery;
+    }
+    if (passed) {
+        record.flags |= JournalRecord::Passed;
+    }
+    m_journal.append(record);
+    m_journal.requestFlush();
+}
@@ -0,0 +1,222 @@
+#ifndef TRAININGSESSION_H
+#define TRAININGSESSION_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+#include "trainingmodel.h"
+#include "testbattery.h"
+#include "trainingprotocol.h"
+#include "trialjournal.h"
+#include "trialscheduler.h"
+
+class QLockFile;
+
+struct TrialData {
+    QString presentedPitch;
+    int octave = 4;
+    bool outOfBounds = false;
+    QString response;
+    bool correct = false;
+    bool semitoneError = false;
+    bool timedOut = false;
+    int responseTimeMs = 0;
+    bool usedDouble = false;
+    bool luckyDouble = false;
+};
+
+struct SpecialContext {
+    bool active = false;
+    QString targetPitch;
+    bool feedbackPhase = true;
+    int totalTrials = 0;
+    int completedTrials = 0;
+    bool secondPhasePending = false;
+};
+
+struct LevelOutcome {
+    // over the level's required trials, skipped ones counting as missed,
+    // the same base the pass decision uses
+    double accuracy = 0.0;
+    // accuracy with double bonuses, which decides the pass
+    double effectiveAccuracy = 0.0;
+    // over the trials actually run, without bonuses
+    double playedAccuracy = 0.0;
+    bool passed = false;
+    int tokensEarned = 0;
+    int nextLevelIndex = 0;
+    // trials left unplayed because no answer could change the outcome
+    int trialsSkipped = 0;
+    // third clear of the final level in a row; the 12 h wait begins
+    bool finalCooldownStarted = false;
+    bool trainingCompleted = false;
+};
+
+// One participant's trial engine: level and special-exercise rules, the
+// schedule, scoring, tokens, journal and statistics. It owns no timers,
+// audio or widgets; the caller presents each trial and reports the answer
+// with its response time. The window runs one session; the session server
+// runs one per connected terminal, each on its own profile directory.
+// Opening a profile takes its lock file; when another instance holds it the
+// session is a read-only view that can show progress but not train.
+class TrainingSession
+{
+public:
+    enum class Mode {
+        Idle,
+        Level,
+        SpecialExercise,
+        TestBattery
+    };
+
+    enum class StartResult {
+        Started,
+        // an interrupted level was picked up from the journal
+        Resumed,
+        SpecialExercise,
+        // a level or special exercise is already running
+        Busy,
+        // the final level waits out the protocol's cooldown after its clears
+        FinalCooldown,
+        // another instance has the profile open
+        ReadOnly,
+        // the profile's recorded protocol file is missing or invalid
+        ProtocolUnavailable
+    };
+
+    static constexpr int kDoubleTokenCost = 10;
+    // the octaves the bundled piano samples cover
+    static constexpr quint16 kDefaultOctaveMask = (1u << 4) | (1u << 5) | (1u << 6);
+
+    TrainingSession();
+    ~TrainingSession();
+
+    // closes the previous profile, then locks and loads this one
+    bool open(const QString &profileDirectory);
+    // flushes and releases the profile's lock; a running level is left
+    // open in the journal and resumed by the next open()
+    void close();
+    QString profileDirectory() const;
+    bool isReadOnly() const;
+    // the recorded protocol could not be loaded; the profile is shown
+    // under the standard one but cannot start levels or tests
+    bool protocolUnavailable() const;
+    // the open profile's trial journal could not be opened or has lost
+    // records to failed writes
+    bool journalFailing() const;
+    static QString lockPathForProfile(const QString &profileDirectory);
+
+    TrainingState &state();
+    const TrainingState &state() const;
+    // the protocol recorded in the profile, or the standard one
+    const TrainingProtocol &protocol() const;
+    // switches an idle, writable profile to another protocol and records it
+    bool setProtocol(const TrainingProtocol &protocol);
+
+    void setOctaveMask(quint16 mask);
+    quint16 octaveMask() const;
+
+    Mode mode() const;
+    bool isRunning() const;
+    bool levelActive() const;
+    bool specialActive() const;
+    bool batteryActive() const;
+    const LevelSpec &currentSpec() const;
+    // chromatic bitmasks of the current stage
+    quint16 trainingPitchMask() const;
+    quint16 outOfBoundsMask() const;
+    const SpecialContext &special() const;
+    quint32 scheduleSeed() const;
+    int trialsCompleted() const;
+    int correctTrials() const;
+    // trials in the running level or special-exercise phase
+    int blockLength() const;
+    // also true once an early-decision protocol has settled the level
+    bool blockComplete() const;
+    const QVector<TrialData> &blockTrials() const;
+    bool shouldRunSpecialExercise() const;
+
+    StartResult startLevel();
+    // a pre/post test in the battery's fixed order, without feedback or
+    // doubles; its trials are journaled like training trials, flagged as a
+    // test, and left out of the training statistics
+    StartResult startTestBattery(const TestBattery &battery);
+    void abort();
+
+    // the next scheduled trial, to be presented; finishTrial() answers it
+    const TrialData &nextTrial();
+    bool luckyDoubleReady() const;
+    bool doubleArmed() const;
+    bool armDouble();
+    // response is a pitch name, "OUT" or empty on a timeout
+    TrialData finishTrial(const QString &response, int responseTimeMs, bool timedOut);
+
+    // delay before the next tone when trials advance on their own, drawn
+    // from the protocol's interval and jitter
+    int nextInterTrialMs() const;
+    // trials answered per minute since resetCadence(), the session's
+    // throughput
+    void resetCadence();
+    int cadenceTrials() const;
+    double trialsPerMinute() const;
+
+    LevelOutcome resolveLevel();
+    // true when the feedback-free second phase starts, false when the
+    // exercise is over
+    bool resolveSpecialExercise();
+    // accuracy of the finished battery; the session is idle again
+    double resolveTestBattery();
+
+private:
+    void resolveProtocol(const QString &profileDirectory);
+    // the protocol's decision for the running level
+    LevelDecision decideLevel(int correct, double bonus) const;
+    bool outcomeSettled() const;
+    void startLevelInternal(bool *resumed);
+    void startSpecialExercise();
+    void resetLevelState();
+    void buildSchedule(ScheduleConstraints constraints, quint32 seed);
+    ScheduleConstraints specialConstraints() const;
+    bool resumeJournaledLevel(const JournalBlock &block);
+    void recordSummary(bool specialExercise, double accuracy, bool passed, int trialsSkipped);
+    void recordTrialStatistics(const TrialData &trial);
+    void journalLevelStarted(int trialCount);
+    void journalInterruptedAborted(const JournalBlock &block);
+    void journalTrial(const TrialData &trial, int trialNumber);
+    void journalLevelEnded(JournalRecord::Kind kind, double accuracy, bool passed);
+
+    TrainingState m_state;
+    TrainingProtocol m_protocol;
+    TrialJournal m_journal;
+    std::unique_ptr<QLockFile> m_lock;
+    bool m_readOnly = false;
+    bool m_protocolUnavailable = false;
+    quint16 m_octaveMask = 0;
+
+    Mode m_mode = Mode::Idle;
+    LevelSpec m_currentSpec;
+    QVector<TrialData> m_trialLog;
+    QVector<ScheduledTrial> m_schedule;
+    quint32 m_scheduleSeed = 0;
+    // with the seed, what a summary needs to rebuild the block
+    ScheduleConstraints m_scheduleConstraints;
+    // levels of an adaptive protocol draw each trial from here instead of
+    // the dealt schedule
+    AdaptiveSelector m_selector;
+    bool m_adaptive = false;
+    SpecialContext m_specialContext;
+    TrialData m_currentTrial;
+    bool m_doubleArmed = false;
+    bool m_randomDouble = false;
+    int m_trialsCompleted = 0;
+    int m_requiredTrials = 0;
+    int m_correctTrials = 0;
+    double m_effectiveBonus = 0.0;
+    bool m_outcomeDecided = false;
+    QElapsedTimer m_cadenceTimer;
+    int m_cadenceTrials = 0;
+};
+
+#endif // TRAININGSESSION_H
@@ -0,0 +1,402 @@
+#include "trialjournal.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtEndian>
+#include <array>
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr char kMagic[4] = {'P', 'T', 'J', '1'};
+constexpr quint16 kVersion = 1;
+constexpr int kHeaderSize = 16;
+constexpr int kBatchRecords = 512;
+constexpr unsigned long kBatchWindowMs = 200;
+constexpr int kScanChunkRecords = 256;
+constexpr int kScanLimitRecords = 4096;
+constexpr int kPayloadSize = JournalRecord::kEncodedSize - 4;
+
+constexpr std::array<quint32, 256> buildCrcTable()
+{
+    std::array<quint32, 256> table{};
+    for (quint32 i = 0; i < 256; ++i) {
+        quint32 c = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            c = (c & 1u) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+constexpr std::array<quint32, 256> kCrcTable = buildCrcTable();
+
+quint32 crc32(const uchar *data, int length)
+{
+    quint32 crc = 0xffffffffu;
+    for (int i = 0; i < length; ++i) {
+        crc = kCrcTable[(crc ^ data[i]) & 0xffu] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+bool syncFile(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+    const int fd = file.handle();
+    if (fd < 0) {
+        return false;
+    }
+#if defined(Q_OS_WIN)
+    return _commit(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+QByteArray encodeHeader()
+{
+    QByteArray header(kHeaderSize, '\0');
+    uchar *dst = reinterpret_cast<uchar *>(header.data());
+    memcpy(dst, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint16>(kVersion, dst + 4);
+    qToLittleEndian<quint16>(JournalRecord::kEncodedSize, dst + 6);
+    return header;
+}
+
+bool headerValid(const QByteArray &header)
+{
+    if (header.size() != kHeaderSize || memcmp(header.constData(), kMagic, sizeof(kMagic)) != 0) {
+        return false;
+    }
+    const uchar *src = reinterpret_cast<const uchar *>(header.constData());
+    return qFromLittleEndian<quint16>(src + 4) == kVersion &&
+           qFromLittleEndian<quint16>(src + 6) == JournalRecord::kEncodedSize;
+}
+}
+
+void JournalRecord::encode(uchar *dst) const
+{
+    dst[0] = kind;
+    dst[1] = 0;
+    qToLittleEndian<quint16>(flags, dst + 2);
+    qToLittleEndian<quint16>(levelIndex, dst + 4);
+    qToLittleEndian<quint16>(trialNumber, dst + 6);
+    dst[8] = static_cast<uchar>(presented);
+    dst[9] = static_cast<uchar>(response);
+    dst[10] = static_cast<uchar>(octave);
+    dst[11] = 0;
+    qToLittleEndian<quint32>(value, dst + 12);
+    qToLittleEndian<qint64>(timestampMs, dst + 16);
+    qToLittleEndian<quint32>(sequence, dst + 24);
+    qToLittleEndian<quint32>(crc32(dst, kPayloadSize), dst + kPayloadSize);
+}
+
+bool JournalRecord::decode(const uchar *src, JournalRecord *record)
+{
+    if (qFromLittleEndian<quint32>(src + kPayloadSize) != crc32(src, kPayloadSize)) {
+        return false;
+    }
+    if (src[0] < Trial || src[0] > LevelAborted) {
+        return false;
+    }
+    record->kind = src[0];
+    record->flags = qFromLittleEndian<quint16>(src + 2);
+    record->levelIndex = qFromLittleEndian<quint16>(src + 4);
+    record->trialNumber = qFromLittleEndian<quint16>(src + 6);
+    record->presented = static_cast<qint8>(src[8]);
+    record->response = static_cast<qint8>(src[9]);
+    record->octave = static_cast<qint8>(src[10]);
+    record->value = qFromLittleEndian<quint32>(src + 12);
+    record->timestampMs = qFromLittleEndian<qint64>(src + 16);
+    record->sequence = qFromLittleEndian<quint32>(src + 24);
+    return true;
+}
+
+TrialJournal::TrialJournal() = default;
+
+TrialJournal::~TrialJournal()
+{
+    close();
+}
+
+bool TrialJournal::open(const QString &path)
+{
+    close();
+    m_path = path;
+    if (!prepareFile()) {
+        m_path.clear();
+        return false;
+    }
+    m_stopping = false;
+    m_writer = QThread::create([this]() { writerLoop(); });
+    m_writer->start(QThread::LowPriority);
+    return true;
+}
+
+void TrialJournal::close()
+{
+    if (m_writer) {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stopping = true;
+        }
+        m_wake.wakeAll();
+        m_writer->wait();
+        delete m_writer;
+        m_writer = nullptr;
+    }
+    QMutexLocker locker(&m_mutex);
+    m_pending.clear();
+    m_flushRequested = false;
+    m_stopping = false;
+    m_nextSequence = 0;
+    m_failedRecords = 0;
+    m_openBlock = JournalBlock{};
+    m_path.clear();
+}
+
+bool TrialJournal::isOpen() const
+{
+    return m_writer != nullptr;
+}
+
+QString TrialJournal::path() const
+{
+    return m_path;
+}
+
+void TrialJournal::append(JournalRecord record)
+{
+    if (!m_writer) {
+        return;
+    }
+    if (record.timestampMs == 0) {
+        record.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    }
+    bool wake = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        record.sequence = m_nextSequence++;
+        m_pending.append(record);
+        // the first record starts the batch window, a full batch ends it
+        wake = m_pending.size() == 1 || m_pending.size() >= kBatchRecords;
+    }
+    if (wake) {
+        m_wake.wakeOne();
+    }
+}
+
+void TrialJournal::requestFlush()
+{
+    if (!m_writer) {
+        return;
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_flushRequested = true;
+    }
+    m_wake.wakeOne();
+}
+
+int TrialJournal::failedRecords() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_failedRecords;
+}
+
+JournalBlock TrialJournal::openBlock() const
+{
+    return m_openBlock;
+}
+
+void TrialJournal::clearOpenBlock()
+{
+    m_openBlock = JournalBlock{};
+}
+
+bool TrialJournal::prepareFile()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    if (file.size() < kHeaderSize) {
+        // empty, or the header write itself was interrupted
+        file.resize(0);
+        const QByteArray header = encodeHeader();
+        if (file.write(header) != header.size()) {
+            return false;
+        }
+        return syncFile(file);
+    }
+    if (!headerValid(file.read(kHeaderSize))) {
+        return false;
+    }
+
+    // drop a record torn by a crash so appends stay aligned
+    const qint64 recordCount = (file.size() - kHeaderSize) / JournalRecord::kEncodedSize;
+    const qint64 alignedSize = kHeaderSize + recordCount * JournalRecord::kEncodedSize;
+    if (alignedSize != file.size()) {
+        file.resize(alignedSize);
+    }
+
+    // walk back from the end: the newest valid record gives the next
+    // sequence number, and trials after the last LevelStarted form an
+    // unfinished block unless a finish or abort record closes it first
+    bool sequenceKnown = false;
+    QVector<JournalRecord> trailingTrials;
+    QByteArray chunk;
+    qint64 remaining = recordCount;
+    qint64 scanned = 0;
+    bool blockResolved = false;
+    while (remaining > 0 && scanned < kScanLimitRecords && !blockResolved) {
+        const qint64 take = qMin<qint64>(remaining, kScanChunkRecords);
+        remaining -= take;
+        file.seek(kHeaderSize + remaining * JournalRecord::kEncodedSize);
+        chunk = file.read(take * JournalRecord::kEncodedSize);
+        const uchar *base = reinterpret_cast<const uchar *>(chunk.constData());
+        for (qint64 i = chunk.size() / JournalRecord::kEncodedSize - 1; i >= 0 && !blockResolved; --i) {
+            ++scanned;
+            JournalRecord record;
+            if (!JournalRecord::decode(base + i * JournalRecord::kEncodedSize, &record)) {
+                continue;
+            }
+            if (!sequenceKnown) {
+                m_nextSequence = record.sequence + 1;
+                sequenceKnown = true;
+            }
+            switch (record.kind) {
+            case JournalRecord::Trial:
+                trailingTrials.prepend(record);
+                break;
+            case JournalRecord::LevelStarted:
+                m_openBlock.start = record;
+                m_openBlock.trials = trailingTrials;
+                m_openBlock.valid = true;
+                blockResolved = true;
+                break;
+            default:
+                blockResolved = true;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+void TrialJournal::writerLoop()
+{
+    QFile file(m_path);
+    // unbuffered, so a full disk shows in the write's result
+    const bool writable = file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered);
+    if (!writable) {
+        qWarning() << "trial journal" << m_path << "cannot be opened for writing:" << file.errorString();
+    }
+    QVector<JournalRecord> batch;
+    QByteArray bytes;
+
+    forever {
+        bool stop = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_stopping && !m_flushRequested && m_pending.size() < kBatchRecords) {
+                if (m_pending.isEmpty()) {
+                    m_wake.wait(&m_mutex);
+                } else if (!m_wake.wait(&m_mutex, kBatchWindowMs)) {
+                    break;
+                }
+            }
+            batch.swap(m_pending);
+            m_flushRequested = false;
+            stop = m_stopping;
+        }
+
+        bool written = batch.isEmpty();
+        if (!batch.isEmpty() && writable) {
+            bytes.resize(batch.size() * JournalRecord::kEncodedSize);
+            uchar *dst = reinterpret_cast<uchar *>(bytes.data());
+            for (const auto &record : batch) {
+                record.encode(dst);
+                dst += JournalRecord::kEncodedSize;
+            }
+            const qint64 size = file.size();
+            written = file.write(bytes) == bytes.size() && syncFile(file);
+            if (!written) {
+                // cut a partial batch so later appends stay aligned
+                qWarning() << "trial journal" << m_path << "write failed:" << file.errorString();
+                file.resize(size);
+            }
+        }
+        if (!written) {
+            QMutexLocker locker(&m_mutex);
+            m_failedRecords += batch.size();
+        }
+        batch.clear();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+QVector<JournalRecord> TrialJournal::readAll(const QString &path, int *corruptRecords)
+{
+    return readRange(path, 0, -1, nullptr, corruptRecords);
+}
+
+QVector<JournalRecord> TrialJournal::readRange(const QString &path, qint64 firstRecord, int maxRecords,
+                                                qint64 *endRecord, int *corruptRecords)
+{
+    QVector<JournalRecord> records;
+    int corrupt = 0;
+    qint64 end = firstRecord;
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly) && headerValid(file.read(kHeaderSize))) {
+        // a record still being written is left for the next read
+        qint64 available = (file.size() - kHeaderSize) / JournalRecord::kEncodedSize;
+        if (maxRecords >= 0) {
+            available = qMin(available, firstRecord + maxRecords);
+        }
+        if (available > firstRecord && file.seek(kHeaderSize + firstRecord * JournalRecord::kEncodedSize)) {
+            const QByteArray data = file.read((available - firstRecord) * JournalRecord::kEncodedSize);
+            const int count = data.size() / JournalRecord::kEncodedSize;
+            records.reserve(count);
+            const uchar *base = reinterpret_cast<const uchar *>(data.constData());
+            for (int i = 0; i < count; ++i) {
+                JournalRecord record;
+                if (JournalRecord::decode(base + i * JournalRecord::kEncodedSize, &record)) {
+                    records.append(record);
+                } else {
+                    ++corrupt;
+                }
+            }
+            end = firstRecord + count;
+        } else {
+            end = available;
+        }
+    }
+    if (endRecord) {
+        *endRecord = end;
+    }
+    if (corruptRecords) {
+        *corruptRecords = corrupt;
+    }
+    return records;
+}
+
+QString TrialJournal::pathForProfile(const QString &profileDirectory)
+{
+    return QDir(profileDirectory).filePath(QStringLiteral("journal.bin"));
+}
@@ -0,0 +1,116 @@
+#ifndef TRIALJOURNAL_H
+#define TRIALJOURNAL_H
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+#include <QtGlobal>
+
+class QThread;
+
+// One fixed-size journal entry. Trials carry the raw response data; the
+// level records bracket a block of trials so an interrupted level can be
+// picked up again.
+struct JournalRecord {
+    enum Kind : quint8 {
+        Trial = 1,
+        LevelStarted = 2,
+        LevelFinished = 3,
+        LevelAborted = 4
+    };
+
+    enum Flag : quint16 {
+        Special = 0x0001,
+        Correct = 0x0002,
+        TimedOut = 0x0004,
+        OutOfBounds = 0x0008,
+        SemitoneError = 0x0010,
+        UsedDouble = 0x0020,
+        LuckyDouble = 0x0040,
+        Passed = 0x0080,
+        Feedback = 0x0100,
+        // a pre/post test battery run rather than training
+        TestBattery = 0x0200
+    };
+
+    static constexpr int kEncodedSize = 32;
+    static constexpr qint8 kNoResponse = -1;
+    static constexpr qint8 kOtherResponse = 12;
+
+    quint8 kind = Trial;
+    quint16 flags = 0;
+    quint16 levelIndex = 0;
+    // trial number for trials, planned trial count for LevelStarted
+    quint16 trialNumber = 0;
+    qint8 presented = -1;
+    qint8 response = kNoResponse;
+    qint8 octave = 0;
+    // response time (ms) for trials, schedule seed for LevelStarted,
+    // accuracy in basis points for LevelFinished
+    quint32 value = 0;
+    qint64 timestampMs = 0;
+    quint32 sequence = 0;
+
+    bool hasFlag(Flag flag) const { return (flags & flag) != 0; }
+
+    void encode(uchar *dst) const;
+    static bool decode(const uchar *src, JournalRecord *record);
+};
+
+// A LevelStarted record and the trials logged after it.
+struct JournalBlock {
+    JournalRecord start;
+    QVector<JournalRecord> trials;
+    bool valid = false;
+};
+
+// Append-only per-profile trial journal. append() only queues the record;
+// a writer thread batches, encodes, writes and fsyncs, so the GUI thread
+// never touches the disk.
+class TrialJournal
+{
+public:
+    TrialJournal();
+    ~TrialJournal();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+    QString path() const;
+
+    void append(JournalRecord record);
+    void requestFlush();
+    // records the writer could not store since open(); the session warns
+    // while this is non-zero
+    int failedRecords() const;
+
+    // level block left open by the previous run (no finish or abort record)
+    JournalBlock openBlock() const;
+    void clearOpenBlock();
+
+    static QVector<JournalRecord> readAll(const QString &path, int *corruptRecords = nullptr);
+    // up to maxRecords records (all when negative) from slot firstRecord
+    // on; *endRecord receives the slot where the next read should start
+    static QVector<JournalRecord> readRange(const QString &path, qint64 firstRecord, int maxRecords,
+                                            qint64 *endRecord, int *corruptRecords = nullptr);
+    static QString pathForProfile(const QString &profileDirectory);
+
+private:
+    void writerLoop();
+    bool prepareFile();
+
+    QString m_path;
+    QThread *m_writer = nullptr;
+    JournalBlock m_openBlock;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QVector<JournalRecord> m_pending;
+    quint32 m_nextSequence = 0;
+    int m_failedRecords = 0;
+    bool m_flushRequested = false;
+    bool m_stopping = false;
+};
+
+#endif // TRIALJOURNAL_H
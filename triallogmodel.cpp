@@ -0,0 +1,152 @@
+#include "triallogmodel.h"
+
+#include "theme.h"
+#include "trainingmodel.h"
+
+#include <QPainter>
+
+namespace {
+constexpr int kRowPaddingX = 8;
+constexpr int kRowPaddingY = 6;
+}
+
+TrialLogModel::TrialLogModel(int capacity, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_records(capacity)
+{
+}
+
+void TrialLogModel::append(const TrialLogRecord &record)
+{
+    ++m_appended;
+    if (m_records.isEmpty()) {
+        // the placeholder row turns into the first record
+        m_records.push(record);
+        const QModelIndex first = index(0);
+        emit dataChanged(first, first);
+        return;
+    }
+    if (m_records.isFull()) {
+        beginRemoveRows(QModelIndex(), 0, 0);
+        m_records.takeFirst();
+        endRemoveRows();
+    }
+    const int row = m_records.size();
+    beginInsertRows(QModelIndex(), row, row);
+    m_records.push(record);
+    endInsertRows();
+}
+
+void TrialLogModel::reset()
+{
+    if (m_records.isEmpty()) {
+        return;
+    }
+    beginResetModel();
+    m_records.clear();
+    m_appended = 0;
+    endResetModel();
+}
+
+bool TrialLogModel::hasEntries() const
+{
+    return !m_records.isEmpty();
+}
+
+int TrialLogModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_records.isEmpty() ? 1 : m_records.size();
+}
+
+QVariant TrialLogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= rowCount()) {
+        return {};
+    }
+    const bool placeholder = m_records.isEmpty();
+    switch (role) {
+    case Qt::DisplayRole:
+        if (placeholder) {
+            return tr("No trials yet. Press \"Hear next tone\" to begin.");
+        }
+        return describe(m_records.at(index.row()));
+    case PositiveRole:
+        return !placeholder && m_records.at(index.row()).positive();
+    case PlaceholderRole:
+        return placeholder;
+    case SequenceRole:
+        return m_appended - m_records.size() + index.row();
+    default:
+        break;
+    }
+    return {};
+}
+
+Qt::ItemFlags TrialLogModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid() || m_records.isEmpty()) {
+        return Qt::NoItemFlags;
+    }
+    return Qt::ItemIsEnabled;
+}
+
+QString TrialLogModel::pitchName(qint8 index) const
+{
+    const auto &order = TrainingSpec::chromaticOrder();
+    if (index >= 0 && index < order.size()) {
+        return order.at(index);
+    }
+    return tr("other");
+}
+
+QString TrialLogModel::describe(const TrialLogRecord &record) const
+{
+    const QString actualDisplay = (record.flags & TrialLogRecord::OutOfBounds) ? tr("other") : pitchName(record.presented);
+    QString text;
+    if (record.flags & TrialLogRecord::TimedOut) {
+        text = tr("Time expired (target %1)").arg(actualDisplay);
+    } else if (record.flags & TrialLogRecord::Correct) {
+        text = tr("Correct (%1)").arg(actualDisplay);
+    } else {
+        const QString responseDisplay = record.response == TrialLogRecord::kNoResponse ? tr("none") : pitchName(record.response);
+        text = tr("Incorrect (target %1, answered %2)").arg(actualDisplay, responseDisplay);
+    }
+    if (record.flags & TrialLogRecord::Special) {
+        text = tr("[Special] %1").arg(text);
+    }
+    return tr("Trial %1: %2").arg(record.trialNumber).arg(text);
+}
+
+TrialLogDelegate::TrialLogDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+void TrialLogDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const auto &theme = Theme::current();
+    painter->save();
+    // striped by sequence, not row, so the stripes stay put once the ring
+    // is full and every append drops the top row
+    if (index.data(TrialLogModel::SequenceRole).toLongLong() % 2 == 1) {
+        painter->fillRect(option.rect, theme.logAlternateRow);
+    }
+    QColor color = theme.logPlaceholder;
+    if (!index.data(TrialLogModel::PlaceholderRole).toBool()) {
+        color = index.data(TrialLogModel::PositiveRole).toBool() ? theme.logPositive : theme.logNegative;
+    }
+    painter->setPen(color);
+    painter->setFont(option.font);
+    const QRect textRect = option.rect.adjusted(kRowPaddingX, 0, -kRowPaddingX, 0);
+    painter->drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter, index.data(Qt::DisplayRole).toString());
+    painter->restore();
+}
+
+QSize TrialLogDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(index);
+    return QSize(option.rect.width(), option.fontMetrics.height() + 2 * kRowPaddingY);
+}
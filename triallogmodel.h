@@ -0,0 +1,70 @@
+#ifndef TRIALLOGMODEL_H
+#define TRIALLOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QStyledItemDelegate>
+
+#include "ringbuffer.h"
+
+struct TrialLogRecord {
+    enum Flag : quint8 {
+        Correct = 0x01,
+        TimedOut = 0x02,
+        OutOfBounds = 0x04,
+        Special = 0x08
+    };
+
+    static constexpr qint8 kNoResponse = -1;
+    static constexpr qint8 kOtherResponse = 12;
+
+    quint16 trialNumber = 0;
+    qint8 presented = -1;
+    qint8 response = kNoResponse;
+    quint8 flags = 0;
+
+    bool positive() const { return (flags & Correct) && !(flags & TimedOut); }
+};
+
+// Trial log backed by a bounded ring buffer of compact records. Row text is
+// only formatted when the view asks for a visible row.
+class TrialLogModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Roles {
+        PositiveRole = Qt::UserRole + 1,
+        PlaceholderRole,
+        // position among every record appended since the last reset, so a
+        // row keeps it when older rows drop out of the ring
+        SequenceRole
+    };
+
+    explicit TrialLogModel(int capacity = 500, QObject *parent = nullptr);
+
+    void append(const TrialLogRecord &record);
+    void reset();
+    bool hasEntries() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+private:
+    QString describe(const TrialLogRecord &record) const;
+    QString pitchName(qint8 index) const;
+
+    RingBuffer<TrialLogRecord> m_records;
+    qint64 m_appended = 0;
+};
+
+class TrialLogDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+public:
+    explicit TrialLogDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+};
+
+#endif // TRIALLOGMODEL_H
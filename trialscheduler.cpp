@@ -0,0 +1,466 @@
+#include "trialscheduler.h"
+
+#include <QRandomGenerator>
+#include <QVarLengthArray>
+#include <cstdlib>
+
+namespace {
+
+constexpr int kMaskBits = 16;
+
+template <typename T>
+void shuffleRange(T *values, int count, ScheduleRng &rng)
+{
+    for (int i = count - 1; i > 0; --i) {
+        const int j = rng.bounded(i + 1);
+        qSwap(values[i], values[j]);
+    }
+}
+
+// Writes n draws from values into out. Balanced mode deals whole shuffled
+// decks so counts differ by at most one.
+void dealValues(const int *values, int valueCount, int n, bool balanced, ScheduleRng &rng, int *out)
+{
+    if (valueCount <= 0) {
+        return;
+    }
+    int deck[kMaskBits];
+    for (int k = 0; k < n; ++k) {
+        if (!balanced) {
+            out[k] = values[rng.bounded(valueCount)];
+            continue;
+        }
+        const int slot = k % valueCount;
+        if (slot == 0) {
+            for (int v = 0; v < valueCount; ++v) {
+                deck[v] = values[v];
+            }
+            shuffleRange(deck, valueCount, rng);
+        }
+        out[k] = deck[slot];
+    }
+}
+
+// Lays out the multiset given by counts so no value runs longer than
+// maxRepeats. Each step draws proportionally to the remaining counts among
+// the values that keep the rest of the sequence feasible.
+void sequenceWithRepeatLimit(int *counts, int total, int maxRepeats, ScheduleRng &rng, int *out)
+{
+    int present[kMaskBits];
+    int presentCount = 0;
+    for (int v = 0; v < kMaskBits; ++v) {
+        if (counts[v] > 0) {
+            present[presentCount++] = v;
+        }
+    }
+
+    int last = -1;
+    int run = 0;
+    for (int position = 0; position < total; ++position) {
+        const int remainingAfter = total - position - 1;
+
+        // only the largest other count can become infeasible
+        int top = present[0];
+        int secondCount = 0;
+        for (int p = 1; p < presentCount; ++p) {
+            const int v = present[p];
+            if (counts[v] > counts[top]) {
+                secondCount = counts[top];
+                top = v;
+            } else if (counts[v] > secondCount) {
+                secondCount = counts[v];
+            }
+        }
+
+        int weights[kMaskBits];
+        int weightSum = 0;
+        int fallback = -1;
+        for (int p = 0; p < presentCount; ++p) {
+            const int v = present[p];
+            weights[p] = 0;
+            if (counts[v] <= 0) {
+                continue;
+            }
+            const int newRun = (v == last) ? run + 1 : 1;
+            if (newRun > maxRepeats) {
+                continue;
+            }
+            fallback = v;
+            const int left = counts[v] - 1;
+            const int others = remainingAfter - left;
+            const int rival = (v == top) ? secondCount : counts[top];
+            const bool feasible = left <= (maxRepeats - newRun) + maxRepeats * others &&
+                                  rival <= maxRepeats * (remainingAfter - rival + 1);
+            if (feasible) {
+                weights[p] = counts[v];
+                weightSum += counts[v];
+            }
+        }
+
+        int chosen = fallback;
+        if (weightSum > 0) {
+            int pick = rng.bounded(weightSum);
+            for (int p = 0; p < presentCount; ++p) {
+                if (pick < weights[p]) {
+                    chosen = present[p];
+                    break;
+                }
+                pick -= weights[p];
+            }
+        }
+        if (chosen < 0) {
+            // only the value that just ran out of repeats is left
+            chosen = last;
+        }
+
+        out[position] = chosen;
+        --counts[chosen];
+        run = (chosen == last) ? run + 1 : 1;
+        last = chosen;
+    }
+}
+
+bool intervalOk(const ScheduledTrial &a, const ScheduledTrial &b, int minInterval)
+{
+    const int first = a.octave * 12 + a.pitch;
+    const int second = b.octave * 12 + b.pitch;
+    return std::abs(second - first) >= minInterval;
+}
+
+// Deals octaves from the balanced counts, preferring ones that keep the
+// required distance from the previous tone. When no counted octave fits,
+// balance gives way to the interval constraint.
+void assignOctaves(QVector<ScheduledTrial> &trials, const int *octaves, int octaveCount, int *counts, int minInterval, ScheduleRng &rng)
+{
+    const int n = static_cast<int>(trials.size());
+    for (int i = 0; i < n; ++i) {
+        int weights[kMaskBits];
+        int weightSum = 0;
+        for (int o = 0; o < octaveCount; ++o) {
+            weights[o] = 0;
+            if (counts[o] <= 0) {
+                continue;
+            }
+            trials[i].octave = static_cast<qint8>(octaves[o]);
+            if (i == 0 || minInterval <= 0 || intervalOk(trials.at(i - 1), trials.at(i), minInterval)) {
+                weights[o] = counts[o];
+                weightSum += counts[o];
+            }
+        }
+        int chosen = -1;
+        if (weightSum > 0) {
+            int pick = rng.bounded(weightSum);
+            for (int o = 0; o < octaveCount; ++o) {
+                if (pick < weights[o]) {
+                    chosen = o;
+                    break;
+                }
+                pick -= weights[o];
+            }
+        } else {
+            const int start = rng.bounded(octaveCount);
+            for (int step = 0; step < octaveCount && chosen < 0; ++step) {
+                const int o = (start + step) % octaveCount;
+                trials[i].octave = static_cast<qint8>(octaves[o]);
+                if (intervalOk(trials.at(i - 1), trials.at(i), minInterval)) {
+                    chosen = o;
+                }
+            }
+            if (chosen < 0) {
+                chosen = start;
+            }
+        }
+        trials[i].octave = static_cast<qint8>(octaves[chosen]);
+        if (counts[chosen] > 0) {
+            --counts[chosen];
+        }
+    }
+}
+
+} // namespace
+
+int TrialScheduler::maskToIndices(quint16 mask, int *indices)
+{
+    int count = 0;
+    for (int bit = 0; bit < kMaskBits; ++bit) {
+        if (mask & (1u << bit)) {
+            indices[count++] = bit;
+        }
+    }
+    return count;
+}
+
+void TrialScheduler::generate(const ScheduleConstraints &constraints, quint32 seed, QVector<ScheduledTrial> *out)
+{
+    if (!out) {
+        return;
+    }
+    const int n = qMax(0, constraints.trialCount);
+    out->resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    ScheduleRng rng(seed);
+    int trained[kMaskBits];
+    int outside[kMaskBits];
+    int octaves[kMaskBits];
+    const int trainedCount = maskToIndices(constraints.pitchMask, trained);
+    const int outsideCount = maskToIndices(static_cast<quint16>(constraints.outOfBoundsMask & ~constraints.pitchMask), outside);
+    const int octaveCount = maskToIndices(constraints.octaveMask, octaves);
+    if (trainedCount == 0 && outsideCount == 0) {
+        out->clear();
+        return;
+    }
+
+    int outsideTrials = 0;
+    if (outsideCount > 0) {
+        const double share = qBound(0.0, constraints.outOfBoundsProportion, 1.0);
+        outsideTrials = trainedCount == 0 ? n : qBound(0, qRound(share * n), n);
+    }
+    const int trainedTrials = n - outsideTrials;
+
+    QVarLengthArray<int, 64> scratch(n);
+    dealValues(trained, trainedCount, trainedTrials, constraints.balanced, rng, scratch.data());
+    dealValues(outside, outsideCount, outsideTrials, constraints.balanced, rng, scratch.data() + trainedTrials);
+    if (constraints.maxRepeats > 0) {
+        int counts[kMaskBits] = {};
+        for (int k = 0; k < n; ++k) {
+            ++counts[scratch.at(k)];
+        }
+        sequenceWithRepeatLimit(counts, n, constraints.maxRepeats, rng, scratch.data());
+    } else {
+        shuffleRange(scratch.data(), n, rng);
+    }
+    const quint16 outsideMask = static_cast<quint16>(constraints.outOfBoundsMask & ~constraints.pitchMask);
+    for (int k = 0; k < n; ++k) {
+        ScheduledTrial &trial = (*out)[k];
+        trial = ScheduledTrial{};
+        trial.pitch = static_cast<qint8>(scratch.at(k));
+        trial.outOfBounds = (outsideMask & (1u << trial.pitch)) != 0;
+    }
+
+    if (octaveCount > 0) {
+        int octaveCounts[kMaskBits] = {};
+        if (constraints.balanced) {
+            // the extras of an uneven split go to random octaves, not
+            // always the lowest ones
+            int order[kMaskBits];
+            for (int k = 0; k < octaveCount; ++k) {
+                octaveCounts[k] = n / octaveCount;
+                order[k] = k;
+            }
+            shuffleRange(order, octaveCount, rng);
+            for (int k = 0; k < n % octaveCount; ++k) {
+                ++octaveCounts[order[k]];
+            }
+        } else {
+            for (int k = 0; k < n; ++k) {
+                ++octaveCounts[rng.bounded(octaveCount)];
+            }
+        }
+        assignOctaves(*out, octaves, octaveCount, octaveCounts, constraints.minIntervalSemitones, rng);
+    }
+
+    if (constraints.luckyDoubleOdds > 0) {
+        for (int k = 0; k < n; ++k) {
+            (*out)[k].luckyDouble = rng.bounded(constraints.luckyDoubleOdds) == 0;
+        }
+    }
+}
+
+QVector<ScheduledTrial> TrialScheduler::generate(const ScheduleConstraints &constraints, quint32 seed)
+{
+    QVector<ScheduledTrial> trials;
+    generate(constraints, seed, &trials);
+    return trials;
+}
+
+quint32 TrialScheduler::newSeed()
+{
+    return QRandomGenerator::global()->generate();
+}
+
+void AdaptiveSelector::reset(const ScheduleConstraints &constraints, const SelectionWeights &weights, quint32 seed)
+{
+    m_weights = weights;
+    m_alpha.fill(1.0);
+    m_beta.fill(1.0);
+    m_base.fill(0.0);
+    m_rngState = ScheduleRng(seed).state;
+    m_maxRepeats = constraints.maxRepeats;
+    m_minInterval = constraints.minIntervalSemitones;
+    m_lastPitch = -1;
+    m_lastOctave = -1;
+    m_run = 0;
+
+    int indices[kMaskBits];
+    const quint16 outsideMask = static_cast<quint16>(constraints.outOfBoundsMask & ~constraints.pitchMask);
+    const int trainedCount = TrialScheduler::maskToIndices(static_cast<quint16>(constraints.pitchMask & 0x0fff), indices);
+    m_outsideCount = TrialScheduler::maskToIndices(static_cast<quint16>(outsideMask & 0x0fff), indices + trainedCount);
+    for (int k = 0; k < m_outsideCount; ++k) {
+        m_outside[k] = static_cast<qint8>(indices[trainedCount + k]);
+    }
+    int octaves[kMaskBits];
+    m_octaveCount = TrialScheduler::maskToIndices(constraints.octaveMask, octaves);
+    for (int k = 0; k < m_octaveCount; ++k) {
+        m_octaves[k] = static_cast<qint8>(octaves[k]);
+    }
+
+    // equal skill gives every item its share under uniform dealing
+    const double share = m_outsideCount == 0 ? 0.0
+                         : trainedCount == 0 ? 1.0
+                                             : qBound(0.0, constraints.outOfBoundsProportion, 1.0);
+    m_itemCount = 0;
+    for (int k = 0; k < trainedCount; ++k) {
+        m_base[indices[k]] = (1.0 - share) / trainedCount;
+        m_items[m_itemCount++] = static_cast<qint8>(indices[k]);
+    }
+    if (m_outsideCount > 0) {
+        m_base[kOutOfBoundsItem] = share;
+        m_items[m_itemCount++] = kOutOfBoundsItem;
+    }
+    m_dirty = true;
+}
+
+void AdaptiveSelector::setPrior(int item, double correct, double total)
+{
+    if (item < 0 || item >= kItemCount || total <= 0.0) {
+        return;
+    }
+    m_alpha[item] = 1.0 + qBound(0.0, correct, total);
+    m_beta[item] = 1.0 + total - qBound(0.0, correct, total);
+    m_dirty = true;
+}
+
+void AdaptiveSelector::record(int item, bool correct)
+{
+    if (item < 0 || item >= kItemCount) {
+        return;
+    }
+    m_alpha[item] = m_alpha[item] * m_weights.decay + (correct ? 1.0 : 0.0);
+    m_beta[item] = m_beta[item] * m_weights.decay + (correct ? 0.0 : 1.0);
+    m_dirty = m_dirty || m_base[item] > 0.0;
+}
+
+double AdaptiveSelector::skill(int item) const
+{
+    if (item < 0 || item >= kItemCount) {
+        return 0.0;
+    }
+    return m_alpha[item] / (m_alpha[item] + m_beta[item]);
+}
+
+double AdaptiveSelector::weight(int item) const
+{
+    const double miss = 1.0 - skill(item);
+    return m_base[item] * (m_weights.minWeight + (m_weights.maxWeight - m_weights.minWeight) * miss);
+}
+
+double AdaptiveSelector::probability(int item) const
+{
+    double sum = 0.0;
+    for (int k = 0; k < m_itemCount; ++k) {
+        sum += weight(m_items[k]);
+    }
+    return sum > 0.0 && item >= 0 && item < kItemCount ? weight(item) / sum : 0.0;
+}
+
+// Vose's method: columns below the mean are topped up by one above it
+void AdaptiveSelector::rebuild()
+{
+    m_dirty = false;
+    const int n = m_itemCount;
+    if (n == 0) {
+        return;
+    }
+    double scaled[kItemCount];
+    double sum = 0.0;
+    for (int k = 0; k < n; ++k) {
+        scaled[k] = weight(m_items[k]);
+        sum += scaled[k];
+    }
+    int small[kItemCount];
+    int large[kItemCount];
+    int smallCount = 0;
+    int largeCount = 0;
+    for (int k = 0; k < n; ++k) {
+        scaled[k] = sum > 0.0 ? scaled[k] * n / sum : 1.0;
+        if (scaled[k] < 1.0) {
+            small[smallCount++] = k;
+        } else {
+            large[largeCount++] = k;
+        }
+    }
+    while (smallCount > 0 && largeCount > 0) {
+        const int less = small[--smallCount];
+        const int more = large[--largeCount];
+        m_threshold[less] = scaled[less];
+        m_alias[less] = static_cast<qint8>(more);
+        scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+        if (scaled[more] < 1.0) {
+            small[smallCount++] = more;
+        } else {
+            large[largeCount++] = more;
+        }
+    }
+    // what is left is 1 up to rounding
+    while (largeCount > 0) {
+        const int k = large[--largeCount];
+        m_threshold[k] = 1.0;
+        m_alias[k] = static_cast<qint8>(k);
+    }
+    while (smallCount > 0) {
+        const int k = small[--smallCount];
+        m_threshold[k] = 1.0;
+        m_alias[k] = static_cast<qint8>(k);
+    }
+}
+
+ScheduledTrial AdaptiveSelector::next()
+{
+    ScheduledTrial trial;
+    if (m_itemCount == 0) {
+        return trial;
+    }
+    if (m_dirty) {
+        rebuild();
+    }
+    ScheduleRng rng(0);
+    rng.state = m_rngState;
+    // a bounded number of redraws keeps the repeat limit without giving
+    // up constant time; a stubborn run is let through
+    int pitch = -1;
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        const int column = rng.bounded(m_itemCount);
+        const int slot = rng.unit() < m_threshold[column] ? column : m_alias[column];
+        const int item = m_items[slot];
+        trial.outOfBounds = item == kOutOfBoundsItem;
+        pitch = trial.outOfBounds ? m_outside[rng.bounded(m_outsideCount)] : item;
+        if (m_maxRepeats <= 0 || pitch != m_lastPitch || m_run < m_maxRepeats) {
+            break;
+        }
+    }
+    trial.pitch = static_cast<qint8>(pitch);
+    if (m_octaveCount > 0) {
+        // the first octave from a random start that keeps the distance
+        // from the previous tone, or the start when none does
+        const int start = rng.bounded(m_octaveCount);
+        trial.octave = m_octaves[start];
+        if (m_minInterval > 0 && m_lastPitch >= 0) {
+            const int previous = m_lastOctave * 12 + m_lastPitch;
+            for (int step = 0; step < m_octaveCount; ++step) {
+                const int octave = m_octaves[(start + step) % m_octaveCount];
+                if (std::abs(octave * 12 + pitch - previous) >= m_minInterval) {
+                    trial.octave = static_cast<qint8>(octave);
+                    break;
+                }
+            }
+        }
+    }
+    m_rngState = rng.state;
+    m_run = pitch == m_lastPitch ? m_run + 1 : 1;
+    m_lastPitch = pitch;
+    m_lastOctave = trial.octave;
+    return trial;
+}
@@ -0,0 +1,135 @@
+#ifndef TRIALSCHEDULER_H
+#define TRIALSCHEDULER_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <array>
+
+struct ScheduledTrial {
+    qint8 pitch = -1;
+    qint8 octave = 4;
+    bool outOfBounds = false;
+    bool luckyDouble = false;
+};
+
+struct ScheduleConstraints {
+    int trialCount = 20;
+    quint16 pitchMask = 0;
+    quint16 outOfBoundsMask = 0;
+    double outOfBoundsProportion = 0.0;
+    quint16 octaveMask = 0;
+    bool balanced = true;
+    // longest allowed run of the same pitch class, 0 = unlimited
+    int maxRepeats = 0;
+    // smallest allowed distance between consecutive tones, 0 = unconstrained
+    int minIntervalSemitones = 0;
+    // one in N trials carries a lucky double, 0 = never
+    int luckyDoubleOdds = 0;
+};
+
+// SplitMix64: a handful of multiplies per draw and no state table to seed,
+// so building a 20-trial block costs a few microseconds at most. The same
+// seed gives the same draws on every platform and standard library, which
+// is what the fixed test orders and the bootstrap resamples rely on too.
+struct ScheduleRng {
+    explicit ScheduleRng(quint64 seed)
+        : state(seed)
+    {
+    }
+
+    quint64 next()
+    {
+        quint64 z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, 1)
+    double unit()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    int bounded(int n)
+    {
+        if (n <= 1) {
+            return 0;
+        }
+        return static_cast<int>(((next() >> 32) * static_cast<quint64>(n)) >> 32);
+    }
+
+    quint64 state;
+};
+
+// Builds a whole block of trials up front from a seed, so a level can be
+// replayed exactly. Pitch and octave counts are balanced and the order is
+// drawn so that repeat and interval limits hold whenever they can.
+class TrialScheduler
+{
+public:
+    static void generate(const ScheduleConstraints &constraints, quint32 seed, QVector<ScheduledTrial> *out);
+    static QVector<ScheduledTrial> generate(const ScheduleConstraints &constraints, quint32 seed);
+    static quint32 newSeed();
+    static int maskToIndices(quint16 mask, int *indices);
+};
+
+struct SelectionWeights {
+    // an item's weight runs from minWeight when always right to maxWeight
+    // when always wrong, times its uniform share
+    double minWeight = 0.5;
+    double maxWeight = 2.0;
+    // share of an item's earlier evidence kept at each new answer
+    double decay = 0.95;
+};
+
+// Draws a level's trials one at a time instead of dealing a block, each
+// item in proportion to how often it is still missed. Items are the
+// trained pitch classes plus the out-of-bounds tones as one item, matching
+// the PitchStatistics categories. Skill is a beta estimate per item,
+// updated in O(1) per answer; a draw is one Vose alias lookup, and the
+// table over at most 13 items is rebuilt only after an answer moved a
+// weight.
+class AdaptiveSelector
+{
+public:
+    static constexpr int kItemCount = 13;
+    static constexpr int kOutOfBoundsItem = 12;
+
+    void reset(const ScheduleConstraints &constraints, const SelectionWeights &weights, quint32 seed);
+    // evidence carried over from earlier levels
+    void setPrior(int item, double correct, double total);
+    void record(int item, bool correct);
+    // estimated chance of a correct answer
+    double skill(int item) const;
+    double probability(int item) const;
+    ScheduledTrial next();
+
+private:
+    double weight(int item) const;
+    void rebuild();
+
+    SelectionWeights m_weights;
+    std::array<double, kItemCount> m_alpha{};
+    std::array<double, kItemCount> m_beta{};
+    std::array<double, kItemCount> m_base{};
+    // alias table over m_items
+    std::array<double, kItemCount> m_threshold{};
+    std::array<qint8, kItemCount> m_alias{};
+    std::array<qint8, kItemCount> m_items{};
+    int m_itemCount = 0;
+    double m_weightSum = 0.0;
+    bool m_dirty = true;
+    std::array<qint8, 16> m_outside{};
+    int m_outsideCount = 0;
+    std::array<qint8, 16> m_octaves{};
+    int m_octaveCount = 0;
+    int m_maxRepeats = 0;
+    int m_minInterval = 0;
+    int m_lastPitch = -1;
+    int m_lastOctave = -1;
+    int m_run = 0;
+    quint64 m_rngState = 0;
+};
+
+#endif // TRIALSCHEDULER_H